@@ -0,0 +1,77 @@
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <stdint.h>
+#include "adc.h"
+#include "evsys.h"
+#include "scheduler.h"
+#include "sleep.h"
+
+// Set by RESRDY ISR once an event started conversion is done
+static volatile uint8_t result_ready_flag = 0;
+static volatile uint16_t event_result = 0;
+static volatile uint8_t event_window = 0;
+
+void adc_event_start(uint8_t channel) {
+    result_ready_flag = 0;
+    
+    // Conversion start from the event channel, result interrupt only
+    ADC0.EVCTRL = ADC_STARTEI_bm;
+    ADC0.INTFLAGS = ADC_WCMP_bm | ADC_RESRDY_bm;
+    ADC0.INTCTRL = ADC_RESRDY_bm;
+    
+    // Stays enabled between events, no per-sample start-up
+    ADC0.CTRLA |= ADC_RUNSTBY_bm | ADC_ENABLE_bm;
+    evsys_connect(&EVSYS.USERADC0START, channel);
+    
+    // RUNSTBY converts in STANDBY, not in POWERDOWN
+    power_vote(POWER_VOTER_ADC, SLEEP_LEVEL_STANDBY);
+}
+
+void adc_event_stop(void) {
+    evsys_disconnect(&EVSYS.USERADC0START);
+    ADC0.INTCTRL = 0;
+    ADC0.EVCTRL = 0;
+    ADC0.CTRLA &= ~(ADC_RUNSTBY_bm | ADC_ENABLE_bm);
+    ADC0.INTFLAGS = ADC_WCMP_bm | ADC_RESRDY_bm;
+    
+    power_vote(POWER_VOTER_ADC, SLEEP_LEVEL_POWERDOWN);
+}
+
+void adc_event_convert(void) {
+    result_ready_flag = 0;
+    
+    ADC0.INTFLAGS = ADC_WCMP_bm | ADC_RESRDY_bm;
+    ADC0.INTCTRL = ADC_RESRDY_bm;
+    ADC0.COMMAND = ADC_STCONV_bm;
+}
+
+uint8_t get_adc_result_ready_status(void) {
+    return result_ready_flag;
+}
+
+void clear_adc_result_ready_status(void) {
+    result_ready_flag = 0;
+}
+
+uint16_t adc_event_get_result(void) {
+    return event_result;
+}
+
+uint8_t adc_event_is_window_satisfied(void) {
+    return event_window;
+}
+
+ISR(ADC0_RESRDY_vect) {
+    // Window flag first, reading the result clears it
+    event_window = (ADC0.INTFLAGS & ADC_WCMP_bm) ? 1 : 0;
+    event_result = ADC0.RES;
+    ADC0.INTFLAGS = ADC_WCMP_bm | ADC_RESRDY_bm;
+    
+    // adc_event_convert() asks for one result only
+    if(!(ADC0.EVCTRL & ADC_STARTEI_bm)) {
+        ADC0.INTCTRL = 0;
+    }
+    
+    result_ready_flag = 1;
+    sched_post(EVENT_ADC_RESULT);
+}
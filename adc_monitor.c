@@ -0,0 +1,72 @@
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <stdint.h>
+#include "adc.h"
+#include "scheduler.h"
+#include "sleep.h"
+
+// Set by WCMP ISR on every window crossing
+static volatile uint8_t window_event_flag = 0;
+static volatile uint8_t window_inside = 0;
+static volatile uint16_t window_result = 0;
+
+void adc_monitor_start(void) {
+    window_event_flag = 0;
+    window_inside = 0;
+    
+    // First crossing to look for: signal entering the window
+    ADC0.CTRLE = ADC_WINCM_INSIDE_gc;
+    
+    // Interrupt on window compare only
+    ADC0.INTFLAGS = ADC_WCMP_bm | ADC_RESRDY_bm;
+    ADC0.INTCTRL = ADC_WCMP_bm;
+    
+    // Free running, kept alive in STANDBY
+    ADC0.CTRLA |= ADC_RUNSTBY_bm | ADC_FREERUN_bm | ADC_ENABLE_bm;
+    ADC0.COMMAND = ADC_STCONV_bm;
+    
+    // RUNSTBY keeps converting in STANDBY, not in POWERDOWN
+    power_vote(POWER_VOTER_ADC, SLEEP_LEVEL_STANDBY);
+}
+
+void adc_monitor_stop(void) {
+    ADC0.INTCTRL = 0;
+    ADC0.CTRLA &= ~(ADC_RUNSTBY_bm | ADC_FREERUN_bm | ADC_ENABLE_bm);
+    ADC0.INTFLAGS = ADC_WCMP_bm | ADC_RESRDY_bm;
+    
+    power_vote(POWER_VOTER_ADC, SLEEP_LEVEL_POWERDOWN);
+}
+
+uint8_t get_adc_window_event_status(void) {
+    return window_event_flag;
+}
+
+void clear_adc_window_event_status(void) {
+    window_event_flag = 0;
+}
+
+uint8_t adc_monitor_is_inside(void) {
+    return window_inside;
+}
+
+uint16_t adc_monitor_get_result(void) {
+    return window_result;
+}
+
+ISR(ADC0_WCMP_vect) {
+    // Reading the result also clears RESRDY
+    window_result = ADC0.RES;
+    ADC0.INTFLAGS = ADC_WCMP_bm;
+    
+    // Crossed the edge we were waiting for, now watch for the opposite one
+    if(window_inside) {
+        window_inside = 0;
+        ADC0.CTRLE = ADC_WINCM_INSIDE_gc;
+    } else {
+        window_inside = 1;
+        ADC0.CTRLE = ADC_WINCM_OUTSIDE_gc;
+    }
+    
+    window_event_flag = 1;
+    sched_post(EVENT_ADC_WINDOW);
+}
@@ -0,0 +1,49 @@
+#include <avr/io.h>
+#include <stdint.h>
+#include "adc.h"
+
+// log2 of the number of accumulated samples (0 = single conversion)
+static uint8_t adc_sampnum = 0;
+
+// Hardware keeps RES at 16 bits: above ACC16 the sum is pre-shifted
+static uint8_t adc_hw_shift(uint8_t sampnum) {
+    return (sampnum > 4) ? (sampnum - 4) : 0;
+}
+
+// Scale a 12-bit window threshold to the accumulated RES value
+static uint16_t adc_scale_threshold(uint16_t threshold) {
+    uint8_t shift = adc_sampnum - adc_hw_shift(adc_sampnum);
+    
+    return (uint16_t)(threshold << shift);
+}
+
+void adc_oversample_init(uint8_t sampnum, uint16_t win_low, uint16_t win_high) {
+    if(sampnum > ADC_OVERSAMPLE_MAX) {
+        sampnum = ADC_OVERSAMPLE_MAX;
+    }
+    
+    adc_sampnum = sampnum;
+    
+    // Number of samples accumulated per conversion
+    ADC0.CTRLB = (sampnum << ADC_SAMPNUM_gp) & ADC_SAMPNUM_gm;
+    
+    // Window compare runs on the accumulated result
+    ADC0.WINLT = adc_scale_threshold(win_low);
+    ADC0.WINHT = adc_scale_threshold(win_high);
+}
+
+uint8_t adc_get_result_bits(void) {
+    // Averaging 2^n samples of white noise gains n/2 bits
+    return 12 + (adc_sampnum >> 1);
+}
+
+uint16_t adc_get_oversampled_result(void) {
+    return adc_oversample_decimate(adc_get_result());
+}
+
+uint16_t adc_oversample_decimate(uint16_t accumulated) {
+    // RES holds 12 + sampnum - hw_shift bits, keep 12 + sampnum/2 of them
+    uint8_t shift = (adc_sampnum - adc_hw_shift(adc_sampnum)) - (adc_sampnum >> 1);
+    
+    return accumulated >> shift;
+}
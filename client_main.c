@@ -10,14 +10,47 @@
 #include "main_clock_control.h"
 #include "ports.h"
 #include "sleep.h"
+#include "rtc.h"
+#include "trace.h"
+#include "scheduler.h"
 #include "spi0.h"
+#include "spi_frame.h"
 #include "usart0_tx.h"
+#include "usart0_format.h"
+#include "nvm_log.h"
 
-// SPI Configuration
-#define NUM_SPI_BYTES 2  // Number of bytes to receive
+// Output format: 0 = verbose multi-line report, 1 = "W1 A2748" line per sample
+#ifndef CLIENT_COMPACT_OUTPUT
+#define CLIENT_COMPACT_OUTPUT 0
+#endif
 
-// External SPI data array (defined in spi0.c)
-extern uint8_t spi_data[NUM_SPI_BYTES];
+// Verbose report through printf(), the output path before usart0_format.c,
+// kept to measure the formatter against (README "Output")
+#ifndef CLIENT_PRINTF_OUTPUT
+#define CLIENT_PRINTF_OUTPUT 0
+#endif
+
+#if CLIENT_COMPACT_OUTPUT && CLIENT_PRINTF_OUTPUT
+#error "CLIENT_PRINTF_OUTPUT prints the verbose report, CLIENT_COMPACT_OUTPUT must be 0"
+#endif
+
+// Terminal baud rate. Output is written at 4 MHz when the 32.768 KHz
+// clock cannot reach it, which is far shorter than printing at 1200 baud.
+#ifndef CLIENT_USART_BAUD
+#define CLIENT_USART_BAUD 115200UL
+#endif
+
+#if USART_BAUD_REACHABLE(CLOCK_LOW_POWER_HZ, CLIENT_USART_BAUD)
+#define CLIENT_USART_POLICY CLOCK_POLICY_LOW_POWER
+#else
+#define CLIENT_USART_POLICY CLOCK_POLICY_4MHZ
+#endif
+
+// Keep every received sample in the EEPROM log, streamed over USART at
+// start-up and when the HOST sends SPI_COMMAND_LOG_DUMP
+#ifndef CLIENT_SAMPLE_LOG
+#define CLIENT_SAMPLE_LOG 1
+#endif
 
 // State Machine Type Definition
 typedef enum {
@@ -25,136 +58,379 @@ typedef enum {
     STATE_SLEEP,
     STATE_SWITCH_TO_HIGHSPEED_CLOCK,
     STATE_RECEIVE_SPI,
-    STATE_SWITCH_TO_LOWPOWER_CLOCK,
-    STATE_WRITE_TO_USART
+    STATE_WRITE_TO_USART,
+    STATE_SWITCH_TO_LOWPOWER_CLOCK
 } app_states_t;
 
+// Give up on a transaction after this long (HOST aborted or vanished)
+#define CLIENT_RX_TIMEOUT_MS    50
+#define CLIENT_RX_TIMEOUT_TICKS ((uint16_t)((CLIENT_RX_TIMEOUT_MS * RTC_CLOCK_HZ) / 1000UL))
+
 // Application data structure
 typedef struct {
-    app_states_t state;
+    uint8_t rx_seq;        // Next expected frame sequence number
+    uint8_t rx_seq_valid;  // 0 until the first frame has been received
+    uint8_t ack_seq;       // Last good frame, acknowledged on MISO
+    uint8_t ack_valid;     // 0 until a frame can be acknowledged
+    uint8_t rx_aborted;    // Timed out with SS still low, wait for a new select edge
 } app_data_t;
 
-int main(void) {
-    // Create state machine instance
-    app_data_t app_data;
-    app_data.state = STATE_INIT;
+static app_data_t app_data;
+
+// Print one packed sample of 'bits' resolution (see spi_frame.h for layout)
+static void print_sample(const uint8_t *sample, uint8_t bits) {
+    // Reconstruct 16-bit result
+    uint16_t results = spi_sample_unpack(sample);
+    
+    // Extract window comparison (bit 15)
+    uint8_t window_result = (results & SPI_SAMPLE_WINDOW_bm) ? 1 : 0;
+    
+    // Extract ADC result (bits 0-11, up to 0-14 when oversampled)
+    uint16_t adc_result = results & ((1U << bits) - 1);
+    
+#if CLIENT_COMPACT_OUTPUT
+    // One fixed-width line per sample: "W1 A2748\r\n" (5 digits above 12 bits)
+    usart0_send_char('W');
+    usart0_send_char('0' + window_result);
+    usart0_send_string(" A");
+    usart0_put_dec16_fixed(adc_result, (bits > 12) ? 5 : 4);
+    usart0_send_string("\r\n");
+#elif CLIENT_PRINTF_OUTPUT
+    printf("SPI Byte[1]: 0x%02X\r\n", sample[1]);
+    printf("SPI Byte[0]: 0x%02X\r\n", sample[0]);
+    printf("Results: 0x%04X\r\n", results);
+    printf("Window: %u\r\n", window_result);
+    printf("ADC: %u\r\n", adc_result);
+    if(bits > 12) {
+        printf("Bits: %u\r\n", bits);
+    }
+    printf("\r\n");
+#else
+    // Print raw SPI bytes
+    usart0_send_string("SPI Byte[1]: 0x");
+    usart0_put_hex8(sample[1]);
+    usart0_send_string("\r\nSPI Byte[0]: 0x");
+    usart0_put_hex8(sample[0]);
+    
+    usart0_send_string("\r\nResults: 0x");
+    usart0_put_hex16(results);
+    
+    usart0_send_string("\r\nWindow: ");
+    usart0_put_dec16(window_result);
+    
+    usart0_send_string("\r\nADC: ");
+    usart0_put_dec16(adc_result);
     
-    // Main state machine loop
-    while(1) {
-        switch(app_data.state) {
+    if(bits > 12) {
+        usart0_send_string("\r\nBits: ");
+        usart0_put_dec16(bits);
+    }
+    usart0_send_string("\r\n\r\n");
+#endif
+}
+
+// Print one received sample and append it to the sample log
+static void client_sample(const uint8_t *sample, uint8_t bits, uint8_t seq) {
+    print_sample(sample, bits);
+    
+#if CLIENT_SAMPLE_LOG
+    nvm_log_record_t record = {seq, bits, {sample[0], sample[1]}};
+    nvm_log_append(&record);
+#endif
+}
+
+// USART: CLIENT_USART_BAUD 8N1, BAUD reloaded on every clock switch
+USART_CONFIG(client_usart_config,
+    0x00,  // Async mode
+    0x00,  // No parity
+    0,     // 1 stop bit
+    0x03,  // 8 data bits
+    CLIENT_USART_BAUD
+);
+
+// Select flag is set by the PA7 port ISR, hand it to the scheduler as an event
+static void client_poll(void) {
+    if(get_client_select_flag_status()) {
+        clear_client_select_flag();
+        sched_post(EVENT_CLIENT_SELECT);
+    }
+}
+
+// Print every queued frame and acknowledge the last good one
+static void client_write_frames(void) {
+    const spi_rx_slot_t *slot;
+    
+    // Drain every queued frame, in place (no copy)
+    while((slot = spi_rx_peek()) != 0) {
+        spi_frame_t frame;
+        
+        // Frames lost because the queue was full
+        if(slot->overruns) {
+            usart0_send_string("Overrun: ");
+            usart0_put_dec16(slot->overruns);
+            usart0_send_string("\r\n");
+        }
+        
+        // Check length and CRC before trusting any field
+        if(spi_frame_decode(slot->data, sizeof(slot->data), &frame) != SPI_FRAME_OK) {
+            usart0_send_string("Frame error\r\n");
+        } else {
+            app_data.ack_seq = frame.seq;
+            app_data.ack_valid = 1;
             
-            case STATE_INIT:
-                // Initialize ports
-                port_init();
-                
-                // Setup low power 32.768 KHz clock
-                low_power_clock_control(
-                    0x01,  // Internal 32.768 KHz oscillator
-                    0,     // Prescaler enable = 0
-                    0x00,  // Prescaler divider (ignored)
-                    0,     // Run standby = 0
-                    0      // Clock out = 0
-                );
-                
-                // Initialize USART (1200 baud)
-                usart_init(
-                    0x00,  // Async mode
-                    0x00,  // No parity
-                    0x00,  // 1 stop bit
-                    0x00,  // 8 data bits
-                    1200   // Baud rate
-                );
-                
-                // Initialize SPI as client
-                spi_client_init();
-                
-                // Initialize sleep controller (power down mode)
-                sleep_init(0x04, 0x01);  // Power down + sleep enable
-                
-                // Enable global interrupts
-                sei();
-                
-                // Move to sleep state
-                app_data.state = STATE_SLEEP;
-                break;
-                
-            case STATE_SLEEP:
-                // Put CPU to sleep
-                __asm__ __volatile__("sleep");
-                
-                // Wake on SPI client select (PA7 pin change interrupt)
-                if(get_client_select_flag_status()) {
-                    clear_client_select_flag();
-                    app_data.state = STATE_SWITCH_TO_HIGHSPEED_CLOCK;
+            // Report frames lost since the last good one. Training frames
+            // go to one CLIENT at a time and take their numbers from the
+            // same HOST counter, they would show up as a gap on the others.
+            if(frame.type != SPI_FRAME_TYPE_TRAIN) {
+                if(app_data.rx_seq_valid && frame.seq != app_data.rx_seq) {
+                    usart0_send_string("Dropped: ");
+                    usart0_put_dec16((uint8_t)(frame.seq - app_data.rx_seq));
+                    usart0_send_string("\r\n");
+                }
+                app_data.rx_seq = frame.seq + 1;
+                app_data.rx_seq_valid = 1;
+            }
+            
+            if(frame.type == SPI_FRAME_TYPE_SAMPLES) {
+                for(uint8_t i = 0; i + SPI_SAMPLE_SIZE <= frame.len; i += SPI_SAMPLE_SIZE) {
+                    client_sample(&frame.payload[i], 12, frame.seq);
+                }
+            } else if(frame.type == SPI_FRAME_TYPE_EVENT &&
+                      frame.len >= 1 + SPI_SAMPLE_SIZE) {
+                // Window crossing reported by HOST monitor mode
+                if(frame.payload[0] == SPI_EVENT_WINDOW_ENTER) {
+                    usart0_send_string("Window enter\r\n");
+                } else {
+                    usart0_send_string("Window leave\r\n");
                 }
-                break;
-                
-            case STATE_SWITCH_TO_HIGHSPEED_CLOCK:
-                // Switch to 4 MHz for faster processing
-                main_clock_control(
-                    0x00,  // OSCHF (high freq internal oscillator)
-                    0x02,  // 4 MHz
-                    0,     // Prescaler disabled
-                    0x00,  // Prescaler div (ignored)
-                    0      // Clock out disabled
-                );
-                
-                // Wait for oscillator to stabilize
-                while(!(CLKCTRL.MCLKSTATUS & CLKCTRL_OSCHFS_bm));
-                
-                app_data.state = STATE_RECEIVE_SPI;
-                break;
-                
-            case STATE_RECEIVE_SPI:
-                // Wait for packet to be complete (received in ISR)
-                while(!get_packet_complete_status());
-                
-                // Clear packet complete flag
-                clear_packet_complete_status();
-                
-                app_data.state = STATE_SWITCH_TO_LOWPOWER_CLOCK;
-                break;
-                
-            case STATE_SWITCH_TO_LOWPOWER_CLOCK:
-                // Switch back to 32.768 KHz for low power
-                low_power_clock_control(
-                    0x01,  // Internal 32.768 KHz
-                    0,     // Prescaler disabled
-                    0x00,  // Prescaler div (ignored)
-                    0,     // Run standby disabled
-                    0      // Clock out disabled
-                );
-                
-                // Wait for oscillator to stabilize
-                while(!(CLKCTRL.MCLKSTATUS & CLKCTRL_OSC32KS_bm));
-                
-                app_data.state = STATE_WRITE_TO_USART;
-                break;
-                
-            case STATE_WRITE_TO_USART:
-                // Print raw SPI bytes
-                printf("SPI Byte[1]: 0x%02X\r\n", spi_data[1]);
-                printf("SPI Byte[0]: 0x%02X\r\n", spi_data[0]);
-                
-                // Reconstruct 16-bit result
-                uint16_t results = ((uint16_t)spi_data[1] << 8) | spi_data[0];
-                printf("Results: 0x%04X\r\n", results);
                 
-                // Extract window comparison (bit 15)
-                uint8_t window_result = (results >> 15) & 0x01;
-                printf("Window: %u\r\n", window_result);
+                client_sample(&frame.payload[1], 12, frame.seq);
+            } else if(frame.type == SPI_FRAME_TYPE_SAMPLES_DELTA) {
+                // Expand delta + varint codes back to packed samples
+                uint8_t samples[SPI_DELTA_MAX_SAMPLES * SPI_SAMPLE_SIZE];
+                uint8_t count = spi_sample_decompress(samples, SPI_DELTA_MAX_SAMPLES,
+                                                      frame.payload, frame.len);
                 
-                // Extract ADC result (bits 0-11)
-                uint16_t adc_result = results & 0x0FFF;
-                printf("ADC: %u\r\n\r\n", adc_result);
+                if(count == 0) {
+                    usart0_send_string("Frame error\r\n");
+                }
                 
-                // Delay to ensure print completes
-                _delay_ms(100);
+                for(uint8_t i = 0; i < count; i++) {
+                    client_sample(&samples[i * SPI_SAMPLE_SIZE], 12, frame.seq);
+                }
+            } else if(frame.type == SPI_FRAME_TYPE_SAMPLES_HIRES && frame.len > 0) {
+                // First payload byte = resolution of every sample
+                uint8_t bits = frame.payload[0];
+                if(bits < 12 || bits > 15) {
+                    bits = 15;
+                }
                 
-                app_data.state = STATE_SLEEP;
-                break;
+                for(uint8_t i = 1; i + SPI_SAMPLE_SIZE <= frame.len; i += SPI_SAMPLE_SIZE) {
+                    client_sample(&frame.payload[i], bits, frame.seq);
+                }
+            } else if(frame.type == SPI_FRAME_TYPE_COMMAND && frame.len >= 1) {
+#if CLIENT_SAMPLE_LOG
+                // Bulk read-back of the stored samples
+                if(frame.payload[0] == SPI_COMMAND_LOG_DUMP) {
+                    nvm_log_dump();
+                }
+#endif
+            }
         }
+        
+        // Hand the slot back to the SPI ISR
+        spi_rx_release();
+    }
+    
+    // Acknowledge the last good frame on MISO during the next
+    // transaction, no extra wake cycle for either side
+    if(app_data.ack_valid) {
+        uint8_t ack[SPI_FRAME_OVERHEAD];
+        uint8_t ack_size = spi_frame_encode(ack, SPI_FRAME_TYPE_ACK,
+                                            app_data.ack_seq, 0, 0);
+        spi_client_set_response(ack, ack_size);
     }
+}
+
+// HOST selected while printing: answer its poll at once when output runs
+// at 4 MHz (fast enough for the SPI ISR), the frame lands in the RX queue
+static void client_accept_select(void) {
+    if(CLIENT_USART_POLICY == CLOCK_POLICY_4MHZ && !(PORTA.IN & PIN7_bm) &&
+       !app_data.rx_aborted) {
+        spi_client_set_ready();
+        
+        // Same limit as RECEIVE_SPI for a transfer that never ends
+        rtc_timeout_start(CLIENT_RX_TIMEOUT_TICKS);
+    }
+}
+
+static uint8_t state_init(sched_event_t event) {
+    // Initialize ports
+    port_init();
+    
+    // Low power 32.768 KHz clock requested by state policy
+    clock_wait_ready();
+    
+    // Initialize USART (8N1, follows clock switches)
+    usart_apply_config(&client_usart_config);
+    
+    // Free running RTC for receive timestamps
+    rtc_counter_init();
+    
+    // Initialize SPI as client
+    spi_client_init();
+    
+    // Client selects reach the scheduler through the poll hook
+    sched_set_poll(client_poll);
+    
+    // Enable global interrupts
+    sei();
+    
+#if CLIENT_SAMPLE_LOG
+    // Resume the log and stream what survived the reset at the USART
+    // clock, the switch back drains the output first
+    nvm_log_init();
+    clock_request(CLIENT_USART_POLICY);
+    clock_wait_ready();
+    nvm_log_dump();
+#endif
+    
+    // Move to sleep state
+    return STATE_SLEEP;
+}
+
+static uint8_t state_sleep(sched_event_t event) {
+    // HOST selected again while we were busy (back-to-back
+    // frames): the edge was already handled, do not sleep on it
+    if(event == EVENT_ENTER && !(PORTA.IN & PIN7_bm) && !app_data.rx_aborted) {
+        clear_client_select_flag();
+        clear_spi_transaction_end_status();
+        return STATE_SWITCH_TO_HIGHSPEED_CLOCK;
+    }
+    
+    // Wake on SPI client select (PA7 pin change interrupt)
+    if(event == EVENT_CLIENT_SELECT) {
+        app_data.rx_aborted = 0;
+        clear_spi_transaction_end_status();
+        return STATE_SWITCH_TO_HIGHSPEED_CLOCK;
+    }
+    
+    return STATE_SLEEP;
+}
+
+static uint8_t state_switch_to_highspeed_clock(sched_event_t event) {
+    // 4 MHz switch started by state policy, SPI ISR needs it
+    clock_wait_ready();
+    
+    // Tell the HOST we can take the frame (answers its MISO poll)
+    spi_client_set_ready();
+    
+    return STATE_RECEIVE_SPI;
+}
+
+static uint8_t state_receive_spi(sched_event_t event) {
+    // Wait in IDLE between SPI interrupts until SS goes high after a
+    // frame. A broadcast wake pulse ends without one, so keep listening
+    // for the addressed transfer that follows. The RTC timeout stops an
+    // aborted transfer holding 4 MHz.
+    if(event == EVENT_ENTER) {
+        rtc_timeout_start(CLIENT_RX_TIMEOUT_TICKS);
+    }
+    
+    // Selected again after a wake pulse or a re-select: drive MISO and
+    // answer the polls
+    if(event == EVENT_CLIENT_SELECT) {
+        spi_client_set_ready();
+    }
+    
+    uint8_t received = get_spi_transaction_end_status() && get_packet_complete_status();
+    if(!received && !get_rtc_timeout_status()) {
+        return STATE_RECEIVE_SPI;
+    }
+    
+    rtc_timeout_cancel();
+    clear_spi_transaction_end_status();
+    
+    // HOST stopped with SS low: the level is no new select, or the
+    // CLIENT would keep waking for it at 4 MHz
+    app_data.rx_aborted = !received && !(PORTA.IN & PIN7_bm);
+    
+    // Selects seen while awake (wake pulse, re-select) are
+    // handled, do not wake again for them
+    clear_client_select_flag();
+    
+    return STATE_WRITE_TO_USART;
+}
+
+static uint8_t state_write_to_usart(sched_event_t event) {
+    switch(event) {
+        case EVENT_ENTER:
+            // USART clock from state policy, BAUD already reloaded
+            clock_wait_ready();
+            
+            // ACK preloaded before answering a select that came in
+            // meanwhile, it goes out with that transfer
+            client_write_frames();
+            client_accept_select();
+            
+            // State trace goes out with the samples once the ring fills up
+            TRACE_DUMP();
+            break;
+            
+        case EVENT_CLIENT_SELECT:
+            client_accept_select();
+            break;
+            
+        case EVENT_SPI_FRAME:
+            // Frame taken while printing, queue it behind the others
+            client_write_frames();
+            break;
+    }
+    
+    // Transfer accepted above that did not end in time
+    uint8_t selected = CLIENT_USART_POLICY == CLOCK_POLICY_4MHZ && !(PORTA.IN & PIN7_bm) &&
+                       !app_data.rx_aborted;
+    if(selected && get_rtc_timeout_status()) {
+        app_data.rx_aborted = 1;
+        selected = 0;
+    }
+    
+    // Wait in IDLE while the USART ISRs drain the TX buffer, and for a
+    // transfer accepted above to end (and be printed) before the clock drops
+    if(!get_usart_tx_complete_status() || get_packet_complete_status() || selected) {
+        return STATE_WRITE_TO_USART;
+    }
+    
+    rtc_timeout_cancel();
+    return STATE_SWITCH_TO_LOWPOWER_CLOCK;
+}
+
+static uint8_t state_switch_to_lowpower_clock(sched_event_t event) {
+    // Still ready from a wake pulse seen while busy: at 32.768 KHz the
+    // HOST polls would each take an SPI interrupt, a select wakes us again
+    spi_client_clear_ready();
+    
+    // Switch back to 32.768 KHz started by state policy
+    clock_wait_ready();
+    
+    return STATE_SLEEP;
+}
+
+// Handler, clock policy and deepest sleep level per state. Switches start
+// on entry and states wait only where they need the clock. Busy drivers
+// vote shallower levels themselves (USART output keeps IDLE).
+static const sched_state_t client_states[] = {
+    [STATE_INIT]                      = {state_init,                      CLOCK_POLICY_LOW_POWER, SLEEP_LEVEL_POWERDOWN},
+    [STATE_SLEEP]                     = {state_sleep,                     CLOCK_POLICY_LOW_POWER, SLEEP_LEVEL_POWERDOWN},
+    [STATE_SWITCH_TO_HIGHSPEED_CLOCK] = {state_switch_to_highspeed_clock, CLOCK_POLICY_4MHZ,      SLEEP_LEVEL_POWERDOWN},
+    [STATE_RECEIVE_SPI]               = {state_receive_spi,               CLOCK_POLICY_4MHZ,      SLEEP_LEVEL_IDLE},  // SPI client
+    [STATE_WRITE_TO_USART]            = {state_write_to_usart,            CLIENT_USART_POLICY,    SLEEP_LEVEL_IDLE},  // SPI client
+    [STATE_SWITCH_TO_LOWPOWER_CLOCK]  = {state_switch_to_lowpower_clock,  CLOCK_POLICY_LOW_POWER, SLEEP_LEVEL_POWERDOWN}
+};
+
+int main(void) {
+    // Dispatch events to the state handlers, never returns
+    sched_run(client_states, STATE_INIT);
     
     return 0;
 }
@@ -0,0 +1,87 @@
+#include <avr/io.h>
+#include <avr/xmega.h>
+#include <stdint.h>
+#include "main_clock_control.h"
+#include "sleep.h"
+
+// Per-policy settings
+typedef struct {
+    uint8_t clksel;     // MCLKCTRLA clock source
+    uint8_t frqsel;     // OSCHFCTRLA frequency (OSCHF only)
+    uint8_t status_bm;  // MCLKSTATUS stable bit of the source
+    uint32_t freq_hz;
+} clock_policy_config_t;
+
+static const clock_policy_config_t policy_config[] = {
+    [CLOCK_POLICY_LOW_POWER] = {CLKCTRL_CLKSEL_OSC32K_gc, 0, CLKCTRL_OSC32KS_bm, CLOCK_LOW_POWER_HZ},
+    [CLOCK_POLICY_1MHZ] = {CLKCTRL_CLKSEL_OSCHF_gc, CLKCTRL_FRQSEL_1M_gc, CLKCTRL_OSCHFS_bm, CLOCK_1MHZ_HZ},
+    [CLOCK_POLICY_4MHZ] = {CLKCTRL_CLKSEL_OSCHF_gc, CLKCTRL_FRQSEL_4M_gc, CLKCTRL_OSCHFS_bm, CLOCK_4MHZ_HZ}
+};
+
+// Device comes out of reset on OSCHF at 4 MHz
+static clock_policy_t requested_policy = CLOCK_POLICY_4MHZ;
+
+// Notified before every switch (e.g. USART baud reload)
+static clock_change_hook_t change_hook = 0;
+
+void clock_set_change_hook(clock_change_hook_t hook) {
+    change_hook = hook;
+}
+
+void clock_request(clock_policy_t policy) {
+    if(policy == requested_policy) {
+        return;
+    }
+    
+    const clock_policy_config_t *cfg = &policy_config[policy];
+    
+    // Peripherals finish work at the old clock and load new settings
+    if(change_hook) {
+        change_hook(policy);
+    }
+    
+    // A switch still running (SOSC) ignores a new source select, let it
+    // finish first (only a switch to OSC32K is slow, ~61 us)
+    while(CLKCTRL.MCLKSTATUS & CLKCTRL_SOSC_bm);
+    
+    // Set OSCHF frequency first (also retunes a running OSCHF)
+    if(cfg->clksel == CLKCTRL_CLKSEL_OSCHF_gc) {
+        _PROTECTED_WRITE(CLKCTRL.OSCHFCTRLA, cfg->frqsel);
+    }
+    
+    // No prescaler, select source; hardware switches once it is stable
+    _PROTECTED_WRITE(CLKCTRL.MCLKCTRLB, 0);
+    _PROTECTED_WRITE(CLKCTRL.MCLKCTRLA, cfg->clksel);
+    
+    // Oscillator start-up needs the core clock tree running
+    power_vote(POWER_VOTER_CLOCK, SLEEP_LEVEL_IDLE);
+    
+    requested_policy = policy;
+}
+
+uint8_t clock_is_ready(void) {
+    // Switch finished and the selected oscillator is stable
+    return !(CLKCTRL.MCLKSTATUS & CLKCTRL_SOSC_bm)
+        && (CLKCTRL.MCLKSTATUS & policy_config[requested_policy].status_bm);
+}
+
+void clock_wait_ready(void) {
+    // Spins: CLKCTRL has no interrupt for a finished switch, nothing would
+    // wake a sleeping core. The start-up is short (OSCHF ~13 us, OSC32K
+    // ~61 us) and callers overlap it with other work first.
+    while(!clock_is_ready());
+    
+    power_vote(POWER_VOTER_CLOCK, SLEEP_LEVEL_POWERDOWN);
+}
+
+clock_policy_t clock_get_policy(void) {
+    return requested_policy;
+}
+
+uint32_t clock_get_frequency(void) {
+    return policy_config[requested_policy].freq_hz;
+}
+
+uint32_t clock_get_policy_frequency(clock_policy_t policy) {
+    return policy_config[policy].freq_hz;
+}
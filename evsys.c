@@ -0,0 +1,47 @@
+#include <avr/io.h>
+#include <stdint.h>
+#include "evsys.h"
+
+void evsys_route(uint8_t channel, uint8_t generator) {
+    if(channel >= EVSYS_CHANNELS) {
+        return;
+    }
+    
+    // CHANNEL0..CHANNEL5 are consecutive registers
+    (&EVSYS.CHANNEL0)[channel] = generator;
+}
+
+void evsys_connect(volatile uint8_t *user, uint8_t channel) {
+    if(channel >= EVSYS_CHANNELS) {
+        return;
+    }
+    
+    // User registers hold channel + 1, 0 = not connected
+    *user = channel + 1;
+}
+
+void evsys_disconnect(volatile uint8_t *user) {
+    *user = 0;
+}
+
+void evsys_trigger(uint8_t channel) {
+    if(channel >= EVSYS_CHANNELS) {
+        return;
+    }
+    
+    // One event pulse, strobe bit per channel
+    EVSYS.SWEVENTA = 1 << channel;
+}
+
+void evsys_pin_generator(PORT_t *port, uint8_t pin, uint8_t invert) {
+    volatile uint8_t *pinctrl = &port->PIN0CTRL + (pin & 0x07);
+    
+    // Keep pull-up, input buffer on without a pin interrupt
+    uint8_t ctrl = (*pinctrl & ~(PORT_ISC_gm | PORT_INVEN_bm)) | PORT_ISC_INTDISABLE_gc;
+    if(invert) {
+        ctrl |= PORT_INVEN_bm;
+    }
+    
+    *pinctrl = ctrl;
+    port->INTFLAGS = 1 << (pin & 0x07);
+}
@@ -24,29 +24,235 @@ void clear_client_select_flag(void);
 #endif // PORTS_H
 
 
+// ========================================
+// spi_frame.h
+// ========================================
+#ifndef SPI_FRAME_H
+#define SPI_FRAME_H
+
+#include <stdint.h>
+
+// Frame layout (shared by HOST and CLIENT):
+//   [LEN][TYPE][SEQ][PAYLOAD 0..LEN-1][CRC8]
+// LEN  = number of payload bytes (0..SPI_FRAME_MAX_PAYLOAD)
+// CRC8 = CRC-8 (poly 0x07, init 0x00) over LEN, TYPE, SEQ and PAYLOAD
+#define SPI_FRAME_MAX_PAYLOAD 16  // Max payload bytes per frame
+#define SPI_FRAME_HEADER_SIZE 3   // LEN + TYPE + SEQ
+#define SPI_FRAME_CRC_SIZE    1
+#define SPI_FRAME_OVERHEAD    (SPI_FRAME_HEADER_SIZE + SPI_FRAME_CRC_SIZE)
+#define SPI_FRAME_MAX_SIZE    (SPI_FRAME_MAX_PAYLOAD + SPI_FRAME_OVERHEAD)
+
+// Header byte offsets
+#define SPI_FRAME_LEN_POS     0
+#define SPI_FRAME_TYPE_POS    1
+#define SPI_FRAME_SEQ_POS     2
+#define SPI_FRAME_PAYLOAD_POS 3
+
+// Frame types
+#define SPI_FRAME_TYPE_SAMPLES       0x01  // Payload = packed 12-bit ADC samples
+#define SPI_FRAME_TYPE_SAMPLES_HIRES 0x02  // Payload = [BITS] + packed oversampled samples
+#define SPI_FRAME_TYPE_EVENT         0x03  // Payload = [EVENT] + one packed sample
+#define SPI_FRAME_TYPE_ACK           0x04  // CLIENT to HOST, SEQ = last good frame, no payload
+#define SPI_FRAME_TYPE_TRAIN         0x05  // Link training, payload = fixed test pattern
+#define SPI_FRAME_TYPE_SAMPLES_DELTA 0x06  // Payload = compressed 12-bit samples (below)
+#define SPI_FRAME_TYPE_COMMAND       0x07  // HOST to CLIENT, payload = [COMMAND]
+
+// Event codes (first byte of an event frame)
+#define SPI_EVENT_WINDOW_ENTER 0x01
+#define SPI_EVENT_WINDOW_LEAVE 0x02
+
+// Command codes (first byte of a command frame)
+#define SPI_COMMAND_LOG_DUMP   0x01  // Stream the CLIENT sample log over USART
+
+// Sample packing (2 bytes per sample, low byte first)
+// Bit 15 = window comparison result, bits 0-11 = ADC result
+#define SPI_SAMPLE_SIZE      2
+#define SPI_SAMPLE_WINDOW_bm 0x8000
+#define SPI_SAMPLE_ADC_gm    0x0FFF
+#define SPI_FRAME_MAX_SAMPLES (SPI_FRAME_MAX_PAYLOAD / SPI_SAMPLE_SIZE)
+
+// High resolution samples: bit 15 = window, bits 0-14 = result of BITS
+// (13..15) resolution, BITS is the first payload byte
+#define SPI_SAMPLE_HIRES_VALUE_gm   0x7FFF
+#define SPI_FRAME_MAX_HIRES_SAMPLES ((SPI_FRAME_MAX_PAYLOAD - 1) / SPI_SAMPLE_SIZE)
+
+// Compressed samples: [COUNT][first sample, 2 bytes][nibble codes]
+// Each further sample is a code = zigzag(ADC delta) << 1 | W, sent as
+// 3 bits per nibble, low bits first, nibble bit 3 = more follow. Two
+// nibbles per byte, high nibble first, last byte padded with 0.
+// A 12-bit delta needs at most 5 nibbles.
+#define SPI_DELTA_HEADER_SIZE 3
+#define SPI_DELTA_MAX_NIBBLES 5
+#define SPI_DELTA_MAX_SAMPLES (1 + (SPI_FRAME_MAX_PAYLOAD - SPI_DELTA_HEADER_SIZE) * 2)
+
+// Decode status
+#define SPI_FRAME_OK         0
+#define SPI_FRAME_ERR_LENGTH 1
+#define SPI_FRAME_ERR_CRC    2
+#define SPI_FRAME_ERR_TYPE   3  // TYPE 0x00, e.g. a line stuck low (CRC of all zeros is 0x00)
+
+// Decoded frame (payload points into the receive buffer, no copy)
+typedef struct {
+    uint8_t type;
+    uint8_t seq;
+    uint8_t len;
+    const uint8_t *payload;
+} spi_frame_t;
+
+uint8_t spi_frame_crc8(const uint8_t *data, uint8_t len);
+uint8_t spi_frame_encode(uint8_t *frame, uint8_t type, uint8_t seq,
+                         const uint8_t *payload, uint8_t len);
+uint8_t spi_frame_decode(const uint8_t *frame, uint8_t size, spi_frame_t *out);
+uint8_t spi_frame_size(uint8_t len_byte);
+
+void spi_sample_pack(uint8_t *dst, uint16_t adc_result, uint8_t window);
+void spi_sample_pack_hires(uint8_t *dst, uint16_t result, uint8_t window);
+uint16_t spi_sample_unpack(const uint8_t *src);
+
+// Fixed memory, bounded loops (SPI_DELTA_MAX_NIBBLES per sample).
+// compress returns the payload size, 0 if it does not fit dst_size;
+// decompress returns the sample count, 0 if malformed or over max_count.
+uint8_t spi_sample_compress(uint8_t *dst, uint8_t dst_size,
+                            const uint8_t *samples, uint8_t count);
+uint8_t spi_sample_decompress(uint8_t *samples, uint8_t max_count,
+                              const uint8_t *src, uint8_t len);
+
+#endif // SPI_FRAME_H
+
+
 // ========================================
 // spi0.h
 // ========================================
 #ifndef SPI0_H
 #define SPI0_H
 
+#include <avr/io.h>
 #include <stdint.h>
+#include "spi_frame.h"
+
+// Ready handshake: HOST clocks SPI_POLL_BYTE after selecting the client,
+// the CLIENT answers SPI_READY_BYTE on MISO once it runs at 4 MHz
+#define SPI_POLL_BYTE  0xFF  // Never a valid frame LEN byte
+#define SPI_READY_BYTE 0xA5
+#define SPI_IDLE_BYTE  0x00
 
 // HOST DEVICE functions
 #ifdef HOST_DEVICE
+#define SPI_READY_POLL_US   250  // Sleep between ready polls
+#define SPI_READY_MAX_POLLS 40   // Poll budget per select (~10 ms)
+#define SPI_SELECT_RETRIES  2    // Re-select attempts before giving up
+#define SPI_WAKE_PULSE_US   1000  // All chip selects low to wake every client
+                                  // (long enough for a CLIENT port ISR at
+                                  // 32.768 KHz to still see SS low)
+#define SPI_RELEASE_US      25    // Before selecting the next client: the one
+                                  // before lets go of MISO in its SS ISR
+                                  // (~110 cycles at 4 MHz)
+
+// SCK rates at the 4 MHz SPI clock, slowest first (PRESC + CLK2X)
+typedef uint8_t spi_rate_t;
+#define SPI_RATE_DIV128 0  // 31.25 kHz
+#define SPI_RATE_DIV64  1  // 62.5 kHz
+#define SPI_RATE_DIV32  2  // 125 kHz
+#define SPI_RATE_DIV16  3  // 250 kHz
+#define SPI_RATE_DIV8   4  // 500 kHz
+#define SPI_RATE_DIV4   5  // 1 MHz
+#define SPI_RATE_DIV2   6  // 2 MHz
+#define SPI_RATE_COUNT  7
+
+// Rate used until link training locks a faster one
+#ifndef SPI_HOST_RATE
+#define SPI_HOST_RATE SPI_RATE_DIV16
+#endif
+
+#if SPI_HOST_RATE >= SPI_RATE_COUNT
+#error "SPI_HOST_RATE must be one of the SPI_RATE_ values"
+#endif
+
+// Client address for spi_send_frame_to(): every client in the table
+#define SPI_BROADCAST 0xFF
+
+// Chip select pin of one client, table index = client address
+typedef struct {
+    PORT_t *port;
+    uint8_t pin_bm;
+} spi_client_cs_t;
+
+// Table must stay valid, default is one client on PA7.
+// Every chip select is made an output and driven high.
+void spi_host_set_clients(const spi_client_cs_t *table, uint8_t count);
+uint8_t spi_get_client_count(void);
+
 void spi_host_init(void);
-void spi_select_client(void);
-void spi_deselect_client(void);
-void spi0_write_block(uint8_t *data, uint8_t size);
+void spi_host_set_rate(spi_rate_t rate);
+spi_rate_t spi_host_get_rate(void);
+void spi_select_client(uint8_t client);
+void spi_deselect_client(uint8_t client);
+
+// Handshake and send one frame to a client, or to all of them with
+// SPI_BROADCAST, returns the number of clients that took the frame.
+// response (size bytes, may be 0) gets what the client shifted out
+// meanwhile, for a broadcast that of the last client.
+uint8_t spi_send_frame_to(uint8_t client, const uint8_t *data, uint16_t size,
+                          uint8_t *response);
+
+// Link training (SPI enabled, 4 MHz): per client, from SPI_HOST_RATE up,
+// send a training frame at the next faster rate and read the client's
+// acknowledgements (SPI_FRAME_TYPE_ACK) to check MISO and MOSI. Locks and
+// returns the fastest rate every client passed. seq is the frame counter.
+spi_rate_t spi_link_train(uint8_t *seq);
+// Called from the SPI ISR when an async transfer has fully shifted out
+typedef void (*spi_tx_done_cb_t)(void);
+
+// Full duplex: rx receives one byte per tx byte (rx = 0 drops them).
+// Blocking calls return 0 without sending while an async transfer runs.
+uint8_t spi_transfer(const uint8_t *tx, uint8_t *rx, uint16_t size);
+uint8_t spi_transfer_async(const uint8_t *tx, uint8_t *rx, uint16_t size,
+                           spi_tx_done_cb_t done_cb);
+uint8_t spi0_write_block(const uint8_t *data, uint16_t size);
+uint8_t spi0_write_block_async(const uint8_t *data, uint16_t size,
+                               spi_tx_done_cb_t done_cb);
+uint8_t get_spi_tx_complete_status(void);
+uint8_t spi0_exchange_byte(uint8_t data);
+uint8_t spi_wait_client_ready(uint8_t max_polls);
 void spi_disable(void);
 void spi_disable_pins(void);
 #endif
 
 // CLIENT DEVICE functions
 #ifdef CLIENT_DEVICE
+#define SPI_RX_SLOTS 4  // Receive queue slots (power of 2, holds SLOTS - 1 frames)
+
+// One received frame, filled in place by the SPI ISR
+typedef struct {
+    uint8_t data[SPI_FRAME_MAX_SIZE];  // Raw frame (see spi_frame.h)
+    uint16_t timestamp;                // rtc_get_ticks() at last byte
+    uint8_t overruns;                  // Frames dropped (queue full) before this one
+} spi_rx_slot_t;
+
 void spi_client_init(void);
+
+// Answer HOST polls with SPI_READY_BYTE and take the frame that follows.
+// Drives MISO only while SS is low, call it again on each select.
+void spi_client_set_ready(void);
+
+// Back to answering polls with SPI_IDLE_BYTE, before dropping to 32.768 KHz
+// (a ready CLIENT takes an SPI interrupt per poll byte)
+void spi_client_clear_ready(void);
 uint8_t get_packet_complete_status(void);
-void clear_packet_complete_status(void);
+
+// Response shifted out on MISO right behind the ready byte, while the
+// next HOST frame comes in. Bytes past the HOST frame length are not
+// sent. Copied, one-shot: sent status is set once it went out in full.
+uint8_t spi_client_set_response(const uint8_t *data, uint8_t size);
+uint8_t get_spi_response_sent_status(void);
+
+// Set when SS goes high (end of transaction), partial frames are discarded
+uint8_t get_spi_transaction_end_status(void);
+void clear_spi_transaction_end_status(void);
+
+// Zero-copy consumer side: peek oldest frame, release it when done
+const spi_rx_slot_t *spi_rx_peek(void);
+void spi_rx_release(void);
 #endif
 
 #endif // SPI0_H
@@ -58,6 +264,7 @@ void clear_packet_complete_status(void);
 #ifndef ADC_H
 #define ADC_H
 
+#include <avr/io.h>
 #include <stdint.h>
 
 void adc_init(uint8_t vref, uint8_t always_on, uint8_t run_standby,
@@ -67,6 +274,113 @@ void adc_init(uint8_t vref, uint8_t always_on, uint8_t run_standby,
               uint8_t neg_ch, uint8_t window_mode, uint16_t win_low,
               uint16_t win_high, uint8_t enable);
 
+// ADC configuration with designated fields, e.g.
+//
+//   ADC_CONFIG(sensor_adc, .vref = VREF_REFSEL_VDD_gc, .pos_ch = 0x08);
+//
+// Fields use the same encoding as adc_init(), left out ones take
+// ADC_CONFIG_DEFAULTS. adc_apply_config() is inlined: for a configuration
+// known at compile time (-O1 and up) GCC folds the register images into
+// a straight-line run of constant stores and an invalid field is a build
+// error naming the field.
+typedef struct {
+    uint8_t vref;          // VREF_REFSEL_*_gc: 1.024, 2.048, 4.096, 2.5 V, VDD, VREFA
+    uint8_t always_on;     // 1 = reference always on
+    uint8_t run_standby;   // 1 = keep converting in STANDBY
+    uint8_t conv_mode;     // 0 = single-ended, 1 = differential
+    uint8_t left_adjust;   // 1 = left adjusted result (no accumulation)
+    uint8_t freerun;       // 1 = free running
+    uint8_t init_delay;    // CTRLD INITDLY, 0..7 (0 to 256 ADC clocks)
+    uint8_t sample_num;    // CTRLB SAMPNUM, accumulate 2^n, 0..7
+    uint8_t presc;         // CTRLC PRESC, 0..11 (/2 to /256)
+    uint8_t sample_delay;  // CTRLD SAMPDLY, 0..15 ADC clocks
+    uint8_t sample_len;    // SAMPCTRL, extra ADC clocks of sampling
+    uint8_t pos_ch;        // MUXPOS
+    uint8_t neg_ch;        // MUXNEG
+    uint8_t window_mode;   // CTRLE WINCM, 0 = off .. 4 = OUTSIDE
+    uint16_t win_low;      // Window thresholds, in result units
+    uint16_t win_high;
+    uint8_t enable;        // 1 = enable when applied
+} adc_config_t;
+
+// Single-ended against GND on the VDD reference, everything else 0
+#define ADC_CONFIG_DEFAULTS .vref = VREF_REFSEL_VDD_gc, .neg_ch = ADC_MUXNEG_GND_gc
+
+// Later designators override the defaults, which -Woverride-init flags
+#define ADC_CONFIG(name, ...)                                                   \
+    _Pragma("GCC diagnostic push")                                              \
+    _Pragma("GCC diagnostic ignored \"-Woverride-init\"")                       \
+    static const adc_config_t name = {ADC_CONFIG_DEFAULTS, __VA_ARGS__};        \
+    _Pragma("GCC diagnostic pop")
+
+// Largest RES value: 12-bit single conversion, 16-bit when accumulating
+#define ADC_CONFIG_MAX_RESULT(sample_num) ((sample_num) ? 0xFFFFUL : 0x0FFFUL)
+
+// Never defined: a call left after constant folding fails the build
+#define ADC_CONFIG_ERROR(fn, message) void fn(void) __attribute__((error(message)))
+
+ADC_CONFIG_ERROR(adc_config_bad_vref, "ADC_CONFIG: vref must be a VREF_REFSEL value, 4 and 7 are reserved");
+ADC_CONFIG_ERROR(adc_config_bad_conv_mode, "ADC_CONFIG: conv_mode must be 0 or 1");
+ADC_CONFIG_ERROR(adc_config_bad_init_delay, "ADC_CONFIG: init_delay out of range");
+ADC_CONFIG_ERROR(adc_config_bad_sample_num, "ADC_CONFIG: sample_num out of range");
+ADC_CONFIG_ERROR(adc_config_bad_presc, "ADC_CONFIG: presc out of range");
+ADC_CONFIG_ERROR(adc_config_bad_sample_delay, "ADC_CONFIG: sample_delay out of range");
+ADC_CONFIG_ERROR(adc_config_bad_channel, "ADC_CONFIG: pos_ch or neg_ch out of range");
+ADC_CONFIG_ERROR(adc_config_bad_window_mode, "ADC_CONFIG: window_mode out of range");
+ADC_CONFIG_ERROR(adc_config_bad_left_adjust, "ADC_CONFIG: left_adjust cannot be used with accumulation");
+ADC_CONFIG_ERROR(adc_config_bad_window_order, "ADC_CONFIG: window low threshold above high threshold");
+ADC_CONFIG_ERROR(adc_config_bad_window_range, "ADC_CONFIG: window threshold above largest ADC result");
+
+// Checked only when the compiler can fold it, a configuration built at
+// run time is written unchecked
+#define ADC_CONFIG_CHECK(cond, error_fn)                                        \
+    do {                                                                        \
+        if(__builtin_constant_p(cond) && !(cond)) {                             \
+            error_fn();                                                         \
+        }                                                                       \
+    } while(0)
+
+static inline void adc_apply_config(const adc_config_t *config) {
+    ADC_CONFIG_CHECK(config->vref <= VREF_REFSEL_VREFA_gc && config->vref != 0x04,
+                     adc_config_bad_vref);
+    ADC_CONFIG_CHECK(config->conv_mode <= 1, adc_config_bad_conv_mode);
+    ADC_CONFIG_CHECK(config->init_delay <= 0x07, adc_config_bad_init_delay);
+    ADC_CONFIG_CHECK(config->sample_num <= 0x07, adc_config_bad_sample_num);
+    ADC_CONFIG_CHECK(config->presc <= 0x0B, adc_config_bad_presc);
+    ADC_CONFIG_CHECK(config->sample_delay <= 0x0F, adc_config_bad_sample_delay);
+    ADC_CONFIG_CHECK(config->pos_ch <= 0x7F && config->neg_ch <= 0x7F, adc_config_bad_channel);
+    ADC_CONFIG_CHECK(config->window_mode <= 0x04, adc_config_bad_window_mode);
+    ADC_CONFIG_CHECK(!(config->left_adjust && config->sample_num), adc_config_bad_left_adjust);
+    ADC_CONFIG_CHECK(config->window_mode == 0 || config->win_low <= config->win_high,
+                     adc_config_bad_window_order);
+    ADC_CONFIG_CHECK(config->win_low <= ADC_CONFIG_MAX_RESULT(config->sample_num) &&
+                     config->win_high <= ADC_CONFIG_MAX_RESULT(config->sample_num),
+                     adc_config_bad_window_range);
+    
+    // Disable while reconfiguring
+    ADC0.CTRLA = 0;
+    
+    VREF.ADC0REF = (config->vref << VREF_REFSEL_gp) |
+                   (config->always_on ? VREF_ALWAYSON_bm : 0);
+    ADC0.CTRLB = config->sample_num << ADC_SAMPNUM_gp;
+    ADC0.CTRLC = config->presc << ADC_PRESC_gp;
+    ADC0.CTRLD = (config->init_delay << ADC_INITDLY_gp) |
+                 (config->sample_delay << ADC_SAMPDLY_gp);
+    ADC0.CTRLE = config->window_mode << ADC_WINCM_gp;
+    ADC0.SAMPCTRL = config->sample_len;
+    ADC0.MUXPOS = config->pos_ch;
+    ADC0.MUXNEG = config->neg_ch;
+    ADC0.WINLT = config->win_low;
+    ADC0.WINHT = config->win_high;
+    
+    // Control A last, it may enable the ADC
+    ADC0.CTRLA = (config->run_standby ? ADC_RUNSTBY_bm : 0) |
+                 (config->conv_mode ? ADC_CONVMODE_bm : 0) |
+                 (config->left_adjust ? ADC_LEFTADJ_bm : 0) |
+                 (config->freerun ? ADC_FREERUN_bm : 0) |
+                 (config->enable ? ADC_ENABLE_bm : 0);
+}
+
 void adc_enable(void);
 void adc_disable(void);
 void adc_start_conversion(void);
@@ -76,6 +390,42 @@ uint16_t adc_get_result(void);
 void adc_enable_power_rails_before_conversion(void);
 void adc_disable_power_rails_after_conversion(void);
 
+// Hardware oversampling: accumulate 2^sampnum conversions (sampnum 0..7 =
+// ADC_SAMPNUM_ACC1..ACC128) and decimate to 12 + sampnum/2 bits.
+// Window thresholds are given in 12-bit units and scaled to the
+// accumulated RES value (RES is right-shifted by hardware above 16 samples).
+#define ADC_OVERSAMPLE_MAX 7
+
+void adc_oversample_init(uint8_t sampnum, uint16_t win_low, uint16_t win_high);
+uint16_t adc_get_oversampled_result(void);
+uint16_t adc_oversample_decimate(uint16_t accumulated);
+uint8_t adc_get_result_bits(void);
+
+// Window monitor: free running conversions that keep going in STANDBY,
+// the CPU is woken only by window compare when the signal enters or
+// leaves the window set up by adc_init (or adc_oversample_init)
+void adc_monitor_start(void);
+void adc_monitor_stop(void);
+uint8_t get_adc_window_event_status(void);
+void clear_adc_window_event_status(void);
+uint8_t adc_monitor_is_inside(void);
+uint16_t adc_monitor_get_result(void);
+
+// Event triggered conversions: the ADC stays enabled (RUNSTBY), an event
+// on 'channel' starts each conversion and RESRDY wakes the CPU only once
+// the result is in. Sleep is limited to STANDBY while armed.
+void adc_event_start(uint8_t channel);
+void adc_event_stop(void);
+
+// One software started conversion on an enabled ADC, finished by the same
+// RESRDY ISR (result, window flag, EVENT_ADC_RESULT) so the CPU can sleep
+void adc_event_convert(void);
+
+uint8_t get_adc_result_ready_status(void);
+void clear_adc_result_ready_status(void);
+uint16_t adc_event_get_result(void);
+uint8_t adc_event_is_window_satisfied(void);
+
 #endif // ADC_H
 
 
@@ -95,6 +445,33 @@ void low_power_clock_control(uint8_t clk_sel, uint8_t presc_en,
                              uint8_t presc_div, uint8_t run_standby, 
                              uint8_t clkout_en);
 
+// Asynchronous clock manager: clock_request() starts the switch and
+// returns at once, the CPU keeps running on the old clock until the new
+// oscillator is stable, so independent work can overlap the start-up
+typedef enum {
+    CLOCK_POLICY_LOW_POWER,  // OSC32K, 32.768 kHz
+    CLOCK_POLICY_1MHZ,       // OSCHF, 1 MHz
+    CLOCK_POLICY_4MHZ,       // OSCHF, 4 MHz (reset default)
+    CLOCK_POLICY_COUNT
+} clock_policy_t;
+
+// Core clock of each policy, also used for compile-time tables
+#define CLOCK_LOW_POWER_HZ 32768UL
+#define CLOCK_1MHZ_HZ      1000000UL
+#define CLOCK_4MHZ_HZ      4000000UL
+
+// Called by clock_request() before a switch is started, with the new
+// policy, so clock dependent peripherals can be reprogrammed
+typedef void (*clock_change_hook_t)(clock_policy_t policy);
+
+void clock_set_change_hook(clock_change_hook_t hook);
+void clock_request(clock_policy_t policy);
+uint8_t clock_is_ready(void);
+void clock_wait_ready(void);
+clock_policy_t clock_get_policy(void);
+uint32_t clock_get_frequency(void);
+uint32_t clock_get_policy_frequency(clock_policy_t policy);
+
 #endif // MAIN_CLOCK_CONTROL_H
 
 
@@ -110,6 +487,36 @@ void sleep_init(uint8_t sleep_mode, uint8_t sleep_en);
 void sleep_disable(void);
 void sleep_enable(void);
 
+// Sleep levels, shallowest first (values are the SLPCTRL SMODE field)
+typedef enum {
+    SLEEP_LEVEL_IDLE      = 0x00,  // Peripheral clocks keep running
+    SLEEP_LEVEL_STANDBY   = 0x02,  // RUNSTDBY peripherals and RTC only
+    SLEEP_LEVEL_POWERDOWN = 0x04   // PIT and pin interrupts only
+} sleep_level_t;
+
+// Power manager: each driver votes for the deepest level it tolerates
+// while it is busy and votes SLEEP_LEVEL_POWERDOWN (no limit) when done.
+// power_idle() sleeps at the shallowest level voted.
+typedef enum {
+    POWER_VOTER_APP,    // Current application state
+    POWER_VOTER_CLOCK,  // Clock switch in progress
+    POWER_VOTER_SPI,    // HOST transfer running
+    POWER_VOTER_USART,  // TX buffer not yet shifted out
+    POWER_VOTER_ADC,    // Free running window monitor
+    POWER_VOTER_RTC,    // Compare timeout armed
+    POWER_VOTER_NVM,    // EEPROM page write running
+    POWER_VOTER_TRACE,  // State trace timestamps (RTC counter)
+    POWER_VOTER_TCB,    // TCB0 counting events (stopped in POWERDOWN)
+    POWER_VOTER_COUNT
+} power_voter_t;
+
+void power_vote(power_voter_t voter, sleep_level_t level);  // ISR safe
+sleep_level_t power_get_level(void);
+
+// Call with interrupts disabled, returns after the wake with them enabled:
+// cli(); while(!flag) { power_idle(); cli(); } sei();
+void power_idle(void);
+
 #endif // SLEEP_H
 
 
@@ -120,176 +527,359 @@ void sleep_enable(void);
 #define USART0_TX_H
 
 #include <stdint.h>
+#include "main_clock_control.h"
 
 void usart_init(uint8_t mode, uint8_t parity, uint8_t stop_bits, 
                 uint8_t char_size, uint32_t baud_rate);
 
+// Largest accepted baud rate error, in 0.01 % units
+#ifndef USART_BAUD_MAX_ERROR
+#define USART_BAUD_MAX_ERROR 200
+#endif
+
+// Compile-time USART configuration (see ADC_CONFIG): BAUD is computed in
+// integer math for the clock of every clock policy. Policies that cannot
+// reach the baud rate get 0 and the transmitter is off while they run.
+typedef struct {
+    uint16_t baud[CLOCK_POLICY_COUNT];
+    uint8_t ctrlc;
+} usart_config_t;
+
+// Datasheet: f_baud = 64 * f_clk / (16 * BAUD), so BAUD = 4 * f_clk / f_baud
+#define USART_BAUD_REG(clk_hz, baud) \
+    ((4UL * (clk_hz) + (baud) / 2UL) / (baud))
+
+// BAUD register range is 64..65535
+#define USART_BAUD_REACHABLE(clk_hz, baud) \
+    (USART_BAUD_REG(clk_hz, baud) >= 64UL && USART_BAUD_REG(clk_hz, baud) <= 0xFFFFUL)
+
+#define USART_BAUD_FOR(clk_hz, baud) \
+    ((uint16_t)(USART_BAUD_REACHABLE(clk_hz, baud) ? USART_BAUD_REG(clk_hz, baud) : 0))
+
+// Divisor guard for baud rates above 8 * f_clk
+#define USART_BAUD_REG_NZ(clk_hz, baud) \
+    (USART_BAUD_REG(clk_hz, baud) ? USART_BAUD_REG(clk_hz, baud) : 1ULL)
+
+// Signed baud rate error in 0.01 % units, (actual - wanted) / wanted
+#define USART_BAUD_ERROR(clk_hz, baud)                                          \
+    ((int32_t)((40000ULL * (clk_hz) + USART_BAUD_REG_NZ(clk_hz, baud) * (baud) / 2ULL) \
+               / (USART_BAUD_REG_NZ(clk_hz, baud) * (baud))) - 10000L)
+
+#define USART_BAUD_ERROR_OK(clk_hz, baud)                                       \
+    (!USART_BAUD_REACHABLE(clk_hz, baud) ||                                     \
+     (USART_BAUD_ERROR(clk_hz, baud) <= USART_BAUD_MAX_ERROR &&                 \
+      USART_BAUD_ERROR(clk_hz, baud) >= -USART_BAUD_MAX_ERROR))
+
+#define USART_CONFIG(name, mode, parity, stop_bits, char_size, baud_rate)       \
+    _Static_assert((mode) <= 0x03, #name ": mode out of range");                \
+    _Static_assert((parity) == 0x00 || (parity) == 0x02 || (parity) == 0x03,    \
+                   #name ": parity must be 0 (none), 2 (even) or 3 (odd)");     \
+    _Static_assert((stop_bits) <= 1, #name ": stop_bits must be 0 or 1");       \
+    _Static_assert((char_size) <= 0x03 ||                                       \
+                   (char_size) == 0x06 || (char_size) == 0x07,                  \
+                   #name ": char_size out of range");                           \
+    _Static_assert(USART_BAUD_REACHABLE(CLOCK_LOW_POWER_HZ, baud_rate) ||       \
+                   USART_BAUD_REACHABLE(CLOCK_1MHZ_HZ, baud_rate) ||            \
+                   USART_BAUD_REACHABLE(CLOCK_4MHZ_HZ, baud_rate),              \
+                   #name ": baud rate not reachable from any clock policy");    \
+    _Static_assert(USART_BAUD_ERROR_OK(CLOCK_LOW_POWER_HZ, baud_rate),          \
+                   #name ": baud error above USART_BAUD_MAX_ERROR at 32.768 kHz"); \
+    _Static_assert(USART_BAUD_ERROR_OK(CLOCK_1MHZ_HZ, baud_rate),               \
+                   #name ": baud error above USART_BAUD_MAX_ERROR at 1 MHz");   \
+    _Static_assert(USART_BAUD_ERROR_OK(CLOCK_4MHZ_HZ, baud_rate),               \
+                   #name ": baud error above USART_BAUD_MAX_ERROR at 4 MHz");   \
+    static const usart_config_t name = {                                        \
+        .baud  = {                                                              \
+            [CLOCK_POLICY_LOW_POWER] = USART_BAUD_FOR(CLOCK_LOW_POWER_HZ, baud_rate), \
+            [CLOCK_POLICY_1MHZ]      = USART_BAUD_FOR(CLOCK_1MHZ_HZ, baud_rate), \
+            [CLOCK_POLICY_4MHZ]      = USART_BAUD_FOR(CLOCK_4MHZ_HZ, baud_rate)  \
+        },                                                                      \
+        .ctrlc = ((mode) << USART_CMODE_gp)                                     \
+               | ((parity) << USART_PMODE_gp)                                   \
+               | ((stop_bits) << USART_SBMODE_bp)                               \
+               | ((char_size) << USART_CHSIZE_gp)                               \
+    }
+
+void usart_apply_config(const usart_config_t *config);
+
+// Clock manager hook (installed by usart_apply_config): lets queued bytes
+// finish at the old rate, then loads BAUD for the new policy. Bytes queued
+// before the new clock is running go out at the wrong rate, so wait with
+// clock_wait_ready() before printing after a clock_request(). Waiting
+// enables interrupts, the caller's interrupt state is restored on return.
+void usart_clock_changed(clock_policy_t policy);
+uint8_t usart_is_tx_enabled(void);
+
+#define USART0_TX_BUFFER_SIZE 64  // TX ring buffer size, must be a power of 2
+
+// Blocking API (waits only while the TX ring buffer is full)
 void usart0_send_char(char c);
 void usart0_send_string(const char *str);
 
+// Non-blocking API (interrupt driven, returns 0 if buffer full)
+uint8_t usart0_tx_enqueue(char c);
+uint8_t usart0_tx_free_space(void);
+uint8_t get_usart_tx_complete_status(void);
+uint8_t get_usart_tx_dropped_count(void);
+void clear_usart_tx_dropped_count(void);
+
 #endif // USART0_TX_H
 
 
-//Client
+// ========================================
+// usart0_format.h
+// ========================================
+#ifndef USART0_FORMAT_H
+#define USART0_FORMAT_H
 
+#include <stdint.h>
 
-#define F_CPU 32768UL  // 32.768 KHz for most of the time
+// printf-free number formatting, written straight into the USART TX path
+void usart0_put_hex8(uint8_t value);
+void usart0_put_hex16(uint16_t value);
+void usart0_put_dec16(uint16_t value);
+void usart0_put_dec16_fixed(uint16_t value, uint8_t width);
+
+#endif // USART0_FORMAT_H
+
+
+// ========================================
+// rtc.h
+// ========================================
+#ifndef RTC_H
+#define RTC_H
 
-#include <avr/io.h>
-#include <avr/interrupt.h>
-#include <util/delay.h>
 #include <stdint.h>
-#include <stdio.h>
 
-// Include custom libraries
+#define RTC_CLOCK_HZ 32768UL  // RTC and PIT run from OSC32K
+
+// Periodic interrupt timer
+// period = RTC_PERIOD_CYCn_gc, e.g. RTC_PERIOD_CYC32768_gc for 1 s
+void rtc_pit_init(uint8_t period);
+void rtc_pit_disable(void);
+uint8_t get_pit_tick_status(void);
+void clear_pit_tick_status(void);
+uint8_t rtc_pit_take_ticks(void);  // Ticks since the last call (max 255)
+
+// PIT prescaler running for its EVSYS taps (RTC_PIT_DIV64..DIV8192) only,
+// no periodic interrupt unless rtc_pit_init() asks for one
+void rtc_pit_events_init(void);
+
+// Free running 16-bit counter (wraps every 2 s), runs in active, IDLE and
+// STANDBY but stops in POWERDOWN, so ticks only compare within one wake
+void rtc_counter_init(void);
+uint16_t rtc_get_ticks(void);
+
+// One-shot RTC compare timeout, does not sleep (poll the status flag),
+// votes STANDBY while armed since the RTC counter stops in POWERDOWN
+void rtc_timeout_start(uint16_t ticks);
+uint8_t get_rtc_timeout_status(void);
+void rtc_timeout_cancel(void);
+
+// RTC compare timed sleep, accuracy independent of F_CPU (~30.5 us steps)
+// sleep_level = deepest level for the wait, at most SLEEP_LEVEL_STANDBY
+// (the RTC counter stops in POWERDOWN), other power votes may keep the
+// core in a shallower mode
+void delay_sleep_ticks(uint32_t ticks, sleep_level_t sleep_level);
+void delay_sleep_us(uint16_t time_us, sleep_level_t sleep_level);
+void delay_sleep_ms(uint16_t time_ms, sleep_level_t sleep_level);
+
+#endif // RTC_H
+
+
+// ========================================
+// trace.h
+// ========================================
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdint.h>
+
+// State transition trace: state ID, active clock policy and RTC tick of
+// every state change, kept in a RAM ring buffer and dumped over USART.
+// Build with -DTRACE_ENABLE=1, otherwise the hooks compile to nothing.
+#ifndef TRACE_ENABLE
+#define TRACE_ENABLE 0
+#endif
+
+#define TRACE_DEPTH 32  // Entries in the ring buffer, must be a power of 2
+
+// TRACE_DUMP() prints once this many entries are waiting, early enough
+// that the states logged before the next call do not wrap the ring
+#ifndef TRACE_DUMP_LEVEL
+#define TRACE_DUMP_LEVEL (TRACE_DEPTH - 8)
+#endif
+
+// Pseudo state logged while a dump drains, so the USART time is not
+// counted in the state that called TRACE_DUMP()
+#define TRACE_STATE_DUMP 0xFE
+
+typedef struct {
+    uint8_t state;   // app_states_t value
+    uint8_t clock;   // clock_policy_t value
+    uint16_t tick;   // RTC counter (32.768 kHz) at state entry
+} trace_entry_t;
+
+#if TRACE_ENABLE
+// Starts the RTC counter on first use and keeps the device out of
+// POWERDOWN, where the counter stops and sleep would not be timed
+void trace_record(uint8_t state);
+
+// Dump at the next TRACE_DUMP() even if the ring is not full
+void trace_request_dump(void);
+
+// Returns 1 if a dump was started (USART output still draining)
+uint8_t trace_dump(void);
+
+#define TRACE_STATE(state) trace_record((uint8_t)(state))
+#define TRACE_DUMP()       ((void)trace_dump())
+#else
+#define TRACE_STATE(state) ((void)0)
+#define TRACE_DUMP()       ((void)0)
+#endif
+
+#endif // TRACE_H
+
+
+// ========================================
+// scheduler.h
+// ========================================
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+#include <stdint.h>
 #include "main_clock_control.h"
-#include "ports.h"
 #include "sleep.h"
-#include "spi0.h"
-#include "usart0_tx.h"
 
-// SPI Configuration
-#define NUM_SPI_BYTES 2  // Number of bytes to receive
+// Run-to-completion event scheduler. ISRs post one-byte events into a
+// fixed queue, the main loop hands them one at a time to the current
+// state's handler and calls power_idle() when the queue is empty.
+#define SCHED_QUEUE_SIZE 16  // Events in the queue, must be a power of 2
+
+typedef uint8_t sched_event_t;
+
+#define EVENT_NONE          0x00
+#define EVENT_ENTER         0x01  // State entered (sent by the scheduler)
+#define EVENT_BUTTON        0x02  // Button pressed
+#define EVENT_CLIENT_SELECT 0x03  // HOST pulled SS low
+#define EVENT_SPI_FRAME     0x04  // Frame queued by the SPI client ISR
+#define EVENT_SPI_END       0x05  // SS released, SPI transaction over
+#define EVENT_PIT_TICK      0x06  // RTC periodic interrupt
+#define EVENT_RTC_TIMEOUT   0x07  // rtc_timeout_start() compare expired
+#define EVENT_ADC_WINDOW    0x08  // ADC window crossing (monitor mode)
+#define EVENT_USART_TX_DONE 0x09  // USART TX buffer fully shifted out
+#define EVENT_ADC_RESULT    0x0A  // Event triggered conversion finished
+#define EVENT_TCB_PERIOD    0x0B  // TCB0 counted a full period of events
+
+// Handles one event, returns the next state (same state = stay)
+typedef uint8_t (*sched_handler_t)(sched_event_t event);
+
+// One row per state, indexed by the state ID
+typedef struct {
+    sched_handler_t handler;
+    clock_policy_t clock;       // Requested on entry
+    sleep_level_t sleep_level;  // Deepest sleep the state allows, voted on entry
+} sched_state_t;
+
+// Turns driver flags without their own post into events, called with
+// interrupts disabled right before the scheduler decides to sleep
+typedef void (*sched_poll_t)(void);
 
-// External SPI data array (defined in spi0.c)
-extern uint8_t spi_data[NUM_SPI_BYTES];
+void sched_post(sched_event_t event);  // ISR and main loop safe
+uint8_t sched_get_overflow_count(void);
+void sched_set_poll(sched_poll_t poll);
+void sched_run(const sched_state_t *states, uint8_t state) __attribute__((noreturn));
+
+#endif // SCHEDULER_H
+
+
+// ========================================
+// evsys.h
+// ========================================
+#ifndef EVSYS_H
+#define EVSYS_H
+
+#include <avr/io.h>
+#include <stdint.h>
+
+// Event system routing: a generator (pin, RTC, ...) drives one of the six
+// channels, users such as the ADC start input listen to a channel. Events
+// need no CPU and pin/RTC events pass in every sleep mode.
+#define EVSYS_CHANNELS 6
+
+// generator = EVSYS_CHANNELn_*_gc value valid for that channel n
+void evsys_route(uint8_t channel, uint8_t generator);
+void evsys_connect(volatile uint8_t *user, uint8_t channel);  // e.g. &EVSYS.USERADC0START
+void evsys_disconnect(volatile uint8_t *user);
+void evsys_trigger(uint8_t channel);  // Software event on the channel
+
+// Pin as event generator: interrupt off so the pin no longer wakes the CPU,
+// invert = 1 for active low inputs (ADC start reacts to a rising edge)
+void evsys_pin_generator(PORT_t *port, uint8_t pin, uint8_t invert);
+
+#endif // EVSYS_H
+
+
+// ========================================
+// tcb.h
+// ========================================
+#ifndef TCB_H
+#define TCB_H
+
+#include <stdint.h>
+
+// TCB0 clocked by an event channel (e.g. an RTC PIT prescaler tap): the
+// counter needs no CPU, only the end of each period wakes it. A period is
+// num / den events on average, periods alternate between the two nearest
+// whole counts so the remainder carries over. Counts in STANDBY
+// (RUNSTDBY) but not in POWERDOWN, votes STANDBY while running.
+void tcb_count_start(uint8_t channel, uint32_t num, uint16_t den);
+void tcb_count_stop(void);
+uint8_t get_tcb_period_status(void);
+uint8_t tcb_take_periods(void);  // Periods since the last call (max 255)
+
+#endif // TCB_H
+
+
+// ========================================
+// nvm_log.h
+// ========================================
+#ifndef NVM_LOG_H
+#define NVM_LOG_H
+
+#include <avr/io.h>
+#include <stdint.h>
+#include "spi_frame.h"
+
+// Append-only sample log in EEPROM. Records are collected in a RAM page
+// and written a whole page at a time (one multi-byte erase) into a ring
+// of pages, so every page wears equally. Page layout:
+//   [RECORD 0..6][PSEQ lo][PSEQ hi][CRC8][COUNT]
+// PSEQ = page sequence number, CRC8 (spi_frame_crc8) covers records and
+// PSEQ. COUNT is written last and commits the page, a page torn by power
+// loss fails COUNT/CRC and is skipped and reused on start-up.
+#define NVM_LOG_PAGE_SIZE    32  // Bytes per page, EEPROM multi-byte erase block
+#define NVM_LOG_PAGES        (EEPROM_SIZE / NVM_LOG_PAGE_SIZE)
+#define NVM_LOG_RECORD_SIZE  4
+#define NVM_LOG_PAGE_RECORDS ((NVM_LOG_PAGE_SIZE - 4) / NVM_LOG_RECORD_SIZE)
 
-// State Machine Type Definition
-typedef enum {
-    STATE_INIT,
-    STATE_SLEEP,
-    STATE_SWITCH_TO_HIGHSPEED_CLOCK,
-    STATE_RECEIVE_SPI,
-    STATE_SWITCH_TO_LOWPOWER_CLOCK,
-    STATE_WRITE_TO_USART
-} app_states_t;
-
-// Application data structure
 typedef struct {
-    app_states_t state;
-} app_data_t;
+    uint8_t seq;                      // Frame sequence number
+    uint8_t bits;                     // Sample resolution (12..15)
+    uint8_t sample[SPI_SAMPLE_SIZE];  // Packed sample (see above)
+} nvm_log_record_t;
+
+// Scan the pages and resume after the newest valid one
+void nvm_log_init(void);
+
+// Queue a record, a full RAM page starts an interrupt driven page write
+void nvm_log_append(const nvm_log_record_t *record);
+
+// Records in EEPROM plus the ones still in RAM
+uint16_t nvm_log_count(void);
+
+// Stream every record, oldest first, as "L<seq> W<window> A<result>" lines
+void nvm_log_dump(void);
+
+#endif // NVM_LOG_H
 
-int main(void) {
-    // Create state machine instance
-    app_data_t app_data;
-    app_data.state = STATE_INIT;
-    
-    // Main state machine loop
-    while(1) {
-        switch(app_data.state) {
-            
-            case STATE_INIT:
-                // Initialize ports
-                port_init();
-                
-                // Setup low power 32.768 KHz clock
-                low_power_clock_control(
-                    0x01,  // Internal 32.768 KHz oscillator
-                    0,     // Prescaler enable = 0
-                    0x00,  // Prescaler divider (ignored)
-                    0,     // Run standby = 0
-                    0      // Clock out = 0
-                );
-                
-                // Initialize USART (1200 baud)
-                usart_init(
-                    0x00,  // Async mode
-                    0x00,  // No parity
-                    0x00,  // 1 stop bit
-                    0x00,  // 8 data bits
-                    1200   // Baud rate
-                );
-                
-                // Initialize SPI as client
-                spi_client_init();
-                
-                // Initialize sleep controller (power down mode)
-                sleep_init(0x04, 0x01);  // Power down + sleep enable
-                
-                // Enable global interrupts
-                sei();
-                
-                // Move to sleep state
-                app_data.state = STATE_SLEEP;
-                break;
-                
-            case STATE_SLEEP:
-                // Put CPU to sleep
-                __asm__ __volatile__("sleep");
-                
-                // Wake on SPI client select (PA7 pin change interrupt)
-                if(get_client_select_flag_status()) {
-                    clear_client_select_flag();
-                    app_data.state = STATE_SWITCH_TO_HIGHSPEED_CLOCK;
-                }
-                break;
-                
-            case STATE_SWITCH_TO_HIGHSPEED_CLOCK:
-                // Switch to 4 MHz for faster processing
-                main_clock_control(
-                    0x00,  // OSCHF (high freq internal oscillator)
-                    0x02,  // 4 MHz
-                    0,     // Prescaler disabled
-                    0x00,  // Prescaler div (ignored)
-                    0      // Clock out disabled
-                );
-                
-                // Wait for oscillator to stabilize
-                while(!(CLKCTRL.MCLKSTATUS & CLKCTRL_OSCHFS_bm));
-                
-                app_data.state = STATE_RECEIVE_SPI;
-                break;
-                
-            case STATE_RECEIVE_SPI:
-                // Wait for packet to be complete (received in ISR)
-                while(!get_packet_complete_status());
-                
-                // Clear packet complete flag
-                clear_packet_complete_status();
-                
-                app_data.state = STATE_SWITCH_TO_LOWPOWER_CLOCK;
-                break;
-                
-            case STATE_SWITCH_TO_LOWPOWER_CLOCK:
-                // Switch back to 32.768 KHz for low power
-                low_power_clock_control(
-                    0x01,  // Internal 32.768 KHz
-                    0,     // Prescaler disabled
-                    0x00,  // Prescaler div (ignored)
-                    0,     // Run standby disabled
-                    0      // Clock out disabled
-                );
-                
-                // Wait for oscillator to stabilize
-                while(!(CLKCTRL.MCLKSTATUS & CLKCTRL_OSC32KS_bm));
-                
-                app_data.state = STATE_WRITE_TO_USART;
-                break;
-                
-            case STATE_WRITE_TO_USART:
-                // Print raw SPI bytes
-                printf("SPI Byte[1]: 0x%02X\r\n", spi_data[1]);
-                printf("SPI Byte[0]: 0x%02X\r\n", spi_data[0]);
-                
-                // Reconstruct 16-bit result
-                uint16_t results = ((uint16_t)spi_data[1] << 8) | spi_data[0];
-                printf("Results: 0x%04X\r\n", results);
-                
-                // Extract window comparison (bit 15)
-                uint8_t window_result = (results >> 15) & 0x01;
-                printf("Window: %u\r\n", window_result);
-                
-                // Extract ADC result (bits 0-11)
-                uint16_t adc_result = results & 0x0FFF;
-                printf("ADC: %u\r\n\r\n", adc_result);
-                
-                // Delay to ensure print completes
-                _delay_ms(100);
-                
-                app_data.state = STATE_SLEEP;
-                break;
-        }
-    }
-    
-    return 0;
-}
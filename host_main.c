@@ -9,223 +9,750 @@
 #include "main_clock_control.h"
 #include "usart0_tx.h"
 #include "spi0.h"
+#include "spi_frame.h"
 #include "adc.h"
 #include "ports.h"
 #include "sleep.h"
+#include "rtc.h"
+#include "trace.h"
+#include "scheduler.h"
+#include "evsys.h"
+#include "tcb.h"
 
-// SPI Configuration
-#define NUM_SPI_BYTES 2  // Number of bytes to send over SPI
+// SPI frame buffer (see spi_frame.h for layout)
+uint8_t spi_data[SPI_FRAME_MAX_SIZE];
 
-// Window comparison results
-#define WINDOW_SATISFIED     (1 << 7)  // Bit 7 = 1
-#define WINDOW_NOT_SATISFIED (0 << 7)  // Bit 7 = 0
+// Clocked in from the client while spi_data goes out
+static uint8_t spi_response[SPI_FRAME_MAX_SIZE];
 
-// SPI data array
-uint8_t spi_data[NUM_SPI_BYTES];
+// Frames whose acknowledgement never came back (saturates at 0xFF)
+uint8_t ack_misses;
 
-// Spin lock function for delays (works with any clock speed)
-void spin_lock(uint16_t time_ms) {
-    // Convert ms to us and apply scaling factor
-    // Scaling accounts for NOP execution time and loop overhead
-    uint32_t loops = (uint32_t)time_ms * 1000UL / 10UL;
-    
-    for(uint32_t i = 0; i < loops; i++) {
-        __asm__ __volatile__("nop");
-    }
-}
+// Batching: samples collected per SPI frame (1 = send every sample)
+#ifndef HOST_BATCH_SIZE
+#define HOST_BATCH_SIZE 1
+#endif
+
+// Batching: send a partial batch once its oldest sample is this old (seconds)
+#ifndef HOST_BATCH_DEADLINE_S
+#define HOST_BATCH_DEADLINE_S 60
+#endif
+
+// ADC oversampling: accumulate 2^n conversions per sample (0 = off, max 7)
+#ifndef HOST_ADC_OVERSAMPLE
+#define HOST_ADC_OVERSAMPLE 0
+#endif
+
+#if HOST_ADC_OVERSAMPLE < 0 || HOST_ADC_OVERSAMPLE > ADC_OVERSAMPLE_MAX
+#error "HOST_ADC_OVERSAMPLE must be between 0 and ADC_OVERSAMPLE_MAX"
+#endif
+
+// Oversampled frames carry the resolution in payload byte 0
+#if HOST_ADC_OVERSAMPLE > 0
+#define HOST_FRAME_TYPE    SPI_FRAME_TYPE_SAMPLES_HIRES
+#define HOST_SAMPLE_OFFSET 1
+#define HOST_MAX_BATCH     SPI_FRAME_MAX_HIRES_SAMPLES
+#else
+#define HOST_FRAME_TYPE    SPI_FRAME_TYPE_SAMPLES
+#define HOST_SAMPLE_OFFSET 0
+#define HOST_MAX_BATCH     SPI_FRAME_MAX_SAMPLES
+#endif
+
+// Window monitor: free running ADC in STANDBY, send an event frame only
+// when the signal enters or leaves the window (replaces button sampling)
+#ifndef HOST_ADC_MONITOR
+#define HOST_ADC_MONITOR 0
+#endif
+
+// 1 = send batches as delta + varint compressed samples when smaller
+// than the raw 2-byte samples (12-bit samples only)
+#ifndef HOST_SAMPLE_COMPRESS
+#define HOST_SAMPLE_COMPRESS (HOST_ADC_OVERSAMPLE == 0)
+#endif
+
+#if HOST_SAMPLE_COMPRESS && HOST_ADC_OVERSAMPLE > 0
+#error "HOST_SAMPLE_COMPRESS supports 12-bit samples only, disable oversampling"
+#endif
+
+// 1 = train the SPI link on the first transfer and keep the fastest
+// rate every client passed, 0 = stay at SPI_HOST_RATE
+#ifndef HOST_SPI_LINK_TRAINING
+#define HOST_SPI_LINK_TRAINING 1
+#endif
+
+// CLIENTs on the bus, the first HOST_SPI_CLIENTS chip selects of
+// host_spi_clients[] are used
+#ifndef HOST_SPI_CLIENTS
+#define HOST_SPI_CLIENTS 1
+#endif
+
+#if HOST_SPI_CLIENTS < 1 || HOST_SPI_CLIENTS > 8
+#error "HOST_SPI_CLIENTS must be between 1 and 8"
+#endif
+
+// Frame destination: client address or SPI_BROADCAST for every client
+#ifndef HOST_SPI_DESTINATION
+#define HOST_SPI_DESTINATION SPI_BROADCAST
+#endif
+
+// Ask the clients to stream their sample log (SPI_COMMAND_LOG_DUMP) after
+// every HOST_LOG_DUMP_FRAMES sample frames, 0 = never
+#ifndef HOST_LOG_DUMP_FRAMES
+#define HOST_LOG_DUMP_FRAMES 0
+#endif
+
+#if HOST_LOG_DUMP_FRAMES < 0 || HOST_LOG_DUMP_FRAMES > 255
+#error "HOST_LOG_DUMP_FRAMES must be between 0 and 255"
+#endif
+
+// Event triggered ADC: the button (PF6) starts a conversion through the
+// event system and the CPU wakes only once the result is in. Sensor
+// rails, ADC and the 1 MHz clock stay on, sleep is STANDBY, not POWERDOWN.
+#ifndef HOST_ADC_EVENT_TRIGGER
+#define HOST_ADC_EVENT_TRIGGER 0
+#endif
+
+#if HOST_ADC_EVENT_TRIGGER && HOST_ADC_MONITOR
+#error "HOST_ADC_MONITOR already runs the ADC, disable HOST_ADC_EVENT_TRIGGER"
+#endif
+
+// PORTF pins are generators of event channels 4 and 5
+#define HOST_ADC_EVENT_CHANNEL 4
+
+// Clock while waiting for work. The ADC clock (main clock / 4) must be
+// 125 kHz..2 MHz, so modes that convert while the CPU sleeps keep OSCHF
+// at 1 MHz (250 kHz ADC clock) instead of dropping to 32.768 KHz.
+#if HOST_ADC_MONITOR || HOST_ADC_EVENT_TRIGGER
+#define HOST_SLEEP_CLOCK CLOCK_POLICY_1MHZ
+#else
+#define HOST_SLEEP_CLOCK CLOCK_POLICY_LOW_POWER
+#endif
+
+// Periodic sampling: one sample every HOST_SAMPLE_PERIOD_MS from the PIT,
+// a button press still samples at once (0 = button only). With
+// HOST_ADC_EVENT_TRIGGER the PIT tick starts the ADC by a software event.
+#ifndef HOST_SAMPLE_PERIOD_MS
+#define HOST_SAMPLE_PERIOD_MS 0
+#endif
+
+#if HOST_SAMPLE_PERIOD_MS != 0 && (HOST_SAMPLE_PERIOD_MS < 100 || HOST_SAMPLE_PERIOD_MS > 3600000)
+#error "HOST_SAMPLE_PERIOD_MS must be 0 or between 100 and 3600000 (1 hour)"
+#endif
+
+#if HOST_SAMPLE_PERIOD_MS && HOST_ADC_MONITOR
+#error "HOST_ADC_MONITOR samples continuously, disable HOST_SAMPLE_PERIOD_MS"
+#endif
+
+// Sample period counted by TCB0 from an RTC PIT prescaler tap (EVSYS), so
+// the CPU wakes once per sample instead of on every PIT tick (0 = PIT
+// ticks). TCB0 stops in POWERDOWN, the HOST sleeps in STANDBY instead,
+// which costs more than the ticks it saves from 500 ms up (README table).
+#ifndef HOST_SAMPLE_TCB
+#define HOST_SAMPLE_TCB (HOST_SAMPLE_PERIOD_MS > 0 && HOST_SAMPLE_PERIOD_MS < 500)
+#endif
+
+#if HOST_SAMPLE_TCB && HOST_SAMPLE_PERIOD_MS == 0
+#error "HOST_SAMPLE_TCB counts the sample period, set HOST_SAMPLE_PERIOD_MS"
+#endif
+
+// Smallest prescaler tap that keeps the period within 16-bit TCB0 counts,
+// a sample is at most one tap late. DIV64..DIV512 are on odd channels,
+// DIV1024..DIV8192 on even ones (channel 4 is the button in event mode).
+#define HOST_TCB_PERIOD_CYCLES ((HOST_SAMPLE_PERIOD_MS * RTC_CLOCK_HZ) / 1000UL)
+
+#if HOST_TCB_PERIOD_CYCLES / 64 <= 0xFFFF
+#define HOST_TCB_TAP       64UL
+#define HOST_TCB_CHANNEL   1
+#define HOST_TCB_GENERATOR EVSYS_CHANNEL1_RTC_PIT_DIV64_gc
+#elif HOST_TCB_PERIOD_CYCLES / 128 <= 0xFFFF
+#define HOST_TCB_TAP       128UL
+#define HOST_TCB_CHANNEL   1
+#define HOST_TCB_GENERATOR EVSYS_CHANNEL1_RTC_PIT_DIV128_gc
+#elif HOST_TCB_PERIOD_CYCLES / 256 <= 0xFFFF
+#define HOST_TCB_TAP       256UL
+#define HOST_TCB_CHANNEL   1
+#define HOST_TCB_GENERATOR EVSYS_CHANNEL1_RTC_PIT_DIV256_gc
+#elif HOST_TCB_PERIOD_CYCLES / 512 <= 0xFFFF
+#define HOST_TCB_TAP       512UL
+#define HOST_TCB_CHANNEL   1
+#define HOST_TCB_GENERATOR EVSYS_CHANNEL1_RTC_PIT_DIV512_gc
+#elif HOST_TCB_PERIOD_CYCLES / 1024 <= 0xFFFF
+#define HOST_TCB_TAP       1024UL
+#define HOST_TCB_CHANNEL   0
+#define HOST_TCB_GENERATOR EVSYS_CHANNEL0_RTC_PIT_DIV1024_gc
+#elif HOST_TCB_PERIOD_CYCLES / 2048 <= 0xFFFF
+#define HOST_TCB_TAP       2048UL
+#define HOST_TCB_CHANNEL   0
+#define HOST_TCB_GENERATOR EVSYS_CHANNEL0_RTC_PIT_DIV2048_gc
+#elif HOST_TCB_PERIOD_CYCLES / 4096 <= 0xFFFF
+#define HOST_TCB_TAP       4096UL
+#define HOST_TCB_CHANNEL   0
+#define HOST_TCB_GENERATOR EVSYS_CHANNEL0_RTC_PIT_DIV4096_gc
+#else
+#define HOST_TCB_TAP       8192UL
+#define HOST_TCB_CHANNEL   0
+#define HOST_TCB_GENERATOR EVSYS_CHANNEL0_RTC_PIT_DIV8192_gc
+#endif
+
+// Taps per period = ms * 32768 / 1000 / tap = (ms * 8192 / tap) / 250,
+// exact for every tap, TCB0 carries the remainder
+#define HOST_TCB_PERIOD_NUM ((uint32_t)HOST_SAMPLE_PERIOD_MS * 8192UL / HOST_TCB_TAP)
+#define HOST_TCB_PERIOD_DEN 250
+
+// PIT tick: largest RTC period up to 1/8 of the sample period, so a
+// sample is at most one tick late. 1 s when only the batch deadline uses it.
+#define HOST_PERIOD_CYCLES ((HOST_SAMPLE_PERIOD_MS * RTC_CLOCK_HZ) / 1000UL / 8)
+
+#if HOST_SAMPLE_PERIOD_MS == 0 || HOST_SAMPLE_TCB || HOST_PERIOD_CYCLES >= 32768
+#define HOST_PIT_PERIOD RTC_PERIOD_CYC32768_gc
+#define HOST_PIT_CYCLES 32768UL
+#elif HOST_PERIOD_CYCLES >= 16384
+#define HOST_PIT_PERIOD RTC_PERIOD_CYC16384_gc
+#define HOST_PIT_CYCLES 16384UL
+#elif HOST_PERIOD_CYCLES >= 8192
+#define HOST_PIT_PERIOD RTC_PERIOD_CYC8192_gc
+#define HOST_PIT_CYCLES 8192UL
+#elif HOST_PERIOD_CYCLES >= 4096
+#define HOST_PIT_PERIOD RTC_PERIOD_CYC4096_gc
+#define HOST_PIT_CYCLES 4096UL
+#elif HOST_PERIOD_CYCLES >= 2048
+#define HOST_PIT_PERIOD RTC_PERIOD_CYC2048_gc
+#define HOST_PIT_CYCLES 2048UL
+#elif HOST_PERIOD_CYCLES >= 1024
+#define HOST_PIT_PERIOD RTC_PERIOD_CYC1024_gc
+#define HOST_PIT_CYCLES 1024UL
+#elif HOST_PERIOD_CYCLES >= 512
+#define HOST_PIT_PERIOD RTC_PERIOD_CYC512_gc
+#define HOST_PIT_CYCLES 512UL
+#else
+#define HOST_PIT_PERIOD RTC_PERIOD_CYC256_gc
+#define HOST_PIT_CYCLES 256UL
+#endif
+
+#define HOST_PIT_TICKS_PER_S (RTC_CLOCK_HZ / HOST_PIT_CYCLES)
+
+// Sample period in phase units: each PIT tick adds 1000 units (1000 / ticks
+// per second ms), the remainder carries over so the mean period is exact
+#define HOST_PERIOD_UNITS ((uint32_t)HOST_SAMPLE_PERIOD_MS * HOST_PIT_TICKS_PER_S)
+
+#define HOST_PIT_ENABLE (HOST_BATCH_SIZE > 1 || (HOST_SAMPLE_PERIOD_MS > 0 && !HOST_SAMPLE_TCB))
+
+// Any periodic wake: PIT ticks or TCB0 periods
+#define HOST_PERIODIC (HOST_PIT_ENABLE || HOST_SAMPLE_TCB)
+
+#if HOST_ADC_MONITOR && (HOST_BATCH_SIZE > 1 || HOST_ADC_OVERSAMPLE > 0)
+#error "HOST_ADC_MONITOR sends single event frames, disable batching and oversampling"
+#endif
+
+#if HOST_BATCH_SIZE < 1 || HOST_BATCH_SIZE > HOST_MAX_BATCH
+#error "HOST_BATCH_SIZE must be between 1 and the samples that fit one frame"
+#endif
+
+#if HOST_BATCH_DEADLINE_S < 1 || HOST_BATCH_DEADLINE_S > 65535
+#error "HOST_BATCH_DEADLINE_S must be between 1 and 65535"
+#endif
 
 // State Machine Type Definition
 typedef enum {
     STATE_INIT,
     STATE_SLEEP,
     STATE_READ_ADC,
-    STATE_SWITCH_TO_HIGHSPEED_CLOCK,
+    STATE_WAKE_DISPATCH,
     STATE_SEND_SPI,
     STATE_SWITCH_TO_LOWPOWER_CLOCK
 } app_states_t;
 
 // Application data structure
 typedef struct {
-    app_states_t state;
+    uint8_t tx_seq;      // Frame sequence number
+    uint8_t tx_size;     // Encoded frame size in spi_data
+    uint8_t samples[HOST_SAMPLE_OFFSET + HOST_BATCH_SIZE * SPI_SAMPLE_SIZE];  // Frame payload
+    uint8_t sample_count;   // Samples currently in batch
+    uint16_t batch_age_s;   // Seconds since first sample in batch
+    uint8_t pit_subsec;     // PIT ticks into the current second
+    uint32_t period_phase;  // Time since the last periodic sample (phase units)
+    uint8_t flush_pending;  // Deadline expired, send partial batch
+    uint8_t sample_pending; // Button pressed, take a conversion
+    uint8_t event_pending;  // Window crossing to report (monitor mode)
+    uint8_t ack_valid;      // 0 until the first acknowledgement
+    uint8_t link_trained;   // SPI rate locked by link training
+    uint8_t dump_frames;    // Sample frames since the last log dump command
 } app_data_t;
 
-int main(void) {
-    // Create state machine instance
-    app_data_t app_data;
-    app_data.state = STATE_INIT;
+static app_data_t app_data;
+
+// VREF settle time before the first conversion (1 ms, rounded up)
+#define HOST_VREF_SETTLE_TICKS ((uint16_t)((RTC_CLOCK_HZ + 999UL) / 1000UL))
+
+// Chip select per client address, free pins for up to 8 clients
+static const spi_client_cs_t host_spi_clients[] = {
+    {&PORTA, PIN7_bm},  // Client 0 on PA7 (SPI0 SS pin)
+    {&PORTC, PIN0_bm},  // Client 1 on PC0
+    {&PORTC, PIN1_bm},  // Client 2 on PC1
+    {&PORTD, PIN1_bm},  // Client 3 on PD1
+    {&PORTD, PIN2_bm},  // Client 4 on PD2
+    {&PORTD, PIN3_bm},  // Client 5 on PD3
+    {&PORTD, PIN5_bm},  // Client 6 on PD5
+    {&PORTD, PIN6_bm}   // Client 7 on PD6
+};
+
+// ADC: AIN8 (PF2) against GND, VDD reference, single 12-bit conversion,
+// window INSIDE 1000..3000. Checked at compile time by adc_apply_config().
+ADC_CONFIG(host_adc_config,
+    .vref = VREF_REFSEL_VDD_gc,
+    .init_delay = 0x01,   // 16 ADC clocks
+    .presc = 0x01,        // ADC clock prescaler /4 (250 kHz at 1 MHz)
+    .sample_len = 2,      // 2 extra ADC clocks
+    .pos_ch = 0x08,       // AIN8 (PF2)
+    .neg_ch = ADC_MUXNEG_GND_gc,
+    .window_mode = 0x03,  // INSIDE
+    .win_low = 1000,
+    .win_high = 3000,
+);
+
+// USART: 1200 baud 8N1, reachable from every clock policy
+USART_CONFIG(host_usart_config,
+    0x00,  // Async mode
+    0x00,  // No parity
+    0,     // 1 stop bit
+    0x03,  // 8 data bits
+    1200   // Baud rate
+);
+
+// Button flag is set by the port ISR, hand it to the scheduler as an event.
+// The sample request is latched too: only SLEEP handles EVENT_BUTTON, a
+// press during READ_ADC or SEND_SPI is taken once back in SLEEP.
+static void host_poll(void) {
+    if(get_button_pressed_status()) {
+        clear_button_pressed_status();
+#if !HOST_ADC_MONITOR && !HOST_ADC_EVENT_TRIGGER
+        app_data.sample_pending = 1;
+#endif
+        sched_post(EVENT_BUTTON);
+    }
+}
+
+// Append one sample to the batch, 1 = batch due for sending
+static uint8_t host_add_sample(uint16_t adc_result, uint8_t window) {
+    // First sample of a batch starts the deadline
+    if(app_data.sample_count == 0) {
+        app_data.batch_age_s = 0;
+    }
+    
+    // Append packed sample to the batch
+    uint8_t *sample = &app_data.samples[HOST_SAMPLE_OFFSET +
+                                        app_data.sample_count * SPI_SAMPLE_SIZE];
+#if HOST_ADC_OVERSAMPLE > 0
+    spi_sample_pack_hires(sample, adc_result, window);
+#else
+    spi_sample_pack(sample, adc_result, window);
+#endif
+    app_data.sample_count++;
+    
+    // Send only when the batch is full or its deadline expired
+    return app_data.sample_count >= HOST_BATCH_SIZE || app_data.flush_pending;
+}
+
+#if HOST_PERIODIC
+// Advance the sample period and batch deadline by the PIT ticks and TCB0
+// periods counted since the last call, those that came in during other
+// states included
+static void host_pit_advance(void) {
+#if HOST_SAMPLE_TCB
+    // Several periods while busy still make one sample
+    if(tcb_take_periods()) {
+        app_data.sample_pending = 1;
+    }
+#endif
+    
+#if HOST_PIT_ENABLE
+    uint8_t ticks = rtc_pit_take_ticks();
     
-    // Main state machine loop
-    while(1) {
-        switch(app_data.state) {
+    while(ticks--) {
+#if HOST_SAMPLE_PERIOD_MS > 0 && !HOST_SAMPLE_TCB
+        app_data.period_phase += 1000;
+        
+        if(app_data.period_phase >= HOST_PERIOD_UNITS) {
+            app_data.period_phase -= HOST_PERIOD_UNITS;
+            app_data.sample_pending = 1;
+        }
+#endif
+        
+#if HOST_BATCH_SIZE > 1
+        // Age the pending batch once per second
+        if(++app_data.pit_subsec >= HOST_PIT_TICKS_PER_S) {
+            app_data.pit_subsec = 0;
             
-            case STATE_INIT:
-                // Setup low power 32.768 KHz clock
-                low_power_clock_control(
-                    0x01,  // Internal 32.768 KHz oscillator
-                    0,     // Prescaler enable = 0
-                    0x00,  // Prescaler divider (ignored)
-                    0,     // Run standby = 0
-                    0      // Clock out = 0
-                );
-                
-                // Initialize ports
-                port_init();
-                
-                // Initialize ADC
-                adc_init(
-                    0x00,  // VREF = VDD
-                    0,     // Always on disabled
-                    0,     // Run standby disabled
-                    0x00,  // Single 12-bit conversion
-                    0,     // Right adjust
-                    0,     // Free running disabled
-                    0x01,  // Init delay 16 ADC clocks
-                    0,     // No sample accumulation
-                    0x00,  // ADC clock prescaler /2
-                    0,     // Sample delay = 0
-                    2,     // Sample length = 2 ADC clocks
-                    0x08,  // Positive channel AIN8 (PF2)
-                    0x40,  // Negative channel = GND
-                    0x03,  // Window mode = INSIDE
-                    1000,  // Lower threshold
-                    3000,  // Upper threshold
-                    0      // Enable = done later
-                );
-                
-                // Initialize USART (1200 baud)
-                usart_init(
-                    0x00,  // Async mode
-                    0x00,  // No parity
-                    0x00,  // 1 stop bit
-                    0x00,  // 8 data bits
-                    1200   // Baud rate
-                );
-                
-                // Initialize sleep controller (power down mode)
-                sleep_init(0x04, 0x01);  // Power down + sleep enable
-                
-                // Enable global interrupts
-                sei();
-                
-                // Move to sleep state
-                app_data.state = STATE_SLEEP;
-                break;
-                
-            case STATE_SLEEP:
-                // Put CPU to sleep
-                __asm__ __volatile__("sleep");
-                
-                // Wake on button press (pin change interrupt)
-                if(get_button_pressed_status()) {
-                    clear_button_pressed_status();
-                    app_data.state = STATE_SWITCH_TO_HIGHSPEED_CLOCK;
-                }
-                break;
-                
-            case STATE_SWITCH_TO_HIGHSPEED_CLOCK:
-                // Switch to 4 MHz for faster processing
-                main_clock_control(
-                    0x00,  // OSCHF (high freq internal oscillator)
-                    0x02,  // 4 MHz
-                    0,     // Prescaler disabled
-                    0x00,  // Prescaler div (ignored)
-                    0      // Clock out disabled
-                );
-                
-                // Wait for oscillator to stabilize
-                while(!(CLKCTRL.MCLKSTATUS & CLKCTRL_OSCHFS_bm));
-                
-                app_data.state = STATE_READ_ADC;
-                break;
-                
-            case STATE_READ_ADC:
-                // Enable power rails for ADC (PC3=HIGH, PC2=LOW)
-                adc_enable_power_rails_before_conversion();
-                
-                // Enable ADC
-                adc_enable();
-                
-                // Delay for VREF stabilization (1ms)
-                _delay_ms(1);
-                
-                // Start ADC conversion
-                adc_start_conversion();
-                
-                // Wait for conversion to complete
-                while(!adc_is_conversion_done());
-                
-                // Clear SPI data array
-                for(uint8_t i = 0; i < NUM_SPI_BYTES; i++) {
-                    spi_data[i] = 0;
-                }
-                
-                // Check window comparison BEFORE reading result
-                // (reading result clears the window flag)
-                if(adc_is_window_satisfied()) {
-                    spi_data[1] = WINDOW_SATISFIED;
-                } else {
-                    spi_data[1] = WINDOW_NOT_SATISFIED;
-                }
-                
-                // Read ADC result
-                uint16_t adc_result = adc_get_result();
-                
-                // Pack data into SPI bytes
-                spi_data[0] = (uint8_t)(adc_result & 0xFF);        // Low byte
-                spi_data[1] |= (uint8_t)((adc_result >> 8) & 0x0F); // High nibble + window bit
-                
-                // Disable ADC and power rails
-                adc_disable();
-                adc_disable_power_rails_after_conversion();
-                
-                app_data.state = STATE_SEND_SPI;
-                break;
-                
-            case STATE_SEND_SPI:
-                // Initialize SPI as host
-                spi_host_init();
-                
-                // Select client (pull SS low)
-                spi_select_client();
-                
-                // Delay to allow client to wake and be ready
-                spin_lock(4);  // 4ms delay
-                
-                // Send SPI data block
-                spi0_write_block(spi_data, NUM_SPI_BYTES);
-                
-                // Deselect client (pull SS high)
-                spi_deselect_client();
-                
-                // Disable SPI
-                spi_disable();
-                
-                // Disable SPI pins to save power
-                spi_disable_pins();
-                
-                app_data.state = STATE_SWITCH_TO_LOWPOWER_CLOCK;
-                break;
-                
-            case STATE_SWITCH_TO_LOWPOWER_CLOCK:
-                // Switch back to 32.768 KHz for low power
-                low_power_clock_control(
-                    0x01,  // Internal 32.768 KHz
-                    0,     // Prescaler disabled
-                    0x00,  // Prescaler div (ignored)
-                    0,     // Run standby disabled
-                    0      // Clock out disabled
-                );
-                
-                // Wait for oscillator to stabilize
-                while(!(CLKCTRL.MCLKSTATUS & CLKCTRL_OSC32KS_bm));
-                
-                // Disable unused pins before sleep
-                turn_off_unused_pins_before_sleep();
-                
-                app_data.state = STATE_SLEEP;
-                break;
+            if(app_data.sample_count > 0 &&
+               ++app_data.batch_age_s >= HOST_BATCH_DEADLINE_S) {
+                app_data.flush_pending = 1;
+            }
         }
+#endif
     }
+#endif
+}
+#endif
+
+static uint8_t state_init(sched_event_t event) {
+    // Sleep clock requested by state policy
+    clock_wait_ready();
+    
+    // Initialize ports
+    port_init();
+    
+    // Initialize ADC (disabled until a conversion is needed)
+    adc_apply_config(&host_adc_config);
+    
+#if HOST_ADC_OVERSAMPLE > 0
+    // Accumulate 2^n conversions, window on the accumulated value
+    adc_oversample_init(HOST_ADC_OVERSAMPLE, 1000, 3000);
+#endif
+    
+    // Client chip selects (driven high, clients stay asleep)
+    spi_host_set_clients(host_spi_clients, HOST_SPI_CLIENTS);
+    
+    // Initialize USART (1200 baud, 8N1)
+    usart_apply_config(&host_usart_config);
+    
+#if HOST_ADC_MONITOR
+    // Sensor stays powered, ADC free runs at 1 MHz / 4 in STANDBY
+    adc_enable_power_rails_before_conversion();
+    adc_monitor_start();
+#elif HOST_ADC_EVENT_TRIGGER
+    // Sensor stays powered, button edge -> event channel -> ADC start,
+    // the button no longer raises a pin interrupt
+    adc_enable_power_rails_before_conversion();
+    evsys_pin_generator(&PORTF, 6, 1);
+    evsys_route(HOST_ADC_EVENT_CHANNEL, EVSYS_CHANNEL4_PORTF_PIN6_gc);
+    adc_event_start(HOST_ADC_EVENT_CHANNEL);
+#endif
+    
+#if HOST_PIT_ENABLE
+    // PIT tick for the sample period and batch deadline (runs in power down)
+    rtc_pit_init(HOST_PIT_PERIOD);
+#endif
+    
+#if HOST_SAMPLE_TCB
+    // PIT prescaler tap -> event channel -> TCB0 count, the CPU wakes
+    // only when a sample period is complete
+    rtc_pit_events_init();
+    evsys_route(HOST_TCB_CHANNEL, HOST_TCB_GENERATOR);
+    tcb_count_start(HOST_TCB_CHANNEL, HOST_TCB_PERIOD_NUM, HOST_TCB_PERIOD_DEN);
+#endif
+    
+    // Button presses reach the scheduler through the poll hook
+    sched_set_poll(host_poll);
+    
+    // Enable global interrupts
+    sei();
+    
+    // Move to sleep state
+    return STATE_SLEEP;
+}
+
+static uint8_t state_sleep(sched_event_t event) {
+#if !HOST_PERIODIC && !HOST_ADC_MONITOR && !HOST_ADC_EVENT_TRIGGER
+    // Button pressed while busy, its event went to that state
+    if(event == EVENT_ENTER && app_data.sample_pending) {
+        return STATE_WAKE_DISPATCH;
+    }
+#endif
+    
+    switch(event) {
+#if HOST_PERIODIC
+        case EVENT_ENTER:
+#if HOST_PIT_ENABLE
+        case EVENT_PIT_TICK:
+#endif
+#if HOST_SAMPLE_TCB
+        case EVENT_TCB_PERIOD:
+#endif
+            // Sample period or batch deadline due
+            host_pit_advance();
+            
+#if HOST_ADC_EVENT_TRIGGER
+            // Start the conversion without leaving the sleep clock
+            if(app_data.sample_pending) {
+                app_data.sample_pending = 0;
+                evsys_trigger(HOST_ADC_EVENT_CHANNEL);
+            }
+#endif
+            
+            if(app_data.sample_pending || app_data.flush_pending) {
+                return STATE_WAKE_DISPATCH;
+            }
+            break;
+#endif
+            
+#if HOST_ADC_MONITOR
+        case EVENT_ADC_WINDOW:
+            // Signal entered or left the window
+            clear_adc_window_event_status();
+            app_data.event_pending = 1;
+            return STATE_WAKE_DISPATCH;
+            
+        // EVENT_BUTTON ignored, a conversion would stop the free running ADC
+#elif HOST_ADC_EVENT_TRIGGER
+        case EVENT_ADC_RESULT:
+            // Button or PIT started conversion done, clock switch only to send
+            clear_adc_result_ready_status();
+            
+#if HOST_ADC_OVERSAMPLE > 0
+            if(host_add_sample(adc_oversample_decimate(adc_event_get_result()),
+                               adc_event_is_window_satisfied())) {
+#else
+            if(host_add_sample(adc_event_get_result(), adc_event_is_window_satisfied())) {
+#endif
+                return STATE_WAKE_DISPATCH;
+            }
+            break;
+#else
+        case EVENT_BUTTON:
+            // Take a conversion now, the sample period keeps its phase
+            // (sample_pending latched by host_poll; already taken if a
+            // press while busy was handled on entry)
+            if(app_data.sample_pending) {
+                return STATE_WAKE_DISPATCH;
+            }
+            break;
+#endif
+    }
+    
+    return STATE_SLEEP;
+}
+
+static uint8_t state_wake_dispatch(sched_event_t event) {
+    // Still at the sleep clock: pick the work for this wake, the next
+    // state's policy starts the OSCHF switch
+    
+    // Deadline-only wake skips the conversion
+    if(app_data.sample_pending) {
+        app_data.sample_pending = 0;
+        return STATE_READ_ADC;
+    }
+    
+    return STATE_SEND_SPI;
+}
+
+static uint8_t state_read_adc(sched_event_t event) {
+    if(event == EVENT_ENTER) {
+        // Rail power-up and VREF settle overlap the 1 MHz start-up
+        
+        // Enable power rails for ADC (PC3=HIGH, PC2=LOW)
+        adc_enable_power_rails_before_conversion();
+        
+        // Enable ADC
+        adc_enable();
+        
+        // VREF stabilization, IDLE (state sleep mode) keeps the ADC running
+        rtc_timeout_start(HOST_VREF_SETTLE_TICKS);
+        return STATE_READ_ADC;
+    }
+    
+    if(event == EVENT_RTC_TIMEOUT && get_rtc_timeout_status()) {
+        rtc_timeout_cancel();
+        
+        // ADC clock comes from the main clock
+        clock_wait_ready();
+        
+        // Sleep (IDLE) until RESRDY posts the result
+        adc_event_convert();
+        return STATE_READ_ADC;
+    }
+    
+    if(event != EVENT_ADC_RESULT || !get_adc_result_ready_status()) {
+        return STATE_READ_ADC;
+    }
+    clear_adc_result_ready_status();
+    
+    // Result and window flag latched by the RESRDY ISR (reading the
+    // result clears the window flag)
+    uint8_t window = adc_event_is_window_satisfied();
+    
+    // Read ADC result (decimated when oversampling)
+#if HOST_ADC_OVERSAMPLE > 0
+    uint16_t adc_result = adc_oversample_decimate(adc_event_get_result());
+#else
+    uint16_t adc_result = adc_event_get_result();
+#endif
+    
+    uint8_t send = host_add_sample(adc_result, window);
+    
+    // Disable ADC and power rails
+    adc_disable();
+    adc_disable_power_rails_after_conversion();
+    
+    if(send) {
+        return STATE_SEND_SPI;
+    }
+    
+    return STATE_SWITCH_TO_LOWPOWER_CLOCK;
+}
+
+#if HOST_LOG_DUMP_FRAMES > 0
+// Command frame after the samples: the clients stream their log over
+// USART, the HOST trace is dumped along with it
+static void host_send_log_dump(void) {
+    static const uint8_t command[] = {SPI_COMMAND_LOG_DUMP};
+    uint8_t frame[SPI_FRAME_OVERHEAD + sizeof(command)];
+    uint8_t size = spi_frame_encode(frame, SPI_FRAME_TYPE_COMMAND, app_data.tx_seq++,
+                                    command, sizeof(command));
+    
+    // Its acknowledgement comes back with the next sample frame
+    spi_send_frame_to(HOST_SPI_DESTINATION, frame, size, 0);
+    
+#if TRACE_ENABLE
+    trace_request_dump();
+#endif
+}
+#endif
+
+static uint8_t state_send_spi(sched_event_t event) {
+#if HOST_SPI_LINK_TRAINING
+    // First transfer after reset: find the fastest reliable SCK,
+    // before this frame takes its sequence number
+    if(!app_data.link_trained) {
+        clock_wait_ready();
+        spi_host_init();
+        spi_link_train(&app_data.tx_seq);
+        app_data.link_trained = 1;
+    }
+#endif
+    
+#if HOST_ADC_MONITOR
+    if(app_data.event_pending) {
+        app_data.event_pending = 0;
+        
+        // Event code + the sample that crossed the window
+        uint8_t window_event[1 + SPI_SAMPLE_SIZE];
+        window_event[0] = adc_monitor_is_inside() ?
+                          SPI_EVENT_WINDOW_ENTER : SPI_EVENT_WINDOW_LEAVE;
+        spi_sample_pack(&window_event[1], adc_monitor_get_result(),
+                        adc_monitor_is_inside());
+        
+        app_data.tx_size = spi_frame_encode(spi_data, SPI_FRAME_TYPE_EVENT,
+                                            app_data.tx_seq++, window_event,
+                                            sizeof(window_event));
+    }
+#else
+#if HOST_ADC_OVERSAMPLE > 0
+    // Tell the client how many bits each sample carries
+    app_data.samples[0] = adc_get_result_bits();
+#endif
+    
+    uint8_t raw_len = HOST_SAMPLE_OFFSET + app_data.sample_count * SPI_SAMPLE_SIZE;
+    
+#if HOST_SAMPLE_COMPRESS
+    // Neighbouring samples differ by a few LSBs: send deltas
+    // when that is shorter, raw samples otherwise
+    uint8_t packed[SPI_FRAME_MAX_PAYLOAD];
+    uint8_t packed_len = 0;
+    
+    if(app_data.sample_count > 1) {
+        packed_len = spi_sample_compress(packed, sizeof(packed),
+                                         app_data.samples, app_data.sample_count);
+    }
+    
+    if(packed_len && packed_len < raw_len) {
+        app_data.tx_size = spi_frame_encode(spi_data, SPI_FRAME_TYPE_SAMPLES_DELTA,
+                                            app_data.tx_seq++, packed, packed_len);
+    } else
+#endif
+    {
+        // Wrap the whole batch in one frame
+        app_data.tx_size = spi_frame_encode(spi_data, HOST_FRAME_TYPE,
+                                            app_data.tx_seq++, app_data.samples,
+                                            raw_len);
+    }
+    app_data.sample_count = 0;
+    app_data.flush_pending = 0;
+#endif
+    
+    // Frame encoding above overlaps the 4 MHz start-up
+    clock_wait_ready();
+    
+    // Initialize SPI as host
+    spi_host_init();
+    
+    // Handshake with each destination client and send the frame,
+    // the client's acknowledgement comes back on MISO meanwhile
+    spi_frame_t ack;
+    uint8_t acked = spi_send_frame_to(HOST_SPI_DESTINATION, spi_data, app_data.tx_size,
+                                      spi_response) &&
+                    spi_frame_decode(spi_response, app_data.tx_size, &ack) == SPI_FRAME_OK &&
+                    ack.type == SPI_FRAME_TYPE_ACK;
+    
+    // It acknowledges the frame before this one (tx_seq - 2), anything
+    // else means that frame was lost or the client restarted. Counted
+    // only, the samples are not kept for a resend.
+    if(app_data.ack_valid && (!acked || ack.seq != (uint8_t)(app_data.tx_seq - 2))) {
+        if(ack_misses != 0xFF) {
+            ack_misses++;
+        }
+    }
+    app_data.ack_valid |= acked;
+    
+#if HOST_LOG_DUMP_FRAMES > 0
+    if(++app_data.dump_frames >= HOST_LOG_DUMP_FRAMES) {
+        app_data.dump_frames = 0;
+        host_send_log_dump();
+    }
+#endif
+    
+    // Disable SPI
+    spi_disable();
+    
+    // Disable SPI pins to save power
+    spi_disable_pins();
+    
+    return STATE_SWITCH_TO_LOWPOWER_CLOCK;
+}
+
+static uint8_t state_switch_to_lowpower_clock(sched_event_t event) {
+    // Switch back to the sleep clock started by state policy
+    
+#if TRACE_ENABLE
+    // Dump at the new clock once the ring fills up, before the USART
+    // pin is turned off
+    clock_wait_ready();
+    if(trace_dump()) {
+        cli();
+        while(!get_usart_tx_complete_status()) {
+            power_idle();
+            cli();
+        }
+        sei();
+    }
+#endif
+    
+#if !HOST_ADC_MONITOR && !HOST_ADC_EVENT_TRIGGER
+    // Disable unused pins before sleep (monitor and event triggered modes
+    // keep the sensor rails and analog input alive)
+    turn_off_unused_pins_before_sleep();
+#endif
+    
+    // Wait for oscillator to stabilize
+    clock_wait_ready();
+    
+    return STATE_SLEEP;
+}
+
+// Handler, clock policy and deepest sleep level per state. Switches start
+// on entry and states wait only where they need the clock. Busy drivers
+// vote shallower levels themselves (monitor mode ADC keeps STANDBY).
+static const sched_state_t host_states[] = {
+    [STATE_INIT]                     = {state_init,                     HOST_SLEEP_CLOCK,  SLEEP_LEVEL_POWERDOWN},
+    [STATE_SLEEP]                    = {state_sleep,                    HOST_SLEEP_CLOCK,  SLEEP_LEVEL_POWERDOWN},
+    [STATE_READ_ADC]                 = {state_read_adc,                 CLOCK_POLICY_1MHZ, SLEEP_LEVEL_IDLE},  // ADC enabled
+    [STATE_WAKE_DISPATCH]            = {state_wake_dispatch,            HOST_SLEEP_CLOCK,  SLEEP_LEVEL_POWERDOWN},
+    [STATE_SEND_SPI]                 = {state_send_spi,                 CLOCK_POLICY_4MHZ, SLEEP_LEVEL_POWERDOWN},
+    [STATE_SWITCH_TO_LOWPOWER_CLOCK] = {state_switch_to_lowpower_clock, HOST_SLEEP_CLOCK,  SLEEP_LEVEL_POWERDOWN}
+};
+
+int main(void) {
+    // Dispatch events to the state handlers, never returns
+    sched_run(host_states, STATE_INIT);
     
     return 0;
 }
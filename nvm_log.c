@@ -0,0 +1,240 @@
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <avr/xmega.h>
+#include <string.h>
+#include <stdint.h>
+#include "nvm_log.h"
+#include "spi_frame.h"
+#include "sleep.h"
+#include "usart0_tx.h"
+#include "usart0_format.h"
+
+// Page trailer byte offsets, COUNT must be the last byte written
+#define NVM_LOG_PSEQ_POS  (NVM_LOG_PAGE_RECORDS * NVM_LOG_RECORD_SIZE)
+#define NVM_LOG_CRC_POS   (NVM_LOG_PSEQ_POS + 2)
+#define NVM_LOG_COUNT_POS (NVM_LOG_CRC_POS + 1)
+
+_Static_assert(sizeof(nvm_log_record_t) == NVM_LOG_RECORD_SIZE,
+               "nvm_log_record_t must match NVM_LOG_RECORD_SIZE");
+_Static_assert(NVM_LOG_COUNT_POS == NVM_LOG_PAGE_SIZE - 1,
+               "COUNT must be the last byte of a page");
+_Static_assert(NVM_LOG_PAGES >= 2, "the log needs at least two pages");
+
+// Records collected for the next page
+static nvm_log_record_t fill_records[NVM_LOG_PAGE_RECORDS];
+static uint8_t fill_count = 0;
+
+// Page image written by the EEREADY ISR, one byte per interrupt
+static uint8_t write_buffer[NVM_LOG_PAGE_SIZE];
+static volatile uint8_t *write_dst = 0;
+static volatile uint8_t write_index = 0;
+static volatile uint8_t write_erased = 0;
+static volatile uint8_t write_busy = 0;
+
+// Next page of the ring and its sequence number
+static uint8_t next_page = 0;
+static uint16_t next_pseq = 0;
+
+static volatile uint8_t *nvm_log_page_addr(uint8_t page) {
+    // EEPROM is mapped into the data space
+    return (volatile uint8_t *)(EEPROM_START + (uint16_t)page * NVM_LOG_PAGE_SIZE);
+}
+
+static void nvm_command(uint8_t cmd) {
+    // A new command must be preceded by NOCMD
+    _PROTECTED_WRITE_SPM(NVMCTRL.CTRLA, NVMCTRL_CMD_NOCMD_gc);
+    _PROTECTED_WRITE_SPM(NVMCTRL.CTRLA, cmd);
+}
+
+// Page contents, the page being written is read from its image so
+// readers need not wait for the EEPROM
+static const uint8_t *nvm_log_page_data(uint8_t page) {
+    volatile uint8_t *addr = nvm_log_page_addr(page);
+    
+    if(write_busy && write_dst == addr) {
+        return write_buffer;
+    }
+    
+    return (const uint8_t *)addr;
+}
+
+// Records on a committed page, 0 for erased, torn or corrupted pages
+static uint8_t nvm_log_page_count(uint8_t page) {
+    const uint8_t *src = nvm_log_page_data(page);
+    uint8_t count = src[NVM_LOG_COUNT_POS];
+    
+    if(count == 0 || count > NVM_LOG_PAGE_RECORDS) {
+        return 0;
+    }
+    
+    if(spi_frame_crc8(src, NVM_LOG_CRC_POS) != src[NVM_LOG_CRC_POS]) {
+        return 0;
+    }
+    
+    return count;
+}
+
+static uint16_t nvm_log_page_pseq(uint8_t page) {
+    const uint8_t *src = (const uint8_t *)nvm_log_page_addr(page);
+    
+    return src[NVM_LOG_PSEQ_POS] | ((uint16_t)src[NVM_LOG_PSEQ_POS + 1] << 8);
+}
+
+// Sleep until the page write in progress has committed
+static void nvm_log_wait(void) {
+    cli();
+    while(write_busy) {
+        power_idle();
+        cli();
+    }
+    sei();
+}
+
+static void nvm_log_write_start(uint8_t page) {
+    write_dst = nvm_log_page_addr(page);
+    write_index = 0;
+    write_erased = 0;
+    write_busy = 1;
+    
+    // EEPROM programming needs the NVM controller clock
+    power_vote(POWER_VOTER_NVM, SLEEP_LEVEL_IDLE);
+    
+    // One erase for the whole page, a write to the block starts it
+    nvm_command(NVMCTRL_CMD_EEMBER32_gc);
+    *write_dst = 0xFF;
+    
+    // EEREADY ISR writes the bytes once the erase is done
+    NVMCTRL.INTFLAGS = NVMCTRL_EEREADY_bm;
+    NVMCTRL.INTCTRL = NVMCTRL_EEREADY_bm;
+}
+
+void nvm_log_init(void) {
+    uint8_t newest = NVM_LOG_PAGES;
+    uint16_t newest_pseq = 0;
+    
+    // Newest committed page, PSEQ compared modulo 2^16
+    for(uint8_t page = 0; page < NVM_LOG_PAGES; page++) {
+        if(!nvm_log_page_count(page)) {
+            continue;
+        }
+        
+        uint16_t pseq = nvm_log_page_pseq(page);
+        if(newest == NVM_LOG_PAGES || (int16_t)(pseq - newest_pseq) > 0) {
+            newest = page;
+            newest_pseq = pseq;
+        }
+    }
+    
+    // Resume after it, a torn page there is simply rewritten
+    if(newest == NVM_LOG_PAGES) {
+        next_page = 0;
+        next_pseq = 0;
+    } else {
+        next_page = (newest + 1) % NVM_LOG_PAGES;
+        next_pseq = newest_pseq + 1;
+    }
+    
+    fill_count = 0;
+}
+
+void nvm_log_append(const nvm_log_record_t *record) {
+    fill_records[fill_count++] = *record;
+    
+    if(fill_count < NVM_LOG_PAGE_RECORDS) {
+        return;
+    }
+    
+    // Previous page must be committed before its buffer is reused
+    nvm_log_wait();
+    
+    memset(write_buffer, 0xFF, sizeof(write_buffer));
+    memcpy(write_buffer, fill_records, sizeof(fill_records));
+    write_buffer[NVM_LOG_PSEQ_POS] = (uint8_t)next_pseq;
+    write_buffer[NVM_LOG_PSEQ_POS + 1] = (uint8_t)(next_pseq >> 8);
+    write_buffer[NVM_LOG_CRC_POS] = spi_frame_crc8(write_buffer, NVM_LOG_CRC_POS);
+    write_buffer[NVM_LOG_COUNT_POS] = fill_count;
+    fill_count = 0;
+    
+    nvm_log_write_start(next_page);
+    
+    next_page = (next_page + 1) % NVM_LOG_PAGES;
+    next_pseq++;
+}
+
+uint16_t nvm_log_count(void) {
+    uint16_t count = fill_count;
+    
+    for(uint8_t page = 0; page < NVM_LOG_PAGES; page++) {
+        count += nvm_log_page_count(page);
+    }
+    
+    return count;
+}
+
+static void nvm_log_print_record(const nvm_log_record_t *record) {
+    uint16_t packed = spi_sample_unpack(record->sample);
+    uint8_t bits = record->bits;
+    
+    if(bits < 12 || bits > 15) {
+        bits = 15;
+    }
+    
+    // "L1F W1 A2748\r\n"
+    usart0_send_char('L');
+    usart0_put_hex8(record->seq);
+    usart0_send_string(" W");
+    usart0_send_char((packed & SPI_SAMPLE_WINDOW_bm) ? '1' : '0');
+    usart0_send_string(" A");
+    usart0_put_dec16(packed & ((1U << bits) - 1));
+    usart0_send_string("\r\n");
+}
+
+void nvm_log_dump(void) {
+    usart0_send_string("Log: ");
+    usart0_put_dec16(nvm_log_count());
+    usart0_send_string("\r\n");
+    
+    // The next page to be overwritten holds the oldest records
+    for(uint8_t i = 0; i < NVM_LOG_PAGES; i++) {
+        uint8_t page = (next_page + i) % NVM_LOG_PAGES;
+        uint8_t count = nvm_log_page_count(page);
+        const nvm_log_record_t *records = (const nvm_log_record_t *)nvm_log_page_data(page);
+        
+        for(uint8_t r = 0; r < count; r++) {
+            nvm_log_print_record(&records[r]);
+        }
+    }
+    
+    // Records not yet on a full page
+    for(uint8_t r = 0; r < fill_count; r++) {
+        nvm_log_print_record(&fill_records[r]);
+    }
+}
+
+ISR(NVMCTRL_EEREADY_vect) {
+    // Erase done: program the page bytes from now on
+    if(!write_erased) {
+        write_erased = 1;
+        nvm_command(NVMCTRL_CMD_EEWR_gc);
+    }
+    
+    // Bytes left at the erased value need no write
+    while(write_index < NVM_LOG_PAGE_SIZE && write_buffer[write_index] == 0xFF) {
+        write_index++;
+    }
+    
+    if(write_index < NVM_LOG_PAGE_SIZE) {
+        write_dst[write_index] = write_buffer[write_index];
+        write_index++;
+        
+        // Clear after the write: the flag is set again whenever the EEPROM is idle
+        NVMCTRL.INTFLAGS = NVMCTRL_EEREADY_bm;
+        return;
+    }
+    
+    // COUNT has been written, the page is committed
+    nvm_command(NVMCTRL_CMD_NOCMD_gc);
+    NVMCTRL.INTCTRL = 0;
+    write_busy = 0;
+    power_vote(POWER_VOTER_NVM, SLEEP_LEVEL_POWERDOWN);
+}
@@ -0,0 +1,50 @@
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <util/atomic.h>
+#include <stdint.h>
+#include "sleep.h"
+
+// After sleep.h: avr-libc defines sleep_enable()/sleep_disable() as macros
+#include <avr/sleep.h>
+
+_Static_assert(POWER_VOTER_COUNT <= 16, "one vote bit per voter in a uint16_t");
+
+// One bit per voter, a voter is in at most one mask (none = POWERDOWN)
+static volatile uint16_t idle_votes = 0;
+static volatile uint16_t standby_votes = 0;
+
+void power_vote(power_voter_t voter, sleep_level_t level) {
+    uint16_t voter_bm = 1U << voter;
+    
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        idle_votes &= ~voter_bm;
+        standby_votes &= ~voter_bm;
+        
+        if(level == SLEEP_LEVEL_IDLE) {
+            idle_votes |= voter_bm;
+        } else if(level == SLEEP_LEVEL_STANDBY) {
+            standby_votes |= voter_bm;
+        }
+    }
+}
+
+sleep_level_t power_get_level(void) {
+    // Shallowest vote wins
+    if(idle_votes) {
+        return SLEEP_LEVEL_IDLE;
+    }
+    
+    if(standby_votes) {
+        return SLEEP_LEVEL_STANDBY;
+    }
+    
+    return SLEEP_LEVEL_POWERDOWN;
+}
+
+void power_idle(void) {
+    // Votes cannot change before the sleep, interrupts are still off
+    SLPCTRL.CTRLA = power_get_level() | SLPCTRL_SEN_bm;
+    
+    sei();  // SEI delays one instruction, so no wake is missed
+    sleep_cpu();
+}
@@ -0,0 +1,220 @@
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <util/atomic.h>
+#include <stdint.h>
+#include "rtc.h"
+#include "scheduler.h"
+#include "sleep.h"
+
+// Longest single compare period (CNT/CMP are 16-bit)
+#define RTC_MAX_DELAY_TICKS 0xFFFFUL
+
+// Set by PIT ISR, cleared by application
+static volatile uint8_t pit_tick_flag = 0;
+
+// Counted by PIT ISR, so ticks seen while the application is busy add up
+static volatile uint8_t pit_tick_count = 0;
+
+// Set by RTC compare ISR when a timeout or timed sleep expires
+static volatile uint8_t delay_done_flag = 0;
+
+// Compare armed by rtc_timeout_start(), timed sleeps do not post an event
+static volatile uint8_t timeout_event = 0;
+
+void rtc_pit_init(uint8_t period) {
+    // 32.768 kHz RTC clock (keeps running in power down)
+    RTC.CLKSEL = RTC_CLKSEL_OSC32K_gc;
+    
+    // Wait until PIT registers can be written
+    while(RTC.PITSTATUS & RTC_CTRLBUSY_bm);
+    
+    pit_tick_flag = 0;
+    pit_tick_count = 0;
+    
+    // Enable periodic interrupt
+    RTC.PITINTCTRL = RTC_PI_bm;
+    RTC.PITCTRLA = (period & RTC_PERIOD_gm) | RTC_PITEN_bm;
+}
+
+void rtc_pit_events_init(void) {
+    RTC.CLKSEL = RTC_CLKSEL_OSC32K_gc;
+    
+    while(RTC.PITSTATUS & RTC_CTRLBUSY_bm);
+    
+    // Already ticking for rtc_pit_init(), its prescaler drives the taps too
+    if(RTC.PITCTRLA & RTC_PITEN_bm) {
+        return;
+    }
+    
+    // Prescaler on, no periodic interrupt
+    RTC.PITINTCTRL = 0;
+    RTC.PITCTRLA = RTC_PERIOD_CYC32768_gc | RTC_PITEN_bm;
+}
+
+void rtc_pit_disable(void) {
+    while(RTC.PITSTATUS & RTC_CTRLBUSY_bm);
+    
+    RTC.PITCTRLA = 0;
+    RTC.PITINTCTRL = 0;
+}
+
+uint8_t get_pit_tick_status(void) {
+    return pit_tick_flag;
+}
+
+void clear_pit_tick_status(void) {
+    pit_tick_flag = 0;
+}
+
+uint8_t rtc_pit_take_ticks(void) {
+    uint8_t ticks;
+    
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        ticks = pit_tick_count;
+        pit_tick_count = 0;
+        pit_tick_flag = 0;
+    }
+    
+    return ticks;
+}
+
+void rtc_counter_init(void) {
+    // Already running for another user (trace, timeouts): keep the count
+    if(RTC.CTRLA & RTC_RTCEN_bm) {
+        return;
+    }
+    
+    RTC.CLKSEL = RTC_CLKSEL_OSC32K_gc;
+    
+    // Wait until CNT/PER/CTRLA can be written
+    while(RTC.STATUS);
+    
+    // Free running over the full 16-bit range
+    RTC.PER = 0xFFFF;
+    RTC.CNT = 0;
+    while(RTC.STATUS);
+    
+    // Counter keeps running in STANDBY
+    RTC.CTRLA = RTC_PRESCALER_DIV1_gc | RTC_RUNSTDBY_bm | RTC_RTCEN_bm;
+}
+
+uint16_t rtc_get_ticks(void) {
+    uint16_t ticks;
+    
+    // 16-bit read through the RTC TEMP register, which an interrupted
+    // CNT/CMP access in main would share (also called from the SPI ISR)
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        ticks = RTC.CNT;
+    }
+    
+    return ticks;
+}
+
+// Arm the one-shot compare 'ticks' from now
+static void rtc_compare_start(uint16_t ticks) {
+    // Start the free running counter on first use
+    if(!(RTC.CTRLA & RTC_RTCEN_bm)) {
+        rtc_counter_init();
+    }
+    
+    // Compare relative to now, 16-bit wrap matches PER = 0xFFFF
+    // (CNT read and CMP write both go through TEMP, an ISR reading CNT
+    // in between would corrupt either)
+    while(RTC.STATUS & RTC_CMPBUSY_bm);
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        RTC.CMP = RTC.CNT + ticks;
+    }
+    while(RTC.STATUS & RTC_CMPBUSY_bm);
+    
+    delay_done_flag = 0;
+    RTC.INTFLAGS = RTC_CMP_bm;
+    RTC.INTCTRL = RTC_CMP_bm;
+    
+    // Counter stops in POWERDOWN, the compare would never fire
+    power_vote(POWER_VOTER_RTC, SLEEP_LEVEL_STANDBY);
+}
+
+void rtc_timeout_start(uint16_t ticks) {
+    timeout_event = 1;
+    rtc_compare_start(ticks);
+}
+
+uint8_t get_rtc_timeout_status(void) {
+    return delay_done_flag;
+}
+
+void rtc_timeout_cancel(void) {
+    // Counter keeps running for timestamps, only the compare is disarmed
+    RTC.INTCTRL = 0;
+    timeout_event = 0;
+    power_vote(POWER_VOTER_RTC, SLEEP_LEVEL_POWERDOWN);
+}
+
+// One compare period of up to RTC_MAX_DELAY_TICKS
+static void delay_sleep_period(uint16_t ticks, sleep_level_t sleep_level) {
+    timeout_event = 0;
+    rtc_compare_start(ticks);
+    
+    // Caller asked for a shallower level than the RTC needs
+    if(sleep_level < SLEEP_LEVEL_STANDBY) {
+        power_vote(POWER_VOTER_RTC, sleep_level);
+    }
+    
+    // Sleep until compare match (other interrupts just loop back to sleep)
+    cli();
+    while(!delay_done_flag) {
+        power_idle();
+        cli();
+    }
+    sei();
+    
+    rtc_timeout_cancel();
+}
+
+void delay_sleep_ticks(uint32_t ticks, sleep_level_t sleep_level) {
+    while(ticks > RTC_MAX_DELAY_TICKS) {
+        delay_sleep_period((uint16_t)RTC_MAX_DELAY_TICKS, sleep_level);
+        ticks -= RTC_MAX_DELAY_TICKS;
+    }
+    
+    if(ticks > 0) {
+        delay_sleep_period((uint16_t)ticks, sleep_level);
+    }
+}
+
+void delay_sleep_us(uint16_t time_us, sleep_level_t sleep_level) {
+    // ticks = us * 32768 / 1000000 = us * 512 / 15625, rounded up
+    uint32_t ticks = ((uint32_t)time_us * 512UL + 15624UL) / 15625UL;
+    
+    delay_sleep_ticks(ticks, sleep_level);
+}
+
+void delay_sleep_ms(uint16_t time_ms, sleep_level_t sleep_level) {
+    // ticks = ms * 32768 / 1000 = ms * 4096 / 125, rounded up
+    uint32_t ticks = ((uint32_t)time_ms * 4096UL + 124UL) / 125UL;
+    
+    delay_sleep_ticks(ticks, sleep_level);
+}
+
+ISR(RTC_PIT_vect) {
+    // Clear interrupt flag
+    RTC.PITINTFLAGS = RTC_PI_bm;
+    
+    pit_tick_flag = 1;
+    if(pit_tick_count != 0xFF) {
+        pit_tick_count++;
+    }
+    sched_post(EVENT_PIT_TICK);
+}
+
+ISR(RTC_CNT_vect) {
+    // Clear interrupt flag
+    RTC.INTFLAGS = RTC_CMP_bm;
+    
+    delay_done_flag = 1;
+    power_vote(POWER_VOTER_RTC, SLEEP_LEVEL_POWERDOWN);
+    
+    if(timeout_event) {
+        sched_post(EVENT_RTC_TIMEOUT);
+    }
+}
@@ -0,0 +1,98 @@
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <util/atomic.h>
+#include <stdint.h>
+#include "scheduler.h"
+#include "main_clock_control.h"
+#include "sleep.h"
+#include "trace.h"
+
+#define SCHED_QUEUE_MASK (SCHED_QUEUE_SIZE - 1)
+
+#if (SCHED_QUEUE_SIZE & SCHED_QUEUE_MASK) != 0
+#error "SCHED_QUEUE_SIZE must be a power of 2"
+#endif
+
+// Event ring (written by ISRs and main, read by the dispatch loop)
+static volatile sched_event_t queue[SCHED_QUEUE_SIZE];
+static volatile uint8_t queue_head = 0;
+static volatile uint8_t queue_tail = 0;
+
+// Events dropped because the queue was full
+static volatile uint8_t queue_overflows = 0;
+
+static sched_poll_t poll_hook = 0;
+
+void sched_post(sched_event_t event) {
+    // ISRs run with interrupts off, this only matters for main loop posts
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        uint8_t next = (queue_head + 1) & SCHED_QUEUE_MASK;
+        
+        if(next == queue_tail) {
+            // Keep the older events, they are handled first anyway
+            if(queue_overflows != 0xFF) {
+                queue_overflows++;
+            }
+        } else {
+            queue[queue_head] = event;
+            queue_head = next;
+        }
+    }
+}
+
+uint8_t sched_get_overflow_count(void) {
+    return queue_overflows;
+}
+
+void sched_set_poll(sched_poll_t poll) {
+    poll_hook = poll;
+}
+
+// Enter a state, and every state its entry handler moves on to
+static uint8_t sched_enter(const sched_state_t *states, uint8_t state) {
+    while(1) {
+        // Start this state's clock switch (no-op if already selected)
+        clock_request(states[state].clock);
+        power_vote(POWER_VOTER_APP, states[state].sleep_level);
+        
+        // Log state changes (compiled out unless TRACE_ENABLE)
+        TRACE_STATE(state);
+        
+        uint8_t next = states[state].handler(EVENT_ENTER);
+        if(next == state) {
+            return state;
+        }
+        
+        state = next;
+    }
+}
+
+void sched_run(const sched_state_t *states, uint8_t state) {
+    state = sched_enter(states, state);
+    
+    while(1) {
+        cli();
+        
+        // Flags checked with interrupts off: one set after this point
+        // comes from an ISR that also ends the sleep below
+        if(poll_hook) {
+            poll_hook();
+        }
+        
+        if(queue_head == queue_tail) {
+            // Nothing to do: sleep as deep as the state and drivers allow
+            power_idle();
+            continue;
+        }
+        
+        sched_event_t event = queue[queue_tail];
+        queue_tail = (queue_tail + 1) & SCHED_QUEUE_MASK;
+        sei();
+        
+        // Run to completion, entry handlers may chain further states
+        uint8_t next = states[state].handler(event);
+        if(next != state) {
+            state = sched_enter(states, next);
+        }
+    }
+}
@@ -0,0 +1,14 @@
+#ifndef SIM_AVR_INTERRUPT_H
+#define SIM_AVR_INTERRUPT_H
+
+// Simulated <avr/interrupt.h>: the global interrupt flag lives in the
+// simulator, which calls the vector functions defined with ISR()
+
+#include "../sim_cpu.h"
+
+#define sei() sim_sei()
+#define cli() sim_cli()
+
+#define ISR(vector, ...) void vector(void); void vector(void)
+
+#endif // SIM_AVR_INTERRUPT_H
@@ -0,0 +1,616 @@
+#ifndef SIM_AVR_IO_H
+#define SIM_AVR_IO_H
+
+// Simulated <avr/io.h> for the host build: the AVR DD peripherals used by
+// the firmware, with the register and bit names of ioavr64dd32.h. Every
+// register block lives in sim_io, one instance per simulated device. The
+// simulator sees each firmware access to it (see sim_core.c).
+
+#include <stdint.h>
+
+#define EEPROM_SIZE 256
+
+typedef volatile uint8_t register8_t;
+typedef volatile uint16_t register16_t;
+
+// ========================================
+// PORT
+// ========================================
+typedef struct {
+    register8_t DIR;
+    register8_t DIRSET;
+    register8_t DIRCLR;
+    register8_t DIRTGL;
+    register8_t OUT;
+    register8_t OUTSET;
+    register8_t OUTCLR;
+    register8_t OUTTGL;
+    register8_t IN;
+    register8_t INTFLAGS;
+    register8_t PORTCTRL;
+    register8_t PINCONFIG;
+    register8_t PINCTRLUPD;
+    register8_t PINCTRLSET;
+    register8_t PINCTRLCLR;
+    register8_t reserved_0x0F;
+    register8_t PIN0CTRL;
+    register8_t PIN1CTRL;
+    register8_t PIN2CTRL;
+    register8_t PIN3CTRL;
+    register8_t PIN4CTRL;
+    register8_t PIN5CTRL;
+    register8_t PIN6CTRL;
+    register8_t PIN7CTRL;
+} PORT_t;
+
+#define PIN0_bm 0x01
+#define PIN1_bm 0x02
+#define PIN2_bm 0x04
+#define PIN3_bm 0x08
+#define PIN4_bm 0x10
+#define PIN5_bm 0x20
+#define PIN6_bm 0x40
+#define PIN7_bm 0x80
+#define PIN0_bp 0
+#define PIN1_bp 1
+#define PIN2_bp 2
+#define PIN3_bp 3
+#define PIN4_bp 4
+#define PIN5_bp 5
+#define PIN6_bp 6
+#define PIN7_bp 7
+
+#define PORT_INVEN_bm              0x80
+#define PORT_PULLUPEN_bm           0x08
+#define PORT_ISC_gm                0x07
+#define PORT_ISC_INTDISABLE_gc     0x00
+#define PORT_ISC_BOTHEDGES_gc      0x01
+#define PORT_ISC_RISING_gc         0x02
+#define PORT_ISC_FALLING_gc        0x03
+#define PORT_ISC_INPUT_DISABLE_gc  0x04
+#define PORT_ISC_LEVEL_gc          0x05
+
+// ========================================
+// SPI
+// ========================================
+typedef struct {
+    register8_t CTRLA;
+    register8_t CTRLB;
+    register8_t INTCTRL;
+    register8_t INTFLAGS;
+    register8_t DATA;
+} SPI_t;
+
+#define SPI_DORD_bm         0x40
+#define SPI_MASTER_bm       0x20
+#define SPI_CLK2X_bm        0x10
+#define SPI_PRESC_gm        0x06
+#define SPI_PRESC_DIV4_gc   0x00
+#define SPI_PRESC_DIV16_gc  0x02
+#define SPI_PRESC_DIV64_gc  0x04
+#define SPI_PRESC_DIV128_gc 0x06
+#define SPI_ENABLE_bm       0x01
+
+#define SPI_BUFEN_bm        0x80
+#define SPI_BUFWR_bm        0x40
+#define SPI_SSD_bm          0x04
+#define SPI_MODE_gm         0x03
+#define SPI_MODE_0_gc       0x00
+#define SPI_MODE_1_gc       0x01
+#define SPI_MODE_2_gc       0x02
+#define SPI_MODE_3_gc       0x03
+
+#define SPI_RXCIE_bm        0x80
+#define SPI_TXCIE_bm        0x40
+#define SPI_DREIE_bm        0x20
+#define SPI_SSIE_bm         0x10
+#define SPI_IE_bm           0x01
+
+#define SPI_RXCIF_bm        0x80
+#define SPI_IF_bm           0x80
+#define SPI_TXCIF_bm        0x40
+#define SPI_WRCOL_bm        0x40
+#define SPI_DREIF_bm        0x20
+#define SPI_SSIF_bm         0x10
+#define SPI_BUFOVF_bm       0x01
+
+// ========================================
+// USART
+// ========================================
+typedef struct {
+    register8_t RXDATAL;
+    register8_t RXDATAH;
+    register8_t TXDATAL;
+    register8_t TXDATAH;
+    register8_t STATUS;
+    register8_t CTRLA;
+    register8_t CTRLB;
+    register8_t CTRLC;
+    register16_t BAUD;
+    register8_t CTRLD;
+    register8_t DBGCTRL;
+    register8_t EVCTRL;
+    register8_t TXPLCTRL;
+    register8_t RXPLCTRL;
+} USART_t;
+
+#define USART_RXCIF_bm   0x80
+#define USART_TXCIF_bm   0x40
+#define USART_DREIF_bm   0x20
+#define USART_RXSIF_bm   0x10
+#define USART_ISFIF_bm   0x08
+#define USART_BDF_bm     0x02
+#define USART_WFB_bm     0x01
+
+#define USART_RXCIE_bm   0x80
+#define USART_TXCIE_bm   0x40
+#define USART_DREIE_bm   0x20
+#define USART_RXSIE_bm   0x10
+#define USART_LBME_bm    0x08
+
+#define USART_RXEN_bm    0x80
+#define USART_TXEN_bm    0x40
+#define USART_SFDEN_bm   0x10
+#define USART_ODME_bm    0x08
+
+#define USART_CMODE_gp   6
+#define USART_CMODE_gm   0xC0
+#define USART_PMODE_gp   4
+#define USART_PMODE_gm   0x30
+#define USART_SBMODE_bp  3
+#define USART_SBMODE_bm  0x08
+#define USART_CHSIZE_gp  0
+#define USART_CHSIZE_gm  0x07
+
+// ========================================
+// ADC
+// ========================================
+typedef struct {
+    register8_t CTRLA;
+    register8_t CTRLB;
+    register8_t CTRLC;
+    register8_t CTRLD;
+    register8_t CTRLE;
+    register8_t SAMPCTRL;
+    register8_t reserved_0x06;
+    register8_t reserved_0x07;
+    register8_t MUXPOS;
+    register8_t MUXNEG;
+    register8_t COMMAND;
+    register8_t EVCTRL;
+    register8_t INTCTRL;
+    register8_t INTFLAGS;
+    register8_t DBGCTRL;
+    register8_t TEMP;
+    register16_t RES;
+    register16_t WINLT;
+    register16_t WINHT;
+} ADC_t;
+
+#define ADC_RUNSTBY_bm    0x80
+#define ADC_CONVMODE_bm   0x20
+#define ADC_LEFTADJ_bm    0x10
+#define ADC_RESSEL_gm     0x0C
+#define ADC_FREERUN_bm    0x02
+#define ADC_ENABLE_bm     0x01
+
+#define ADC_SAMPNUM_gp    0
+#define ADC_SAMPNUM_gm    0x07
+#define ADC_SAMPNUM_NONE_gc   0x00
+#define ADC_SAMPNUM_ACC2_gc   0x01
+#define ADC_SAMPNUM_ACC4_gc   0x02
+#define ADC_SAMPNUM_ACC8_gc   0x03
+#define ADC_SAMPNUM_ACC16_gc  0x04
+#define ADC_SAMPNUM_ACC32_gc  0x05
+#define ADC_SAMPNUM_ACC64_gc  0x06
+#define ADC_SAMPNUM_ACC128_gc 0x07
+
+#define ADC_PRESC_gp      0
+#define ADC_PRESC_gm      0x0F
+#define ADC_PRESC_DIV2_gc   0x00
+#define ADC_PRESC_DIV4_gc   0x01
+#define ADC_PRESC_DIV8_gc   0x02
+#define ADC_PRESC_DIV12_gc  0x03
+#define ADC_PRESC_DIV16_gc  0x04
+#define ADC_PRESC_DIV20_gc  0x05
+#define ADC_PRESC_DIV24_gc  0x06
+#define ADC_PRESC_DIV28_gc  0x07
+#define ADC_PRESC_DIV32_gc  0x08
+#define ADC_PRESC_DIV48_gc  0x09
+#define ADC_PRESC_DIV64_gc  0x0A
+#define ADC_PRESC_DIV96_gc  0x0B
+#define ADC_PRESC_DIV128_gc 0x0C
+#define ADC_PRESC_DIV256_gc 0x0D
+
+#define ADC_INITDLY_gp    5
+#define ADC_INITDLY_gm    0xE0
+#define ADC_INITDLY_DLY0_gc   (0x00 << 5)
+#define ADC_INITDLY_DLY16_gc  (0x01 << 5)
+#define ADC_INITDLY_DLY32_gc  (0x02 << 5)
+#define ADC_INITDLY_DLY64_gc  (0x03 << 5)
+#define ADC_INITDLY_DLY128_gc (0x04 << 5)
+#define ADC_INITDLY_DLY256_gc (0x05 << 5)
+#define ADC_SAMPDLY_gp    0
+#define ADC_SAMPDLY_gm    0x0F
+
+#define ADC_WINCM_gp      0
+#define ADC_WINCM_gm      0x07
+#define ADC_WINCM_NONE_gc     0x00
+#define ADC_WINCM_BELOW_gc    0x01
+#define ADC_WINCM_ABOVE_gc    0x02
+#define ADC_WINCM_INSIDE_gc   0x03
+#define ADC_WINCM_OUTSIDE_gc  0x04
+
+#define ADC_MUXPOS_AIN0_gc   0x00
+#define ADC_MUXPOS_AIN8_gc   0x08
+#define ADC_MUXPOS_GND_gc    0x40
+#define ADC_MUXNEG_AIN0_gc   0x00
+#define ADC_MUXNEG_GND_gc    0x40
+
+#define ADC_SPCONV_bm     0x02
+#define ADC_STCONV_bm     0x01
+#define ADC_STARTEI_bm    0x01
+#define ADC_WCMP_bm       0x02
+#define ADC_RESRDY_bm     0x01
+
+// ========================================
+// VREF
+// ========================================
+typedef struct {
+    register8_t ADC0REF;
+    register8_t reserved_0x01;
+    register8_t DAC0REF;
+    register8_t reserved_0x03;
+    register8_t ACREF;
+} VREF_t;
+
+#define VREF_ALWAYSON_bm      0x80
+#define VREF_REFSEL_gp        0
+#define VREF_REFSEL_gm        0x07
+#define VREF_REFSEL_1V024_gc  0x00
+#define VREF_REFSEL_2V048_gc  0x01
+#define VREF_REFSEL_4V096_gc  0x02
+#define VREF_REFSEL_2V500_gc  0x03
+#define VREF_REFSEL_VDD_gc    0x05
+#define VREF_REFSEL_VREFA_gc  0x06
+
+// ========================================
+// CLKCTRL
+// ========================================
+typedef struct {
+    register8_t MCLKCTRLA;
+    register8_t MCLKCTRLB;
+    register8_t MCLKCTRLC;
+    register8_t MCLKINTCTRL;
+    register8_t MCLKINTFLAGS;
+    register8_t MCLKSTATUS;
+    register8_t MCLKTIMEBASE;
+    register8_t reserved_0x07;
+    register8_t OSCHFCTRLA;
+    register8_t OSCHFTUNE;
+    register8_t reserved_0x0A;
+    register8_t reserved_0x0B;
+    register8_t OSC32KCTRLA;
+    register8_t XOSC32KCTRLA;
+    register8_t XOSCHFCTRLA;
+} CLKCTRL_t;
+
+#define CLKCTRL_CLKOUT_bm        0x80
+#define CLKCTRL_CLKSEL_gm        0x0F
+#define CLKCTRL_CLKSEL_OSCHF_gc  0x00
+#define CLKCTRL_CLKSEL_OSC32K_gc 0x01
+#define CLKCTRL_CLKSEL_XOSC32K_gc 0x02
+#define CLKCTRL_CLKSEL_EXTCLK_gc 0x03
+#define CLKCTRL_PDIV_gm          0x1E
+#define CLKCTRL_PEN_bm           0x01
+#define CLKCTRL_EXTS_bm          0x10
+#define CLKCTRL_XOSC32KS_bm      0x08
+#define CLKCTRL_OSC32KS_bm       0x04
+#define CLKCTRL_OSCHFS_bm        0x02
+#define CLKCTRL_SOSC_bm          0x01
+#define CLKCTRL_RUNSTDBY_bm      0x80
+#define CLKCTRL_FRQSEL_gm        0x3C
+#define CLKCTRL_FRQSEL_1M_gc     (0x00 << 2)
+#define CLKCTRL_FRQSEL_2M_gc     (0x01 << 2)
+#define CLKCTRL_FRQSEL_3M_gc     (0x02 << 2)
+#define CLKCTRL_FRQSEL_4M_gc     (0x03 << 2)
+#define CLKCTRL_FRQSEL_8M_gc     (0x05 << 2)
+#define CLKCTRL_FRQSEL_12M_gc    (0x06 << 2)
+#define CLKCTRL_FRQSEL_16M_gc    (0x07 << 2)
+#define CLKCTRL_FRQSEL_20M_gc    (0x08 << 2)
+#define CLKCTRL_FRQSEL_24M_gc    (0x09 << 2)
+#define CLKCTRL_AUTOTUNE_bm      0x01
+
+// ========================================
+// SLPCTRL
+// ========================================
+typedef struct {
+    register8_t CTRLA;
+    register8_t VREGCTRL;
+} SLPCTRL_t;
+
+#define SLPCTRL_SMODE_gm        0x06
+#define SLPCTRL_SMODE_IDLE_gc   0x00
+#define SLPCTRL_SMODE_STDBY_gc  0x02
+#define SLPCTRL_SMODE_PDOWN_gc  0x04
+#define SLPCTRL_SEN_bm          0x01
+
+// ========================================
+// RTC
+// ========================================
+typedef struct {
+    register8_t CTRLA;
+    register8_t STATUS;
+    register8_t INTCTRL;
+    register8_t INTFLAGS;
+    register8_t TEMP;
+    register8_t DBGCTRL;
+    register8_t CALIB;
+    register8_t CLKSEL;
+    register16_t CNT;
+    register16_t PER;
+    register16_t CMP;
+    register8_t reserved_0x0E;
+    register8_t reserved_0x0F;
+    register8_t PITCTRLA;
+    register8_t PITSTATUS;
+    register8_t PITINTCTRL;
+    register8_t PITINTFLAGS;
+    register8_t reserved_0x14;
+    register8_t PITDBGCTRL;
+} RTC_t;
+
+#define RTC_RUNSTDBY_bm        0x80
+#define RTC_PRESCALER_gm       0x78
+#define RTC_PRESCALER_DIV1_gc  (0x00 << 3)
+#define RTC_CORREN_bm          0x04
+#define RTC_RTCEN_bm           0x01
+#define RTC_CMPBUSY_bm         0x08
+#define RTC_PERBUSY_bm         0x04
+#define RTC_CNTBUSY_bm         0x02
+#define RTC_CTRLABUSY_bm       0x01
+#define RTC_CMP_bm             0x02
+#define RTC_OVF_bm             0x01
+#define RTC_CLKSEL_gm          0x03
+#define RTC_CLKSEL_OSC32K_gc   0x00
+#define RTC_CLKSEL_OSC1K_gc    0x01
+#define RTC_CLKSEL_XOSC32K_gc  0x02
+#define RTC_CLKSEL_EXTCLK_gc   0x03
+
+#define RTC_PERIOD_gm          0x78
+#define RTC_PERIOD_OFF_gc      (0x00 << 3)
+#define RTC_PERIOD_CYC4_gc     (0x01 << 3)
+#define RTC_PERIOD_CYC8_gc     (0x02 << 3)
+#define RTC_PERIOD_CYC16_gc    (0x03 << 3)
+#define RTC_PERIOD_CYC32_gc    (0x04 << 3)
+#define RTC_PERIOD_CYC64_gc    (0x05 << 3)
+#define RTC_PERIOD_CYC128_gc   (0x06 << 3)
+#define RTC_PERIOD_CYC256_gc   (0x07 << 3)
+#define RTC_PERIOD_CYC512_gc   (0x08 << 3)
+#define RTC_PERIOD_CYC1024_gc  (0x09 << 3)
+#define RTC_PERIOD_CYC2048_gc  (0x0A << 3)
+#define RTC_PERIOD_CYC4096_gc  (0x0B << 3)
+#define RTC_PERIOD_CYC8192_gc  (0x0C << 3)
+#define RTC_PERIOD_CYC16384_gc (0x0D << 3)
+#define RTC_PERIOD_CYC32768_gc (0x0E << 3)
+#define RTC_PITEN_bm           0x01
+#define RTC_CTRLBUSY_bm        0x01
+#define RTC_PI_bm              0x01
+
+// ========================================
+// EVSYS
+// ========================================
+typedef struct {
+    register8_t SWEVENTA;
+    register8_t reserved_0x01[15];
+    register8_t CHANNEL0;
+    register8_t CHANNEL1;
+    register8_t CHANNEL2;
+    register8_t CHANNEL3;
+    register8_t CHANNEL4;
+    register8_t CHANNEL5;
+    register8_t reserved_0x16[10];
+    register8_t USERCCLLUT0A;
+    register8_t USERCCLLUT0B;
+    register8_t USERCCLLUT1A;
+    register8_t USERCCLLUT1B;
+    register8_t USERCCLLUT2A;
+    register8_t USERCCLLUT2B;
+    register8_t USERCCLLUT3A;
+    register8_t USERCCLLUT3B;
+    register8_t USERADC0START;
+    register8_t USEREVSYSEVOUTA;
+    register8_t USEREVSYSEVOUTC;
+    register8_t USEREVSYSEVOUTD;
+    register8_t USEREVSYSEVOUTF;
+    register8_t USERUSART0IRDA;
+    register8_t USERUSART1IRDA;
+    register8_t USERTCA0CNTA;
+    register8_t USERTCA0CNTB;
+    register8_t USERTCB0CAPT;
+    register8_t USERTCB0COUNT;
+    register8_t USERTCB1CAPT;
+    register8_t USERTCB1COUNT;
+} EVSYS_t;
+
+// Generators (channel n), same code on every channel unless noted
+#define EVSYS_CHANNEL_OFF_gc                0x00
+#define EVSYS_CHANNEL_RTC_OVF_gc            0x06
+#define EVSYS_CHANNEL_RTC_CMP_gc            0x07
+#define EVSYS_CHANNEL_TCB0_CAPT_gc          0xA0
+#define EVSYS_CHANNEL_TCB0_OVF_gc           0xA1
+
+// RTC PIT prescaler taps: DIV8192..DIV1024 on even, DIV512..DIV64 on odd channels
+#define EVSYS_CHANNEL0_RTC_PIT_DIV8192_gc   0x08
+#define EVSYS_CHANNEL0_RTC_PIT_DIV4096_gc   0x09
+#define EVSYS_CHANNEL0_RTC_PIT_DIV2048_gc   0x0A
+#define EVSYS_CHANNEL0_RTC_PIT_DIV1024_gc   0x0B
+#define EVSYS_CHANNEL1_RTC_PIT_DIV512_gc    0x08
+#define EVSYS_CHANNEL1_RTC_PIT_DIV256_gc    0x09
+#define EVSYS_CHANNEL1_RTC_PIT_DIV128_gc    0x0A
+#define EVSYS_CHANNEL1_RTC_PIT_DIV64_gc     0x0B
+#define EVSYS_CHANNEL2_RTC_PIT_DIV8192_gc   0x08
+#define EVSYS_CHANNEL2_RTC_PIT_DIV4096_gc   0x09
+#define EVSYS_CHANNEL2_RTC_PIT_DIV2048_gc   0x0A
+#define EVSYS_CHANNEL2_RTC_PIT_DIV1024_gc   0x0B
+#define EVSYS_CHANNEL3_RTC_PIT_DIV512_gc    0x08
+#define EVSYS_CHANNEL3_RTC_PIT_DIV256_gc    0x09
+#define EVSYS_CHANNEL3_RTC_PIT_DIV128_gc    0x0A
+#define EVSYS_CHANNEL3_RTC_PIT_DIV64_gc     0x0B
+#define EVSYS_CHANNEL4_RTC_PIT_DIV8192_gc   0x08
+#define EVSYS_CHANNEL4_RTC_PIT_DIV4096_gc   0x09
+#define EVSYS_CHANNEL4_RTC_PIT_DIV2048_gc   0x0A
+#define EVSYS_CHANNEL4_RTC_PIT_DIV1024_gc   0x0B
+#define EVSYS_CHANNEL5_RTC_PIT_DIV512_gc    0x08
+#define EVSYS_CHANNEL5_RTC_PIT_DIV256_gc    0x09
+#define EVSYS_CHANNEL5_RTC_PIT_DIV128_gc    0x0A
+#define EVSYS_CHANNEL5_RTC_PIT_DIV64_gc     0x0B
+
+// Port pins: PORTA/PORTC/PORTE on 0x40 + pin, PORTD/PORTF on 0x48 + pin
+#define EVSYS_CHANNEL0_PORTA_PIN7_gc        0x47
+#define EVSYS_CHANNEL2_PORTC_PIN3_gc        0x43
+#define EVSYS_CHANNEL2_PORTD_PIN4_gc        0x4C
+#define EVSYS_CHANNEL4_PORTF_PIN6_gc        0x4E
+#define EVSYS_CHANNEL5_PORTF_PIN6_gc        0x4E
+
+#define EVSYS_USER_OFF_gc                   0x00
+#define EVSYS_USER_CHANNEL0_gc              0x01
+
+// ========================================
+// TCB
+// ========================================
+typedef struct {
+    register8_t CTRLA;
+    register8_t CTRLB;
+    register8_t reserved_0x02;
+    register8_t reserved_0x03;
+    register8_t EVCTRL;
+    register8_t INTCTRL;
+    register8_t INTFLAGS;
+    register8_t STATUS;
+    register8_t DBGCTRL;
+    register8_t TEMP;
+    register16_t CNT;
+    register16_t CCMP;
+} TCB_t;
+
+#define TCB_RUNSTDBY_bm        0x40
+#define TCB_CASCADE_bm         0x20
+#define TCB_SYNCUPD_bm         0x10
+#define TCB_CLKSEL_gm          0x0E
+#define TCB_CLKSEL_DIV1_gc     (0x00 << 1)
+#define TCB_CLKSEL_DIV2_gc     (0x01 << 1)
+#define TCB_CLKSEL_TCA0_gc     (0x02 << 1)
+#define TCB_CLKSEL_EVENT_gc    (0x07 << 1)
+#define TCB_ENABLE_bm          0x01
+#define TCB_CNTMODE_gm         0x07
+#define TCB_CNTMODE_INT_gc     0x00
+#define TCB_CAPTEI_bm          0x01
+#define TCB_OVF_bm             0x02
+#define TCB_CAPT_bm            0x01
+#define TCB_RUN_bm             0x01
+
+// ========================================
+// NVMCTRL
+// ========================================
+typedef struct {
+    register8_t CTRLA;
+    register8_t CTRLB;
+    register8_t CTRLC;
+    register8_t reserved_0x03;
+    register8_t INTCTRL;
+    register8_t INTFLAGS;
+    register8_t STATUS;
+    register8_t reserved_0x07;
+    register16_t DATA;
+    register8_t reserved_0x0A;
+    register8_t reserved_0x0B;
+    register16_t ADDR;
+} NVMCTRL_t;
+
+#define NVMCTRL_CMD_gm            0x7F
+#define NVMCTRL_CMD_NOCMD_gc      0x00
+#define NVMCTRL_CMD_NOOP_gc       0x01
+#define NVMCTRL_CMD_EEWR_gc       0x12
+#define NVMCTRL_CMD_EEERWR_gc     0x13
+#define NVMCTRL_CMD_EEBER_gc      0x18
+#define NVMCTRL_CMD_EEMBER2_gc    0x19
+#define NVMCTRL_CMD_EEMBER4_gc    0x1A
+#define NVMCTRL_CMD_EEMBER8_gc    0x1B
+#define NVMCTRL_CMD_EEMBER16_gc   0x1C
+#define NVMCTRL_CMD_EEMBER32_gc   0x1D
+#define NVMCTRL_EEREADY_bm        0x01
+#define NVMCTRL_EEBUSY_bm         0x02
+#define NVMCTRL_FBUSY_bm          0x01
+
+// ========================================
+// CPU
+// ========================================
+#define CCP_SPM_gc   0x9D
+#define CCP_IOREG_gc 0xD8
+
+// ========================================
+// One simulated device
+// ========================================
+typedef struct {
+    PORT_t porta;
+    PORT_t portc;
+    PORT_t portd;
+    PORT_t portf;
+    SPI_t spi0;
+    USART_t usart0;
+    ADC_t adc0;
+    VREF_t vref;
+    CLKCTRL_t clkctrl;
+    SLPCTRL_t slpctrl;
+    RTC_t rtc;
+    EVSYS_t evsys;
+    TCB_t tcb0;
+    NVMCTRL_t nvmctrl;
+    register8_t ccp;
+    register8_t eeprom[EEPROM_SIZE];
+} sim_io_t;
+
+// Defined once per firmware image (sim_board.c)
+extern sim_io_t sim_io;
+
+#define PORTA   (sim_io.porta)
+#define PORTC   (sim_io.portc)
+#define PORTD   (sim_io.portd)
+#define PORTF   (sim_io.portf)
+#define SPI0    (sim_io.spi0)
+#define USART0  (sim_io.usart0)
+#define ADC0    (sim_io.adc0)
+#define VREF    (sim_io.vref)
+#define CLKCTRL (sim_io.clkctrl)
+#define SLPCTRL (sim_io.slpctrl)
+#define RTC     (sim_io.rtc)
+#define EVSYS   (sim_io.evsys)
+#define TCB0    (sim_io.tcb0)
+#define NVMCTRL (sim_io.nvmctrl)
+#define CCP     (sim_io.ccp)
+
+// EEPROM is mapped into the data space
+#define EEPROM_START ((uintptr_t)sim_io.eeprom)
+#define EEPROM_END   (EEPROM_START + EEPROM_SIZE - 1)
+
+// ========================================
+// Interrupt vectors (ISR() defines a function of this name)
+// ========================================
+#define NVMCTRL_EE_vect      sim_vect_NVMCTRL_EE
+#define NVMCTRL_EEREADY_vect sim_vect_NVMCTRL_EE
+#define PORTA_PORT_vect      sim_vect_PORTA_PORT
+#define RTC_CNT_vect         sim_vect_RTC_CNT
+#define RTC_PIT_vect         sim_vect_RTC_PIT
+#define PORTC_PORT_vect      sim_vect_PORTC_PORT
+#define TCB0_INT_vect        sim_vect_TCB0_INT
+#define PORTD_PORT_vect      sim_vect_PORTD_PORT
+#define ADC0_RESRDY_vect     sim_vect_ADC0_RESRDY
+#define ADC0_WCMP_vect       sim_vect_ADC0_WCMP
+#define USART0_RXC_vect      sim_vect_USART0_RXC
+#define USART0_DRE_vect      sim_vect_USART0_DRE
+#define USART0_TXC_vect      sim_vect_USART0_TXC
+#define PORTF_PORT_vect      sim_vect_PORTF_PORT
+#define SPI0_INT_vect        sim_vect_SPI0_INT
+
+#endif // SIM_AVR_IO_H
@@ -0,0 +1,12 @@
+#ifndef SIM_AVR_PGMSPACE_H
+#define SIM_AVR_PGMSPACE_H
+
+// Simulated <avr/pgmspace.h>: one address space on the host
+
+#include <stdint.h>
+
+#define PROGMEM
+#define pgm_read_byte(addr) (*(const uint8_t *)(addr))
+#define pgm_read_word(addr) (*(const uint16_t *)(addr))
+
+#endif // SIM_AVR_PGMSPACE_H
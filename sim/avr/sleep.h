@@ -0,0 +1,17 @@
+#ifndef SIM_AVR_SLEEP_H
+#define SIM_AVR_SLEEP_H
+
+// Simulated <avr/sleep.h>: SLEEP hands the core to the simulator until
+// an enabled interrupt wakes it
+
+#include <avr/io.h>
+#include "../sim_cpu.h"
+
+#define sleep_cpu() sim_sleep_cpu()
+
+#define set_sleep_mode(mode) \
+    do { SLPCTRL.CTRLA = (SLPCTRL.CTRLA & ~SLPCTRL_SMODE_gm) | (mode); } while(0)
+#define sleep_enable()  do { SLPCTRL.CTRLA |= SLPCTRL_SEN_bm; } while(0)
+#define sleep_disable() do { SLPCTRL.CTRLA &= ~SLPCTRL_SEN_bm; } while(0)
+
+#endif // SIM_AVR_SLEEP_H
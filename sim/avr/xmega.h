@@ -0,0 +1,11 @@
+#ifndef SIM_AVR_XMEGA_H
+#define SIM_AVR_XMEGA_H
+
+// Simulated <avr/xmega.h>: the CCP unlock is not modelled, the write is
+
+#include <avr/io.h>
+
+#define _PROTECTED_WRITE(reg, value)     do { (reg) = (value); } while(0)
+#define _PROTECTED_WRITE_SPM(reg, value) do { (reg) = (value); } while(0)
+
+#endif // SIM_AVR_XMEGA_H
@@ -0,0 +1,41 @@
+// Stand-in for the board's adc.c, which is not part of this tree:
+// conversion control and the sensor rails on PC3 (VCC) and PC2 (GND)
+
+#include <avr/io.h>
+#include <stdint.h>
+#include "adc.h"
+
+void adc_enable(void) {
+    ADC0.CTRLA |= ADC_ENABLE_bm;
+}
+
+void adc_disable(void) {
+    ADC0.CTRLA &= ~ADC_ENABLE_bm;
+}
+
+void adc_start_conversion(void) {
+    ADC0.COMMAND = ADC_STCONV_bm;
+}
+
+uint8_t adc_is_conversion_done(void) {
+    return (ADC0.INTFLAGS & ADC_RESRDY_bm) ? 1 : 0;
+}
+
+uint8_t adc_is_window_satisfied(void) {
+    return (ADC0.INTFLAGS & ADC_WCMP_bm) ? 1 : 0;
+}
+
+uint16_t adc_get_result(void) {
+    return ADC0.RES;
+}
+
+void adc_enable_power_rails_before_conversion(void) {
+    PORTC.OUTSET = PIN3_bm;
+    PORTC.OUTCLR = PIN2_bm;
+    PORTC.DIRSET = PIN3_bm | PIN2_bm;
+}
+
+void adc_disable_power_rails_after_conversion(void) {
+    PORTC.OUTCLR = PIN3_bm;
+    PORTC.DIRCLR = PIN3_bm | PIN2_bm;
+}
@@ -0,0 +1,64 @@
+// Stand-in for the board's ports.c, which is not part of this tree:
+// HOST button on PF6, CLIENT select on PA7, as wired in the README
+
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <stdint.h>
+#include "ports.h"
+
+#ifdef HOST_DEVICE
+static volatile uint8_t button_pressed_flag = 0;
+
+void port_init(void) {
+    // Built-in button to GND, falling edge when pressed
+    PORTF.DIRCLR = PIN6_bm;
+    PORTF.PIN6CTRL = PORT_PULLUPEN_bm | PORT_ISC_FALLING_gc;
+}
+
+uint8_t get_button_pressed_status(void) {
+    return button_pressed_flag;
+}
+
+void clear_button_pressed_status(void) {
+    button_pressed_flag = 0;
+}
+
+void turn_off_unused_pins_before_sleep(void) {
+    // Analog input buffer off while the sensor is unpowered
+    PORTF.PIN2CTRL = PORT_ISC_INPUT_DISABLE_gc;
+}
+
+ISR(PORTF_PORT_vect) {
+    if(PORTF.INTFLAGS & PIN6_bm) {
+        button_pressed_flag = 1;
+    }
+
+    PORTF.INTFLAGS = PORTF.INTFLAGS;
+}
+#endif
+
+#ifdef CLIENT_DEVICE
+static volatile uint8_t client_select_flag = 0;
+
+void port_init(void) {
+    // SS from the HOST, both edges (the SPI ISR sees the rising one)
+    PORTA.DIRCLR = PIN7_bm;
+    PORTA.PIN7CTRL = PORT_PULLUPEN_bm | PORT_ISC_BOTHEDGES_gc;
+}
+
+uint8_t get_client_select_flag_status(void) {
+    return client_select_flag;
+}
+
+void clear_client_select_flag(void) {
+    client_select_flag = 0;
+}
+
+ISR(PORTA_PORT_vect) {
+    if((PORTA.INTFLAGS & PIN7_bm) && !(PORTA.IN & PIN7_bm)) {
+        client_select_flag = 1;
+    }
+
+    PORTA.INTFLAGS = PORTA.INTFLAGS;
+}
+#endif
@@ -0,0 +1,119 @@
+// Stand-in for avr-libc's printf(), which is not linked on the host:
+// the same walk over the format string and the same per-digit division,
+// one stream put per character. It is firmware code, so its cycles count
+// like the formatter's do (avr-libc's vfprintf does more per call, this is
+// the lower bound). Only the conversions the firmware used: %c %s %u %d
+// %x %X with '0' padding and a width.
+
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+
+static void put_padded(const char *s, uint8_t len, uint8_t width, char pad) {
+    while(width > len) {
+        sim_fdev_put(pad, stdout);
+        width--;
+    }
+    while(len--) {
+        sim_fdev_put(*s++, stdout);
+    }
+}
+
+int sim_fw_printf(const char *fmt, ...) {
+    va_list ap;
+    char buf[6];
+    int count = 0;
+
+    va_start(ap, fmt);
+    for(; *fmt; fmt++) {
+        if(*fmt != '%') {
+            sim_fdev_put(*fmt, stdout);
+            count++;
+            continue;
+        }
+
+        // Flags and width
+        char pad = ' ';
+        uint8_t width = 0;
+
+        fmt++;
+        if(*fmt == '0') {
+            pad = '0';
+            fmt++;
+        }
+        while(*fmt >= '0' && *fmt <= '9') {
+            width = width * 10 + (*fmt++ - '0');
+        }
+
+        // Numbers are converted into buf from the end
+        uint16_t value;
+        uint8_t base = 10;
+        char hex_a = 'a';
+        uint8_t negative = 0;
+        uint8_t len = 0;
+
+        switch(*fmt) {
+            case 'c':
+                buf[0] = (char)va_arg(ap, int);
+                put_padded(buf, 1, width, ' ');
+                count += (width > 1) ? width : 1;
+                continue;
+
+            case 's': {
+                const char *s = va_arg(ap, const char *);
+
+                while(s[len]) {
+                    len++;
+                }
+                put_padded(s, len, width, ' ');
+                count += (width > len) ? width : len;
+                continue;
+            }
+
+            case 'd': {
+                int v = va_arg(ap, int);
+
+                negative = v < 0;
+                value = negative ? -v : v;
+                break;
+            }
+
+            case 'X':
+                hex_a = 'A';
+                // fall through
+            case 'x':
+                base = 16;
+                // fall through
+            case 'u':
+                value = (uint16_t)va_arg(ap, unsigned int);
+                break;
+
+            case '\0':
+                fmt--;
+                continue;
+
+            default:
+                sim_fdev_put(*fmt, stdout);
+                count++;
+                continue;
+        }
+
+        do {
+            uint8_t digit = value % base;
+
+            buf[sizeof(buf) - 1 - len++] = (digit < 10) ? '0' + digit : hex_a + digit - 10;
+            value /= base;
+        } while(value);
+
+        if(negative) {
+            sim_fdev_put('-', stdout);
+            count++;
+            width = width ? width - 1 : 0;
+        }
+        put_padded(&buf[sizeof(buf) - len], len, width, pad);
+        count += (width > len) ? width : len;
+    }
+    va_end(ap);
+
+    return count;
+}
@@ -0,0 +1,25 @@
+#ifndef SIM_FW_STDIO_H
+#define SIM_FW_STDIO_H
+
+// avr-libc stdio additions for firmware sources. Firmware printf() goes
+// to the stream set up with FDEV_SETUP_STREAM(), formatted by the
+// stand-in in sim/baseline/printf.c, the simulator's own stdout stays
+// untouched.
+
+#include_next <stdio.h>
+
+#define _FDEV_SETUP_WRITE 2
+
+#define FDEV_SETUP_STREAM(put, get, rwflag) {0}; \
+    int (*const sim_fdev_put)(char, FILE *) = (put)
+
+extern int (*const sim_fdev_put)(char, FILE *);
+
+#undef stdout
+#define stdout sim_fw_stdout
+extern FILE *sim_fw_stdout;
+
+#define printf sim_fw_printf
+int sim_fw_printf(const char *fmt, ...);
+
+#endif // SIM_FW_STDIO_H
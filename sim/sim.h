@@ -0,0 +1,275 @@
+#ifndef SIM_H
+#define SIM_H
+
+// Host simulation of AVR DD devices running the unmodified firmware.
+//
+// Firmware sources are compiled for Linux against the mock headers in
+// sim/ (avr/io.h, avr/interrupt.h, ...) with -fsanitize=thread, but not
+// linked with the TSan runtime: the compiler calls a hook before every
+// memory access, and the hooks in sim_core.c advance the device time by
+// SIM_CYCLES_PER_ACCESS CPU cycles, run the peripheral models for
+// register accesses and call the ISRs. Cycle counts are therefore an
+// estimate for comparing firmware variants, not an exact AVR count.
+//
+// A device is a node. A firmware image built as a module is loaded with
+// sim_node_load(), a fresh copy per node (power-on reset, own globals).
+// Firmware linked into the test itself is used with sim_node_attach().
+// Nodes run their main() as coroutines, always the one furthest behind
+// in time, and share one SPI bus plus any pins joined with sim_wire().
+
+#include <stddef.h>
+#include <stdint.h>
+#include <avr/io.h>
+
+// ========================================
+// Time
+// ========================================
+typedef uint64_t sim_time_t;  // 1 unit = 1/512 us (32.768 kHz cycle = 15625)
+
+#define SIM_TIME_HZ 512000000ULL
+#define SIM_NEVER   UINT64_MAX
+#define SIM_US(us)  ((sim_time_t)(us) * 512ULL)
+#define SIM_MS(ms)  ((sim_time_t)(ms) * 512000ULL)
+#define SIM_S(s)    ((sim_time_t)(s) * SIM_TIME_HZ)
+
+#define SIM_RTC_TICK (SIM_TIME_HZ / 32768ULL)  // One OSC32K cycle
+
+// CPU cost model
+#define SIM_CYCLES_PER_ACCESS 2   // Per memory access of the firmware
+#define SIM_ISR_CYCLES        20  // Interrupt entry, RETI, register save
+
+// ========================================
+// Statistics
+// ========================================
+// Clock buckets for active time (CPU running)
+typedef enum {
+    SIM_CLK_32K,
+    SIM_CLK_1M,
+    SIM_CLK_4M,
+    SIM_CLK_OTHER,
+    SIM_CLK_COUNT
+} sim_clk_t;
+
+// Sleep modes, SLPCTRL SMODE / 2
+typedef enum {
+    SIM_SLEEP_IDLE,
+    SIM_SLEEP_STANDBY,
+    SIM_SLEEP_POWERDOWN,
+    SIM_SLEEP_COUNT
+} sim_sleep_t;
+
+// Time and work split, for a node and for each scheduler state
+typedef struct {
+    sim_time_t active[SIM_CLK_COUNT];
+    sim_time_t idle[SIM_CLK_COUNT];    // IDLE sleep, by the clock left running
+    sim_time_t sleep[SIM_SLEEP_COUNT];
+    sim_time_t adc_busy;  // ADC converting
+    uint64_t cycles;      // CPU cycles (estimate)
+    uint32_t entries;     // State entries (per state only)
+} sim_acct_t;
+
+// Interrupt vectors in priority order (lowest vector number first)
+typedef enum {
+    SIM_VECT_RTC_CNT,
+    SIM_VECT_RTC_PIT,
+    SIM_VECT_PORTA,
+    SIM_VECT_TCB0,
+    SIM_VECT_SPI0,
+    SIM_VECT_USART0_RXC,
+    SIM_VECT_USART0_DRE,
+    SIM_VECT_USART0_TXC,
+    SIM_VECT_PORTD,
+    SIM_VECT_ADC0_RESRDY,
+    SIM_VECT_ADC0_WCMP,
+    SIM_VECT_PORTC,
+    SIM_VECT_PORTF,
+    SIM_VECT_NVMCTRL_EE,
+    SIM_VECT_COUNT
+} sim_vect_t;
+
+// Timers of the peripheral models, stalled ones are counted per timer
+typedef enum {
+    SIM_TMR_CLOCK,   // Main clock switch
+    SIM_TMR_SPI,     // SPI host byte
+    SIM_TMR_USART,   // USART frame
+    SIM_TMR_ADC,     // ADC conversion
+    SIM_TMR_RTC,     // RTC compare / overflow
+    SIM_TMR_PIT,     // Periodic interrupt
+    SIM_TMR_PIT_EV,  // PIT prescaler events on EVSYS channels
+    SIM_TMR_NVM,     // EEPROM erase / write
+    SIM_TMR_EXT,     // Pin changes and SPI bytes from outside
+    SIM_TMR_COUNT
+} sim_timer_t;
+
+#define SIM_MAX_STATES 16
+
+typedef struct {
+    sim_acct_t total;
+    sim_acct_t state[SIM_MAX_STATES];  // By the scheduler state ID
+
+    uint32_t wakes;                    // Sleeps that ended
+    uint32_t isr[SIM_VECT_COUNT];      // ISR calls per vector
+    uint32_t stalls[SIM_TMR_COUNT];    // Peripheral work frozen by a deep sleep
+    uint32_t clock_switch_lost;        // MCLKCTRLA written while a switch ran (SOSC set)
+
+    uint32_t spi_bytes;                // Bytes shifted as SPI host
+    uint32_t spi_rx_bytes;             // Bytes received as SPI client
+    uint32_t spi_rx_lost;              // Client bytes missed in STANDBY/POWERDOWN
+    uint32_t spi_overflows;            // RX FIFO full (BUFOVF)
+    uint32_t spi_tx_overwrites;        // DATA written with the TX buffer full
+    uint32_t miso_contention;          // Host bytes with 2+ nodes driving MISO
+    uint32_t miso_driven_unselected;   // Host bytes where this unselected client drove MISO
+
+    uint32_t usart_bytes;              // Frames shifted out
+    uint32_t usart_bad_rate;           // Frames off the expected baud rate by > 2 %
+    uint32_t usart_breaks;             // TX line driven low with the transmitter off
+    uint32_t usart_tx_off_writes;      // TXDATAL written with TXEN clear
+
+    uint32_t adc_conversions;          // Results (accumulated ones count once)
+    uint32_t adc_clock_range;          // Conversions with CLK_ADC outside 125 kHz..2 MHz
+    uint32_t adc_bad_ref;              // Conversions with a reserved REFSEL
+    uint32_t adc_start_lost;           // Start while busy or disabled
+
+    uint32_t port_missed_edges;        // Edges a non-async pin cannot see in deep sleep
+    uint32_t events;                   // Event system pulses routed to a user
+    uint32_t tcb_captures;             // TCB0 CAPT
+    uint32_t tcb_missed;               // TCB0 count events lost in a sleep mode it stops in
+
+    uint32_t nvm_erases;               // Erase operations
+    uint32_t nvm_writes;               // Byte writes
+    uint32_t nvm_errors;               // Write without command / while busy
+    uint16_t eeprom_erases[EEPROM_SIZE];  // Wear per byte
+} sim_stats_t;
+
+// ========================================
+// Power model
+// ========================================
+// Supply current in uA. README figures where it has them (sleep, ADC,
+// 4 MHz active), rough AVR DD typicals for the rest.
+typedef struct {
+    double active_ua[SIM_CLK_COUNT];
+    double idle_ua[SIM_CLK_COUNT];
+    double standby_ua;
+    double powerdown_ua;
+    double adc_ua;  // Added while converting
+    double vdd;
+} sim_power_model_t;
+
+extern const sim_power_model_t sim_power_default;
+
+// Charge in uC and energy in uJ of an account
+double sim_charge_uc(const sim_acct_t *acct, const sim_power_model_t *model);
+double sim_energy_uj(const sim_acct_t *acct, const sim_power_model_t *model);
+sim_time_t sim_acct_time(const sim_acct_t *acct);
+sim_time_t sim_acct_active(const sim_acct_t *acct);
+
+// ========================================
+// Nodes
+// ========================================
+typedef struct sim_node sim_node_t;
+
+// Load a firmware module (built by fw_module() in CMakeLists.txt)
+sim_node_t *sim_node_load(const char *path, const char *name);
+
+// Firmware linked into the test: its sim_io, vectors looked up globally
+sim_node_t *sim_node_attach(sim_io_t *io, const char *name);
+
+void sim_node_free(sim_node_t *node);  // Power off, module unloaded
+
+// Run the firmware's main() (fw_main) from the current time
+void sim_node_start(sim_node_t *node);
+
+// Direct calls into attached firmware run on this node (NULL = none)
+void sim_node_select(sim_node_t *node);
+
+sim_io_t *sim_node_io(sim_node_t *node);
+void *sim_node_symbol(sim_node_t *node, const char *symbol);
+const char *sim_node_name(const sim_node_t *node);
+sim_time_t sim_node_now(const sim_node_t *node);
+uint8_t sim_node_sleeping(const sim_node_t *node);
+uint8_t sim_node_state(const sim_node_t *node);  // Last scheduler state entered
+uint32_t sim_node_cpu_hz(const sim_node_t *node);
+uint8_t sim_node_irq_enabled(const sim_node_t *node);
+
+// Statistics up to the node's current time
+const sim_stats_t *sim_node_stats(sim_node_t *node);
+void sim_node_stats_reset(sim_node_t *node);
+
+// ========================================
+// Running
+// ========================================
+// Run every started node up to time t
+void sim_run_until(sim_time_t t);
+void sim_run_for(sim_time_t duration);
+sim_time_t sim_time(void);
+
+// Direct mode (selected node): spin the CPU for a while, interrupts
+// and peripherals keep running
+void sim_spin(sim_node_t *node, sim_time_t duration);
+
+// How far a node may run ahead of the others (default 1 us)
+void sim_set_quantum(sim_time_t quantum);
+
+// Abort with a message (unsupported configuration, firmware fault)
+void sim_fail(const char *format, ...) __attribute__((noreturn, format(printf, 1, 2)));
+
+// ========================================
+// Pins
+// ========================================
+#define SIM_PIN_RELEASE (-1)
+
+// Drive an input from outside at time t (0, 1 or SIM_PIN_RELEASE)
+void sim_pin_drive(sim_node_t *node, char port, uint8_t pin, int level, sim_time_t t);
+
+// Button to GND on a pulled-up pin, pressed for 'hold'
+void sim_button_press(sim_node_t *node, char port, uint8_t pin, sim_time_t t, sim_time_t hold);
+
+// Level the pin shows (input side), and whether the node drives it
+uint8_t sim_pin_level(sim_node_t *node, char port, uint8_t pin);
+uint8_t sim_pin_is_output(sim_node_t *node, char port, uint8_t pin);
+
+// Output of one node drives an input of another (e.g. chip select)
+void sim_wire(sim_node_t *from, char from_port, uint8_t from_pin,
+              sim_node_t *to, char to_port, uint8_t to_pin);
+
+// ========================================
+// SPI from outside
+// ========================================
+// A byte from an SPI host that is not a node, shifted in completely at
+// time t (select the client with sim_pin_drive() on its SS pin)
+void sim_spi_inject(sim_node_t *node, uint8_t data, sim_time_t t);
+
+// ========================================
+// Analog inputs
+// ========================================
+// Volts on AINx at time t
+typedef double (*sim_analog_fn_t)(sim_node_t *node, uint8_t ain, sim_time_t t, void *ctx);
+
+void sim_analog_set(sim_node_t *node, sim_analog_fn_t fn, void *ctx);
+void sim_analog_const(sim_node_t *node, uint8_t ain, double volts);
+void sim_set_vdd(sim_node_t *node, double volts);
+
+// Last conversion results, oldest first (ring of SIM_ADC_LOG entries)
+#define SIM_ADC_LOG 64
+uint16_t sim_adc_result(sim_node_t *node, uint32_t index);
+
+// ========================================
+// USART output
+// ========================================
+const char *sim_usart_output(sim_node_t *node, size_t *len);
+void sim_usart_clear(sim_node_t *node);
+
+// Terminal rate: frames more than 2 % off count as usart_bad_rate
+void sim_usart_expect_baud(sim_node_t *node, uint32_t baud);
+
+// ========================================
+// EEPROM
+// ========================================
+void sim_nvm_set_times(sim_time_t erase, sim_time_t write);
+void sim_nvm_seed(uint32_t seed);
+
+// Power loss now: an erase or write in progress leaves random bits.
+// Returns 1 if an operation was cut. Free the node afterwards.
+uint8_t sim_nvm_power_cut(sim_node_t *node);
+
+#endif // SIM_H
@@ -0,0 +1,272 @@
+// ADC0 with VREF: conversion time from the ADC clock, result from the
+// analog input model, accumulation, window compare, event start
+
+#include <math.h>
+#include "sim_internal.h"
+
+#define ADC_REG_CTRLA    0x00
+#define ADC_REG_COMMAND  0x0A
+#define ADC_REG_INTFLAGS 0x0D
+#define ADC_REG_RES      0x10
+
+// CLK_ADC range of the datasheet
+#define SIM_ADC_CLK_MIN 125000UL
+#define SIM_ADC_CLK_MAX 2000000UL
+
+static const uint16_t presc_div[16] = {
+    2, 4, 8, 12, 16, 20, 24, 28, 32, 48, 64, 96, 128, 256, 256, 256
+};
+
+static const uint16_t init_delay[8] = {0, 16, 32, 64, 128, 256, 256, 256};
+
+void sim_adc_reset(sim_node_t *node) {
+    node->adc_busy = 0;
+    node->adc_first = 1;
+}
+
+static double sim_adc_input(sim_node_t *node, uint8_t mux, sim_time_t t) {
+    if(mux == ADC_MUXPOS_GND_gc) {
+        return 0.0;
+    }
+
+    if(node->analog_fn) {
+        return node->analog_fn(node, mux, t, node->analog_ctx);
+    }
+
+    return mux < 64 ? node->analog_const[mux] : 0.0;
+}
+
+static double sim_adc_reference(sim_node_t *node) {
+    switch(node->io->vref.ADC0REF & VREF_REFSEL_gm) {
+        case VREF_REFSEL_1V024_gc: return 1.024;
+        case VREF_REFSEL_2V048_gc: return 2.048;
+        case VREF_REFSEL_4V096_gc: return 4.096;
+        case VREF_REFSEL_2V500_gc: return 2.5;
+        case VREF_REFSEL_VDD_gc:   return node->vdd;
+        case VREF_REFSEL_VREFA_gc: return node->vdd;  // VREFA tied to VDD
+        default:
+            // Reserved codes: counted, converted against VDD
+            node->stats.adc_bad_ref++;
+            return node->vdd;
+    }
+}
+
+// One conversion sample, 12-bit (single-ended) or signed 12-bit
+static int32_t sim_adc_sample(sim_node_t *node, sim_time_t t, double ref) {
+    ADC_t *adc = &node->io->adc0;
+    double v = sim_adc_input(node, adc->MUXPOS & 0x7F, t);
+
+    if(adc->CTRLA & ADC_CONVMODE_bm) {
+        v -= sim_adc_input(node, adc->MUXNEG & 0x7F, t);
+        long code = lround(v / ref * 2048.0);
+        return code < -2048 ? -2048 : (code > 2047 ? 2047 : code);
+    }
+
+    long code = lround(v / ref * 4096.0);
+    return code < 0 ? 0 : (code > 4095 ? 4095 : code);
+}
+
+static sim_time_t sim_adc_clk_period(sim_node_t *node) {
+    return presc_div[node->io->adc0.CTRLC & ADC_PRESC_gm] * node->cpu_period;
+}
+
+static uint32_t sim_adc_sample_cycles(sim_node_t *node) {
+    ADC_t *adc = &node->io->adc0;
+
+    // Sample delay + sample length + 2, then 13 conversion clocks
+    return (adc->CTRLD & ADC_SAMPDLY_gm) + adc->SAMPCTRL + 2 + 13;
+}
+
+static void sim_adc_start(sim_node_t *node, sim_time_t t) {
+    ADC_t *adc = &node->io->adc0;
+    uint32_t clk_hz = node->cpu_hz / presc_div[adc->CTRLC & ADC_PRESC_gm];
+    uint32_t cycles = sim_adc_sample_cycles(node) << (adc->CTRLB & ADC_SAMPNUM_gm);
+
+    if(clk_hz < SIM_ADC_CLK_MIN || clk_hz > SIM_ADC_CLK_MAX) {
+        node->stats.adc_clock_range++;
+    }
+
+    if(node->adc_first) {
+        cycles += init_delay[(adc->CTRLD & ADC_INITDLY_gm) >> ADC_INITDLY_gp];
+        node->adc_first = 0;
+    }
+
+    node->adc_busy = 1;
+    node->adc_start = t;
+    adc->COMMAND |= ADC_STCONV_bm;
+    sim_timer_set(node, SIM_TMR_ADC, t + cycles * sim_adc_clk_period(node));
+}
+
+static void sim_adc_stop(sim_node_t *node, sim_time_t t) {
+    if(node->adc_busy) {
+        sim_account_adc(node, t - node->adc_start);
+    }
+
+    node->adc_busy = 0;
+    node->io->adc0.COMMAND &= ~ADC_STCONV_bm;
+    sim_timer_stop(node, SIM_TMR_ADC);
+}
+
+void sim_adc_timer(sim_node_t *node, sim_time_t t) {
+    ADC_t *adc = &node->io->adc0;
+    uint8_t sampnum = adc->CTRLB & ADC_SAMPNUM_gm;
+    uint32_t samples = 1U << sampnum;
+    sim_time_t sample_time = (t - node->adc_start) / samples;
+    double ref = sim_adc_reference(node);
+    int32_t sum = 0;
+
+    if(!node->adc_busy) {
+        return;
+    }
+
+    // Each sample sees the input at its own sampling time
+    for(uint32_t i = 0; i < samples; i++) {
+        sum += sim_adc_sample(node, node->adc_start + i * sample_time, ref);
+    }
+
+    // RES stays 16 bits: sums above 16 samples are shifted down
+    if(sampnum > 4) {
+        sum >>= sampnum - 4;
+    }
+
+    if((adc->CTRLA & ADC_LEFTADJ_bm) && !sampnum) {
+        sum <<= 4;
+    }
+
+    uint16_t res = (uint16_t)sum;
+    adc->RES = res;
+    adc->INTFLAGS |= ADC_RESRDY_bm;
+    node->adc_log[node->adc_log_count++ % SIM_ADC_LOG] = res;
+    node->stats.adc_conversions++;
+    sim_account_adc(node, t - node->adc_start);
+
+    uint8_t window = 0;
+    switch(adc->CTRLE & ADC_WINCM_gm) {
+        case ADC_WINCM_BELOW_gc:   window = res < adc->WINLT; break;
+        case ADC_WINCM_ABOVE_gc:   window = res > adc->WINHT; break;
+        case ADC_WINCM_INSIDE_gc:  window = res > adc->WINLT && res < adc->WINHT; break;
+        case ADC_WINCM_OUTSIDE_gc: window = res < adc->WINLT || res > adc->WINHT; break;
+        default: break;
+    }
+    if(window) {
+        adc->INTFLAGS |= ADC_WCMP_bm;
+    }
+
+    node->adc_busy = 0;
+    adc->COMMAND &= ~ADC_STCONV_bm;
+
+    if(adc->CTRLA & ADC_FREERUN_bm) {
+        sim_adc_start(node, t);
+    }
+}
+
+void sim_adc_event(sim_node_t *node, sim_time_t t) {
+    ADC_t *adc = &node->io->adc0;
+
+    if(!(adc->EVCTRL & ADC_STARTEI_bm)) {
+        return;
+    }
+
+    if(!(adc->CTRLA & ADC_ENABLE_bm) || node->adc_busy) {
+        node->stats.adc_start_lost++;
+        return;
+    }
+
+    sim_adc_start(node, t);
+}
+
+void sim_adc_write(sim_node_t *node, uint32_t reg, uint32_t size, const uint8_t *old) {
+    ADC_t *adc = &node->io->adc0;
+
+    for(uint32_t i = 0; i < size; i++) {
+        switch(reg + i) {
+            case ADC_REG_CTRLA:
+                if((adc->CTRLA ^ old[i]) & ADC_ENABLE_bm) {
+                    // Enabling pays the init delay on the first conversion
+                    sim_adc_stop(node, node->now);
+                    node->adc_first = 1;
+                }
+                break;
+
+            case ADC_REG_COMMAND: {
+                uint8_t command = adc->COMMAND;
+                adc->COMMAND = node->adc_busy ? ADC_STCONV_bm : 0;
+
+                if(command & ADC_SPCONV_bm) {
+                    sim_adc_stop(node, node->now);
+                } else if(command & ADC_STCONV_bm) {
+                    if(!(adc->CTRLA & ADC_ENABLE_bm) || node->adc_busy) {
+                        node->stats.adc_start_lost++;
+                    } else {
+                        sim_adc_start(node, node->now);
+                    }
+                }
+                break;
+            }
+
+            case ADC_REG_INTFLAGS:
+                adc->INTFLAGS = old[i] & ~adc->INTFLAGS;
+                break;
+
+            case ADC_REG_RES:
+            case ADC_REG_RES + 1:
+                ((volatile uint8_t *)adc)[reg + i] = old[i];
+                break;
+
+            default:
+                break;
+        }
+    }
+}
+
+void sim_adc_read_done(sim_node_t *node, uint32_t reg) {
+    // Reading the result clears RESRDY and the window flag
+    if(reg == ADC_REG_RES) {
+        node->io->adc0.INTFLAGS &= ~(ADC_RESRDY_bm | ADC_WCMP_bm);
+    }
+}
+
+uint8_t sim_adc_runs_in(sim_node_t *node, uint8_t sleep_mode) {
+    ADC_t *adc = &node->io->adc0;
+
+    if(sleep_mode == SIM_SLEEP_IDLE) {
+        return 1;
+    }
+
+    return sleep_mode == SIM_SLEEP_STANDBY && (adc->CTRLA & ADC_RUNSTBY_bm);
+}
+
+uint8_t sim_adc_irq(sim_node_t *node, sim_vect_t vect) {
+    ADC_t *adc = &node->io->adc0;
+    uint8_t bm = (vect == SIM_VECT_ADC0_RESRDY) ? ADC_RESRDY_bm : ADC_WCMP_bm;
+
+    return (adc->INTFLAGS & adc->INTCTRL & bm) != 0;
+}
+
+// ========================================
+// Analog inputs
+// ========================================
+void sim_analog_set(sim_node_t *node, sim_analog_fn_t fn, void *ctx) {
+    node->analog_fn = fn;
+    node->analog_ctx = ctx;
+}
+
+void sim_analog_const(sim_node_t *node, uint8_t ain, double volts) {
+    if(ain < 64) {
+        node->analog_const[ain] = volts;
+    }
+}
+
+void sim_set_vdd(sim_node_t *node, double volts) {
+    node->vdd = volts;
+}
+
+uint16_t sim_adc_result(sim_node_t *node, uint32_t index) {
+    uint32_t count = node->adc_log_count < SIM_ADC_LOG ? node->adc_log_count : SIM_ADC_LOG;
+
+    if(index >= count) {
+        return 0;
+    }
+
+    return node->adc_log[(node->adc_log_count - count + index) % SIM_ADC_LOG];
+}
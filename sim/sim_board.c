@@ -0,0 +1,7 @@
+// Register space of one firmware image, linked into every module
+
+#include <stdio.h>
+#include <avr/io.h>
+
+sim_io_t sim_io;
+FILE *sim_fw_stdout;
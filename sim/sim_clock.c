@@ -0,0 +1,127 @@
+// CLKCTRL: main clock source switch with oscillator start-up, OSCHF
+// frequency and the main clock prescaler
+
+#include "sim_internal.h"
+
+#define CLKCTRL_REG_MCLKCTRLA  0x00
+#define CLKCTRL_REG_MCLKCTRLB  0x01
+#define CLKCTRL_REG_MCLKSTATUS 0x05
+#define CLKCTRL_REG_OSCHFCTRLA 0x08
+
+// Start-up time until the new source is used
+#define SIM_OSCHF_STARTUP  SIM_US(13)
+#define SIM_OSC32K_STARTUP SIM_US(61)
+
+static uint32_t sim_clock_source_hz(sim_node_t *node, uint8_t sel) {
+    static const uint32_t frqsel_hz[16] = {
+        1000000, 2000000, 3000000, 4000000, 0, 8000000, 12000000, 16000000,
+        20000000, 24000000, 0, 0, 0, 0, 0, 0
+    };
+
+    switch(sel) {
+        case CLKCTRL_CLKSEL_OSCHF_gc: {
+            uint32_t hz = frqsel_hz[(node->io->clkctrl.OSCHFCTRLA & CLKCTRL_FRQSEL_gm) >> 2];
+            if(!hz) {
+                sim_fail("CLKCTRL: reserved FRQSEL");
+            }
+            return hz;
+        }
+
+        case CLKCTRL_CLKSEL_OSC32K_gc:
+            return 32768;
+
+        default:
+            sim_fail("CLKCTRL: only OSCHF and OSC32K are simulated");
+    }
+}
+
+static uint32_t sim_clock_hz(sim_node_t *node) {
+    static const uint8_t pdiv[16] = {2, 4, 8, 16, 32, 64, 0, 0, 6, 10, 12, 24, 48, 0, 0, 0};
+    uint8_t ctrlb = node->io->clkctrl.MCLKCTRLB;
+    uint32_t hz = sim_clock_source_hz(node, node->clk_sel);
+
+    if(ctrlb & CLKCTRL_PEN_bm) {
+        uint8_t div = pdiv[(ctrlb & CLKCTRL_PDIV_gm) >> 1];
+        if(!div) {
+            sim_fail("CLKCTRL: reserved PDIV");
+        }
+        hz /= div;
+    }
+
+    return hz;
+}
+
+void sim_clock_reset(sim_node_t *node) {
+    CLKCTRL_t *clk = &node->io->clkctrl;
+
+    clk->MCLKCTRLA = CLKCTRL_CLKSEL_OSCHF_gc;
+    clk->OSCHFCTRLA = CLKCTRL_FRQSEL_4M_gc;
+    clk->MCLKSTATUS = CLKCTRL_OSCHFS_bm | CLKCTRL_OSC32KS_bm;
+    node->clk_sel = CLKCTRL_CLKSEL_OSCHF_gc;
+    node->clk_target = CLKCTRL_CLKSEL_OSCHF_gc;
+    sim_cpu_clock(node, sim_clock_hz(node));
+}
+
+void sim_clock_timer(sim_node_t *node, sim_time_t t) {
+    CLKCTRL_t *clk = &node->io->clkctrl;
+    (void)t;
+
+    node->clk_sel = node->clk_target;
+
+    // OSCHF stops when nothing uses it, OSC32K always runs (RTC)
+    clk->MCLKSTATUS = CLKCTRL_OSC32KS_bm |
+                      (node->clk_sel == CLKCTRL_CLKSEL_OSCHF_gc ? CLKCTRL_OSCHFS_bm : 0);
+    sim_cpu_clock(node, sim_clock_hz(node));
+}
+
+void sim_clock_write(sim_node_t *node, uint32_t reg, const uint8_t *old) {
+    CLKCTRL_t *clk = &node->io->clkctrl;
+
+    switch(reg) {
+        case CLKCTRL_REG_MCLKCTRLA: {
+            uint8_t sel = clk->MCLKCTRLA & CLKCTRL_CLKSEL_gm;
+
+            // No new source until the running switch is done
+            if(clk->MCLKSTATUS & CLKCTRL_SOSC_bm) {
+                clk->MCLKCTRLA = *old;
+                node->stats.clock_switch_lost++;
+                break;
+            }
+
+            if(sel == node->clk_target) {
+                break;
+            }
+
+            // Checked now, the switch completes later
+            sim_clock_source_hz(node, sel);
+            node->clk_target = sel;
+            clk->MCLKSTATUS |= CLKCTRL_SOSC_bm;
+            sim_timer_set(node, SIM_TMR_CLOCK, node->now +
+                          (sel == CLKCTRL_CLKSEL_OSCHF_gc ? SIM_OSCHF_STARTUP : SIM_OSC32K_STARTUP));
+            break;
+        }
+
+        case CLKCTRL_REG_MCLKCTRLB:
+            sim_cpu_clock(node, sim_clock_hz(node));
+            break;
+
+        case CLKCTRL_REG_OSCHFCTRLA:
+            // Running OSCHF is retuned at once
+            if(node->clk_sel == CLKCTRL_CLKSEL_OSCHF_gc &&
+               node->clk_target == CLKCTRL_CLKSEL_OSCHF_gc) {
+                sim_cpu_clock(node, sim_clock_hz(node));
+            }
+            break;
+
+        case CLKCTRL_REG_MCLKSTATUS:
+            clk->MCLKSTATUS = *old;
+            break;
+
+        default:
+            break;
+    }
+}
+
+uint8_t sim_clock_oschf_main(sim_node_t *node) {
+    return node->clk_sel == CLKCTRL_CLKSEL_OSCHF_gc;
+}
@@ -0,0 +1,1002 @@
+// Simulator core: memory access hooks, CPU (interrupts, sleep, time),
+// per-node timers and the coordinator that runs the nodes as coroutines
+
+#define _GNU_SOURCE
+#include <dlfcn.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "sim_internal.h"
+#include "sim_cpu.h"
+
+#define SIM_MAX_NODES  16
+#define SIM_STACK_SIZE (1024 * 1024)
+
+// CPU cycles from the wake-up condition to the first instruction
+#define SIM_WAKE_CYCLES 6
+
+// OSCHF start-up when waking from STANDBY / POWERDOWN
+#define SIM_OSCHF_WAKE SIM_US(13)
+
+sim_node_t *sim_cur = 0;
+sim_node_t *sim_nodes[SIM_MAX_NODES];
+uint32_t sim_node_count = 0;
+
+static ucontext_t sim_main_ctx;
+static sim_time_t sim_quantum = SIM_US(1);
+static sim_time_t sim_global_time = 0;
+
+static const char *const sim_vect_names[SIM_VECT_COUNT] = {
+    [SIM_VECT_RTC_CNT]     = "sim_vect_RTC_CNT",
+    [SIM_VECT_RTC_PIT]     = "sim_vect_RTC_PIT",
+    [SIM_VECT_PORTA]       = "sim_vect_PORTA_PORT",
+    [SIM_VECT_TCB0]        = "sim_vect_TCB0_INT",
+    [SIM_VECT_SPI0]        = "sim_vect_SPI0_INT",
+    [SIM_VECT_USART0_RXC]  = "sim_vect_USART0_RXC",
+    [SIM_VECT_USART0_DRE]  = "sim_vect_USART0_DRE",
+    [SIM_VECT_USART0_TXC]  = "sim_vect_USART0_TXC",
+    [SIM_VECT_PORTD]       = "sim_vect_PORTD_PORT",
+    [SIM_VECT_ADC0_RESRDY] = "sim_vect_ADC0_RESRDY",
+    [SIM_VECT_ADC0_WCMP]   = "sim_vect_ADC0_WCMP",
+    [SIM_VECT_PORTC]       = "sim_vect_PORTC_PORT",
+    [SIM_VECT_PORTF]       = "sim_vect_PORTF_PORT",
+    [SIM_VECT_NVMCTRL_EE]  = "sim_vect_NVMCTRL_EE"
+};
+
+void sim_fail(const char *format, ...) {
+    va_list args;
+
+    fprintf(stderr, "sim: ");
+    if(sim_cur) {
+        fprintf(stderr, "%s at %.3f ms: ", sim_cur->name, sim_cur->now / 512000.0);
+    }
+    va_start(args, format);
+    vfprintf(stderr, format, args);
+    va_end(args);
+    fprintf(stderr, "\n");
+    exit(2);
+}
+
+// ========================================
+// Accounting
+// ========================================
+static sim_clk_t sim_clk_bucket(uint32_t hz) {
+    switch(hz) {
+        case 32768:   return SIM_CLK_32K;
+        case 1000000: return SIM_CLK_1M;
+        case 4000000: return SIM_CLK_4M;
+        default:      return SIM_CLK_OTHER;
+    }
+}
+
+static sim_acct_t *sim_state_acct(sim_node_t *node) {
+    return &node->stats.state[node->state % SIM_MAX_STATES];
+}
+
+static void sim_account_active(sim_node_t *node, sim_time_t dt, uint64_t cycles) {
+    sim_clk_t clk = sim_clk_bucket(node->cpu_hz);
+
+    node->stats.total.active[clk] += dt;
+    node->stats.total.cycles += cycles;
+    sim_state_acct(node)->active[clk] += dt;
+    sim_state_acct(node)->cycles += cycles;
+}
+
+static void sim_account_sleep(sim_node_t *node, sim_time_t dt) {
+    node->stats.total.sleep[node->sleep_mode] += dt;
+    sim_state_acct(node)->sleep[node->sleep_mode] += dt;
+
+    // IDLE current depends on the clock that keeps running
+    if(node->sleep_mode == SIM_SLEEP_IDLE) {
+        sim_clk_t clk = sim_clk_bucket(node->cpu_hz);
+        node->stats.total.idle[clk] += dt;
+        sim_state_acct(node)->idle[clk] += dt;
+    }
+}
+
+void sim_account_adc(sim_node_t *node, sim_time_t duration) {
+    node->stats.total.adc_busy += duration;
+    sim_state_acct(node)->adc_busy += duration;
+}
+
+// ========================================
+// Timers
+// ========================================
+// Peripherals clocked by CLK_PER stop in STANDBY (unless RUNSTBY) and
+// POWERDOWN, their timers are frozen until the wake
+static uint8_t sim_timer_runs(sim_node_t *node, sim_timer_t timer) {
+    if(!node->sleeping || node->sleep_mode == SIM_SLEEP_IDLE) {
+        return 1;
+    }
+
+    switch(timer) {
+        case SIM_TMR_ADC:
+            return sim_adc_runs_in(node, node->sleep_mode);
+        case SIM_TMR_CLOCK:
+        case SIM_TMR_SPI:
+        case SIM_TMR_USART:
+            return 0;
+        default:
+            return 1;
+    }
+}
+
+void sim_timer_set(sim_node_t *node, sim_timer_t timer, sim_time_t t) {
+    if(!sim_timer_runs(node, timer)) {
+        node->frozen[timer] = 1;
+        node->frozen_left[timer] = t > node->now ? t - node->now : 0;
+        node->timer[timer] = SIM_NEVER;
+        node->stats.stalls[timer]++;
+        return;
+    }
+
+    node->frozen[timer] = 0;
+    node->timer[timer] = t;
+}
+
+void sim_timer_stop(sim_node_t *node, sim_timer_t timer) {
+    node->frozen[timer] = 0;
+    node->timer[timer] = SIM_NEVER;
+}
+
+sim_time_t sim_timer_left(sim_node_t *node, sim_timer_t timer) {
+    if(node->frozen[timer]) {
+        return node->frozen_left[timer];
+    }
+
+    if(node->timer[timer] == SIM_NEVER) {
+        return SIM_NEVER;
+    }
+
+    return node->timer[timer] > node->now ? node->timer[timer] - node->now : 0;
+}
+
+static void sim_timers_freeze(sim_node_t *node) {
+    for(int i = 0; i < SIM_TMR_COUNT; i++) {
+        if(node->timer[i] != SIM_NEVER && !sim_timer_runs(node, (sim_timer_t)i)) {
+            node->frozen[i] = 1;
+            node->frozen_left[i] = node->timer[i] > node->now ? node->timer[i] - node->now : 0;
+            node->timer[i] = SIM_NEVER;
+            node->stats.stalls[i]++;
+        }
+    }
+}
+
+static void sim_timers_thaw(sim_node_t *node) {
+    for(int i = 0; i < SIM_TMR_COUNT; i++) {
+        if(node->frozen[i]) {
+            node->frozen[i] = 0;
+            node->timer[i] = node->now + node->frozen_left[i];
+        }
+    }
+}
+
+void sim_ext_post(sim_node_t *node, const sim_ext_t *event) {
+    if(node->ext_count == node->ext_cap) {
+        node->ext_cap = node->ext_cap ? node->ext_cap * 2 : 64;
+        node->ext = realloc(node->ext, node->ext_cap * sizeof(sim_ext_t));
+        if(!node->ext) {
+            sim_fail("out of memory");
+        }
+    }
+
+    sim_ext_t ev = *event;
+
+    // Never in the past of the target (nodes run up to a quantum apart)
+    if(ev.t < node->now) {
+        ev.t = node->now;
+    }
+
+    // Sorted insert, equal times keep their posting order
+    uint32_t i = node->ext_count;
+    while(i > 0 && node->ext[i - 1].t > ev.t) {
+        node->ext[i] = node->ext[i - 1];
+        i--;
+    }
+    node->ext[i] = ev;
+    node->ext_count++;
+    node->timer[SIM_TMR_EXT] = node->ext[0].t;
+
+    // Let the target react before the poster runs far ahead
+    if(sim_cur && sim_cur != node && !sim_cur->direct &&
+       sim_cur->horizon > ev.t + sim_quantum) {
+        sim_cur->horizon = ev.t + sim_quantum;
+    }
+}
+
+static void sim_ext_timer(sim_node_t *node, sim_time_t t) {
+    while(node->ext_count && node->ext[0].t <= t) {
+        sim_ext_t ev = node->ext[0];
+
+        memmove(&node->ext[0], &node->ext[1], (node->ext_count - 1) * sizeof(sim_ext_t));
+        node->ext_count--;
+
+        if(ev.kind == SIM_EXT_PIN) {
+            sim_port_ext(node, &ev, ev.t);
+        } else {
+            sim_spi_ext(node, &ev, ev.t);
+        }
+    }
+
+    node->timer[SIM_TMR_EXT] = node->ext_count ? node->ext[0].t : SIM_NEVER;
+}
+
+static void sim_timer_fire(sim_node_t *node, sim_timer_t timer, sim_time_t t) {
+    switch(timer) {
+        case SIM_TMR_CLOCK:  sim_clock_timer(node, t); break;
+        case SIM_TMR_SPI:    sim_spi_timer(node, t); break;
+        case SIM_TMR_USART:  sim_usart_timer(node, t); break;
+        case SIM_TMR_ADC:    sim_adc_timer(node, t); break;
+        case SIM_TMR_RTC:    sim_rtc_timer(node, t); break;
+        case SIM_TMR_PIT:    sim_pit_timer(node, t); break;
+        case SIM_TMR_PIT_EV: sim_pit_ev_timer(node, t); break;
+        case SIM_TMR_NVM:    sim_nvm_timer(node, t); break;
+        case SIM_TMR_EXT:    sim_ext_timer(node, t); break;
+        default: break;
+    }
+}
+
+static sim_time_t sim_next_event(sim_node_t *node, sim_timer_t *which) {
+    sim_time_t next = SIM_NEVER;
+
+    for(int i = 0; i < SIM_TMR_COUNT; i++) {
+        if(node->timer[i] < next) {
+            next = node->timer[i];
+            if(which) {
+                *which = (sim_timer_t)i;
+            }
+        }
+    }
+
+    return next;
+}
+
+// Fire every timer due up to t, in time order
+static void sim_process_events(sim_node_t *node, sim_time_t t) {
+    sim_timer_t timer = SIM_TMR_CLOCK;
+    sim_time_t next;
+
+    while((next = sim_next_event(node, &timer)) <= t) {
+        node->timer[timer] = SIM_NEVER;
+        sim_timer_fire(node, timer, next);
+    }
+}
+
+// ========================================
+// Interrupts
+// ========================================
+static uint8_t sim_vect_pending(sim_node_t *node, sim_vect_t vect) {
+    switch(vect) {
+        case SIM_VECT_RTC_CNT:
+        case SIM_VECT_RTC_PIT:     return sim_rtc_irq(node, vect);
+        case SIM_VECT_PORTA:       return sim_port_irq(node, 0);
+        case SIM_VECT_PORTC:       return sim_port_irq(node, 1);
+        case SIM_VECT_PORTD:       return sim_port_irq(node, 2);
+        case SIM_VECT_PORTF:       return sim_port_irq(node, 3);
+        case SIM_VECT_TCB0:        return (node->io->tcb0.INTFLAGS & node->io->tcb0.INTCTRL & 0x03) != 0;
+        case SIM_VECT_SPI0:        return sim_spi_irq(node);
+        case SIM_VECT_USART0_RXC:
+        case SIM_VECT_USART0_DRE:
+        case SIM_VECT_USART0_TXC:  return sim_usart_irq(node, vect);
+        case SIM_VECT_ADC0_RESRDY:
+        case SIM_VECT_ADC0_WCMP:   return sim_adc_irq(node, vect);
+        case SIM_VECT_NVMCTRL_EE:  return sim_nvm_irq(node);
+        default:                   return 0;
+    }
+}
+
+uint8_t sim_irq_pending(sim_node_t *node) {
+    for(int v = 0; v < SIM_VECT_COUNT; v++) {
+        if(sim_vect_pending(node, (sim_vect_t)v)) {
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+static void sim_flush(sim_node_t *node);
+
+// Call the highest priority pending ISR, interrupts do not nest
+static void sim_dispatch(sim_node_t *node) {
+    if(!node->i_flag || node->in_isr) {
+        return;
+    }
+
+    for(int v = 0; v < SIM_VECT_COUNT; v++) {
+        if(!sim_vect_pending(node, (sim_vect_t)v)) {
+            continue;
+        }
+
+        if(!node->vect[v]) {
+            sim_fail("interrupt %s enabled without an ISR (BADISR)", sim_vect_names[v] + 9);
+        }
+
+        node->stats.isr[v]++;
+        node->now += SIM_ISR_CYCLES * node->cpu_period;
+        sim_account_active(node, SIM_ISR_CYCLES * node->cpu_period, SIM_ISR_CYCLES);
+
+        node->in_isr = 1;
+        node->vect[v]();
+        sim_flush(node);
+        node->in_isr = 0;
+        return;
+    }
+}
+
+// ========================================
+// Register access side effects
+// ========================================
+static void sim_io_write(sim_node_t *node, uint32_t off, uint32_t size, const uint8_t *old) {
+    // Multi-byte stores are handled per register
+    if(off >= SIM_IO_OFF(porta) && off < SIM_IO_END(portf)) {
+        uint32_t port = (off - SIM_IO_OFF(porta)) / sizeof(PORT_t);
+        for(uint32_t i = 0; i < size; i++) {
+            sim_port_write(node, (uint8_t)port,
+                           (off + i - SIM_IO_OFF(porta)) % sizeof(PORT_t), &old[i]);
+        }
+    } else if(off >= SIM_IO_OFF(spi0) && off < SIM_IO_END(spi0)) {
+        for(uint32_t i = 0; i < size; i++) {
+            sim_spi_write(node, off + i - SIM_IO_OFF(spi0), &old[i]);
+        }
+    } else if(off >= SIM_IO_OFF(usart0) && off < SIM_IO_END(usart0)) {
+        sim_usart_write(node, off - SIM_IO_OFF(usart0), size, old);
+    } else if(off >= SIM_IO_OFF(adc0) && off < SIM_IO_END(adc0)) {
+        sim_adc_write(node, off - SIM_IO_OFF(adc0), size, old);
+    } else if(off >= SIM_IO_OFF(clkctrl) && off < SIM_IO_END(clkctrl)) {
+        for(uint32_t i = 0; i < size; i++) {
+            sim_clock_write(node, off + i - SIM_IO_OFF(clkctrl), &old[i]);
+        }
+    } else if(off >= SIM_IO_OFF(rtc) && off < SIM_IO_END(rtc)) {
+        sim_rtc_write(node, off - SIM_IO_OFF(rtc), size, old);
+    } else if(off >= SIM_IO_OFF(evsys) && off < SIM_IO_END(evsys)) {
+        for(uint32_t i = 0; i < size; i++) {
+            sim_evsys_write(node, off + i - SIM_IO_OFF(evsys), &old[i]);
+        }
+    } else if(off >= SIM_IO_OFF(tcb0) && off < SIM_IO_END(tcb0)) {
+        sim_tcb_write(node, off - SIM_IO_OFF(tcb0), size, old);
+    } else if(off >= SIM_IO_OFF(nvmctrl) && off < SIM_IO_END(nvmctrl)) {
+        sim_nvm_write(node, off - SIM_IO_OFF(nvmctrl), size, old);
+    } else if(off >= SIM_IO_OFF(eeprom) && off < SIM_IO_END(eeprom)) {
+        for(uint32_t i = 0; i < size; i++) {
+            sim_nvm_eeprom_write(node, off + i - SIM_IO_OFF(eeprom), &old[i]);
+        }
+    }
+    // VREF, SLPCTRL and CCP only hold their value
+}
+
+// Value refresh before a firmware read
+static void sim_io_read(sim_node_t *node, uint32_t off) {
+    if(off >= SIM_IO_OFF(spi0) && off < SIM_IO_END(spi0)) {
+        sim_spi_read(node, off - SIM_IO_OFF(spi0));
+    } else if(off >= SIM_IO_OFF(rtc) && off < SIM_IO_END(rtc)) {
+        sim_rtc_read(node, off - SIM_IO_OFF(rtc));
+    }
+}
+
+// Side effect of the read that just happened
+static void sim_io_read_done(sim_node_t *node, uint32_t off) {
+    if(off >= SIM_IO_OFF(spi0) && off < SIM_IO_END(spi0)) {
+        sim_spi_read_done(node, off - SIM_IO_OFF(spi0));
+    } else if(off >= SIM_IO_OFF(adc0) && off < SIM_IO_END(adc0)) {
+        sim_adc_read_done(node, off - SIM_IO_OFF(adc0));
+    }
+}
+
+// Apply the access recorded by the previous hook, its store or load has
+// happened by now
+static void sim_flush(sim_node_t *node) {
+    if(node->pend_write) {
+        node->pend_write = 0;
+        sim_io_write(node, node->pend_off, node->pend_size, node->pend_old);
+    }
+
+    if(node->pend_read) {
+        node->pend_read = 0;
+        sim_io_read_done(node, node->pend_off);
+    }
+}
+
+// ========================================
+// CPU time
+// ========================================
+static void sim_yield(sim_node_t *node);
+
+// Run the peripherals up to the node's time and take interrupts
+static void sim_step(sim_node_t *node) {
+    sim_process_events(node, node->now);
+    sim_dispatch(node);
+
+    while(!node->direct && node->now > node->horizon) {
+        sim_yield(node);
+        sim_process_events(node, node->now);
+        sim_dispatch(node);
+    }
+}
+
+static void sim_cycles(sim_node_t *node, uint64_t cycles) {
+    sim_time_t dt = cycles * node->cpu_period;
+
+    node->now += dt;
+    sim_account_active(node, dt, cycles);
+}
+
+// Busy CPU for a number of cycles, peripherals and ISRs keep running
+static void sim_busy(sim_node_t *node, uint64_t cycles) {
+    sim_flush(node);
+
+    while(cycles) {
+        // Jump to the next event, or to the point where the node yields
+        sim_time_t until = sim_next_event(node, 0);
+        if(!node->direct && node->horizon < until) {
+            until = node->horizon + 1;
+        }
+
+        uint64_t step = cycles;
+        if(until != SIM_NEVER) {
+            uint64_t to_next = until > node->now ?
+                               (until - node->now + node->cpu_period - 1) / node->cpu_period : 1;
+            if(to_next < step) {
+                step = to_next ? to_next : 1;
+            }
+        }
+
+        sim_cycles(node, step);
+        cycles -= step;
+        sim_step(node);
+    }
+}
+
+void sim_cpu_clock(sim_node_t *node, uint32_t hz) {
+    node->cpu_hz = hz;
+    node->cpu_period = (SIM_TIME_HZ + hz / 2) / hz;
+    sim_usart_clock(node);
+}
+
+// ========================================
+// TSan hooks: called before every load and store of firmware code
+// ========================================
+static inline void sim_access(void *addr, uint32_t size, uint8_t write) {
+    sim_node_t *node = sim_cur;
+
+    if(!node) {
+        return;
+    }
+
+    sim_flush(node);
+    sim_cycles(node, SIM_CYCLES_PER_ACCESS);
+    sim_step(node);
+
+    uintptr_t off = (uintptr_t)addr - (uintptr_t)node->io;
+    if(off >= sizeof(sim_io_t)) {
+        return;
+    }
+
+    node->pend_off = (uint32_t)off;
+    node->pend_size = (uint8_t)(size < sizeof(node->pend_old) ? size : sizeof(node->pend_old));
+
+    if(write) {
+        memcpy(node->pend_old, addr, node->pend_size);
+        node->pend_write = 1;
+    } else {
+        sim_io_read(node, (uint32_t)off);
+        node->pend_read = 1;
+    }
+}
+
+#define SIM_TSAN_HOOKS(n)                                                       \
+    void __tsan_read##n(void *addr) { sim_access(addr, n, 0); }                 \
+    void __tsan_write##n(void *addr) { sim_access(addr, n, 1); }                \
+    void __tsan_unaligned_read##n(void *addr) { sim_access(addr, n, 0); }       \
+    void __tsan_unaligned_write##n(void *addr) { sim_access(addr, n, 1); }      \
+    void __tsan_volatile_read##n(void *addr) { sim_access(addr, n, 0); }        \
+    void __tsan_volatile_write##n(void *addr) { sim_access(addr, n, 1); }
+
+SIM_TSAN_HOOKS(1)
+SIM_TSAN_HOOKS(2)
+SIM_TSAN_HOOKS(4)
+SIM_TSAN_HOOKS(8)
+SIM_TSAN_HOOKS(16)
+
+void __tsan_read_range(void *addr, unsigned long size) { sim_access(addr, (uint32_t)size, 0); }
+void __tsan_write_range(void *addr, unsigned long size) { sim_access(addr, (uint32_t)size, 1); }
+void *__tsan_memcpy(void *dst, const void *src, unsigned long size) {
+    sim_access((void *)src, (uint32_t)size, 0);
+    sim_access(dst, (uint32_t)size, 1);
+    return memcpy(dst, src, size);
+}
+
+void *__tsan_memset(void *dst, int value, unsigned long size) {
+    sim_access(dst, (uint32_t)size, 1);
+    return memset(dst, value, size);
+}
+
+void __tsan_init(void) {}
+void __tsan_func_entry(void *pc) { (void)pc; }
+void __tsan_func_exit(void) {}
+
+// ========================================
+// CPU instructions (sim_cpu.h)
+// ========================================
+static sim_node_t *sim_cpu(void) {
+    if(!sim_cur) {
+        sim_fail("firmware called without a selected node");
+    }
+
+    sim_flush(sim_cur);
+    return sim_cur;
+}
+
+void sim_sei(void) {
+    // Takes effect after the next instruction (the next hook)
+    sim_cpu()->i_flag = 1;
+}
+
+void sim_cli(void) {
+    sim_cpu()->i_flag = 0;
+}
+
+uint8_t sim_sreg_get(void) {
+    return sim_cpu()->i_flag ? 0x80 : 0x00;
+}
+
+void sim_sreg_restore(const uint8_t *sreg) {
+    sim_cpu()->i_flag = (*sreg & 0x80) ? 1 : 0;
+}
+
+uint8_t sim_cli_ret(void) {
+    sim_cli();
+    return 1;
+}
+
+uint8_t sim_sei_ret(void) {
+    sim_sei();
+    return 1;
+}
+
+void sim_sei_cleanup(const uint8_t *unused) {
+    (void)unused;
+    sim_sei();
+}
+
+void sim_cli_cleanup(const uint8_t *unused) {
+    (void)unused;
+    sim_cli();
+}
+
+void sim_delay_cycles(uint32_t cycles) {
+    sim_busy(sim_cpu(), cycles);
+}
+
+void sim_state_enter(uint8_t state) {
+    sim_node_t *node = sim_cpu();
+
+    node->state = state;
+    sim_state_acct(node)->entries++;
+}
+
+static uint8_t sim_can_wake(sim_node_t *node) {
+    return node->i_flag && sim_irq_pending(node);
+}
+
+void sim_sleep_cpu(void) {
+    sim_node_t *node = sim_cpu();
+    uint8_t ctrla = node->io->slpctrl.CTRLA;
+
+    // SLEEP is a NOP unless enabled
+    if(!(ctrla & SLPCTRL_SEN_bm)) {
+        sim_cycles(node, 1);
+        sim_step(node);
+        return;
+    }
+
+    sim_cycles(node, 1);
+    sim_process_events(node, node->now);
+
+    if(!sim_can_wake(node)) {
+        if(!node->i_flag) {
+            sim_fail("SLEEP with interrupts disabled never wakes");
+        }
+
+        uint8_t mode = (ctrla & SLPCTRL_SMODE_gm) >> 1;
+        node->sleep_mode = mode > SIM_SLEEP_POWERDOWN ? SIM_SLEEP_POWERDOWN : mode;
+        node->sleeping = 1;
+        sim_timers_freeze(node);
+        sim_rtc_sleep(node, node->now);
+
+        while(!sim_can_wake(node)) {
+            sim_time_t next = sim_next_event(node, 0);
+
+            if(next == SIM_NEVER && node->direct) {
+                sim_fail("sleeping with no wake-up source");
+            }
+
+            if(!node->direct && next > node->horizon) {
+                sim_yield(node);
+                continue;
+            }
+
+            if(next > node->now) {
+                sim_account_sleep(node, next - node->now);
+                node->now = next;
+            }
+            sim_process_events(node, node->now);
+        }
+
+        // Wake-up: oscillator start-up, then the clocks come back
+        uint8_t deep = node->sleep_mode != SIM_SLEEP_IDLE;
+        node->sleeping = 0;
+        node->stats.wakes++;
+        sim_rtc_wake(node, node->now);
+        sim_timers_thaw(node);
+
+        sim_time_t latency = SIM_WAKE_CYCLES * node->cpu_period;
+        if(deep && sim_clock_oschf_main(node)) {
+            latency += SIM_OSCHF_WAKE;
+        }
+        node->now += latency;
+        sim_account_active(node, latency, SIM_WAKE_CYCLES);
+    }
+
+    sim_process_events(node, node->now);
+    sim_dispatch(node);
+
+    if(!node->direct && node->now > node->horizon) {
+        sim_step(node);
+    }
+}
+
+// ========================================
+// Nodes
+// ========================================
+static void sim_node_reset(sim_node_t *node) {
+    memset((void *)node->io, 0, sizeof(sim_io_t));
+    memset((void *)node->io->eeprom, 0xFF, EEPROM_SIZE);
+
+    for(int i = 0; i < SIM_TMR_COUNT; i++) {
+        node->timer[i] = SIM_NEVER;
+    }
+
+    node->vdd = 3.3;
+    sim_clock_reset(node);
+    sim_port_reset(node);
+    sim_spi_reset(node);
+    sim_usart_reset(node);
+    sim_adc_reset(node);
+    sim_rtc_reset(node);
+    sim_nvm_reset(node);
+}
+
+static sim_node_t *sim_node_new(sim_io_t *io, const char *name) {
+    if(sim_node_count >= SIM_MAX_NODES) {
+        sim_fail("too many nodes");
+    }
+
+    sim_node_t *node = calloc(1, sizeof(sim_node_t));
+    if(!node) {
+        sim_fail("out of memory");
+    }
+
+    snprintf(node->name, sizeof(node->name), "%s", name);
+    node->io = io;
+    node->now = sim_global_time;
+    sim_node_reset(node);
+
+    sim_nodes[sim_node_count++] = node;
+    return node;
+}
+
+static void sim_node_bind(sim_node_t *node, void *handle) {
+    for(int v = 0; v < SIM_VECT_COUNT; v++) {
+        node->vect[v] = (void (*)(void))dlsym(handle, sim_vect_names[v]);
+    }
+
+    node->fw_main = (int (*)(void))dlsym(handle, "fw_main");
+}
+
+sim_node_t *sim_node_load(const char *path, const char *name) {
+    char tmp[] = "/tmp/sim_node_XXXXXX";
+    int fd = mkstemp(tmp);
+    FILE *src = fopen(path, "rb");
+
+    if(fd < 0 || !src) {
+        sim_fail("cannot load %s", path);
+    }
+
+    // Private copy: dlopen() of the same file would share the globals
+    char buf[65536];
+    size_t n;
+    while((n = fread(buf, 1, sizeof(buf), src)) > 0) {
+        if(write(fd, buf, n) != (ssize_t)n) {
+            sim_fail("cannot copy %s", path);
+        }
+    }
+    fclose(src);
+    close(fd);
+
+    void *handle = dlopen(tmp, RTLD_NOW | RTLD_LOCAL);
+    if(!handle) {
+        sim_fail("dlopen %s: %s", path, dlerror());
+    }
+
+    sim_io_t *io = dlsym(handle, "sim_io");
+    if(!io) {
+        sim_fail("%s has no sim_io", path);
+    }
+
+    sim_node_t *node = sim_node_new(io, name);
+    node->module = handle;
+    snprintf(node->module_path, sizeof(node->module_path), "%s", tmp);
+    sim_node_bind(node, handle);
+
+    return node;
+}
+
+sim_node_t *sim_node_attach(sim_io_t *io, const char *name) {
+    sim_node_t *node = sim_node_new(io, name);
+    sim_node_bind(node, RTLD_DEFAULT);
+
+    return node;
+}
+
+void sim_node_free(sim_node_t *node) {
+    if(sim_cur == node) {
+        sim_cur = 0;
+    }
+
+    for(uint32_t i = 0; i < sim_node_count; i++) {
+        if(sim_nodes[i] == node) {
+            sim_nodes[i] = sim_nodes[--sim_node_count];
+            break;
+        }
+    }
+
+    // Pins it drove on other nodes are released
+    sim_port_unwire(node);
+
+    if(node->module) {
+        dlclose(node->module);
+        unlink(node->module_path);
+    }
+
+    free(node->stack);
+    free(node->ext);
+    free(node->usart_out);
+    free(node);
+}
+
+static void sim_node_entry(void) {
+    sim_node_t *node = sim_cur;
+
+    node->fw_main();
+
+    node->finished = 1;
+    sim_flush(node);
+    swapcontext(&node->ctx, &sim_main_ctx);
+}
+
+void sim_node_start(sim_node_t *node) {
+    if(!node->fw_main) {
+        sim_fail("%s has no fw_main", node->name);
+    }
+
+    node->stack = malloc(SIM_STACK_SIZE);
+    if(!node->stack) {
+        sim_fail("out of memory");
+    }
+
+    getcontext(&node->ctx);
+    node->ctx.uc_stack.ss_sp = node->stack;
+    node->ctx.uc_stack.ss_size = SIM_STACK_SIZE;
+    node->ctx.uc_link = 0;
+    makecontext(&node->ctx, sim_node_entry, 0);
+
+    node->started = 1;
+}
+
+void sim_node_select(sim_node_t *node) {
+    if(sim_cur) {
+        sim_flush(sim_cur);
+        sim_cur->direct = 0;
+    }
+
+    if(node && node->started) {
+        sim_fail("%s runs its own main(), it cannot be called directly", node->name);
+    }
+
+    sim_cur = node;
+    if(node) {
+        node->direct = 1;
+        node->horizon = SIM_NEVER;
+    }
+}
+
+sim_io_t *sim_node_io(sim_node_t *node) {
+    return node->io;
+}
+
+void *sim_node_symbol(sim_node_t *node, const char *symbol) {
+    return dlsym(node->module ? node->module : RTLD_DEFAULT, symbol);
+}
+
+const char *sim_node_name(const sim_node_t *node) {
+    return node->name;
+}
+
+sim_time_t sim_node_now(const sim_node_t *node) {
+    return node->now;
+}
+
+uint8_t sim_node_sleeping(const sim_node_t *node) {
+    return node->sleeping;
+}
+
+uint8_t sim_node_state(const sim_node_t *node) {
+    return node->state;
+}
+
+uint32_t sim_node_cpu_hz(const sim_node_t *node) {
+    return node->cpu_hz;
+}
+
+uint8_t sim_node_irq_enabled(const sim_node_t *node) {
+    return node->i_flag;
+}
+
+const sim_stats_t *sim_node_stats(sim_node_t *node) {
+    if(sim_cur == node) {
+        sim_flush(node);
+    }
+
+    return &node->stats;
+}
+
+void sim_node_stats_reset(sim_node_t *node) {
+    memset(&node->stats, 0, sizeof(node->stats));
+}
+
+// ========================================
+// Coordinator
+// ========================================
+static void sim_yield(sim_node_t *node) {
+    if(node->direct) {
+        return;
+    }
+
+    swapcontext(&node->ctx, &sim_main_ctx);
+    sim_cur = node;
+}
+
+// Time up to which a node has nothing to do
+static sim_time_t sim_ready_time(sim_node_t *node) {
+    if(node->sleeping && !sim_can_wake(node)) {
+        return sim_next_event(node, 0);
+    }
+
+    return node->now;
+}
+
+void sim_node_sync(sim_node_t *node, sim_time_t t) {
+    if(node == sim_cur) {
+        return;
+    }
+
+    sim_flush(node);
+
+    if(!node->sleeping) {
+        // Running behind by up to a quantum: only what the bus can see
+        if(node->timer[SIM_TMR_EXT] <= t) {
+            sim_ext_timer(node, t);
+        }
+        return;
+    }
+
+    while(!sim_can_wake(node)) {
+        sim_time_t next = sim_next_event(node, 0);
+
+        if(next > t) {
+            break;
+        }
+
+        if(next > node->now) {
+            sim_account_sleep(node, next - node->now);
+            node->now = next;
+        }
+        sim_process_events(node, node->now);
+    }
+}
+
+void sim_set_quantum(sim_time_t quantum) {
+    sim_quantum = quantum ? quantum : 1;
+}
+
+sim_time_t sim_time(void) {
+    return sim_global_time;
+}
+
+void sim_run_until(sim_time_t until) {
+    sim_node_t *direct = sim_cur;
+
+    if(direct) {
+        sim_flush(direct);
+    }
+
+    while(1) {
+        sim_node_t *next = 0;
+        sim_time_t next_ready = SIM_NEVER;
+
+        for(uint32_t i = 0; i < sim_node_count; i++) {
+            sim_node_t *node = sim_nodes[i];
+
+            if(!node->started || node->finished) {
+                continue;
+            }
+
+            sim_time_t ready = sim_ready_time(node);
+            if(ready < next_ready) {
+                next_ready = ready;
+                next = node;
+            }
+        }
+
+        if(!next || next_ready >= until) {
+            break;
+        }
+
+        // Run it until it gets a quantum ahead of the next one
+        sim_time_t horizon = until;
+        for(uint32_t i = 0; i < sim_node_count; i++) {
+            sim_node_t *node = sim_nodes[i];
+
+            if(node != next && node->started && !node->finished) {
+                sim_time_t ready = sim_ready_time(node);
+                if(ready != SIM_NEVER && ready + sim_quantum < horizon) {
+                    horizon = ready + sim_quantum;
+                }
+            }
+        }
+
+        next->horizon = horizon;
+        sim_cur = next;
+        swapcontext(&sim_main_ctx, &next->ctx);
+        sim_cur = 0;
+    }
+
+    // Sleeping nodes sleep on up to the end time
+    for(uint32_t i = 0; i < sim_node_count; i++) {
+        sim_node_t *node = sim_nodes[i];
+
+        if(node->started && !node->finished && node->sleeping && node->now < until) {
+            sim_node_sync(node, until);
+            if(node->now < until && !sim_can_wake(node)) {
+                sim_account_sleep(node, until - node->now);
+                node->now = until;
+            }
+        }
+    }
+
+    if(until > sim_global_time) {
+        sim_global_time = until;
+    }
+
+    sim_cur = direct;
+}
+
+void sim_run_for(sim_time_t duration) {
+    sim_run_until(sim_global_time + duration);
+}
+
+void sim_spin(sim_node_t *node, sim_time_t duration) {
+    sim_node_t *prev = sim_cur;
+
+    sim_node_select(node);
+    sim_busy(node, (duration + node->cpu_period - 1) / node->cpu_period);
+
+    if(node->now > sim_global_time) {
+        sim_global_time = node->now;
+    }
+
+    sim_node_select(prev);
+}
@@ -0,0 +1,27 @@
+#ifndef SIM_CPU_H
+#define SIM_CPU_H
+
+// CPU side of the simulator, called by the simulated avr-libc macros
+// (sei, cli, ATOMIC_BLOCK, sleep_cpu, _delay_*) inside firmware code
+
+#include <stdint.h>
+
+void sim_sei(void);
+void sim_cli(void);
+uint8_t sim_sreg_get(void);            // SREG, only the I bit is modelled
+void sim_sreg_restore(const uint8_t *sreg);
+uint8_t sim_cli_ret(void);             // cli(), returns 1 (ATOMIC_BLOCK)
+uint8_t sim_sei_ret(void);
+void sim_sei_cleanup(const uint8_t *unused);
+void sim_cli_cleanup(const uint8_t *unused);
+
+// SLEEP instruction: returns once an enabled interrupt has been served
+void sim_sleep_cpu(void);
+
+// Busy wait of CPU cycles at the current clock
+void sim_delay_cycles(uint32_t cycles);
+
+// State table index entered by the scheduler (per-state accounting)
+void sim_state_enter(uint8_t state);
+
+#endif // SIM_CPU_H
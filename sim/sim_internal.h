@@ -0,0 +1,222 @@
+#ifndef SIM_INTERNAL_H
+#define SIM_INTERNAL_H
+
+// Simulator internals shared by sim_core.c and the peripheral models
+
+#include <stddef.h>
+#include <stdint.h>
+#include <ucontext.h>
+#include "sim.h"
+
+#define SIM_PORTS 4  // A, C, D, F
+
+#define SIM_IO_OFF(member) offsetof(sim_io_t, member)
+#define SIM_IO_END(member) (offsetof(sim_io_t, member) + sizeof(((sim_io_t *)0)->member))
+
+// One pin change or SPI byte from another node or the test script
+typedef enum {
+    SIM_EXT_PIN,       // port, pin, level (-1 = released)
+    SIM_EXT_SPI_BYTE   // data shifted in from the SPI host
+} sim_ext_kind_t;
+
+typedef struct {
+    sim_time_t t;
+    uint8_t kind;
+    uint8_t port;
+    uint8_t pin;
+    int8_t level;
+    uint8_t data;
+} sim_ext_t;
+
+struct sim_node {
+    char name[32];
+    void *module;       // dlopen() handle, 0 for attached firmware
+    char module_path[256];
+    sim_io_t *io;
+    void (*vect[SIM_VECT_COUNT])(void);
+    int (*fw_main)(void);
+
+    // Coroutine
+    ucontext_t ctx;
+    void *stack;
+    uint8_t started;
+    uint8_t finished;
+    uint8_t direct;     // Called from the test (sim_node_select)
+    sim_time_t horizon; // Yield once past this time
+
+    // CPU
+    sim_time_t now;
+    uint32_t cpu_hz;
+    sim_time_t cpu_period;  // Time units per CPU cycle
+    uint8_t i_flag;
+    uint8_t in_isr;
+    uint8_t sleeping;
+    uint8_t sleep_mode;     // sim_sleep_t while sleeping
+    uint8_t state;          // Scheduler state (per-state accounting)
+
+    // Firmware access waiting for its side effect (applied by sim_flush)
+    uint8_t pend_write;
+    uint8_t pend_read;
+    uint32_t pend_off;
+    uint8_t pend_size;
+    uint8_t pend_old[16];
+
+    // Timers (SIM_NEVER = off), frozen ones keep the time left
+    sim_time_t timer[SIM_TMR_COUNT];
+    sim_time_t frozen_left[SIM_TMR_COUNT];
+    uint8_t frozen[SIM_TMR_COUNT];
+
+    // External events, sorted by time
+    sim_ext_t *ext;
+    uint32_t ext_count;
+    uint32_t ext_cap;
+
+    // PORT
+    int8_t pin_drive[SIM_PORTS][8];  // From outside, -1 = not driven
+    uint8_t pin_in[SIM_PORTS];       // IN as last computed
+    uint8_t pin_out[SIM_PORTS];      // Driven level (DIR and OUT) as last seen
+    uint8_t pin_dir[SIM_PORTS];
+
+    // SPI
+    uint8_t spi_busy;         // Host: byte shifting
+    uint8_t spi_shift_tx;
+    uint8_t spi_buf;          // TX buffer (DATA write)
+    uint8_t spi_buf_full;
+    uint8_t spi_fifo[2];      // RX FIFO
+    uint8_t spi_fifo_count;
+    uint8_t spi_last_rx;
+    uint8_t spi_shift;        // Client: next byte on MISO
+    uint8_t spi_shift_loaded;
+    uint8_t spi_ss;           // Client: last SS level
+
+    // USART
+    uint8_t usart_busy;
+    uint8_t usart_shift;
+    uint8_t usart_buf;
+    uint8_t usart_buf_full;
+    uint8_t usart_garbled;    // Clock changed during the frame
+    uint8_t usart_break;      // TX line held low with TXEN off
+    uint32_t usart_expect;
+    char *usart_out;
+    size_t usart_len;
+    size_t usart_cap;
+
+    // ADC
+    uint8_t adc_busy;
+    uint8_t adc_first;        // Next conversion pays INITDLY
+    sim_time_t adc_start;
+    sim_analog_fn_t analog_fn;
+    void *analog_ctx;
+    double analog_const[64];
+    double vdd;
+    uint16_t adc_log[SIM_ADC_LOG];
+    uint32_t adc_log_count;
+
+    // RTC: CNT = cnt_base + ticks since t_base (running), mod PER + 1
+    uint8_t rtc_running;
+    uint16_t rtc_cnt_base;
+    sim_time_t rtc_t_base;
+    sim_time_t rtc_cmp_t;     // Next compare match, SIM_NEVER = none
+    sim_time_t rtc_ovf_t;     // Next overflow
+
+    // CLKCTRL
+    uint8_t clk_sel;          // Running main clock source
+    uint8_t clk_target;       // Source being switched to
+
+    // NVM
+    uint8_t nvm_busy;
+    uint8_t nvm_erase;        // Busy with an erase (else a write)
+    uint16_t nvm_addr;
+    uint16_t nvm_count;       // Bytes of the operation
+    uint8_t nvm_data;
+
+    sim_stats_t stats;
+};
+
+extern sim_node_t *sim_cur;       // Node whose firmware is running
+extern sim_node_t *sim_nodes[];   // Every node, for the SPI bus and wires
+extern uint32_t sim_node_count;
+
+// ========================================
+// Core (sim_core.c)
+// ========================================
+void sim_timer_set(sim_node_t *node, sim_timer_t timer, sim_time_t t);
+void sim_timer_stop(sim_node_t *node, sim_timer_t timer);
+sim_time_t sim_timer_left(sim_node_t *node, sim_timer_t timer);  // SIM_NEVER if off
+
+void sim_ext_post(sim_node_t *node, const sim_ext_t *event);
+uint8_t sim_irq_pending(sim_node_t *node);
+
+// Bring a node's peripherals up to time t (sleeping nodes are advanced)
+void sim_node_sync(sim_node_t *node, sim_time_t t);
+
+// Main clock change, called by the CLKCTRL model
+void sim_cpu_clock(sim_node_t *node, uint32_t hz);
+
+void sim_account_adc(sim_node_t *node, sim_time_t duration);
+
+// ========================================
+// Peripheral models
+// ========================================
+void sim_port_reset(sim_node_t *node);
+void sim_port_write(sim_node_t *node, uint8_t port, uint32_t reg, const uint8_t *old);
+void sim_port_update(sim_node_t *node, uint8_t port, sim_time_t t);  // Recompute IN
+void sim_port_ext(sim_node_t *node, const sim_ext_t *event, sim_time_t t);
+uint8_t sim_port_irq(sim_node_t *node, uint8_t port);
+PORT_t *sim_port_regs(sim_node_t *node, uint8_t port);
+int sim_port_index(char port);
+void sim_port_unwire(sim_node_t *node);  // Drop every wire to or from the node
+
+void sim_evsys_write(sim_node_t *node, uint32_t reg, const uint8_t *old);
+void sim_evsys_generator(sim_node_t *node, uint8_t code, sim_time_t t);
+void sim_evsys_port(sim_node_t *node, uint8_t port, uint8_t pin, sim_time_t t);
+void sim_evsys_pulse(sim_node_t *node, uint8_t channel, sim_time_t t);
+void sim_tcb_write(sim_node_t *node, uint32_t reg, uint32_t size, const uint8_t *old);
+
+void sim_spi_reset(sim_node_t *node);
+void sim_spi_write(sim_node_t *node, uint32_t reg, const uint8_t *old);
+void sim_spi_read(sim_node_t *node, uint32_t reg);
+void sim_spi_read_done(sim_node_t *node, uint32_t reg);
+void sim_spi_timer(sim_node_t *node, sim_time_t t);
+void sim_spi_ext(sim_node_t *node, const sim_ext_t *event, sim_time_t t);
+void sim_spi_ss(sim_node_t *node, uint8_t level, sim_time_t t);
+uint8_t sim_spi_irq(sim_node_t *node);
+
+void sim_usart_reset(sim_node_t *node);
+void sim_usart_write(sim_node_t *node, uint32_t reg, uint32_t size, const uint8_t *old);
+void sim_usart_timer(sim_node_t *node, sim_time_t t);
+void sim_usart_clock(sim_node_t *node);
+void sim_usart_line(sim_node_t *node);
+uint8_t sim_usart_irq(sim_node_t *node, sim_vect_t vect);
+
+void sim_adc_reset(sim_node_t *node);
+void sim_adc_write(sim_node_t *node, uint32_t reg, uint32_t size, const uint8_t *old);
+void sim_adc_read_done(sim_node_t *node, uint32_t reg);
+void sim_adc_timer(sim_node_t *node, sim_time_t t);
+void sim_adc_event(sim_node_t *node, sim_time_t t);
+uint8_t sim_adc_runs_in(sim_node_t *node, uint8_t sleep_mode);
+uint8_t sim_adc_irq(sim_node_t *node, sim_vect_t vect);
+
+void sim_rtc_reset(sim_node_t *node);
+void sim_rtc_write(sim_node_t *node, uint32_t reg, uint32_t size, const uint8_t *old);
+void sim_rtc_read(sim_node_t *node, uint32_t reg);
+void sim_rtc_timer(sim_node_t *node, sim_time_t t);
+void sim_pit_timer(sim_node_t *node, sim_time_t t);
+void sim_pit_ev_timer(sim_node_t *node, sim_time_t t);
+void sim_pit_ev_update(sim_node_t *node, sim_time_t t);
+void sim_rtc_sleep(sim_node_t *node, sim_time_t t);
+void sim_rtc_wake(sim_node_t *node, sim_time_t t);
+uint8_t sim_rtc_irq(sim_node_t *node, sim_vect_t vect);
+
+void sim_clock_reset(sim_node_t *node);
+void sim_clock_write(sim_node_t *node, uint32_t reg, const uint8_t *old);
+void sim_clock_timer(sim_node_t *node, sim_time_t t);
+uint8_t sim_clock_oschf_main(sim_node_t *node);
+
+void sim_nvm_reset(sim_node_t *node);
+void sim_nvm_write(sim_node_t *node, uint32_t reg, uint32_t size, const uint8_t *old);
+void sim_nvm_eeprom_write(sim_node_t *node, uint32_t index, const uint8_t *old);
+void sim_nvm_timer(sim_node_t *node, sim_time_t t);
+uint8_t sim_nvm_irq(sim_node_t *node);
+
+#endif // SIM_INTERNAL_H
@@ -0,0 +1,184 @@
+// NVMCTRL EEPROM commands: erase and write times, wear per byte, and the
+// bytes a power loss leaves behind
+
+#include "sim_internal.h"
+
+#define NVM_REG_CTRLA    0x00
+#define NVM_REG_INTFLAGS 0x05
+#define NVM_REG_STATUS   0x06
+
+static sim_time_t erase_time = SIM_MS(10);
+static sim_time_t write_time = SIM_MS(4);
+static uint32_t rng_state = 1;
+
+void sim_nvm_set_times(sim_time_t erase, sim_time_t write) {
+    erase_time = erase;
+    write_time = write;
+}
+
+void sim_nvm_seed(uint32_t seed) {
+    rng_state = seed ? seed : 1;
+}
+
+static uint8_t sim_nvm_random(void) {
+    // xorshift32
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 17;
+    rng_state ^= rng_state << 5;
+    return (uint8_t)rng_state;
+}
+
+void sim_nvm_reset(sim_node_t *node) {
+    node->nvm_busy = 0;
+    node->io->nvmctrl.INTFLAGS = NVMCTRL_EEREADY_bm;
+}
+
+// First byte and size of the operation the command starts at index
+static uint16_t sim_nvm_block(uint8_t cmd, uint32_t index, uint16_t *first) {
+    uint16_t size = 1;
+
+    if(cmd >= NVMCTRL_CMD_EEMBER2_gc && cmd <= NVMCTRL_CMD_EEMBER32_gc) {
+        size = 2 << (cmd - NVMCTRL_CMD_EEMBER2_gc);
+    }
+
+    *first = (uint16_t)(index & ~(uint32_t)(size - 1));
+    return size;
+}
+
+void sim_nvm_eeprom_write(sim_node_t *node, uint32_t index, const uint8_t *old) {
+    NVMCTRL_t *nvm = &node->io->nvmctrl;
+    uint8_t cmd = nvm->CTRLA & NVMCTRL_CMD_gm;
+    uint8_t data = node->io->eeprom[index];
+
+    // The store only hands data to the controller
+    node->io->eeprom[index] = *old;
+
+    if(node->nvm_busy) {
+        node->stats.nvm_errors++;
+        return;
+    }
+
+    sim_time_t duration;
+    switch(cmd) {
+        case NVMCTRL_CMD_EEWR_gc:
+            node->nvm_erase = 0;
+            duration = write_time;
+            break;
+
+        case NVMCTRL_CMD_EEERWR_gc:
+            node->nvm_erase = 1;
+            duration = erase_time + write_time;
+            break;
+
+        case NVMCTRL_CMD_EEBER_gc:
+        case NVMCTRL_CMD_EEMBER2_gc:
+        case NVMCTRL_CMD_EEMBER4_gc:
+        case NVMCTRL_CMD_EEMBER8_gc:
+        case NVMCTRL_CMD_EEMBER16_gc:
+        case NVMCTRL_CMD_EEMBER32_gc:
+            node->nvm_erase = 1;
+            duration = erase_time;
+            break;
+
+        default:
+            // No EEPROM command loaded
+            node->stats.nvm_errors++;
+            return;
+    }
+
+    node->nvm_count = sim_nvm_block(cmd, index, &node->nvm_addr);
+    if(cmd == NVMCTRL_CMD_EEWR_gc || cmd == NVMCTRL_CMD_EEERWR_gc) {
+        node->nvm_addr = (uint16_t)index;
+        node->nvm_count = 1;
+    }
+    node->nvm_data = data;
+    node->nvm_busy = cmd;
+    nvm->STATUS |= NVMCTRL_EEBUSY_bm;
+    sim_timer_set(node, SIM_TMR_NVM, node->now + duration);
+}
+
+void sim_nvm_timer(sim_node_t *node, sim_time_t t) {
+    NVMCTRL_t *nvm = &node->io->nvmctrl;
+    volatile uint8_t *eeprom = node->io->eeprom;
+    uint8_t cmd = node->nvm_busy;
+    (void)t;
+
+    if(!cmd) {
+        return;
+    }
+
+    if(node->nvm_erase) {
+        node->stats.nvm_erases++;
+        for(uint16_t i = 0; i < node->nvm_count; i++) {
+            eeprom[node->nvm_addr + i] = 0xFF;
+            node->stats.eeprom_erases[node->nvm_addr + i]++;
+        }
+    }
+
+    if(cmd == NVMCTRL_CMD_EEWR_gc || cmd == NVMCTRL_CMD_EEERWR_gc) {
+        // Programming only clears bits
+        node->stats.nvm_writes++;
+        eeprom[node->nvm_addr] &= node->nvm_data;
+    }
+
+    node->nvm_busy = 0;
+    nvm->STATUS &= ~NVMCTRL_EEBUSY_bm;
+    nvm->INTFLAGS |= NVMCTRL_EEREADY_bm;
+}
+
+void sim_nvm_write(sim_node_t *node, uint32_t reg, uint32_t size, const uint8_t *old) {
+    NVMCTRL_t *nvm = &node->io->nvmctrl;
+
+    for(uint32_t i = 0; i < size; i++) {
+        switch(reg + i) {
+            case NVM_REG_INTFLAGS:
+                // EEREADY is set whenever the EEPROM is idle, clearing it
+                // only sticks while an operation runs
+                nvm->INTFLAGS = old[i] & ~nvm->INTFLAGS;
+                if(!node->nvm_busy) {
+                    nvm->INTFLAGS |= NVMCTRL_EEREADY_bm;
+                }
+                break;
+
+            case NVM_REG_STATUS:
+                nvm->STATUS = old[i];
+                break;
+
+            default:
+                break;
+        }
+    }
+}
+
+uint8_t sim_nvm_irq(sim_node_t *node) {
+    NVMCTRL_t *nvm = &node->io->nvmctrl;
+
+    return (nvm->INTFLAGS & nvm->INTCTRL & NVMCTRL_EEREADY_bm) != 0;
+}
+
+uint8_t sim_nvm_power_cut(sim_node_t *node) {
+    volatile uint8_t *eeprom = node->io->eeprom;
+
+    if(sim_cur == node) {
+        sim_node_select(0);
+    }
+
+    if(!node->nvm_busy) {
+        return 0;
+    }
+
+    // Cells of the interrupted operation are left half programmed
+    for(uint16_t i = 0; i < node->nvm_count; i++) {
+        uint8_t partial = sim_nvm_random();
+
+        if(node->nvm_erase) {
+            eeprom[node->nvm_addr + i] |= partial;
+        } else {
+            eeprom[node->nvm_addr + i] &= node->nvm_data | partial;
+        }
+    }
+
+    node->nvm_busy = 0;
+    sim_timer_stop(node, SIM_TMR_NVM);
+    return 1;
+}
@@ -0,0 +1,461 @@
+// PORT pins, wires between nodes, event system and TCB0 (event counter)
+
+#include <stdlib.h>
+#include <string.h>
+#include "sim_internal.h"
+
+#define SIM_MAX_WIRES 32
+
+#define PORT_REG_DIR      0x00
+#define PORT_REG_DIRSET   0x01
+#define PORT_REG_DIRCLR   0x02
+#define PORT_REG_DIRTGL   0x03
+#define PORT_REG_OUT      0x04
+#define PORT_REG_OUTSET   0x05
+#define PORT_REG_OUTCLR   0x06
+#define PORT_REG_OUTTGL   0x07
+#define PORT_REG_IN       0x08
+#define PORT_REG_INTFLAGS 0x09
+#define PORT_REG_PINCONFIG  0x0B
+#define PORT_REG_PINCTRLUPD 0x0C
+#define PORT_REG_PINCTRLSET 0x0D
+#define PORT_REG_PINCTRLCLR 0x0E
+#define PORT_REG_PIN0CTRL   0x10
+
+typedef struct {
+    sim_node_t *from;
+    uint8_t from_port;
+    uint8_t from_pin;
+    sim_node_t *to;
+    uint8_t to_port;
+    uint8_t to_pin;
+} sim_wire_t;
+
+static sim_wire_t wires[SIM_MAX_WIRES];
+static uint32_t wire_count = 0;
+
+static const char port_names[SIM_PORTS] = {'A', 'C', 'D', 'F'};
+
+int sim_port_index(char port) {
+    for(int i = 0; i < SIM_PORTS; i++) {
+        if(port_names[i] == port || port_names[i] == port - 'a' + 'A') {
+            return i;
+        }
+    }
+
+    return -1;
+}
+
+static uint8_t sim_port_checked(char port) {
+    int index = sim_port_index(port);
+
+    if(index < 0) {
+        sim_fail("PORT%c is not simulated", port);
+    }
+
+    return (uint8_t)index;
+}
+
+PORT_t *sim_port_regs(sim_node_t *node, uint8_t port) {
+    return &(&node->io->porta)[port];
+}
+
+// Level seen by the input buffer of one pin
+static uint8_t sim_pin_input(sim_node_t *node, uint8_t port, uint8_t pin) {
+    PORT_t *regs = sim_port_regs(node, port);
+    uint8_t ctrl = (&regs->PIN0CTRL)[pin];
+    uint8_t level;
+
+    if((ctrl & PORT_ISC_gm) == PORT_ISC_INPUT_DISABLE_gc) {
+        return 0;
+    }
+
+    if(regs->DIR & (1 << pin)) {
+        level = (regs->OUT >> pin) & 1;
+    } else if(node->pin_drive[port][pin] >= 0) {
+        level = (uint8_t)node->pin_drive[port][pin];
+    } else {
+        level = (ctrl & PORT_PULLUPEN_bm) ? 1 : 0;
+    }
+
+    if(ctrl & PORT_INVEN_bm) {
+        level ^= 1;
+    }
+
+    return level;
+}
+
+// Pins 2 and 6 are fully asynchronous, the others only see both-edges
+// and level changes without a peripheral clock
+static uint8_t sim_pin_sees_edge(sim_node_t *node, uint8_t pin) {
+    return !node->sleeping || node->sleep_mode == SIM_SLEEP_IDLE || pin == 2 || pin == 6;
+}
+
+void sim_port_update(sim_node_t *node, uint8_t port, sim_time_t t) {
+    PORT_t *regs = sim_port_regs(node, port);
+    uint8_t in = 0;
+
+    for(uint8_t pin = 0; pin < 8; pin++) {
+        in |= sim_pin_input(node, port, pin) << pin;
+    }
+
+    uint8_t changed = in ^ node->pin_in[port];
+    node->pin_in[port] = in;
+    regs->IN = in;
+
+    for(uint8_t pin = 0; pin < 8; pin++) {
+        uint8_t bm = 1 << pin;
+
+        if(!(changed & bm)) {
+            continue;
+        }
+
+        uint8_t rising = (in & bm) != 0;
+        uint8_t isc = (&regs->PIN0CTRL)[pin] & PORT_ISC_gm;
+
+        if(isc == PORT_ISC_BOTHEDGES_gc ||
+           (isc == PORT_ISC_RISING_gc && rising) ||
+           (isc == PORT_ISC_FALLING_gc && !rising)) {
+            if(isc == PORT_ISC_BOTHEDGES_gc || sim_pin_sees_edge(node, pin)) {
+                regs->INTFLAGS |= bm;
+            } else {
+                node->stats.port_missed_edges++;
+            }
+        }
+
+        if(rising) {
+            sim_evsys_port(node, port, pin, t);
+        }
+
+        // SPI client select is PA7
+        if(port == 0 && pin == 7) {
+            sim_spi_ss(node, rising, t);
+        }
+    }
+
+    // Output side: wires follow DIR and OUT
+    uint8_t dir = regs->DIR;
+    uint8_t out = regs->OUT;
+    uint8_t out_changed = (dir ^ node->pin_dir[port]) | ((out ^ node->pin_out[port]) & dir);
+
+    node->pin_dir[port] = dir;
+    node->pin_out[port] = out;
+
+    if(out_changed) {
+        for(uint32_t i = 0; i < wire_count; i++) {
+            sim_wire_t *wire = &wires[i];
+
+            if(wire->from != node || wire->from_port != port ||
+               !(out_changed & (1 << wire->from_pin))) {
+                continue;
+            }
+
+            sim_ext_t ev = {
+                .t = t,
+                .kind = SIM_EXT_PIN,
+                .port = wire->to_port,
+                .pin = wire->to_pin,
+                .level = (dir & (1 << wire->from_pin)) ?
+                         (int8_t)((out >> wire->from_pin) & 1) : SIM_PIN_RELEASE
+            };
+            sim_ext_post(wire->to, &ev);
+        }
+
+        // USART TX pin, a low line with the transmitter off is a break
+        if(port == 2 && (out_changed & PIN4_bm)) {
+            sim_usart_line(node);
+        }
+    }
+}
+
+void sim_port_reset(sim_node_t *node) {
+    for(uint8_t port = 0; port < SIM_PORTS; port++) {
+        for(uint8_t pin = 0; pin < 8; pin++) {
+            node->pin_drive[port][pin] = SIM_PIN_RELEASE;
+        }
+
+        node->pin_in[port] = 0;
+        node->pin_out[port] = 0;
+        node->pin_dir[port] = 0;
+        sim_port_regs(node, port)->IN = 0;
+    }
+}
+
+void sim_port_write(sim_node_t *node, uint8_t port, uint32_t reg, const uint8_t *old) {
+    PORT_t *regs = sim_port_regs(node, port);
+    volatile uint8_t *r = (volatile uint8_t *)regs;
+    uint8_t value = r[reg];
+
+    switch(reg) {
+        case PORT_REG_DIRSET: regs->DIR = *old | value; break;
+        case PORT_REG_DIRCLR: regs->DIR = *old & ~value; break;
+        case PORT_REG_DIRTGL: regs->DIR = *old ^ value; break;
+        case PORT_REG_OUTSET: regs->OUT = *old | value; break;
+        case PORT_REG_OUTCLR: regs->OUT = *old & ~value; break;
+        case PORT_REG_OUTTGL: regs->OUT = *old ^ value; break;
+
+        case PORT_REG_IN:
+            // Writing ones to IN toggles OUT
+            regs->IN = *old;
+            regs->OUT ^= value;
+            break;
+
+        case PORT_REG_INTFLAGS:
+            regs->INTFLAGS = *old & ~value;
+            break;
+
+        case PORT_REG_PINCTRLUPD:
+        case PORT_REG_PINCTRLSET:
+        case PORT_REG_PINCTRLCLR:
+            for(uint8_t pin = 0; pin < 8; pin++) {
+                if(!(value & (1 << pin))) {
+                    continue;
+                }
+
+                volatile uint8_t *ctrl = &regs->PIN0CTRL + pin;
+                if(reg == PORT_REG_PINCTRLUPD) {
+                    *ctrl = regs->PINCONFIG;
+                } else if(reg == PORT_REG_PINCTRLSET) {
+                    *ctrl |= regs->PINCONFIG;
+                } else {
+                    *ctrl &= ~regs->PINCONFIG;
+                }
+            }
+            r[reg] = 0;
+            break;
+
+        default:
+            break;
+    }
+
+    // Strobe registers read back DIR and OUT
+    regs->DIRSET = regs->DIRCLR = regs->DIRTGL = regs->DIR;
+    regs->OUTSET = regs->OUTCLR = regs->OUTTGL = regs->OUT;
+
+    sim_port_update(node, port, node->now);
+}
+
+void sim_port_ext(sim_node_t *node, const sim_ext_t *event, sim_time_t t) {
+    node->pin_drive[event->port][event->pin] = event->level;
+    sim_port_update(node, event->port, t);
+}
+
+uint8_t sim_port_irq(sim_node_t *node, uint8_t port) {
+    PORT_t *regs = sim_port_regs(node, port);
+
+    // Level interrupts stay pending while the pin is low
+    for(uint8_t pin = 0; pin < 8; pin++) {
+        if(((&regs->PIN0CTRL)[pin] & PORT_ISC_gm) == PORT_ISC_LEVEL_gc &&
+           !(node->pin_in[port] & (1 << pin))) {
+            regs->INTFLAGS |= 1 << pin;
+        }
+    }
+
+    return regs->INTFLAGS != 0;
+}
+
+// ========================================
+// Pins from the test and between nodes
+// ========================================
+void sim_pin_drive(sim_node_t *node, char port, uint8_t pin, int level, sim_time_t t) {
+    sim_ext_t ev = {
+        .t = t,
+        .kind = SIM_EXT_PIN,
+        .port = sim_port_checked(port),
+        .pin = pin & 0x07,
+        .level = (int8_t)(level < 0 ? SIM_PIN_RELEASE : (level ? 1 : 0))
+    };
+
+    sim_ext_post(node, &ev);
+}
+
+void sim_button_press(sim_node_t *node, char port, uint8_t pin, sim_time_t t, sim_time_t hold) {
+    sim_pin_drive(node, port, pin, 0, t);
+    sim_pin_drive(node, port, pin, SIM_PIN_RELEASE, t + hold);
+}
+
+uint8_t sim_pin_level(sim_node_t *node, char port, uint8_t pin) {
+    return (node->pin_in[sim_port_checked(port)] >> (pin & 0x07)) & 1;
+}
+
+uint8_t sim_pin_is_output(sim_node_t *node, char port, uint8_t pin) {
+    return (sim_port_regs(node, sim_port_checked(port))->DIR >> (pin & 0x07)) & 1;
+}
+
+void sim_wire(sim_node_t *from, char from_port, uint8_t from_pin,
+              sim_node_t *to, char to_port, uint8_t to_pin) {
+    if(wire_count >= SIM_MAX_WIRES) {
+        sim_fail("too many wires");
+    }
+
+    sim_wire_t *wire = &wires[wire_count++];
+    wire->from = from;
+    wire->from_port = sim_port_checked(from_port);
+    wire->from_pin = from_pin & 0x07;
+    wire->to = to;
+    wire->to_port = sim_port_checked(to_port);
+    wire->to_pin = to_pin & 0x07;
+
+    // Current level of the driving pin
+    uint8_t bm = 1 << wire->from_pin;
+    sim_pin_drive(to, to_port, to_pin,
+                  (from->pin_dir[wire->from_port] & bm) ?
+                  ((from->pin_out[wire->from_port] & bm) ? 1 : 0) : SIM_PIN_RELEASE,
+                  to->now);
+}
+
+void sim_port_unwire(sim_node_t *node) {
+    uint32_t kept = 0;
+
+    for(uint32_t i = 0; i < wire_count; i++) {
+        sim_wire_t *wire = &wires[i];
+
+        if(wire->to == node) {
+            continue;
+        }
+
+        if(wire->from == node) {
+            // Pin left floating on the other node
+            sim_ext_t ev = {
+                .t = wire->to->now,
+                .kind = SIM_EXT_PIN,
+                .port = wire->to_port,
+                .pin = wire->to_pin,
+                .level = SIM_PIN_RELEASE
+            };
+            sim_ext_post(wire->to, &ev);
+            continue;
+        }
+
+        wires[kept++] = *wire;
+    }
+
+    wire_count = kept;
+}
+
+// ========================================
+// Event system
+// ========================================
+#define EVSYS_REG_SWEVENTA 0x00
+#define EVSYS_REG_CHANNEL0 0x10
+#define EVSYS_REG_CHANNEL5 0x15
+
+static void sim_tcb_event(sim_node_t *node, sim_time_t t);
+
+void sim_evsys_pulse(sim_node_t *node, uint8_t channel, sim_time_t t) {
+    EVSYS_t *evsys = &node->io->evsys;
+    uint8_t user = channel + 1;
+
+    if(evsys->USERADC0START == user) {
+        node->stats.events++;
+        sim_adc_event(node, t);
+    }
+
+    if(evsys->USERTCB0COUNT == user) {
+        node->stats.events++;
+        sim_tcb_event(node, t);
+    }
+}
+
+void sim_evsys_generator(sim_node_t *node, uint8_t code, sim_time_t t) {
+    volatile uint8_t *channel = &node->io->evsys.CHANNEL0;
+
+    for(uint8_t ch = 0; ch < 6; ch++) {
+        if(channel[ch] == code) {
+            sim_evsys_pulse(node, ch, t);
+        }
+    }
+}
+
+void sim_evsys_port(sim_node_t *node, uint8_t port, uint8_t pin, sim_time_t t) {
+    volatile uint8_t *channel = &node->io->evsys.CHANNEL0;
+
+    // Port generators: A on channels 0/1, C and D on 2/3, F on 4/5
+    static const uint8_t first_channel[SIM_PORTS] = {0, 2, 2, 4};
+    static const uint8_t base[SIM_PORTS] = {0x40, 0x40, 0x48, 0x48};
+    uint8_t code = base[port] + pin;
+
+    for(uint8_t ch = first_channel[port]; ch < first_channel[port] + 2; ch++) {
+        if(channel[ch] == code) {
+            sim_evsys_pulse(node, ch, t);
+        }
+    }
+}
+
+void sim_evsys_write(sim_node_t *node, uint32_t reg, const uint8_t *old) {
+    EVSYS_t *evsys = &node->io->evsys;
+
+    if(reg == EVSYS_REG_SWEVENTA) {
+        // Strobe: one pulse per bit, reads back 0
+        uint8_t strobe = evsys->SWEVENTA;
+        evsys->SWEVENTA = 0;
+
+        for(uint8_t ch = 0; ch < 6; ch++) {
+            if(strobe & (1 << ch)) {
+                sim_evsys_pulse(node, ch, node->now);
+            }
+        }
+        return;
+    }
+
+    // New PIT prescaler taps
+    if(reg >= EVSYS_REG_CHANNEL0 && reg <= EVSYS_REG_CHANNEL5) {
+        (void)old;
+        sim_pit_ev_update(node, node->now);
+    }
+}
+
+// ========================================
+// TCB0, periodic interrupt mode counting events
+// ========================================
+#define TCB_REG_CTRLA    0x00
+#define TCB_REG_CTRLB    0x01
+#define TCB_REG_INTFLAGS 0x06
+
+static void sim_tcb_event(sim_node_t *node, sim_time_t t) {
+    TCB_t *tcb = &node->io->tcb0;
+
+    if(!(tcb->CTRLA & TCB_ENABLE_bm)) {
+        return;
+    }
+
+    // No peripheral clock in POWERDOWN, in STANDBY only with RUNSTDBY
+    if(node->sleeping && (node->sleep_mode == SIM_SLEEP_POWERDOWN ||
+       (node->sleep_mode == SIM_SLEEP_STANDBY && !(tcb->CTRLA & TCB_RUNSTDBY_bm)))) {
+        node->stats.tcb_missed++;
+        return;
+    }
+
+    if(tcb->CNT >= tcb->CCMP) {
+        tcb->CNT = 0;
+        tcb->INTFLAGS |= TCB_CAPT_bm;
+        node->stats.tcb_captures++;
+        sim_evsys_generator(node, EVSYS_CHANNEL_TCB0_CAPT_gc, t);
+    } else {
+        tcb->CNT++;
+    }
+}
+
+void sim_tcb_write(sim_node_t *node, uint32_t reg, uint32_t size, const uint8_t *old) {
+    TCB_t *tcb = &node->io->tcb0;
+
+    for(uint32_t i = 0; i < size; i++) {
+        switch(reg + i) {
+            case TCB_REG_INTFLAGS:
+                tcb->INTFLAGS = old[i] & ~tcb->INTFLAGS;
+                break;
+
+            case TCB_REG_CTRLA:
+            case TCB_REG_CTRLB:
+                if((tcb->CTRLA & TCB_ENABLE_bm) &&
+                   ((tcb->CTRLA & TCB_CLKSEL_gm) != TCB_CLKSEL_EVENT_gc ||
+                    (tcb->CTRLB & TCB_CNTMODE_gm) != TCB_CNTMODE_INT_gc)) {
+                    sim_fail("TCB0: only event clocked periodic interrupt mode is simulated");
+                }
+                break;
+
+            default:
+                break;
+        }
+    }
+}
@@ -0,0 +1,65 @@
+// Supply current model: charge and energy of an account
+
+#include "sim_internal.h"
+
+const sim_power_model_t sim_power_default = {
+    .active_ua = {
+        [SIM_CLK_32K]   = 12.0,
+        [SIM_CLK_1M]    = 330.0,
+        [SIM_CLK_4M]    = 1300.0,
+        [SIM_CLK_OTHER] = 1300.0
+    },
+    .idle_ua = {
+        [SIM_CLK_32K]   = 5.0,
+        [SIM_CLK_1M]    = 150.0,
+        [SIM_CLK_4M]    = 550.0,
+        [SIM_CLK_OTHER] = 550.0
+    },
+    .standby_ua = 2.0,
+    .powerdown_ua = 1.5,
+    .adc_ua = 160.0,
+    .vdd = 3.3
+};
+
+static double sim_seconds(sim_time_t t) {
+    return (double)t / (double)SIM_TIME_HZ;
+}
+
+double sim_charge_uc(const sim_acct_t *acct, const sim_power_model_t *model) {
+    double uc = 0.0;
+
+    for(int clk = 0; clk < SIM_CLK_COUNT; clk++) {
+        uc += model->active_ua[clk] * sim_seconds(acct->active[clk]);
+        uc += model->idle_ua[clk] * sim_seconds(acct->idle[clk]);
+    }
+
+    uc += model->standby_ua * sim_seconds(acct->sleep[SIM_SLEEP_STANDBY]);
+    uc += model->powerdown_ua * sim_seconds(acct->sleep[SIM_SLEEP_POWERDOWN]);
+    uc += model->adc_ua * sim_seconds(acct->adc_busy);
+
+    return uc;
+}
+
+double sim_energy_uj(const sim_acct_t *acct, const sim_power_model_t *model) {
+    return sim_charge_uc(acct, model) * model->vdd;
+}
+
+sim_time_t sim_acct_active(const sim_acct_t *acct) {
+    sim_time_t t = 0;
+
+    for(int clk = 0; clk < SIM_CLK_COUNT; clk++) {
+        t += acct->active[clk];
+    }
+
+    return t;
+}
+
+sim_time_t sim_acct_time(const sim_acct_t *acct) {
+    sim_time_t t = sim_acct_active(acct);
+
+    for(int mode = 0; mode < SIM_SLEEP_COUNT; mode++) {
+        t += acct->sleep[mode];
+    }
+
+    return t;
+}
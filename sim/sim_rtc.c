@@ -0,0 +1,291 @@
+// RTC counter (compare, overflow), PIT and the PIT prescaler event taps
+
+#include "sim_internal.h"
+
+#define RTC_REG_CTRLA       0x00
+#define RTC_REG_STATUS      0x01
+#define RTC_REG_INTFLAGS    0x03
+#define RTC_REG_CNT         0x08
+#define RTC_REG_PER         0x0A
+#define RTC_REG_CMP         0x0C
+#define RTC_REG_PITCTRLA    0x10
+#define RTC_REG_PITSTATUS   0x11
+#define RTC_REG_PITINTFLAGS 0x13
+
+// One cycle of the RTC clock source
+static sim_time_t sim_rtc_clk(sim_node_t *node) {
+    switch(node->io->rtc.CLKSEL & RTC_CLKSEL_gm) {
+        case RTC_CLKSEL_OSC32K_gc: return SIM_RTC_TICK;
+        case RTC_CLKSEL_OSC1K_gc:  return SIM_RTC_TICK * 32;
+        default:
+            sim_fail("RTC: only OSC32K and OSC1K are simulated");
+    }
+}
+
+static sim_time_t sim_rtc_tick(sim_node_t *node) {
+    return sim_rtc_clk(node) << ((node->io->rtc.CTRLA & RTC_PRESCALER_gm) >> 3);
+}
+
+// Counter stopped in POWERDOWN, and in STANDBY without RUNSTDBY
+static uint8_t sim_rtc_counts(sim_node_t *node) {
+    RTC_t *rtc = &node->io->rtc;
+
+    if(!(rtc->CTRLA & RTC_RTCEN_bm)) {
+        return 0;
+    }
+
+    if(node->sleeping && (node->sleep_mode == SIM_SLEEP_POWERDOWN ||
+       (node->sleep_mode == SIM_SLEEP_STANDBY && !(rtc->CTRLA & RTC_RUNSTDBY_bm)))) {
+        return 0;
+    }
+
+    return 1;
+}
+
+static uint16_t sim_rtc_cnt(sim_node_t *node, sim_time_t t) {
+    uint32_t top = (uint32_t)node->io->rtc.PER + 1;
+
+    if(!node->rtc_running || t < node->rtc_t_base) {
+        return node->rtc_cnt_base;
+    }
+
+    uint64_t ticks = (t - node->rtc_t_base) / sim_rtc_tick(node);
+    return (uint16_t)((node->rtc_cnt_base + ticks) % top);
+}
+
+// Freeze the count at t, counting restarts from there if running
+static void sim_rtc_rebase(sim_node_t *node, sim_time_t t) {
+    node->rtc_cnt_base = sim_rtc_cnt(node, t);
+    node->rtc_t_base = t;
+}
+
+// Next compare and overflow times from the count at t
+static void sim_rtc_schedule(sim_node_t *node, sim_time_t t) {
+    RTC_t *rtc = &node->io->rtc;
+
+    node->rtc_cmp_t = SIM_NEVER;
+    node->rtc_ovf_t = SIM_NEVER;
+
+    if(!node->rtc_running) {
+        sim_timer_stop(node, SIM_TMR_RTC);
+        return;
+    }
+
+    sim_time_t tick = sim_rtc_tick(node);
+    uint64_t ticks = (t - node->rtc_t_base) / tick;
+    uint32_t top = (uint32_t)rtc->PER + 1;
+    uint32_t cnt = (uint32_t)((node->rtc_cnt_base + ticks) % top);
+    sim_time_t next_tick = node->rtc_t_base + (ticks + 1) * tick;
+
+    // CNT becomes CMP, and PER wraps to 0
+    if(rtc->CMP <= rtc->PER) {
+        uint32_t to_cmp = (rtc->CMP + top - cnt - 1) % top;
+        node->rtc_cmp_t = next_tick + to_cmp * tick;
+    }
+    node->rtc_ovf_t = next_tick + (top - cnt - 1) * tick;
+
+    sim_timer_set(node, SIM_TMR_RTC,
+                  node->rtc_cmp_t < node->rtc_ovf_t ? node->rtc_cmp_t : node->rtc_ovf_t);
+}
+
+static void sim_rtc_restart(sim_node_t *node, sim_time_t t) {
+    sim_rtc_rebase(node, t);
+    node->rtc_running = sim_rtc_counts(node);
+    sim_rtc_schedule(node, t);
+}
+
+void sim_rtc_reset(sim_node_t *node) {
+    node->io->rtc.PER = 0xFFFF;
+    node->rtc_running = 0;
+    node->rtc_cnt_base = 0;
+    node->rtc_t_base = 0;
+    node->rtc_cmp_t = SIM_NEVER;
+    node->rtc_ovf_t = SIM_NEVER;
+}
+
+void sim_rtc_timer(sim_node_t *node, sim_time_t t) {
+    RTC_t *rtc = &node->io->rtc;
+
+    if(t == node->rtc_cmp_t) {
+        rtc->INTFLAGS |= RTC_CMP_bm;
+        sim_evsys_generator(node, EVSYS_CHANNEL_RTC_CMP_gc, t);
+    }
+
+    if(t == node->rtc_ovf_t) {
+        rtc->INTFLAGS |= RTC_OVF_bm;
+        sim_evsys_generator(node, EVSYS_CHANNEL_RTC_OVF_gc, t);
+    }
+
+    sim_rtc_schedule(node, t);
+}
+
+void sim_rtc_sleep(sim_node_t *node, sim_time_t t) {
+    if(node->rtc_running && !sim_rtc_counts(node)) {
+        sim_rtc_rebase(node, t);
+        node->rtc_running = 0;
+        sim_rtc_schedule(node, t);
+    }
+}
+
+void sim_rtc_wake(sim_node_t *node, sim_time_t t) {
+    if(!node->rtc_running && sim_rtc_counts(node)) {
+        sim_rtc_restart(node, t);
+    }
+}
+
+// ========================================
+// PIT
+// ========================================
+static void sim_pit_schedule(sim_node_t *node, sim_time_t t) {
+    RTC_t *rtc = &node->io->rtc;
+    uint8_t period = (rtc->PITCTRLA & RTC_PERIOD_gm) >> 3;
+
+    if(!(rtc->PITCTRLA & RTC_PITEN_bm) || period == 0 || period > 14) {
+        sim_timer_stop(node, SIM_TMR_PIT);
+        return;
+    }
+
+    // 2^(PERIOD + 1) cycles, on the free running prescaler
+    sim_time_t interval = sim_rtc_clk(node) << (period + 1);
+    sim_timer_set(node, SIM_TMR_PIT, (t / interval + 1) * interval);
+}
+
+void sim_pit_timer(sim_node_t *node, sim_time_t t) {
+    node->io->rtc.PITINTFLAGS |= RTC_PI_bm;
+    sim_pit_schedule(node, t);
+}
+
+// Prescaler taps: DIV8192..DIV1024 on even, DIV512..DIV64 on odd channels
+static sim_time_t sim_pit_ev_interval(sim_node_t *node, uint8_t channel) {
+    uint8_t code = (&node->io->evsys.CHANNEL0)[channel];
+    RTC_t *rtc = &node->io->rtc;
+
+    if(code < EVSYS_CHANNEL0_RTC_PIT_DIV8192_gc || code > EVSYS_CHANNEL0_RTC_PIT_DIV1024_gc) {
+        return 0;
+    }
+
+    // Prescaler runs while the RTC or the PIT is enabled
+    if(!(rtc->CTRLA & RTC_RTCEN_bm) && !(rtc->PITCTRLA & RTC_PITEN_bm)) {
+        return 0;
+    }
+
+    uint32_t div = ((channel & 1) ? 512U : 8192U) >> (code - EVSYS_CHANNEL0_RTC_PIT_DIV8192_gc);
+    return SIM_RTC_TICK * div;
+}
+
+void sim_pit_ev_update(sim_node_t *node, sim_time_t t) {
+    sim_time_t next = SIM_NEVER;
+
+    for(uint8_t ch = 0; ch < 6; ch++) {
+        sim_time_t interval = sim_pit_ev_interval(node, ch);
+
+        if(interval) {
+            sim_time_t at = (t / interval + 1) * interval;
+            if(at < next) {
+                next = at;
+            }
+        }
+    }
+
+    if(next == SIM_NEVER) {
+        sim_timer_stop(node, SIM_TMR_PIT_EV);
+    } else {
+        sim_timer_set(node, SIM_TMR_PIT_EV, next);
+    }
+}
+
+void sim_pit_ev_timer(sim_node_t *node, sim_time_t t) {
+    for(uint8_t ch = 0; ch < 6; ch++) {
+        sim_time_t interval = sim_pit_ev_interval(node, ch);
+
+        if(interval && t % interval == 0) {
+            sim_evsys_pulse(node, ch, t);
+        }
+    }
+
+    sim_pit_ev_update(node, t);
+}
+
+// ========================================
+// Registers
+// ========================================
+void sim_rtc_write(sim_node_t *node, uint32_t reg, uint32_t size, const uint8_t *old) {
+    RTC_t *rtc = &node->io->rtc;
+    volatile uint8_t *r = (volatile uint8_t *)rtc;
+    uint8_t counter = 0;
+    uint8_t pit = 0;
+
+    for(uint32_t i = 0; i < size; i++) {
+        switch(reg + i) {
+            case RTC_REG_STATUS:
+            case RTC_REG_PITSTATUS:
+                // Writes are synchronised at once, never busy
+                r[reg + i] = 0;
+                break;
+
+            case RTC_REG_INTFLAGS:
+                rtc->INTFLAGS = old[i] & ~rtc->INTFLAGS;
+                break;
+
+            case RTC_REG_PITINTFLAGS:
+                rtc->PITINTFLAGS = old[i] & ~rtc->PITINTFLAGS;
+                break;
+
+            case RTC_REG_CTRLA:
+                counter = 1;
+                pit = 1;
+                break;
+
+            case RTC_REG_CNT:
+            case RTC_REG_CNT + 1:
+                // New count from now
+                node->rtc_cnt_base = rtc->CNT;
+                node->rtc_t_base = node->now;
+                counter = 1;
+                break;
+
+            case RTC_REG_PER:
+            case RTC_REG_PER + 1:
+            case RTC_REG_CMP:
+            case RTC_REG_CMP + 1:
+                counter = 1;
+                break;
+
+            case RTC_REG_PITCTRLA:
+                pit = 1;
+                break;
+
+            default:
+                break;
+        }
+    }
+
+    if(counter) {
+        if(reg > RTC_REG_CNT + 1 || reg + size <= RTC_REG_CNT) {
+            sim_rtc_rebase(node, node->now);
+        }
+        node->rtc_running = sim_rtc_counts(node);
+        sim_rtc_schedule(node, node->now);
+    }
+
+    if(pit) {
+        sim_pit_schedule(node, node->now);
+        sim_pit_ev_update(node, node->now);
+    }
+}
+
+void sim_rtc_read(sim_node_t *node, uint32_t reg) {
+    if(reg == RTC_REG_CNT || reg == RTC_REG_CNT + 1) {
+        node->io->rtc.CNT = sim_rtc_cnt(node, node->now);
+    }
+}
+
+uint8_t sim_rtc_irq(sim_node_t *node, sim_vect_t vect) {
+    RTC_t *rtc = &node->io->rtc;
+
+    if(vect == SIM_VECT_RTC_PIT) {
+        return (rtc->PITINTFLAGS & rtc->PITINTCTRL & RTC_PI_bm) != 0;
+    }
+
+    return (rtc->INTFLAGS & rtc->INTCTRL & (RTC_OVF_bm | RTC_CMP_bm)) != 0;
+}
@@ -0,0 +1,240 @@
+// Command line runner: HOST and CLIENT firmware modules on one simulated
+// bus, driven by button presses and analog steps from the command line
+// or a script, prints each CLIENT's USART output and a power summary
+//
+//   sim_run --host host_fw.so --client client_fw.so [--clients N]
+//           [--cs <port><pin>,...] [--time ms] [--button ms]...
+//           [--analog volts] [--script file]
+//
+// Script lines, times in ms from power-on ('#' starts a comment):
+//   <ms> button down|up|press
+//   <ms> analog <volts>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "sim.h"
+
+#define MAX_CLIENTS 4
+#define MAX_STEPS   256
+
+// Analog input of the HOST sensor (AIN8), piecewise constant
+typedef struct {
+    sim_time_t t[MAX_STEPS];
+    double volts[MAX_STEPS];
+    uint32_t count;
+} analog_steps_t;
+
+static analog_steps_t analog = {{0}, {1.65}, 1};
+
+static double analog_input(sim_node_t *node, uint8_t ain, sim_time_t t, void *ctx) {
+    const analog_steps_t *steps = ctx;
+    double volts = 0.0;
+    (void)node;
+
+    if(ain != 8) {
+        return 0.0;
+    }
+
+    for(uint32_t i = 0; i < steps->count && steps->t[i] <= t; i++) {
+        volts = steps->volts[i];
+    }
+
+    return volts;
+}
+
+static void analog_step(double ms, double volts) {
+    if(analog.count >= MAX_STEPS) {
+        sim_fail("too many analog steps");
+    }
+
+    // Kept sorted, a step at the same time replaces the earlier one
+    sim_time_t t = (sim_time_t)(ms * 512000.0);
+    uint32_t i = analog.count;
+    while(i > 0 && analog.t[i - 1] > t) {
+        analog.t[i] = analog.t[i - 1];
+        analog.volts[i] = analog.volts[i - 1];
+        i--;
+    }
+    analog.t[i] = t;
+    analog.volts[i] = volts;
+    analog.count++;
+}
+
+static void run_script(const char *path, sim_node_t *host) {
+    FILE *f = fopen(path, "r");
+    char line[256];
+    unsigned line_no = 0;
+
+    if(!f) {
+        sim_fail("cannot open %s", path);
+    }
+
+    while(fgets(line, sizeof(line), f)) {
+        char what[32] = "";
+        char arg[32] = "";
+        double ms;
+
+        line_no++;
+        char *comment = strchr(line, '#');
+        if(comment) {
+            *comment = '\0';
+        }
+
+        int fields = sscanf(line, "%lf %31s %31s", &ms, what, arg);
+        if(fields <= 0) {
+            continue;
+        }
+
+        sim_time_t t = (sim_time_t)(ms * 512000.0);
+
+        if(fields == 3 && !strcmp(what, "button")) {
+            if(!strcmp(arg, "down")) {
+                sim_pin_drive(host, 'F', 6, 0, t);
+            } else if(!strcmp(arg, "up")) {
+                sim_pin_drive(host, 'F', 6, SIM_PIN_RELEASE, t);
+            } else if(!strcmp(arg, "press")) {
+                sim_button_press(host, 'F', 6, t, SIM_MS(50));
+            } else {
+                sim_fail("%s:%u: button down, up or press", path, line_no);
+            }
+        } else if(fields == 3 && !strcmp(what, "analog")) {
+            analog_step(ms, atof(arg));
+        } else {
+            sim_fail("%s:%u: unknown line", path, line_no);
+        }
+    }
+
+    fclose(f);
+}
+
+static void print_summary(sim_node_t *node, sim_time_t duration) {
+    const sim_stats_t *stats = sim_node_stats(node);
+    const sim_acct_t *total = &stats->total;
+    double charge = sim_charge_uc(total, &sim_power_default);
+    double seconds = (double)duration / SIM_TIME_HZ;
+
+    printf("%-8s active %9.3f ms  idle %9.3f ms  standby %9.3f ms  powerdown %9.3f ms\n",
+           sim_node_name(node),
+           sim_acct_active(total) / 512000.0,
+           total->sleep[SIM_SLEEP_IDLE] / 512000.0,
+           total->sleep[SIM_SLEEP_STANDBY] / 512000.0,
+           total->sleep[SIM_SLEEP_POWERDOWN] / 512000.0);
+    printf("%-8s wakes %u  cycles %llu  charge %.3f uC  average %.3f uA  energy %.3f uJ\n",
+           "", stats->wakes, (unsigned long long)total->cycles, charge,
+           seconds > 0 ? charge / seconds : 0.0,
+           sim_energy_uj(total, &sim_power_default));
+}
+
+int main(int argc, char **argv) {
+    const char *host_path = 0;
+    const char *client_path = 0;
+    const char *script = 0;
+    const char *cs = "A7";
+    unsigned clients = 1;
+    double time_ms = 2000;
+    double buttons[64];
+    unsigned button_count = 0;
+
+    for(int i = 1; i < argc; i++) {
+        const char *opt = argv[i];
+        const char *val = i + 1 < argc ? argv[i + 1] : 0;
+
+        if(!val) {
+            sim_fail("%s needs a value", opt);
+        }
+        i++;
+
+        if(!strcmp(opt, "--host")) {
+            host_path = val;
+        } else if(!strcmp(opt, "--client")) {
+            client_path = val;
+        } else if(!strcmp(opt, "--clients")) {
+            clients = (unsigned)atoi(val);
+        } else if(!strcmp(opt, "--cs")) {
+            cs = val;
+        } else if(!strcmp(opt, "--time")) {
+            time_ms = atof(val);
+        } else if(!strcmp(opt, "--button")) {
+            if(button_count < sizeof(buttons) / sizeof(buttons[0])) {
+                buttons[button_count++] = atof(val);
+            }
+        } else if(!strcmp(opt, "--analog")) {
+            analog.volts[0] = atof(val);
+        } else if(!strcmp(opt, "--script")) {
+            script = val;
+        } else {
+            sim_fail("unknown option %s", opt);
+        }
+    }
+
+    if(!host_path || (clients && !client_path) || clients > MAX_CLIENTS) {
+        fprintf(stderr, "usage: sim_run --host <module> --client <module> [--clients 1..%d]\n"
+                        "               [--cs A7,...] [--time ms] [--button ms]...\n"
+                        "               [--analog volts] [--script file]\n", MAX_CLIENTS);
+        return 2;
+    }
+
+    sim_node_t *host = sim_node_load(host_path, "host");
+    sim_node_t *client[MAX_CLIENTS];
+
+    // Client i is selected by the i-th HOST pin of --cs, on its PA7
+    const char *pin = cs;
+    for(unsigned i = 0; i < clients; i++) {
+        char name[16];
+
+        if(!pin[0] || !pin[1]) {
+            sim_fail("--cs lists fewer pins than --clients");
+        }
+
+        snprintf(name, sizeof(name), "client%u", i);
+        client[i] = sim_node_load(client_path, name);
+        sim_wire(host, pin[0], (uint8_t)(pin[1] - '0'), client[i], 'A', 7);
+
+        pin += 2;
+        if(*pin == ',') {
+            pin++;
+        }
+    }
+
+    for(unsigned i = 0; i < button_count; i++) {
+        sim_button_press(host, 'F', 6, (sim_time_t)(buttons[i] * 512000.0), SIM_MS(50));
+    }
+
+    if(script) {
+        run_script(script, host);
+    }
+
+    sim_analog_set(host, analog_input, &analog);
+
+    sim_node_start(host);
+    for(unsigned i = 0; i < clients; i++) {
+        sim_node_start(client[i]);
+    }
+
+    sim_time_t end = (sim_time_t)(time_ms * 512000.0);
+    sim_run_until(end);
+
+    for(unsigned i = 0; i < clients; i++) {
+        printf("==== %s USART ====\n%s\n", sim_node_name(client[i]),
+               sim_usart_output(client[i], 0));
+    }
+
+    const char *host_out = sim_usart_output(host, 0);
+    if(host_out[0]) {
+        printf("==== host USART ====\n%s\n", host_out);
+    }
+
+    printf("==== power (%.1f ms) ====\n", time_ms);
+    print_summary(host, end);
+    for(unsigned i = 0; i < clients; i++) {
+        print_summary(client[i], end);
+    }
+
+    for(unsigned i = 0; i < clients; i++) {
+        sim_node_free(client[i]);
+    }
+    sim_node_free(host);
+
+    return 0;
+}
@@ -0,0 +1,15 @@
+// scheduler.c for the simulator: state entries are also reported to the
+// simulator for per-state time and energy accounting
+
+#include "trace.h"
+#include "sim_cpu.h"
+
+#undef TRACE_STATE
+
+#if TRACE_ENABLE
+#define TRACE_STATE(state) do { sim_state_enter((uint8_t)(state)); trace_record((uint8_t)(state)); } while(0)
+#else
+#define TRACE_STATE(state) sim_state_enter((uint8_t)(state))
+#endif
+
+#include "../scheduler.c"
@@ -0,0 +1,298 @@
+// SPI0: host shifts bytes on its own timer, clients receive them as
+// external events. MISO is sampled from the other nodes at byte start.
+
+#include "sim_internal.h"
+
+#define SPI_REG_CTRLA    0x00
+#define SPI_REG_CTRLB    0x01
+#define SPI_REG_INTCTRL  0x02
+#define SPI_REG_INTFLAGS 0x03
+#define SPI_REG_DATA     0x04
+
+#define SPI_MISO_PIN PIN5_bm
+#define SPI_SS_PIN   PIN7_bm
+
+static uint8_t sim_spi_enabled(sim_node_t *node) {
+    return (node->io->spi0.CTRLA & SPI_ENABLE_bm) != 0;
+}
+
+static uint8_t sim_spi_host(sim_node_t *node) {
+    return (node->io->spi0.CTRLA & (SPI_MASTER_bm | SPI_ENABLE_bm)) ==
+           (SPI_MASTER_bm | SPI_ENABLE_bm);
+}
+
+static uint8_t sim_spi_client(sim_node_t *node) {
+    return (node->io->spi0.CTRLA & (SPI_MASTER_bm | SPI_ENABLE_bm)) == SPI_ENABLE_bm;
+}
+
+// Empty buffers and FIFO, as after enabling
+static void sim_spi_flush(sim_node_t *node) {
+    SPI_t *spi = &node->io->spi0;
+
+    node->spi_busy = 0;
+    node->spi_buf_full = 0;
+    node->spi_fifo_count = 0;
+    node->spi_shift_loaded = 0;
+    sim_timer_stop(node, SIM_TMR_SPI);
+
+    spi->INTFLAGS = (spi->CTRLB & SPI_BUFEN_bm) ? SPI_DREIF_bm : 0;
+}
+
+void sim_spi_reset(sim_node_t *node) {
+    node->spi_ss = 1;
+    node->spi_last_rx = 0;
+    sim_spi_flush(node);
+    node->io->spi0.INTFLAGS = 0;
+}
+
+static void sim_spi_fifo_push(sim_node_t *node, uint8_t data) {
+    SPI_t *spi = &node->io->spi0;
+
+    if(node->spi_fifo_count >= 2) {
+        // Received byte lost, the older ones are kept
+        spi->INTFLAGS |= SPI_BUFOVF_bm;
+        node->stats.spi_overflows++;
+    } else {
+        node->spi_fifo[node->spi_fifo_count++] = data;
+    }
+
+    spi->INTFLAGS |= SPI_RXCIF_bm;
+}
+
+// SCK period in CPU cycles
+static uint32_t sim_spi_sck_cycles(sim_node_t *node) {
+    static const uint8_t presc[4] = {4, 16, 64, 128};
+    uint8_t ctrla = node->io->spi0.CTRLA;
+    uint32_t cycles = presc[(ctrla & SPI_PRESC_gm) >> 1];
+
+    return (ctrla & SPI_CLK2X_bm) ? cycles / 2 : cycles;
+}
+
+// Byte a client presents on MISO at the start of a host byte
+static uint8_t sim_spi_client_out(sim_node_t *node) {
+    if(!node->spi_shift_loaded && node->spi_buf_full) {
+        node->spi_shift = node->spi_buf;
+        node->spi_shift_loaded = 1;
+        node->spi_buf_full = 0;
+        node->io->spi0.INTFLAGS |= SPI_DREIF_bm;
+    }
+
+    // Nothing written: the last received byte goes back out
+    return node->spi_shift_loaded ? node->spi_shift : node->spi_last_rx;
+}
+
+static void sim_spi_host_start(sim_node_t *node, uint8_t data, sim_time_t t0) {
+    sim_time_t t1 = t0 + (sim_time_t)sim_spi_sck_cycles(node) * 8 * node->cpu_period;
+    uint8_t miso = 0xFF;
+    uint8_t drivers = 0;
+
+    node->spi_busy = 1;
+    node->spi_shift_tx = data;
+
+    for(uint32_t i = 0; i < sim_node_count; i++) {
+        sim_node_t *other = sim_nodes[i];
+
+        if(other == node) {
+            continue;
+        }
+
+        sim_node_sync(other, t0);
+
+        PORT_t *porta = &other->io->porta;
+        uint8_t selected = !(other->pin_in[0] & SPI_SS_PIN);
+        uint8_t value;
+
+        if(sim_spi_client(other) && selected) {
+            // MOSI byte reaches the client at the end of the byte
+            sim_ext_t ev = {
+                .t = t1,
+                .kind = SIM_EXT_SPI_BYTE,
+                .data = data
+            };
+            sim_ext_post(other, &ev);
+
+            if(!(porta->DIR & SPI_MISO_PIN)) {
+                continue;
+            }
+            value = sim_spi_client_out(other);
+        } else if(porta->DIR & SPI_MISO_PIN) {
+            // Output left on while not selected: fights the selected client
+            value = (porta->OUT & SPI_MISO_PIN) ? 0xFF : 0x00;
+            other->stats.miso_driven_unselected++;
+        } else {
+            continue;
+        }
+
+        miso = drivers ? (miso & value) : value;
+        drivers++;
+    }
+
+    if(drivers > 1) {
+        node->stats.miso_contention++;
+    }
+
+    node->spi_shift = miso;
+    sim_timer_set(node, SIM_TMR_SPI, t1);
+}
+
+void sim_spi_timer(sim_node_t *node, sim_time_t t) {
+    SPI_t *spi = &node->io->spi0;
+
+    if(!node->spi_busy) {
+        return;
+    }
+
+    node->stats.spi_bytes++;
+    sim_spi_fifo_push(node, node->spi_shift);
+
+    if(!(spi->CTRLB & SPI_BUFEN_bm)) {
+        node->spi_busy = 0;
+        return;
+    }
+
+    if(node->spi_buf_full) {
+        node->spi_buf_full = 0;
+        spi->INTFLAGS |= SPI_DREIF_bm;
+        sim_spi_host_start(node, node->spi_buf, t);
+    } else {
+        node->spi_busy = 0;
+        spi->INTFLAGS |= SPI_TXCIF_bm;
+    }
+}
+
+// Byte from the host shifted in completely
+void sim_spi_ext(sim_node_t *node, const sim_ext_t *event, sim_time_t t) {
+    SPI_t *spi = &node->io->spi0;
+    (void)t;
+
+    if(!sim_spi_client(node) || node->spi_ss) {
+        return;
+    }
+
+    node->spi_shift_loaded = 0;
+
+    // Clocked by SCK, but the peripheral logic needs CLK_PER
+    if(node->sleeping && node->sleep_mode != SIM_SLEEP_IDLE) {
+        node->stats.spi_rx_lost++;
+        return;
+    }
+
+    node->stats.spi_rx_bytes++;
+    node->spi_last_rx = event->data;
+    sim_spi_fifo_push(node, event->data);
+
+    if(node->spi_buf_full) {
+        node->spi_shift = node->spi_buf;
+        node->spi_shift_loaded = 1;
+        node->spi_buf_full = 0;
+        spi->INTFLAGS |= SPI_DREIF_bm;
+    } else {
+        spi->INTFLAGS |= SPI_TXCIF_bm;
+    }
+}
+
+void sim_spi_inject(sim_node_t *node, uint8_t data, sim_time_t t) {
+    sim_ext_t ev = {
+        .t = t,
+        .kind = SIM_EXT_SPI_BYTE,
+        .data = data
+    };
+
+    sim_ext_post(node, &ev);
+}
+
+void sim_spi_ss(sim_node_t *node, uint8_t level, sim_time_t t) {
+    SPI_t *spi = &node->io->spi0;
+    (void)t;
+
+    if(level == node->spi_ss) {
+        return;
+    }
+    node->spi_ss = level;
+
+    // Released: transaction over
+    if(level && sim_spi_client(node) && (spi->CTRLB & SPI_BUFEN_bm)) {
+        spi->INTFLAGS |= SPI_SSIF_bm;
+    }
+}
+
+void sim_spi_write(sim_node_t *node, uint32_t reg, const uint8_t *old) {
+    SPI_t *spi = &node->io->spi0;
+
+    switch(reg) {
+        case SPI_REG_CTRLA:
+            if((spi->CTRLA ^ *old) & SPI_ENABLE_bm) {
+                sim_spi_flush(node);
+                node->spi_ss = (node->pin_in[0] & SPI_SS_PIN) ? 1 : 0;
+            }
+            break;
+
+        case SPI_REG_INTFLAGS:
+            if(spi->CTRLB & SPI_BUFEN_bm) {
+                spi->INTFLAGS = *old & ~(spi->INTFLAGS & (SPI_TXCIF_bm | SPI_SSIF_bm | SPI_BUFOVF_bm));
+            } else {
+                spi->INTFLAGS = *old;
+            }
+            break;
+
+        case SPI_REG_DATA: {
+            uint8_t data = spi->DATA;
+            spi->DATA = *old;
+
+            if(!sim_spi_enabled(node)) {
+                break;
+            }
+
+            if(sim_spi_host(node) && !node->spi_busy) {
+                sim_spi_host_start(node, data, node->now);
+            } else if(!sim_spi_host(node) && (spi->CTRLB & SPI_BUFWR_bm) &&
+                      node->spi_ss && !node->spi_shift_loaded) {
+                // Client not selected: first byte straight to the shift register
+                node->spi_shift = data;
+                node->spi_shift_loaded = 1;
+            } else if(!node->spi_buf_full) {
+                node->spi_buf = data;
+                node->spi_buf_full = 1;
+                spi->INTFLAGS &= ~SPI_DREIF_bm;
+            } else {
+                node->spi_buf = data;
+                node->stats.spi_tx_overwrites++;
+            }
+            break;
+        }
+
+        default:
+            break;
+    }
+}
+
+void sim_spi_read(sim_node_t *node, uint32_t reg) {
+    if(reg == SPI_REG_DATA) {
+        node->io->spi0.DATA = node->spi_fifo_count ? node->spi_fifo[0] : node->spi_last_rx;
+    }
+}
+
+void sim_spi_read_done(sim_node_t *node, uint32_t reg) {
+    SPI_t *spi = &node->io->spi0;
+
+    if(reg != SPI_REG_DATA || !node->spi_fifo_count) {
+        return;
+    }
+
+    node->spi_fifo[0] = node->spi_fifo[1];
+    node->spi_fifo_count--;
+
+    if(!node->spi_fifo_count) {
+        spi->INTFLAGS &= ~SPI_RXCIF_bm;
+    }
+}
+
+uint8_t sim_spi_irq(sim_node_t *node) {
+    SPI_t *spi = &node->io->spi0;
+
+    if(spi->CTRLB & SPI_BUFEN_bm) {
+        return (spi->INTFLAGS & spi->INTCTRL & 0xF0) != 0;
+    }
+
+    return (spi->INTFLAGS & SPI_IF_bm) && (spi->INTCTRL & SPI_IE_bm);
+}
@@ -0,0 +1,186 @@
+// USART0 transmitter: frame timing from BAUD and the CPU clock, the
+// characters are captured per node as the terminal would see them
+
+#include <stdlib.h>
+#include <string.h>
+#include "sim_internal.h"
+
+#define USART_REG_TXDATAL 0x02
+#define USART_REG_STATUS  0x04
+#define USART_REG_CTRLB   0x06
+
+// Largest rate error a terminal still decodes (in 0.01 %)
+#define SIM_USART_MAX_ERROR 200
+
+static void sim_usart_append(sim_node_t *node, char c) {
+    if(node->usart_len + 2 > node->usart_cap) {
+        node->usart_cap = node->usart_cap ? node->usart_cap * 2 : 256;
+        node->usart_out = realloc(node->usart_out, node->usart_cap);
+        if(!node->usart_out) {
+            sim_fail("out of memory");
+        }
+    }
+
+    node->usart_out[node->usart_len++] = c;
+    node->usart_out[node->usart_len] = '\0';
+}
+
+void sim_usart_reset(sim_node_t *node) {
+    node->usart_busy = 0;
+    node->usart_buf_full = 0;
+    node->usart_garbled = 0;
+    node->usart_break = 0;
+    node->io->usart0.STATUS = USART_DREIF_bm;
+}
+
+// Frame rate off the terminal's, or clock changed while shifting
+static uint8_t sim_usart_rate_bad(sim_node_t *node) {
+    uint16_t baud = node->io->usart0.BAUD;
+
+    if(node->usart_garbled) {
+        return 1;
+    }
+
+    if(!node->usart_expect || !baud) {
+        return 0;
+    }
+
+    // f_baud = 4 * f_clk / BAUD
+    int64_t actual = (4LL * node->cpu_hz * 10000LL) / baud;
+    int64_t error = actual / node->usart_expect - 10000LL;
+
+    return error > SIM_USART_MAX_ERROR || error < -SIM_USART_MAX_ERROR;
+}
+
+static void sim_usart_start(sim_node_t *node, uint8_t data, sim_time_t t) {
+    USART_t *usart = &node->io->usart0;
+    uint8_t ctrlc = usart->CTRLC;
+    uint32_t bits = 1 + 5 + ((ctrlc & USART_CHSIZE_gm) > 3 ? 3 : (ctrlc & USART_CHSIZE_gm));
+
+    if(((ctrlc & USART_PMODE_gm) >> USART_PMODE_gp) >= 2) {
+        bits++;
+    }
+    bits += (ctrlc & USART_SBMODE_bm) ? 2 : 1;
+
+    // Bit time = BAUD / (4 * f_clk)
+    uint16_t baud = usart->BAUD ? usart->BAUD : 1;
+    sim_time_t frame = ((sim_time_t)baud * node->cpu_period * bits + 2) / 4;
+
+    node->usart_busy = 1;
+    node->usart_shift = data;
+    node->usart_garbled = 0;
+    sim_timer_set(node, SIM_TMR_USART, t + frame);
+}
+
+void sim_usart_timer(sim_node_t *node, sim_time_t t) {
+    USART_t *usart = &node->io->usart0;
+
+    if(!node->usart_busy) {
+        return;
+    }
+
+    node->stats.usart_bytes++;
+    if(sim_usart_rate_bad(node)) {
+        node->stats.usart_bad_rate++;
+        sim_usart_append(node, '?');
+    } else {
+        sim_usart_append(node, (char)node->usart_shift);
+    }
+
+    if(node->usart_buf_full) {
+        node->usart_buf_full = 0;
+        usart->STATUS |= USART_DREIF_bm;
+        sim_usart_start(node, node->usart_buf, t);
+    } else {
+        node->usart_busy = 0;
+        usart->STATUS |= USART_TXCIF_bm;
+    }
+}
+
+void sim_usart_clock(sim_node_t *node) {
+    // The frame being shifted changes rate half way
+    if(node->usart_busy) {
+        node->usart_garbled = 1;
+    }
+}
+
+void sim_usart_line(sim_node_t *node) {
+    USART_t *usart = &node->io->usart0;
+    PORT_t *portd = &node->io->portd;
+    uint8_t brk = !(usart->CTRLB & USART_TXEN_bm) &&
+                  (portd->DIR & PIN4_bm) && !(portd->OUT & PIN4_bm);
+
+    if(brk && !node->usart_break) {
+        node->stats.usart_breaks++;
+    }
+    node->usart_break = brk;
+}
+
+void sim_usart_write(sim_node_t *node, uint32_t reg, uint32_t size, const uint8_t *old) {
+    USART_t *usart = &node->io->usart0;
+
+    for(uint32_t i = 0; i < size; i++) {
+        switch(reg + i) {
+            case USART_REG_TXDATAL: {
+                uint8_t data = usart->TXDATAL;
+
+                if(!(usart->CTRLB & USART_TXEN_bm)) {
+                    node->stats.usart_tx_off_writes++;
+                } else if(!node->usart_busy) {
+                    sim_usart_start(node, data, node->now);
+                } else {
+                    // Waits in the buffer, a byte already there is replaced
+                    node->usart_buf = data;
+                    node->usart_buf_full = 1;
+                    usart->STATUS &= ~USART_DREIF_bm;
+                }
+                break;
+            }
+
+            case USART_REG_STATUS:
+                usart->STATUS = old[i] & ~(usart->STATUS & (USART_TXCIF_bm | USART_RXSIF_bm | USART_ISFIF_bm));
+                break;
+
+            case USART_REG_CTRLB:
+                sim_usart_line(node);
+                break;
+
+            default:
+                break;
+        }
+    }
+}
+
+uint8_t sim_usart_irq(sim_node_t *node, sim_vect_t vect) {
+    USART_t *usart = &node->io->usart0;
+
+    switch(vect) {
+        case SIM_VECT_USART0_RXC:
+            return (usart->STATUS & USART_RXCIF_bm) && (usart->CTRLA & USART_RXCIE_bm);
+        case SIM_VECT_USART0_DRE:
+            return (usart->STATUS & USART_DREIF_bm) && (usart->CTRLA & USART_DREIE_bm);
+        case SIM_VECT_USART0_TXC:
+            return (usart->STATUS & USART_TXCIF_bm) && (usart->CTRLA & USART_TXCIE_bm);
+        default:
+            return 0;
+    }
+}
+
+const char *sim_usart_output(sim_node_t *node, size_t *len) {
+    if(len) {
+        *len = node->usart_len;
+    }
+
+    return node->usart_out ? node->usart_out : "";
+}
+
+void sim_usart_clear(sim_node_t *node) {
+    node->usart_len = 0;
+    if(node->usart_out) {
+        node->usart_out[0] = '\0';
+    }
+}
+
+void sim_usart_expect_baud(sim_node_t *node, uint32_t baud) {
+    node->usart_expect = baud;
+}
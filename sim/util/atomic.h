@@ -0,0 +1,24 @@
+#ifndef SIM_UTIL_ATOMIC_H
+#define SIM_UTIL_ATOMIC_H
+
+// Simulated <util/atomic.h>, same structure as the avr-libc macros
+
+#include "../sim_cpu.h"
+
+#define ATOMIC_BLOCK(type) \
+    for(type, sim_atomic_todo = sim_cli_ret(); sim_atomic_todo; sim_atomic_todo = 0)
+
+#define NONATOMIC_BLOCK(type) \
+    for(type, sim_atomic_todo = sim_sei_ret(); sim_atomic_todo; sim_atomic_todo = 0)
+
+#define ATOMIC_RESTORESTATE \
+    uint8_t sim_sreg_save __attribute__((__cleanup__(sim_sreg_restore))) = sim_sreg_get()
+
+#define ATOMIC_FORCEON \
+    uint8_t sim_sreg_save __attribute__((__cleanup__(sim_sei_cleanup))) = 0
+
+#define NONATOMIC_RESTORESTATE ATOMIC_RESTORESTATE
+#define NONATOMIC_FORCEOFF \
+    uint8_t sim_sreg_save __attribute__((__cleanup__(sim_cli_cleanup))) = 0
+
+#endif // SIM_UTIL_ATOMIC_H
@@ -0,0 +1,16 @@
+#ifndef SIM_UTIL_DELAY_H
+#define SIM_UTIL_DELAY_H
+
+// Simulated <util/delay.h>: busy waits of F_CPU cycles
+
+#include <stdint.h>
+#include "../sim_cpu.h"
+
+#ifndef F_CPU
+#define F_CPU 4000000UL
+#endif
+
+#define _delay_us(us) sim_delay_cycles((uint32_t)((double)(us) * (F_CPU / 1e6)))
+#define _delay_ms(ms) sim_delay_cycles((uint32_t)((double)(ms) * (F_CPU / 1e3)))
+
+#endif // SIM_UTIL_DELAY_H
@@ -1,160 +1,696 @@
-#define F_CPU 32768UL  // 32.768 KHz for most of the time
-
 #include <avr/io.h>
 #include <avr/interrupt.h>
-#include <util/delay.h>
+#include <util/atomic.h>
+#include <string.h>
 #include <stdint.h>
-#include <stdio.h>
-
-// Include custom libraries
 #include "main_clock_control.h"
-#include "ports.h"
-#include "sleep.h"
 #include "spi0.h"
-#include "usart0_tx.h"
-
-// SPI Configuration
-#define NUM_SPI_BYTES 2  // Number of bytes to receive
-
-// External SPI data array (defined in spi0.c)
-extern uint8_t spi_data[NUM_SPI_BYTES];
-
-// State Machine Type Definition
-typedef enum {
-    STATE_INIT,
-    STATE_SLEEP,
-    STATE_SWITCH_TO_HIGHSPEED_CLOCK,
-    STATE_RECEIVE_SPI,
-    STATE_SWITCH_TO_LOWPOWER_CLOCK,
-    STATE_WRITE_TO_USART
-} app_states_t;
-
-// Application data structure
-typedef struct {
-    app_states_t state;
-} app_data_t;
-
-int main(void) {
-    // Create state machine instance
-    app_data_t app_data;
-    app_data.state = STATE_INIT;
-    
-    // Main state machine loop
-    while(1) {
-        switch(app_data.state) {
-            
-            case STATE_INIT:
-                // Initialize ports
-                port_init();
-                
-                // Setup low power 32.768 KHz clock
-                low_power_clock_control(
-                    0x01,  // Internal 32.768 KHz oscillator
-                    0,     // Prescaler enable = 0
-                    0x00,  // Prescaler divider (ignored)
-                    0,     // Run standby = 0
-                    0      // Clock out = 0
-                );
-                
-                // Initialize USART (1200 baud)
-                usart_init(
-                    0x00,  // Async mode
-                    0x00,  // No parity
-                    0x00,  // 1 stop bit
-                    0x00,  // 8 data bits
-                    1200   // Baud rate
-                );
-                
-                // Initialize SPI as client
-                spi_client_init();
-                
-                // Initialize sleep controller (power down mode)
-                sleep_init(0x04, 0x01);  // Power down + sleep enable
-                
-                // Enable global interrupts
-                sei();
-                
-                // Move to sleep state
-                app_data.state = STATE_SLEEP;
-                break;
-                
-            case STATE_SLEEP:
-                // Put CPU to sleep
-                __asm__ __volatile__("sleep");
-                
-                // Wake on SPI client select (PA7 pin change interrupt)
-                if(get_client_select_flag_status()) {
-                    clear_client_select_flag();
-                    app_data.state = STATE_SWITCH_TO_HIGHSPEED_CLOCK;
-                }
-                break;
-                
-            case STATE_SWITCH_TO_HIGHSPEED_CLOCK:
-                // Switch to 4 MHz for faster processing
-                main_clock_control(
-                    0x00,  // OSCHF (high freq internal oscillator)
-                    0x02,  // 4 MHz
-                    0,     // Prescaler disabled
-                    0x00,  // Prescaler div (ignored)
-                    0      // Clock out disabled
-                );
-                
-                // Wait for oscillator to stabilize
-                while(!(CLKCTRL.MCLKSTATUS & CLKCTRL_OSCHFS_bm));
-                
-                app_data.state = STATE_RECEIVE_SPI;
-                break;
-                
-            case STATE_RECEIVE_SPI:
-                // Wait for packet to be complete (received in ISR)
-                while(!get_packet_complete_status());
-                
-                // Clear packet complete flag
-                clear_packet_complete_status();
-                
-                app_data.state = STATE_SWITCH_TO_LOWPOWER_CLOCK;
-                break;
-                
-            case STATE_SWITCH_TO_LOWPOWER_CLOCK:
-                // Switch back to 32.768 KHz for low power
-                low_power_clock_control(
-                    0x01,  // Internal 32.768 KHz
-                    0,     // Prescaler disabled
-                    0x00,  // Prescaler div (ignored)
-                    0,     // Run standby disabled
-                    0      // Clock out disabled
-                );
-                
-                // Wait for oscillator to stabilize
-                while(!(CLKCTRL.MCLKSTATUS & CLKCTRL_OSC32KS_bm));
-                
-                app_data.state = STATE_WRITE_TO_USART;
-                break;
-                
-            case STATE_WRITE_TO_USART:
-                // Print raw SPI bytes
-                printf("SPI Byte[1]: 0x%02X\r\n", spi_data[1]);
-                printf("SPI Byte[0]: 0x%02X\r\n", spi_data[0]);
-                
-                // Reconstruct 16-bit result
-                uint16_t results = ((uint16_t)spi_data[1] << 8) | spi_data[0];
-                printf("Results: 0x%04X\r\n", results);
-                
-                // Extract window comparison (bit 15)
-                uint8_t window_result = (results >> 15) & 0x01;
-                printf("Window: %u\r\n", window_result);
-                
-                // Extract ADC result (bits 0-11)
-                uint16_t adc_result = results & 0x0FFF;
-                printf("ADC: %u\r\n\r\n", adc_result);
-                
-                // Delay to ensure print completes
-                _delay_ms(100);
-                
-                app_data.state = STATE_SLEEP;
-                break;
+#include "spi_frame.h"
+#include "rtc.h"
+#include "scheduler.h"
+#include "sleep.h"
+
+// Busy waits run at the SPI clock
+#define F_CPU CLOCK_4MHZ_HZ
+#include <util/delay.h>
+
+// SPI pins (default route): PA4 = MOSI, PA5 = MISO, PA6 = SCK, PA7 = SS
+
+// ========================================
+// HOST DEVICE
+// ========================================
+#ifdef HOST_DEVICE
+
+// Default client table: one client on PA7 (SPI0 SS pin)
+static const spi_client_cs_t default_clients[] = {
+    {&PORTA, PIN7_bm}
+};
+
+// Chip select per client address
+static const spi_client_cs_t *clients = default_clients;
+static uint8_t client_count = 1;
+
+// CTRLA prescaler bits per spi_rate_t
+static const uint8_t rate_ctrla[SPI_RATE_COUNT] = {
+    [SPI_RATE_DIV128] = SPI_PRESC_DIV128_gc,
+    [SPI_RATE_DIV64]  = SPI_PRESC_DIV64_gc,
+    [SPI_RATE_DIV32]  = SPI_PRESC_DIV64_gc | SPI_CLK2X_bm,
+    [SPI_RATE_DIV16]  = SPI_PRESC_DIV16_gc,
+    [SPI_RATE_DIV8]   = SPI_PRESC_DIV16_gc | SPI_CLK2X_bm,
+    [SPI_RATE_DIV4]   = SPI_PRESC_DIV4_gc,
+    [SPI_RATE_DIV2]   = SPI_PRESC_DIV4_gc | SPI_CLK2X_bm
+};
+
+static spi_rate_t host_rate = SPI_HOST_RATE;
+
+// Training payload: all bit levels, alternating and walking bits
+static const uint8_t train_pattern[SPI_FRAME_MAX_PAYLOAD] = {
+    0x00, 0xFF, 0xAA, 0x55, 0x01, 0x02, 0x04, 0x08,
+    0x10, 0x20, 0x40, 0x80, 0xFE, 0xFD, 0xF0, 0x0F
+};
+
+// Interrupt driven transfer state (rx_ptr = 0 discards received bytes)
+static const uint8_t *tx_ptr = 0;
+static volatile uint16_t tx_remaining = 0;
+static uint8_t *rx_ptr = 0;
+static volatile uint16_t rx_remaining = 0;
+static volatile uint8_t tx_complete_flag = 1;
+static spi_tx_done_cb_t tx_done_cb = 0;
+
+void spi_host_set_clients(const spi_client_cs_t *table, uint8_t count) {
+    clients = table;
+    client_count = count;
+    
+    // Chip selects high right away so sleeping clients are not woken
+    for(uint8_t i = 0; i < client_count; i++) {
+        clients[i].port->OUTSET = clients[i].pin_bm;
+        clients[i].port->DIRSET = clients[i].pin_bm;
+    }
+}
+
+uint8_t spi_get_client_count(void) {
+    return client_count;
+}
+
+void spi_host_init(void) {
+    // Keep chip selects high before making them outputs (no false wake)
+    for(uint8_t i = 0; i < client_count; i++) {
+        clients[i].port->OUTSET = clients[i].pin_bm;
+        clients[i].port->DIRSET = clients[i].pin_bm;
+    }
+    
+    // MOSI, SCK as outputs, MISO as input
+    PORTA.DIRSET = PIN4_bm | PIN6_bm;
+    PORTA.DIRCLR = PIN5_bm;
+    
+    // Re-enable digital input on MISO (disabled in spi_disable_pins)
+    PORTA.PIN5CTRL = PORT_ISC_INTDISABLE_gc;
+    
+    // SS driven by software, buffered mode (DRE/TXC interrupts), mode 0
+    SPI0.CTRLB = SPI_BUFEN_bm | SPI_SSD_bm | SPI_MODE_0_gc;
+    SPI0.INTCTRL = 0;
+    tx_remaining = 0;
+    tx_complete_flag = 1;
+    
+    // Host mode, MSB first, SCK from the selected rate
+    SPI0.CTRLA = SPI_MASTER_bm | rate_ctrla[host_rate] | SPI_ENABLE_bm;
+}
+
+void spi_host_set_rate(spi_rate_t rate) {
+    host_rate = rate;
+    
+    // Takes effect at once if enabled (no transfer may be running)
+    if(SPI0.CTRLA & SPI_ENABLE_bm) {
+        SPI0.CTRLA = SPI_MASTER_bm | rate_ctrla[host_rate] | SPI_ENABLE_bm;
+    }
+}
+
+spi_rate_t spi_host_get_rate(void) {
+    return host_rate;
+}
+
+void spi_select_client(uint8_t client) {
+    clients[client].port->OUTCLR = clients[client].pin_bm;
+}
+
+void spi_deselect_client(uint8_t client) {
+    clients[client].port->OUTSET = clients[client].pin_bm;
+}
+
+uint8_t spi_transfer_async(const uint8_t *tx, uint8_t *rx, uint16_t size,
+                           spi_tx_done_cb_t done_cb) {
+    // One transfer at a time
+    if(!tx_complete_flag) {
+        return 0;
+    }
+    
+    // Drop bytes left in the receive buffer by earlier transfers
+    while(SPI0.INTFLAGS & SPI_RXCIF_bm) {
+        (void)SPI0.DATA;
+    }
+    
+    // Nothing to send: complete straight away
+    if(size == 0) {
+        if(done_cb) {
+            done_cb();
         }
+        return 1;
     }
     
+    tx_ptr = tx;
+    tx_remaining = size;
+    rx_ptr = rx;
+    rx_remaining = rx ? size : 0;
+    tx_done_cb = done_cb;
+    tx_complete_flag = 0;
+    
+    // SPI0 runs from the peripheral clock, stopped in STANDBY
+    power_vote(POWER_VOTER_SPI, SLEEP_LEVEL_IDLE);
+    
+    // DRE ISR feeds the buffer, TXC ISR signals the end
+    SPI0.INTFLAGS = SPI_TXCIF_bm;
+    SPI0.INTCTRL = SPI_DREIE_bm;
+    
+    return 1;
+}
+
+uint8_t spi0_write_block_async(const uint8_t *data, uint16_t size,
+                               spi_tx_done_cb_t done_cb) {
+    return spi_transfer_async(data, 0, size, done_cb);
+}
+
+uint8_t get_spi_tx_complete_status(void) {
+    return tx_complete_flag;
+}
+
+uint8_t spi_transfer(const uint8_t *tx, uint8_t *rx, uint16_t size) {
+    // An async transfer is still running, nothing was sent
+    if(!spi_transfer_async(tx, rx, size, 0)) {
+        return 0;
+    }
+    
+    // Sleep (IDLE by the SPI vote) while the ISR shifts the bytes out
+    cli();
+    while(!tx_complete_flag) {
+        power_idle();
+        cli();
+    }
+    sei();
+    
+    return 1;
+}
+
+uint8_t spi0_write_block(const uint8_t *data, uint16_t size) {
+    return spi_transfer(data, 0, size);
+}
+
+uint8_t spi0_exchange_byte(uint8_t data) {
+    // Drop bytes left in the receive buffer by earlier transmits
+    while(SPI0.INTFLAGS & SPI_RXCIF_bm) {
+        (void)SPI0.DATA;
+    }
+    
+    SPI0.DATA = data;
+    
+    // Wait for the byte clocked in from the client
+    while(!(SPI0.INTFLAGS & SPI_RXCIF_bm));
+    
+    return SPI0.DATA;
+}
+
+uint8_t spi_wait_client_ready(uint8_t max_polls) {
+    for(uint8_t i = 0; i < max_polls; i++) {
+        // Poll first, an already woken client answers at once
+        if(spi0_exchange_byte(SPI_POLL_BYTE) == SPI_READY_BYTE) {
+            return 1;
+        }
+        
+        // Give the client time to wake, sleeping instead of spinning
+        delay_sleep_us(SPI_READY_POLL_US, SLEEP_LEVEL_STANDBY);
+    }
+    
+    // Client did not answer within the poll budget
     return 0;
 }
+
+// Select one client, wait for its ready byte and send the frame,
+// re-selecting if it does not answer within the poll budget
+static uint8_t spi_deliver_frame(uint8_t client, const uint8_t *data, uint16_t size,
+                                 uint8_t *response) {
+    uint8_t delivered = 0;
+    
+    // The ready polls would corrupt a running async transfer
+    if(!tx_complete_flag) {
+        return 0;
+    }
+    
+    for(uint8_t attempt = 0; attempt < SPI_SELECT_RETRIES && !delivered; attempt++) {
+        spi_select_client(client);
+        
+        if(spi_wait_client_ready(SPI_READY_MAX_POLLS)) {
+            delivered = spi_transfer(data, response, size);
+            
+            // Bus taken by an async transfer started meanwhile (ISR
+            // callback), selecting again would not help
+            if(!delivered) {
+                spi_deselect_client(client);
+                return 0;
+            }
+        }
+        
+        spi_deselect_client(client);
+    }
+    
+    return delivered;
+}
+
+uint8_t spi_send_frame_to(uint8_t client, const uint8_t *data, uint16_t size,
+                          uint8_t *response) {
+    if(client != SPI_BROADCAST) {
+        if(client >= client_count) {
+            return 0;
+        }
+        
+        return spi_deliver_frame(client, data, size, response);
+    }
+    
+    // Wake every client with one pulse on all chip selects, so their
+    // clock start-ups overlap instead of being paid once per client
+    if(client_count > 1) {
+        for(uint8_t i = 0; i < client_count; i++) {
+            spi_select_client(i);
+        }
+        
+        delay_sleep_us(SPI_WAKE_PULSE_US, SLEEP_LEVEL_STANDBY);
+        
+        for(uint8_t i = 0; i < client_count; i++) {
+            spi_deselect_client(i);
+        }
+        
+        // A client already awake answered the pulse and drives MISO until
+        // its SS interrupt runs, let it let go before the first poll
+        delay_sleep_us(SPI_READY_POLL_US, SLEEP_LEVEL_STANDBY);
+    }
+    
+    // Deliver one at a time, only one client may drive MISO
+    uint8_t delivered = 0;
+    for(uint8_t i = 0; i < client_count; i++) {
+        // The client before still drives MISO until its SS ISR runs
+        if(i) {
+            _delay_us(SPI_RELEASE_US);
+        }
+        
+        delivered += spi_deliver_frame(i, data, size, response);
+    }
+    
+    return delivered;
+}
+
+void spi_disable(void) {
+    SPI0.CTRLA &= ~SPI_ENABLE_bm;
+}
+
+void spi_disable_pins(void) {
+    // MOSI, SCK back to inputs with input buffers off
+    PORTA.DIRCLR = PIN4_bm | PIN5_bm | PIN6_bm;
+    PORTA.PIN4CTRL = PORT_ISC_INPUT_DISABLE_gc;
+    PORTA.PIN5CTRL = PORT_ISC_INPUT_DISABLE_gc;
+    PORTA.PIN6CTRL = PORT_ISC_INPUT_DISABLE_gc;
+    
+    // Chip selects stay outputs, held high so the clients sleep
+}
+
+// Send one frame to a client and check that it acknowledged ack_seq
+static uint8_t spi_train_exchange(uint8_t client, const uint8_t *frame, uint8_t size,
+                                  uint8_t ack_seq) {
+    uint8_t response[SPI_FRAME_MAX_SIZE];
+    spi_frame_t ack;
+    
+    if(!spi_send_frame_to(client, frame, size, response)) {
+        return 0;
+    }
+    
+    return spi_frame_decode(response, size, &ack) == SPI_FRAME_OK &&
+           ack.type == SPI_FRAME_TYPE_ACK && ack.seq == ack_seq;
+}
+
+// Raise the rate for one client until a check fails, at most to limit
+static spi_rate_t spi_train_client(uint8_t client, uint8_t *seq, spi_rate_t limit) {
+    uint8_t frame[SPI_FRAME_MAX_SIZE];
+    spi_rate_t proven = SPI_HOST_RATE;
+    uint8_t size;
+    
+    // Prime with one frame at the proven rate, its acknowledgement comes
+    // back during the first trial frame
+    spi_host_set_rate(proven);
+    size = spi_frame_encode(frame, SPI_FRAME_TYPE_TRAIN, *seq,
+                            train_pattern, sizeof(train_pattern));
+    if(!spi_send_frame_to(client, frame, size, 0)) {
+        return proven;
+    }
+    uint8_t last_good = (*seq)++;
+    
+    while(proven < limit) {
+        spi_rate_t trial = proven + 1;
+        
+        // MISO at the trial rate: acknowledgement of the last good frame
+        spi_host_set_rate(trial);
+        size = spi_frame_encode(frame, SPI_FRAME_TYPE_TRAIN, *seq,
+                                train_pattern, sizeof(train_pattern));
+        uint8_t passed = spi_train_exchange(client, frame, size, last_good);
+        uint8_t trial_seq = (*seq)++;
+        
+        // MOSI at the trial rate: that frame must be acknowledged, read
+        // back at the proven rate
+        spi_host_set_rate(proven);
+        size = spi_frame_encode(frame, SPI_FRAME_TYPE_TRAIN, *seq,
+                                train_pattern, sizeof(train_pattern));
+        passed = spi_train_exchange(client, frame, size, trial_seq) && passed;
+        last_good = (*seq)++;
+        
+        // First failure ends training, keep the last rate that passed
+        if(!passed) {
+            break;
+        }
+        
+        proven = trial;
+    }
+    
+    return proven;
+}
+
+spi_rate_t spi_link_train(uint8_t *seq) {
+    spi_rate_t locked = SPI_RATE_COUNT - 1;
+    
+    // Shared bus: the slowest client sets the rate
+    for(uint8_t client = 0; client < client_count; client++) {
+        if(client) {
+            _delay_us(SPI_RELEASE_US);
+        }
+        
+        spi_rate_t rate = spi_train_client(client, seq, locked);
+        
+        if(rate < locked) {
+            locked = rate;
+        }
+    }
+    
+    spi_host_set_rate(locked);
+    return locked;
+}
+
+// Store bytes clocked in from the client, or drop them
+static void spi_host_drain_rx(void) {
+    while(SPI0.INTFLAGS & SPI_RXCIF_bm) {
+        uint8_t data = SPI0.DATA;
+        
+        if(rx_remaining) {
+            *rx_ptr++ = data;
+            rx_remaining--;
+        }
+    }
+}
+
+ISR(SPI0_INT_vect) {
+    uint8_t intctrl = SPI0.INTCTRL;
+    
+    spi_host_drain_rx();
+    
+    // TX buffer has room: queue next byte
+    if((intctrl & SPI_DREIE_bm) && (SPI0.INTFLAGS & SPI_DREIF_bm)) {
+        if(tx_remaining) {
+            SPI0.DATA = *tx_ptr++;
+            tx_remaining--;
+            
+            // Clear after the write so TXC only marks the real end
+            SPI0.INTFLAGS = SPI_TXCIF_bm;
+        }
+        
+        // Last byte queued: wait for the shift register to empty
+        if(!tx_remaining) {
+            SPI0.INTCTRL = SPI_TXCIE_bm;
+        }
+    }
+    
+    // Last byte has left the shift register
+    if((intctrl & SPI_TXCIE_bm) && (SPI0.INTFLAGS & SPI_TXCIF_bm)) {
+        SPI0.INTFLAGS = SPI_TXCIF_bm;
+        SPI0.INTCTRL = 0;
+        
+        // Last received byte completes together with TXC
+        spi_host_drain_rx();
+        tx_complete_flag = 1;
+        power_vote(POWER_VOTER_SPI, SLEEP_LEVEL_POWERDOWN);
+        
+        if(tx_done_cb) {
+            tx_done_cb();
+        }
+    }
+}
+
+#endif // HOST_DEVICE
+
+
+// ========================================
+// CLIENT DEVICE
+// ========================================
+#ifdef CLIENT_DEVICE
+
+#define SPI_RX_SLOT_MASK (SPI_RX_SLOTS - 1)
+
+#if (SPI_RX_SLOTS & SPI_RX_SLOT_MASK) != 0
+#error "SPI_RX_SLOTS must be a power of 2"
+#endif
+
+// Single producer (SPI ISR) / single consumer (main loop) frame queue.
+// The ISR only writes slot[rx_head], which the consumer never sees until
+// rx_head moves past it; the consumer only reads slots before rx_head.
+static spi_rx_slot_t rx_slots[SPI_RX_SLOTS];
+static volatile uint8_t rx_head = 0;
+static volatile uint8_t rx_tail = 0;
+
+static volatile uint8_t rx_index = 0;
+static volatile uint8_t rx_frame_size = SPI_FRAME_OVERHEAD;
+static volatile uint8_t rx_overruns = 0;
+static volatile uint8_t client_ready_flag = 0;
+static volatile uint8_t transaction_end_flag = 0;
+
+// MISO stream once ready: [READY][response bytes][IDLE...], shifted out
+// while the HOST frame is shifted in
+static uint8_t resp_buffer[SPI_FRAME_MAX_SIZE];
+static volatile uint8_t resp_size = 0;
+static volatile uint8_t resp_index = 0;
+static volatile uint8_t ready_sent = 0;
+static volatile uint8_t resp_sent_flag = 0;
+
+// Keep the TX buffer loaded with the next MISO byte
+static void spi_client_feed_tx(void) {
+    if(!(SPI0.INTFLAGS & SPI_DREIF_bm)) {
+        return;
+    }
+    
+    if(!client_ready_flag) {
+        SPI0.DATA = SPI_IDLE_BYTE;
+    } else if(!ready_sent) {
+        SPI0.DATA = SPI_READY_BYTE;
+        ready_sent = 1;
+    } else if(resp_index < resp_size) {
+        SPI0.DATA = resp_buffer[resp_index++];
+    } else {
+        SPI0.DATA = SPI_IDLE_BYTE;
+    }
+}
+
+void spi_client_init(void) {
+    // All inputs, MISO is driven only while selected and ready
+    // (spi_client_set_ready), other clients share the line
+    PORTA.DIRCLR = PIN4_bm | PIN5_bm | PIN6_bm | PIN7_bm;
+    
+    // Mode 0, buffered (gives the SS released interrupt), first write
+    // while SS is high goes straight to the shift register
+    SPI0.CTRLB = SPI_BUFEN_bm | SPI_BUFWR_bm | SPI_MODE_0_gc;
+    
+    // Client mode
+    SPI0.CTRLA = SPI_ENABLE_bm;
+    
+    rx_head = 0;
+    rx_tail = 0;
+    rx_index = 0;
+    rx_overruns = 0;
+    client_ready_flag = 0;
+    transaction_end_flag = 0;
+    resp_size = 0;
+    resp_index = 0;
+    ready_sent = 0;
+    resp_sent_flag = 0;
+    
+    // Not ready until the main loop says so
+    SPI0.DATA = SPI_IDLE_BYTE;
+    
+    // No interrupts until ready: at 32.768 kHz every HOST poll byte and
+    // every SS edge of a wake pulse would take an ISR and starve the
+    // switch to 4 MHz
+    SPI0.INTFLAGS = SPI_SSIF_bm;
+    SPI0.INTCTRL = 0;
+}
+
+void spi_client_set_ready(void) {
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        // Polls clocked in and SS edges before now are not part of a
+        // frame (the end of a wake pulse would read as a transaction end)
+        if(!client_ready_flag) {
+            while(SPI0.INTFLAGS & SPI_RXCIF_bm) {
+                (void)SPI0.DATA;
+            }
+            SPI0.INTFLAGS = SPI_BUFOVF_bm | SPI_SSIF_bm;
+            rx_index = 0;
+        }
+        
+        // Refill the TX buffer as soon as a byte moves to the shift
+        // register: the HOST clocks its frame right behind the READY poll,
+        // refilling on RXC only would leave MISO one byte late
+        client_ready_flag = 1;
+        SPI0.INTCTRL = SPI_RXCIE_bm | SPI_DREIE_bm | SPI_SSIE_bm;
+        
+        // Drive MISO only while selected, SS going high releases it
+        // (re-armed on the next select event)
+        if(!(PORTA.IN & PIN7_bm)) {
+            PORTA.DIRSET = PIN5_bm;
+        }
+        
+        // Queue the ready byte, the response follows behind it
+        spi_client_feed_tx();
+    }
+}
+
+void spi_client_clear_ready(void) {
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        client_ready_flag = 0;
+        SPI0.INTCTRL = 0;
+        PORTA.DIRCLR = PIN5_bm;
+        
+        // A READY byte may be queued from a wake pulse, the next select
+        // must see IDLE until set_ready again
+        SPI0.CTRLA &= ~SPI_ENABLE_bm;
+        SPI0.CTRLA |= SPI_ENABLE_bm;
+        resp_index = 0;
+        ready_sent = 0;
+        SPI0.DATA = SPI_IDLE_BYTE;
+    }
+}
+
+uint8_t spi_client_set_response(const uint8_t *data, uint8_t size) {
+    if(size > SPI_FRAME_MAX_SIZE) {
+        return 0;
+    }
+    
+    // The SPI ISR streams from the buffer, swap it in one piece
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        memcpy(resp_buffer, data, size);
+        resp_size = size;
+        resp_index = 0;
+        resp_sent_flag = 0;
+    }
+    
+    return 1;
+}
+
+uint8_t get_spi_response_sent_status(void) {
+    return resp_sent_flag;
+}
+
+uint8_t get_packet_complete_status(void) {
+    return rx_head != rx_tail;
+}
+
+uint8_t get_spi_transaction_end_status(void) {
+    return transaction_end_flag;
+}
+
+void clear_spi_transaction_end_status(void) {
+    transaction_end_flag = 0;
+}
+
+const spi_rx_slot_t *spi_rx_peek(void) {
+    if(rx_head == rx_tail) {
+        return 0;
+    }
+    
+    return &rx_slots[rx_tail];
+}
+
+void spi_rx_release(void) {
+    if(rx_head != rx_tail) {
+        // Single byte store, the ISR sees either the old or new tail
+        rx_tail = (rx_tail + 1) & SPI_RX_SLOT_MASK;
+    }
+}
+
+// Handle one received byte
+static void spi_client_receive_byte(uint8_t data) {
+    // First byte is the frame length, it fixes how many bytes follow
+    if(rx_index == SPI_FRAME_LEN_POS) {
+        // Ready poll from HOST, not part of a frame
+        if(data == SPI_POLL_BYTE) {
+            return;
+        }
+        
+        rx_frame_size = spi_frame_size(data);
+    }
+    
+    spi_rx_slot_t *slot = &rx_slots[rx_head];
+    slot->data[rx_index++] = data;
+    
+    // Whole frame received
+    if(rx_index >= rx_frame_size) {
+        rx_index = 0;
+        
+        uint8_t next = (rx_head + 1) & SPI_RX_SLOT_MASK;
+        
+        if(next == rx_tail) {
+            // Queue full: drop this frame, keep the ones not yet consumed
+            if(rx_overruns != 0xFF) {
+                rx_overruns++;
+            }
+        } else {
+            slot->timestamp = rtc_get_ticks();
+            slot->overruns = rx_overruns;
+            rx_overruns = 0;
+            
+            // Publish the slot to the main loop
+            rx_head = next;
+            sched_post(EVENT_SPI_FRAME);
+        }
+        
+        // Response went out in full alongside this frame (one-shot)
+        if(resp_size && ready_sent && resp_size <= rx_frame_size) {
+            resp_size = 0;
+            resp_sent_flag = 1;
+        }
+        
+        // Next select starts with a fresh handshake, ignore the rest
+        client_ready_flag = 0;
+        SPI0.INTCTRL = SPI_SSIE_bm;
+    }
+}
+
+ISR(SPI0_INT_vect) {
+    // Drain the receive buffer (up to 2 bytes in buffered mode)
+    while(SPI0.INTFLAGS & SPI_RXCIF_bm) {
+        spi_client_receive_byte(SPI0.DATA);
+    }
+    
+    // Each received byte frees one TX buffer place
+    spi_client_feed_tx();
+    
+    // SS released: transaction over
+    if(SPI0.INTFLAGS & SPI_SSIF_bm) {
+        SPI0.INTFLAGS = SPI_SSIF_bm;
+        
+        // Deselected: release MISO for the other clients
+        PORTA.DIRCLR = PIN5_bm;
+        
+        // HOST aborted mid-frame: drop the partial frame
+        rx_index = 0;
+        
+        // Flush MISO bytes still queued, an unsent response restarts
+        // from its first byte on the next select. Still ready (woken by
+        // a broadcast pulse): the first poll gets READY straight away.
+        SPI0.CTRLA &= ~SPI_ENABLE_bm;
+        SPI0.CTRLA |= SPI_ENABLE_bm;
+        resp_index = 0;
+        ready_sent = client_ready_flag;
+        SPI0.DATA = client_ready_flag ? SPI_READY_BYTE : SPI_IDLE_BYTE;
+        spi_client_feed_tx();
+        
+        // Idle again until the next set_ready
+        if(!client_ready_flag) {
+            SPI0.INTCTRL = 0;
+        }
+        
+        transaction_end_flag = 1;
+        sched_post(EVENT_SPI_END);
+    }
+}
+
+#endif // CLIENT_DEVICE
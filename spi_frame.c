@@ -0,0 +1,246 @@
+#include <stdint.h>
+#include "spi_frame.h"
+
+// Table lives in flash on the AVR, plain const array elsewhere (x86 builds)
+#ifdef __AVR__
+#include <avr/pgmspace.h>
+#define CRC8_TABLE_READ(i) pgm_read_byte(&crc8_table[(i)])
+#else
+#define PROGMEM
+#define CRC8_TABLE_READ(i) (crc8_table[(i)])
+#endif
+
+// CRC-8 lookup table (polynomial 0x07)
+static const uint8_t crc8_table[256] PROGMEM = {
+    0x00, 0x07, 0x0E, 0x09, 0x1C, 0x1B, 0x12, 0x15,
+    0x38, 0x3F, 0x36, 0x31, 0x24, 0x23, 0x2A, 0x2D,
+    0x70, 0x77, 0x7E, 0x79, 0x6C, 0x6B, 0x62, 0x65,
+    0x48, 0x4F, 0x46, 0x41, 0x54, 0x53, 0x5A, 0x5D,
+    0xE0, 0xE7, 0xEE, 0xE9, 0xFC, 0xFB, 0xF2, 0xF5,
+    0xD8, 0xDF, 0xD6, 0xD1, 0xC4, 0xC3, 0xCA, 0xCD,
+    0x90, 0x97, 0x9E, 0x99, 0x8C, 0x8B, 0x82, 0x85,
+    0xA8, 0xAF, 0xA6, 0xA1, 0xB4, 0xB3, 0xBA, 0xBD,
+    0xC7, 0xC0, 0xC9, 0xCE, 0xDB, 0xDC, 0xD5, 0xD2,
+    0xFF, 0xF8, 0xF1, 0xF6, 0xE3, 0xE4, 0xED, 0xEA,
+    0xB7, 0xB0, 0xB9, 0xBE, 0xAB, 0xAC, 0xA5, 0xA2,
+    0x8F, 0x88, 0x81, 0x86, 0x93, 0x94, 0x9D, 0x9A,
+    0x27, 0x20, 0x29, 0x2E, 0x3B, 0x3C, 0x35, 0x32,
+    0x1F, 0x18, 0x11, 0x16, 0x03, 0x04, 0x0D, 0x0A,
+    0x57, 0x50, 0x59, 0x5E, 0x4B, 0x4C, 0x45, 0x42,
+    0x6F, 0x68, 0x61, 0x66, 0x73, 0x74, 0x7D, 0x7A,
+    0x89, 0x8E, 0x87, 0x80, 0x95, 0x92, 0x9B, 0x9C,
+    0xB1, 0xB6, 0xBF, 0xB8, 0xAD, 0xAA, 0xA3, 0xA4,
+    0xF9, 0xFE, 0xF7, 0xF0, 0xE5, 0xE2, 0xEB, 0xEC,
+    0xC1, 0xC6, 0xCF, 0xC8, 0xDD, 0xDA, 0xD3, 0xD4,
+    0x69, 0x6E, 0x67, 0x60, 0x75, 0x72, 0x7B, 0x7C,
+    0x51, 0x56, 0x5F, 0x58, 0x4D, 0x4A, 0x43, 0x44,
+    0x19, 0x1E, 0x17, 0x10, 0x05, 0x02, 0x0B, 0x0C,
+    0x21, 0x26, 0x2F, 0x28, 0x3D, 0x3A, 0x33, 0x34,
+    0x4E, 0x49, 0x40, 0x47, 0x52, 0x55, 0x5C, 0x5B,
+    0x76, 0x71, 0x78, 0x7F, 0x6A, 0x6D, 0x64, 0x63,
+    0x3E, 0x39, 0x30, 0x37, 0x22, 0x25, 0x2C, 0x2B,
+    0x06, 0x01, 0x08, 0x0F, 0x1A, 0x1D, 0x14, 0x13,
+    0xAE, 0xA9, 0xA0, 0xA7, 0xB2, 0xB5, 0xBC, 0xBB,
+    0x96, 0x91, 0x98, 0x9F, 0x8A, 0x8D, 0x84, 0x83,
+    0xDE, 0xD9, 0xD0, 0xD7, 0xC2, 0xC5, 0xCC, 0xCB,
+    0xE6, 0xE1, 0xE8, 0xEF, 0xFA, 0xFD, 0xF4, 0xF3
+};
+
+uint8_t spi_frame_crc8(const uint8_t *data, uint8_t len) {
+    uint8_t crc = 0x00;
+    
+    while(len--) {
+        crc = CRC8_TABLE_READ(crc ^ *data++);
+    }
+    
+    return crc;
+}
+
+uint8_t spi_frame_encode(uint8_t *frame, uint8_t type, uint8_t seq,
+                         const uint8_t *payload, uint8_t len) {
+    // Reject payloads that do not fit in one frame
+    if(len > SPI_FRAME_MAX_PAYLOAD) {
+        return 0;
+    }
+    
+    frame[SPI_FRAME_LEN_POS] = len;
+    frame[SPI_FRAME_TYPE_POS] = type;
+    frame[SPI_FRAME_SEQ_POS] = seq;
+    
+    for(uint8_t i = 0; i < len; i++) {
+        frame[SPI_FRAME_PAYLOAD_POS + i] = payload[i];
+    }
+    
+    // CRC covers header and payload
+    uint8_t crc_pos = SPI_FRAME_HEADER_SIZE + len;
+    frame[crc_pos] = spi_frame_crc8(frame, crc_pos);
+    
+    // Return total number of bytes to send
+    return crc_pos + SPI_FRAME_CRC_SIZE;
+}
+
+uint8_t spi_frame_decode(const uint8_t *frame, uint8_t size, spi_frame_t *out) {
+    // Need at least a header and a CRC
+    if(size < SPI_FRAME_OVERHEAD) {
+        return SPI_FRAME_ERR_LENGTH;
+    }
+    
+    uint8_t len = frame[SPI_FRAME_LEN_POS];
+    
+    // Length byte must fit both the protocol limit and the received bytes
+    if(len > SPI_FRAME_MAX_PAYLOAD || (uint8_t)(len + SPI_FRAME_OVERHEAD) > size) {
+        return SPI_FRAME_ERR_LENGTH;
+    }
+    
+    uint8_t crc_pos = SPI_FRAME_HEADER_SIZE + len;
+    if(spi_frame_crc8(frame, crc_pos) != frame[crc_pos]) {
+        return SPI_FRAME_ERR_CRC;
+    }
+    
+    // An idle or stuck-low line reads all zeros, which has a valid CRC
+    if(frame[SPI_FRAME_TYPE_POS] == 0x00) {
+        return SPI_FRAME_ERR_TYPE;
+    }
+    
+    out->type = frame[SPI_FRAME_TYPE_POS];
+    out->seq = frame[SPI_FRAME_SEQ_POS];
+    out->len = len;
+    out->payload = &frame[SPI_FRAME_PAYLOAD_POS];
+    
+    return SPI_FRAME_OK;
+}
+
+uint8_t spi_frame_size(uint8_t len_byte) {
+    // Oversized length bytes are clamped so a receiver never overruns its buffer
+    if(len_byte > SPI_FRAME_MAX_PAYLOAD) {
+        len_byte = SPI_FRAME_MAX_PAYLOAD;
+    }
+    
+    return len_byte + SPI_FRAME_OVERHEAD;
+}
+
+void spi_sample_pack(uint8_t *dst, uint16_t adc_result, uint8_t window) {
+    uint16_t sample = adc_result & SPI_SAMPLE_ADC_gm;
+    
+    if(window) {
+        sample |= SPI_SAMPLE_WINDOW_bm;
+    }
+    
+    dst[0] = (uint8_t)(sample & 0xFF);  // Low byte
+    dst[1] = (uint8_t)(sample >> 8);    // High nibble + window bit
+}
+
+void spi_sample_pack_hires(uint8_t *dst, uint16_t result, uint8_t window) {
+    uint16_t sample = result & SPI_SAMPLE_HIRES_VALUE_gm;
+    
+    if(window) {
+        sample |= SPI_SAMPLE_WINDOW_bm;
+    }
+    
+    dst[0] = (uint8_t)(sample & 0xFF);
+    dst[1] = (uint8_t)(sample >> 8);
+}
+
+uint16_t spi_sample_unpack(const uint8_t *src) {
+    return ((uint16_t)src[1] << 8) | src[0];
+}
+
+uint8_t spi_sample_compress(uint8_t *dst, uint8_t dst_size,
+                            const uint8_t *samples, uint8_t count) {
+    if(count == 0 || count > SPI_DELTA_MAX_SAMPLES || dst_size < SPI_DELTA_HEADER_SIZE) {
+        return 0;
+    }
+    
+    // First sample goes out as is
+    dst[0] = count;
+    dst[1] = samples[0];
+    dst[2] = samples[1];
+    
+    uint16_t prev = spi_sample_unpack(samples) & SPI_SAMPLE_ADC_gm;
+    // 16 bits: a buffer over 130 bytes has more than 255 nibbles
+    uint16_t max_nibbles = (uint16_t)(dst_size - SPI_DELTA_HEADER_SIZE) * 2;
+    uint16_t nibbles = 0;
+    
+    for(uint8_t i = 1; i < count; i++) {
+        uint16_t sample = spi_sample_unpack(&samples[i * SPI_SAMPLE_SIZE]);
+        uint16_t value = sample & SPI_SAMPLE_ADC_gm;
+        int16_t delta = (int16_t)(value - prev);
+        prev = value;
+        
+        // Zig-zag: 0, -1, 1, -2, ... -> 0, 1, 2, 3, ...
+        uint16_t code = (delta < 0) ? (uint16_t)(~((uint16_t)delta << 1))
+                                    : ((uint16_t)delta << 1);
+        code = (code << 1) | ((sample & SPI_SAMPLE_WINDOW_bm) ? 1 : 0);
+        
+        // 3 bits per nibble, bit 3 marks a continuation
+        do {
+            if(nibbles >= max_nibbles) {
+                return 0;
+            }
+            
+            uint8_t nibble = code & 0x07;
+            code >>= 3;
+            if(code) {
+                nibble |= 0x08;
+            }
+            
+            uint8_t *byte = &dst[SPI_DELTA_HEADER_SIZE + (nibbles >> 1)];
+            if(nibbles & 1) {
+                *byte |= nibble;
+            } else {
+                *byte = nibble << 4;
+            }
+            nibbles++;
+        } while(code);
+    }
+    
+    return SPI_DELTA_HEADER_SIZE + ((nibbles + 1) >> 1);
+}
+
+uint8_t spi_sample_decompress(uint8_t *samples, uint8_t max_count,
+                              const uint8_t *src, uint8_t len) {
+    if(len < SPI_DELTA_HEADER_SIZE) {
+        return 0;
+    }
+    
+    uint8_t count = src[0];
+    if(count == 0 || count > max_count) {
+        return 0;
+    }
+    
+    samples[0] = src[1];
+    samples[1] = src[2];
+    
+    uint16_t prev = spi_sample_unpack(samples) & SPI_SAMPLE_ADC_gm;
+    uint16_t max_nibbles = (uint16_t)(len - SPI_DELTA_HEADER_SIZE) * 2;
+    uint16_t nibbles = 0;
+    
+    for(uint8_t i = 1; i < count; i++) {
+        uint16_t code = 0;
+        uint8_t shift = 0;
+        uint8_t nibble;
+        
+        do {
+            // Truncated payload or over-long code
+            if(nibbles >= max_nibbles || shift >= SPI_DELTA_MAX_NIBBLES * 3) {
+                return 0;
+            }
+            
+            uint8_t byte = src[SPI_DELTA_HEADER_SIZE + (nibbles >> 1)];
+            nibble = (nibbles & 1) ? (byte & 0x0F) : (byte >> 4);
+            nibbles++;
+            
+            code |= (uint16_t)(nibble & 0x07) << shift;
+            shift += 3;
+        } while(nibble & 0x08);
+        
+        uint8_t window = code & 1;
+        uint16_t zigzag = code >> 1;
+        uint16_t delta = (zigzag & 1) ? ~(zigzag >> 1) : (zigzag >> 1);
+        
+        prev = (prev + delta) & SPI_SAMPLE_ADC_gm;
+        spi_sample_pack(&samples[i * SPI_SAMPLE_SIZE], prev, window);
+    }
+    
+    return count;
+}
@@ -0,0 +1,93 @@
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <util/atomic.h>
+#include <stdint.h>
+#include "tcb.h"
+#include "evsys.h"
+#include "scheduler.h"
+#include "sleep.h"
+
+// Whole events per period and the fraction left over (in 1/period_den)
+static uint16_t period_count = 1;
+static uint16_t period_frac = 0;
+static uint16_t period_den = 1;
+static volatile uint16_t period_phase = 0;
+
+// Counted by the CAPT ISR, so periods ending while the application is
+// busy add up
+static volatile uint8_t period_done_count = 0;
+
+// Compare for the period just started: one event more whenever the
+// fractions add up to a whole event
+static void tcb_load_period(void) {
+    uint16_t count = period_count;
+    
+    period_phase += period_frac;
+    if(period_phase >= period_den) {
+        period_phase -= period_den;
+        count++;
+    }
+    
+    // Periodic interrupt mode counts 0..CCMP
+    TCB0.CCMP = count - 1;
+}
+
+void tcb_count_start(uint8_t channel, uint32_t num, uint16_t den) {
+    period_count = (uint16_t)(num / den);
+    period_frac = (uint16_t)(num % den);
+    period_den = den;
+    period_phase = 0;
+    period_done_count = 0;
+    
+    TCB0.CTRLA = 0;
+    TCB0.CNT = 0;
+    tcb_load_period();
+    
+    // Periodic interrupt mode, clocked by the event user input
+    TCB0.CTRLB = TCB_CNTMODE_INT_gc;
+    TCB0.INTFLAGS = TCB_CAPT_bm;
+    TCB0.INTCTRL = TCB_CAPT_bm;
+    TCB0.CTRLA = TCB_CLKSEL_EVENT_gc | TCB_RUNSTDBY_bm | TCB_ENABLE_bm;
+    evsys_connect(&EVSYS.USERTCB0COUNT, channel);
+    
+    // RUNSTDBY keeps counting in STANDBY, events are lost in POWERDOWN
+    power_vote(POWER_VOTER_TCB, SLEEP_LEVEL_STANDBY);
+}
+
+void tcb_count_stop(void) {
+    evsys_disconnect(&EVSYS.USERTCB0COUNT);
+    TCB0.CTRLA = 0;
+    TCB0.INTCTRL = 0;
+    TCB0.INTFLAGS = TCB_CAPT_bm;
+    
+    power_vote(POWER_VOTER_TCB, SLEEP_LEVEL_POWERDOWN);
+}
+
+uint8_t get_tcb_period_status(void) {
+    return period_done_count != 0;
+}
+
+uint8_t tcb_take_periods(void) {
+    uint8_t periods;
+    
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        periods = period_done_count;
+        period_done_count = 0;
+    }
+    
+    return periods;
+}
+
+ISR(TCB0_INT_vect) {
+    // Clear interrupt flag
+    TCB0.INTFLAGS = TCB_CAPT_bm;
+    
+    // The counter restarted at the match, set this period's length
+    // before its first event comes in
+    tcb_load_period();
+    
+    if(period_done_count != 0xFF) {
+        period_done_count++;
+    }
+    sched_post(EVENT_TCB_PERIOD);
+}
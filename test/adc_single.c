@@ -0,0 +1,30 @@
+// Firmware side of ADC tests without host_main: the HOST ADC settings
+// with a given SAMPNUM, and one blocking conversion. Built with the
+// firmware sources, register accesses from test code do not reach the
+// simulator.
+
+#include <avr/io.h>
+#include "adc.h"
+
+void adc_single_init(uint8_t sampnum) {
+    // HOST settings, the ADC clock at 250 kHz from 4 MHz (/16)
+    adc_config_t config = {
+        .vref = VREF_REFSEL_VDD_gc,
+        .presc = 0x04,
+        .sample_len = 2,
+        .pos_ch = 0x08,
+        .neg_ch = ADC_MUXNEG_GND_gc,
+        .enable = 1
+    };
+    
+    adc_apply_config(&config);
+    adc_oversample_init(sampnum, 0, 4095);
+}
+
+uint16_t adc_single_convert(void) {
+    adc_start_conversion();
+    while(!adc_is_conversion_done());
+    
+    // Reading RES clears RESRDY
+    return adc_get_oversampled_result();
+}
@@ -0,0 +1,20 @@
+// Firmware side of CLIENT tests without client_main: ready for the frame
+// as soon as the HOST selects (PA7 falling edge). Built with the firmware
+// sources, register accesses from test code do not reach the simulator.
+
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include "spi0.h"
+
+void client_select_init(void) {
+    PORTA.PIN7CTRL = PORT_ISC_FALLING_gc;
+}
+
+ISR(PORTA_PORT_vect) {
+    uint8_t flags = PORTA.INTFLAGS;
+    
+    PORTA.INTFLAGS = flags;
+    if((flags & PIN7_bm) && !(PORTA.IN & PIN7_bm)) {
+        spi_client_set_ready();
+    }
+}
@@ -0,0 +1,86 @@
+// Firmware side of test_scheduler: a three state table on the real
+// scheduler. The button moves SLEEP to BUSY and back, BUSY posts a burst
+// of events on entry. Every dispatched event is handed to the test.
+
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <stdint.h>
+#include "ports.h"
+#include "scheduler.h"
+#include "main_clock_control.h"
+#include "sleep.h"
+
+enum {
+    APP_INIT,
+    APP_SLEEP,
+    APP_BUSY
+};
+
+#define EVENT_APP_BURST 0x40  // First of the burst events, one ID each
+
+// Set by the test
+void (*app_on_event)(uint8_t state, sched_event_t event);
+uint8_t app_burst_size;
+
+static void app_log(uint8_t state, sched_event_t event) {
+    if(app_on_event) {
+        app_on_event(state, event);
+    }
+}
+
+static void app_poll(void) {
+    if(get_button_pressed_status()) {
+        clear_button_pressed_status();
+        sched_post(EVENT_BUTTON);
+    }
+}
+
+static uint8_t app_init(sched_event_t event) {
+    app_log(APP_INIT, event);
+
+    port_init();
+    sched_set_poll(app_poll);
+    sei();
+
+    // Entry handlers chain without going through the queue
+    return APP_SLEEP;
+}
+
+// Clock switch started by the scheduler, its IDLE vote ends here
+static void app_wait_clock(sched_event_t event) {
+    if(event == EVENT_ENTER) {
+        clock_wait_ready();
+    }
+}
+
+static uint8_t app_sleep(sched_event_t event) {
+    app_wait_clock(event);
+    app_log(APP_SLEEP, event);
+
+    return (event == EVENT_BUTTON) ? APP_BUSY : APP_SLEEP;
+}
+
+static uint8_t app_busy(sched_event_t event) {
+    app_wait_clock(event);
+    app_log(APP_BUSY, event);
+
+    if(event == EVENT_ENTER) {
+        for(uint8_t i = 0; i < app_burst_size; i++) {
+            sched_post(EVENT_APP_BURST + i);
+        }
+    }
+
+    return (event == EVENT_BUTTON) ? APP_SLEEP : APP_BUSY;
+}
+
+static const sched_state_t app_states[] = {
+    [APP_INIT]  = {app_init,  CLOCK_POLICY_LOW_POWER, SLEEP_LEVEL_POWERDOWN},
+    [APP_SLEEP] = {app_sleep, CLOCK_POLICY_LOW_POWER, SLEEP_LEVEL_POWERDOWN},
+    [APP_BUSY]  = {app_busy,  CLOCK_POLICY_4MHZ,      SLEEP_LEVEL_IDLE}
+};
+
+int fw_main(void) {
+    sched_run(app_states, APP_INIT);
+
+    return 0;
+}
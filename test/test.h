@@ -0,0 +1,37 @@
+#ifndef TEST_H
+#define TEST_H
+
+// Minimal test helpers: a failed check prints its line and the test
+// exits non-zero at the end
+
+#include <stdio.h>
+#include <stdlib.h>
+
+static int test_failures = 0;
+
+#define CHECK(cond)                                                         \
+    do {                                                                    \
+        if(!(cond)) {                                                       \
+            fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond); \
+            test_failures++;                                                \
+        }                                                                   \
+    } while(0)
+
+#define CHECK_EQ(actual, expected)                                          \
+    do {                                                                    \
+        long long test_a = (long long)(actual);                             \
+        long long test_e = (long long)(expected);                           \
+        if(test_a != test_e) {                                              \
+            fprintf(stderr, "%s:%d: %s = %lld, expected %lld\n",            \
+                    __FILE__, __LINE__, #actual, test_a, test_e);           \
+            test_failures++;                                                \
+        }                                                                   \
+    } while(0)
+
+// Firmware module built next to the test
+#define TEST_MODULE(name) SIM_MODULE_DIR "/" name ".so"
+
+#define TEST_RESULT()                                                       \
+    (test_failures ? (fprintf(stderr, "%d check(s) failed\n", test_failures), 1) : 0)
+
+#endif // TEST_H
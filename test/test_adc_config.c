@@ -0,0 +1,69 @@
+// ADC_CONFIG() checks, compiled by ctest once per ADC_CONFIG_CASE: case 0
+// must build without warnings, every other case must fail with the
+// message CMakeLists.txt expects. Never linked or run.
+
+#include <avr/io.h>
+#include "adc.h"
+
+#ifndef ADC_CONFIG_CASE
+#define ADC_CONFIG_CASE 0
+#endif
+
+#if ADC_CONFIG_CASE == 0
+// Every VREF selection, defaults only, full 16-bit window when accumulating
+ADC_CONFIG(vref_1v024, .vref = VREF_REFSEL_1V024_gc);
+ADC_CONFIG(vref_2v048, .vref = VREF_REFSEL_2V048_gc);
+ADC_CONFIG(vref_4v096, .vref = VREF_REFSEL_4V096_gc);
+ADC_CONFIG(vref_2v500, .vref = VREF_REFSEL_2V500_gc);
+ADC_CONFIG(vref_vdd, .vref = VREF_REFSEL_VDD_gc);
+ADC_CONFIG(vref_vrefa, .vref = VREF_REFSEL_VREFA_gc);
+ADC_CONFIG(defaults, .enable = 1);
+ADC_CONFIG(accumulate, .sample_num = 0x07, .presc = 0x0B, .init_delay = 0x07,
+           .sample_delay = 0x0F, .window_mode = 0x04, .win_low = 0, .win_high = 0xFFFF);
+
+void adc_config_case(uint8_t vref) {
+    adc_apply_config(&vref_1v024);
+    adc_apply_config(&vref_2v048);
+    adc_apply_config(&vref_4v096);
+    adc_apply_config(&vref_2v500);
+    adc_apply_config(&vref_vdd);
+    adc_apply_config(&vref_vrefa);
+    adc_apply_config(&defaults);
+    adc_apply_config(&accumulate);
+
+    // Built at run time: not checked, still builds
+    adc_config_t runtime = defaults;
+    runtime.vref = vref;
+    adc_apply_config(&runtime);
+}
+#else
+#if ADC_CONFIG_CASE == 1
+ADC_CONFIG(bad, .vref = 0x04);
+#elif ADC_CONFIG_CASE == 2
+ADC_CONFIG(bad, .vref = 0x07);
+#elif ADC_CONFIG_CASE == 3
+ADC_CONFIG(bad, .conv_mode = 2);
+#elif ADC_CONFIG_CASE == 4
+ADC_CONFIG(bad, .init_delay = 8);
+#elif ADC_CONFIG_CASE == 5
+ADC_CONFIG(bad, .sample_num = 8);
+#elif ADC_CONFIG_CASE == 6
+ADC_CONFIG(bad, .presc = 0x0C);
+#elif ADC_CONFIG_CASE == 7
+ADC_CONFIG(bad, .sample_delay = 16);
+#elif ADC_CONFIG_CASE == 8
+ADC_CONFIG(bad, .pos_ch = 0x80);
+#elif ADC_CONFIG_CASE == 9
+ADC_CONFIG(bad, .window_mode = 5);
+#elif ADC_CONFIG_CASE == 10
+ADC_CONFIG(bad, .left_adjust = 1, .sample_num = 1);
+#elif ADC_CONFIG_CASE == 11
+ADC_CONFIG(bad, .window_mode = 0x03, .win_low = 3000, .win_high = 1000);
+#elif ADC_CONFIG_CASE == 12
+ADC_CONFIG(bad, .window_mode = 0x03, .win_low = 1000, .win_high = 4096);
+#endif
+
+void adc_config_case(void) {
+    adc_apply_config(&bad);
+}
+#endif
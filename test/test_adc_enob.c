@@ -0,0 +1,130 @@
+// Oversampling (adc_oversample.c) against the simulated ADC accumulator:
+// a DC input with 1 LSB rms of Gaussian noise, converted with every
+// SAMPNUM and decimated like the HOST does. ENOB comes from the rms
+// error against the input, offset removed (truncating decimation adds a
+// fixed half LSB). The README "Oversampling" table is this output.
+
+#include <math.h>
+#include <stdio.h>
+#include "sim.h"
+#include "adc.h"
+#include "test.h"
+
+#define CONVERSIONS 400
+#define VDD         3.3
+#define NOISE_LSB   1.0  // Input noise, rms in 12-bit LSB
+
+// adc_single.c
+void adc_single_init(uint8_t sampnum);
+uint16_t adc_single_convert(void);
+
+static sim_node_t *dut;
+
+static uint32_t rng_state = 11;
+static double input_volts;
+
+static uint32_t next_random(void) {
+    // xorshift32
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 17;
+    rng_state ^= rng_state << 5;
+    return rng_state;
+}
+
+static double uniform(void) {
+    return (next_random() + 1.0) / 4294967297.0;
+}
+
+// Box-Muller, one value per call
+static double gaussian(void) {
+    return sqrt(-2.0 * log(uniform())) * cos(2.0 * M_PI * uniform());
+}
+
+// Called once per accumulated sample
+static double noisy_input(sim_node_t *node, uint8_t ain, sim_time_t t, void *ctx) {
+    (void)node;
+    (void)ain;
+    (void)t;
+    (void)ctx;
+    return input_volts + gaussian() * NOISE_LSB * VDD / 4096.0;
+}
+
+typedef struct {
+    uint8_t bits;
+    double enob;
+    double conversion_us;
+} enob_result_t;
+
+static enob_result_t measure(uint8_t sampnum) {
+    adc_single_init(sampnum);
+
+    const sim_stats_t *stats = sim_node_stats(dut);
+    sim_time_t busy = stats->total.adc_busy;
+    double sum = 0.0;
+    double sum_sq = 0.0;
+    enob_result_t result;
+
+    result.bits = adc_get_result_bits();
+    for(uint32_t i = 0; i < CONVERSIONS; i++) {
+        // New level each conversion, away from the rails
+        input_volts = VDD * (0.1 + 0.8 * uniform());
+
+        uint16_t res = adc_single_convert();
+        double error = res * VDD / (1UL << result.bits) - input_volts;
+        sum += error;
+        sum_sq += error * error;
+    }
+
+    double mean = sum / CONVERSIONS;
+    double rms = sqrt(sum_sq / CONVERSIONS - mean * mean);
+
+    result.enob = log2(VDD / (rms * sqrt(12.0)));
+    result.conversion_us = (double)(stats->total.adc_busy - busy) / SIM_US(1) / CONVERSIONS;
+    return result;
+}
+
+int main(void) {
+    enob_result_t results[ADC_OVERSAMPLE_MAX + 1];
+
+    dut = sim_node_attach(&sim_io, "dut");
+    sim_node_select(dut);
+    sim_set_vdd(dut, VDD);
+    sim_analog_set(dut, noisy_input, 0);
+
+    printf("| SAMPNUM | Bits | ENOB  | Conversion | ENOB/µs over ACC1 |\n");
+    printf("|---------|------|-------|------------|-------------------|\n");
+    for(uint8_t n = 0; n <= ADC_OVERSAMPLE_MAX; n++) {
+        results[n] = measure(n);
+
+        double gain = n ? (results[n].enob - results[0].enob) /
+                          (results[n].conversion_us - results[0].conversion_us) : 0.0;
+        printf("| ACC%-4u | %-4u | %-5.2f | %-7.0f µs | %-17.4f |\n", 1U << n, results[n].bits,
+               results[n].enob, results[n].conversion_us, gain);
+    }
+
+    // Single conversion: 1 LSB of noise on top of quantization
+    CHECK(results[0].enob > 9.8 && results[0].enob < 10.5);
+
+    // Each doubling of the samples doubles the conversion time, each
+    // fourfold about one more bit until the decimated LSB limits it
+    for(uint8_t n = 1; n <= ADC_OVERSAMPLE_MAX; n++) {
+        double ratio = results[n].conversion_us / results[n - 1].conversion_us;
+
+        CHECK(ratio > 1.9 && ratio < 2.1);
+        CHECK(results[n].enob > results[n - 1].enob);
+        CHECK(results[n].enob < results[n].bits);
+    }
+    CHECK(results[4].enob - results[0].enob > 1.7);
+
+    // Less gain per µs the more samples are added
+    for(uint8_t n = 2; n <= ADC_OVERSAMPLE_MAX; n++) {
+        double gain = (results[n].enob - results[n - 1].enob) /
+                      (results[n].conversion_us - results[n - 1].conversion_us);
+        double previous = (results[n - 1].enob - results[n - 2].enob) /
+                          (results[n - 1].conversion_us - results[n - 2].conversion_us);
+        CHECK(gain < previous);
+    }
+
+    sim_node_select(0);
+    return TEST_RESULT();
+}
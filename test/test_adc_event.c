@@ -0,0 +1,95 @@
+// Event triggered conversions (HOST_ADC_EVENT_TRIGGER=1) against the
+// default button wake: the press reaches the ADC start through EVSYS, no
+// pin interrupt, and the CPU wakes only for RESRDY. The README
+// "Event-triggered ADC" table is this output. Cycles are the simulator's
+// estimate, good for comparing the two builds.
+
+#include <stdio.h>
+#include "sim.h"
+#include "test.h"
+
+#define STATE_SEND_SPI 4  // host_main.c app_states_t
+#define SAMPLES        8
+
+typedef struct {
+    double cycles;         // CPU cycles per sample, everything
+    double sample_cycles;  // Without SEND_SPI (the frame is the same)
+    double wakes;
+    double active_us;      // CPU running, per sample
+    double current_ua;     // Average at one sample every 300 ms
+} event_result_t;
+
+static event_result_t run(const char *module, uint8_t event_mode) {
+    event_result_t result = {0};
+    sim_node_t *host = sim_node_load(module, "host");
+    sim_node_t *client = sim_node_load(TEST_MODULE("client_fw"), "client");
+    sim_time_t t = sim_time() + SIM_MS(200);
+
+    sim_wire(host, 'A', 7, client, 'A', 7);
+    sim_analog_const(host, 8, 0.5);
+    sim_node_start(host);
+    sim_node_start(client);
+
+    // Warm-up sample (link training)
+    sim_button_press(host, 'F', 6, t, SIM_MS(50));
+    t += SIM_MS(300);
+    sim_run_until(t);
+    sim_node_stats_reset(host);
+
+    for(uint8_t i = 0; i < SAMPLES; i++, t += SIM_MS(300)) {
+        sim_button_press(host, 'F', 6, t, SIM_MS(50));
+    }
+    sim_run_until(t);
+
+    const sim_stats_t *stats = sim_node_stats(host);
+
+    CHECK_EQ(stats->adc_conversions, SAMPLES);
+    CHECK_EQ(stats->adc_start_lost, 0);
+    CHECK_EQ(stats->adc_clock_range, 0);
+    CHECK_EQ(stats->state[STATE_SEND_SPI].entries, SAMPLES);
+
+    if(event_mode) {
+        // Routed: one event per press, the pin never interrupts
+        CHECK_EQ(stats->events, SAMPLES);
+        CHECK_EQ(stats->isr[SIM_VECT_PORTF], 0);
+        CHECK_EQ(stats->isr[SIM_VECT_ADC0_RESRDY], SAMPLES);
+    } else {
+        CHECK_EQ(stats->events, 0);
+        CHECK(stats->isr[SIM_VECT_PORTF] >= SAMPLES);
+    }
+
+    result.cycles = (double)stats->total.cycles / SAMPLES;
+    result.sample_cycles = (double)(stats->total.cycles -
+                                    stats->state[STATE_SEND_SPI].cycles) / SAMPLES;
+    result.wakes = (double)stats->wakes / SAMPLES;
+    result.active_us = (double)sim_acct_active(&stats->total) / SIM_US(1) / SAMPLES;
+    result.current_ua = sim_charge_uc(&stats->total, &sim_power_default) /
+                        ((double)sim_acct_time(&stats->total) / SIM_TIME_HZ);
+
+    sim_node_free(client);
+    sim_node_free(host);
+    return result;
+}
+
+int main(void) {
+    event_result_t button = run(TEST_MODULE("host_fw"), 0);
+    event_result_t event = run(TEST_MODULE("host_fw_event"), 1);
+
+    printf("| Per sample                   | Button wake (default) | Event triggered |\n");
+    printf("|------------------------------|-----------------------|-----------------|\n");
+    printf("| CPU cycles, all              | %-21.0f | %-15.0f |\n", button.cycles, event.cycles);
+    printf("| CPU cycles, without SEND_SPI | %-21.0f | %-15.0f |\n",
+           button.sample_cycles, event.sample_cycles);
+    printf("| CPU wakes                    | %-21.1f | %-15.1f |\n", button.wakes, event.wakes);
+    printf("| CPU active                   | %-18.0f µs | %-12.0f µs |\n",
+           button.active_us, event.active_us);
+    printf("| Average current (300 ms)     | %-18.1f µA | %-12.1f µA |\n",
+           button.current_ua, event.current_ua);
+
+    // No pin ISR, clock switch, VREF wait or polling before the result
+    CHECK(event.sample_cycles < button.sample_cycles);
+    CHECK(event.cycles < button.cycles);
+    CHECK(event.wakes < button.wakes);
+
+    return TEST_RESULT();
+}
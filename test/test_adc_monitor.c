@@ -0,0 +1,124 @@
+// HOST window monitor (HOST_ADC_MONITOR=1) replaying a recorded sensor
+// waveform: one event frame per window crossing, the CPU asleep while the
+// ADC free-runs, and the ADC clock inside its 125 kHz..2 MHz range
+
+#include <string.h>
+#include "sim.h"
+#include "test.h"
+
+#define STATE_SEND_SPI 4  // host_main.c app_states_t
+
+// host_main.c ADC configuration: VREF and window thresholds
+#define VREF_VOLTS 3.3
+#define WIN_LOW    1000
+#define WIN_HIGH   3000
+
+// Recorded sensor output, linear between points: slow drift into the
+// window, a short excursion above it, a dip below and back
+typedef struct {
+    double ms;
+    double volts;
+} wave_point_t;
+
+static const wave_point_t wave[] = {
+    {0,    0.32}, {300,  0.39}, {500,  1.29}, {900,  1.68},
+    {1000, 1.93}, {1150, 2.90}, {1350, 2.26}, {1700, 1.45},
+    {2000, 0.48}, {2300, 0.16}, {2600, 1.13}, {3000, 1.61},
+    {3500, 1.61}
+};
+
+#define WAVE_POINTS (sizeof(wave) / sizeof(wave[0]))
+
+static sim_time_t wave_start;
+
+static double wave_volts(double ms) {
+    if(ms <= wave[0].ms) {
+        return wave[0].volts;
+    }
+
+    for(size_t i = 1; i < WAVE_POINTS; i++) {
+        if(ms <= wave[i].ms) {
+            double f = (ms - wave[i - 1].ms) / (wave[i].ms - wave[i - 1].ms);
+            return wave[i - 1].volts + f * (wave[i].volts - wave[i - 1].volts);
+        }
+    }
+
+    return wave[WAVE_POINTS - 1].volts;
+}
+
+static double analog_input(sim_node_t *node, uint8_t ain, sim_time_t t, void *ctx) {
+    (void)node;
+    (void)ctx;
+
+    if(ain != 8 || t < wave_start) {
+        return wave[0].volts;
+    }
+
+    return wave_volts((double)(t - wave_start) / SIM_MS(1));
+}
+
+static uint8_t inside(double volts) {
+    double code = volts / VREF_VOLTS * 4095.0;
+    return code >= WIN_LOW && code <= WIN_HIGH;
+}
+
+// Count occurrences of a string in the CLIENT output
+static uint32_t count(const char *text, const char *what) {
+    uint32_t n = 0;
+
+    while((text = strstr(text, what)) != 0) {
+        n++;
+        text += strlen(what);
+    }
+
+    return n;
+}
+
+int main(void) {
+    sim_node_t *host = sim_node_load(TEST_MODULE("host_fw_monitor"), "host");
+    sim_node_t *client = sim_node_load(TEST_MODULE("client_fw"), "client");
+
+    // Crossings in the recording, at 1 ms steps
+    uint32_t enters = 0;
+    uint32_t leaves = 0;
+    uint8_t was_inside = inside(wave[0].volts);
+    for(double ms = 1; ms <= wave[WAVE_POINTS - 1].ms; ms++) {
+        uint8_t now_inside = inside(wave_volts(ms));
+
+        if(now_inside != was_inside) {
+            enters += now_inside;
+            leaves += !now_inside;
+        }
+        was_inside = now_inside;
+    }
+
+    sim_wire(host, 'A', 7, client, 'A', 7);
+    wave_start = sim_time();
+    sim_analog_set(host, analog_input, 0);
+    sim_node_start(host);
+    sim_node_start(client);
+
+    sim_run_until(wave_start + SIM_MS(wave[WAVE_POINTS - 1].ms));
+
+    const sim_stats_t *stats = sim_node_stats(host);
+    const char *out = sim_usart_output(client, 0);
+    uint32_t transfers = stats->state[STATE_SEND_SPI].entries;
+
+    printf("%u crossings: %u transfers, %u wakes, %u conversions\n",
+           enters + leaves, transfers, stats->wakes, stats->adc_conversions);
+
+    CHECK(enters + leaves >= 4);
+    CHECK_EQ(transfers, enters + leaves);
+    CHECK_EQ(count(out, "Window enter"), enters);
+    CHECK_EQ(count(out, "Window leave"), leaves);
+    CHECK_EQ(count(out, "Frame error"), 0);
+
+    // Free running at 250 kHz, the CPU wakes for crossings only
+    CHECK_EQ(stats->adc_clock_range, 0);
+    CHECK(stats->adc_conversions > 1000 * (enters + leaves));
+    CHECK(stats->wakes < stats->adc_conversions / 100);
+
+    sim_node_free(client);
+    sim_node_free(host);
+    return TEST_RESULT();
+}
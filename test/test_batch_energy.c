@@ -0,0 +1,93 @@
+// HOST energy per sample with batching (HOST_BATCH_SIZE = K): the README
+// batching table is this output. Each run starts after one warm-up
+// frame (link training), then K frames' worth of button samples.
+
+#include <stdio.h>
+#include "sim.h"
+#include "test.h"
+
+#define STATE_SEND_SPI 4  // host_main.c app_states_t
+#define SAMPLES        8
+
+typedef struct {
+    double frame_uj;   // SEND_SPI state per frame
+    double sample_uj;  // Everything but sleep, per sample
+    uint32_t frames;
+} batch_result_t;
+
+static batch_result_t run(const char *module, uint8_t k) {
+    batch_result_t result = {0};
+    sim_node_t *host = sim_node_load(module, "host");
+    sim_node_t *client = sim_node_load(TEST_MODULE("client_fw"), "client");
+    sim_time_t t = sim_time() + SIM_MS(200);  // Nodes start at the current time
+
+    sim_wire(host, 'A', 7, client, 'A', 7);
+    sim_analog_const(host, 8, 0.5);
+    sim_node_start(host);
+    sim_node_start(client);
+
+    // Warm-up frame
+    for(uint8_t i = 0; i < k; i++, t += SIM_MS(300)) {
+        sim_button_press(host, 'F', 6, t, SIM_MS(50));
+    }
+    sim_run_until(t);
+    sim_node_stats_reset(host);
+
+    for(uint8_t i = 0; i < SAMPLES; i++, t += SIM_MS(300)) {
+        sim_button_press(host, 'F', 6, t, SIM_MS(50));
+    }
+    sim_run_until(t + SIM_MS(300));
+
+    const sim_stats_t *stats = sim_node_stats(host);
+    sim_acct_t active = stats->total;
+
+    // Sleep between samples is the same for every K
+    active.sleep[SIM_SLEEP_POWERDOWN] = 0;
+
+    result.frames = stats->state[STATE_SEND_SPI].entries;
+    result.frame_uj = sim_energy_uj(&stats->state[STATE_SEND_SPI], &sim_power_default) /
+                      (result.frames ? result.frames : 1);
+    result.sample_uj = sim_energy_uj(&active, &sim_power_default) / SAMPLES;
+
+    CHECK_EQ(stats->adc_conversions, SAMPLES);
+    CHECK_EQ(result.frames, SAMPLES / k);
+
+    sim_node_free(client);
+    sim_node_free(host);
+    return result;
+}
+
+int main(void) {
+    static const struct {
+        uint8_t k;
+        const char *module;
+    } runs[] = {
+        {1, TEST_MODULE("host_fw")},
+        {2, TEST_MODULE("host_fw_batch2")},
+        {4, TEST_MODULE("host_fw_batch4")},
+        {8, TEST_MODULE("host_fw_batch8")}
+    };
+    double last = 1e9;
+
+    printf("| K | Frame bytes | SPI energy per frame | Energy per sample |\n");
+    printf("|---|-------------|----------------------|-------------------|\n");
+
+    for(size_t i = 0; i < sizeof(runs) / sizeof(runs[0]); i++) {
+        batch_result_t r = run(runs[i].module, runs[i].k);
+
+        char frame[24];
+        char sample[24];
+        snprintf(frame, sizeof(frame), "~%.1fµJ", r.frame_uj);
+        snprintf(sample, sizeof(sample), "~%.1fµJ", r.sample_uj);
+
+        // Samples are delta compressed from K = 2 on, raw size shown
+        // (µ is two bytes, one column)
+        printf("| %u | %-11u | %-22s| %-19s|\n", runs[i].k, 4 + 2 * runs[i].k,
+               frame, sample);
+
+        CHECK(r.sample_uj < last);
+        last = r.sample_uj;
+    }
+
+    return TEST_RESULT();
+}
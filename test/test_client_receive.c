@@ -0,0 +1,131 @@
+// CLIENT receive path (STATE_RECEIVE_SPI): the core sleeps in IDLE
+// between SPI interrupts instead of polling for the end of the frame at
+// 4 MHz. The old busy poll is modelled from the same run, with the time
+// spent in IDLE charged as active 4 MHz time. The README "Receive path"
+// table is this output. A HOST that stops halfway through a frame, or
+// leaves SS low, must not keep the CLIENT at 4 MHz.
+
+#include <stdio.h>
+#include "sim.h"
+#include "test.h"
+
+#define STATE_SLEEP   1  // client_main.c app_states_t
+#define STATE_RECEIVE 3
+#define FRAMES        20
+
+typedef struct {
+    double time_us;    // In the receive state, per frame
+    double active_us;  // CPU running
+    double charge_nc;  // Per frame
+    double current_ua; // Average while receiving
+} receive_result_t;
+
+static receive_result_t receive_figures(const sim_acct_t *acct, uint32_t frames) {
+    receive_result_t result;
+    double time_s = (double)sim_acct_time(acct) / SIM_TIME_HZ;
+
+    result.time_us = (double)sim_acct_time(acct) / SIM_US(1) / frames;
+    result.active_us = (double)sim_acct_active(acct) / SIM_US(1) / frames;
+    result.charge_nc = sim_charge_uc(acct, &sim_power_default) * 1000.0 / frames;
+    result.current_ua = sim_charge_uc(acct, &sim_power_default) / time_s;
+    return result;
+}
+
+static void test_receive_current(void) {
+    sim_node_t *host = sim_node_load(TEST_MODULE("host_fw"), "host");
+    sim_node_t *client = sim_node_load(TEST_MODULE("client_fw"), "client");
+    sim_time_t t = sim_time() + SIM_MS(200);
+
+    sim_wire(host, 'A', 7, client, 'A', 7);
+    sim_analog_const(host, 8, 0.5);
+    sim_node_start(host);
+    sim_node_start(client);
+
+    // Warm-up sample (link training)
+    sim_button_press(host, 'F', 6, t, SIM_MS(50));
+    t += SIM_MS(300);
+    sim_run_until(t);
+    sim_node_stats_reset(client);
+
+    for(uint32_t i = 0; i < FRAMES; i++, t += SIM_MS(300)) {
+        sim_button_press(host, 'F', 6, t, SIM_MS(50));
+    }
+    sim_run_until(t);
+
+    const sim_stats_t *stats = sim_node_stats(client);
+    sim_acct_t sleeping = stats->state[STATE_RECEIVE];
+    CHECK_EQ(sleeping.entries, FRAMES);
+
+    // Busy poll: the CPU runs at 4 MHz for the whole state
+    sim_acct_t polling = sleeping;
+    for(int clk = 0; clk < SIM_CLK_COUNT; clk++) {
+        polling.active[clk] += polling.idle[clk];
+        polling.idle[clk] = 0;
+    }
+    polling.sleep[SIM_SLEEP_IDLE] = 0;
+
+    receive_result_t old_path = receive_figures(&polling, FRAMES);
+    receive_result_t new_path = receive_figures(&sleeping, FRAMES);
+
+    printf("| Receive path         | Time/frame | CPU active | Charge/frame | Current  |\n");
+    printf("|----------------------|------------|------------|--------------|----------|\n");
+    printf("| Busy poll (old)      | %-7.0f µs | %-7.0f µs | %-9.1f nC | %-5.0f µA |\n",
+           old_path.time_us, old_path.active_us, old_path.charge_nc, old_path.current_ua);
+    printf("| IDLE sleep (current) | %-7.0f µs | %-7.0f µs | %-9.1f nC | %-5.0f µA |\n",
+           new_path.time_us, new_path.active_us, new_path.charge_nc, new_path.current_ua);
+
+    // The core sleeps between bytes, the SPI ISR does the work; the rest
+    // of the state is decoding and queueing the frame
+    CHECK(sleeping.idle[SIM_CLK_4M] > 0);
+    CHECK(new_path.active_us < new_path.time_us);
+    CHECK(new_path.charge_nc < 0.85 * old_path.charge_nc);
+
+    sim_node_free(client);
+    sim_node_free(host);
+}
+
+// SS low from outside with part of a frame, then 'release' later (0 = never)
+static void test_aborted_frame(sim_time_t release) {
+    sim_node_t *client = sim_node_load(TEST_MODULE("client_fw"), "client");
+    sim_time_t t = sim_time() + SIM_MS(100);
+
+    sim_node_start(client);
+    sim_run_until(t);
+    sim_node_stats_reset(client);
+
+    // LEN, TYPE, SEQ of a 2-byte samples frame, then nothing
+    sim_pin_drive(client, 'A', 7, 0, t);
+    sim_spi_inject(client, 0x02, t + SIM_MS(5));
+    sim_spi_inject(client, 0x01, t + SIM_MS(6));
+    sim_spi_inject(client, 0x00, t + SIM_MS(7));
+    if(release) {
+        sim_pin_drive(client, 'A', 7, 1, t + release);
+    }
+    sim_run_until(t + SIM_MS(500));
+
+    const sim_stats_t *stats = sim_node_stats(client);
+    sim_time_t receiving = sim_acct_time(&stats->state[STATE_RECEIVE]);
+    sim_time_t fast = stats->total.active[SIM_CLK_4M] + stats->total.idle[SIM_CLK_4M];
+
+    printf("SS %s: %u receive entries, %.1f ms receiving, %.1f ms at 4 MHz in 500 ms\n",
+           release ? "released" : "held low", stats->state[STATE_RECEIVE].entries,
+           (double)receiving / SIM_MS(1), (double)fast / SIM_MS(1));
+
+    // Given up after the 50 ms timeout, back asleep at 32.768 kHz
+    CHECK(stats->state[STATE_RECEIVE].entries >= 1);
+    CHECK(receiving < SIM_MS(60) * stats->state[STATE_RECEIVE].entries);
+    CHECK(fast < SIM_MS(100));
+    CHECK_EQ(sim_node_state(client), STATE_SLEEP);
+    CHECK(sim_node_sleeping(client));
+    CHECK_EQ(sim_node_cpu_hz(client), 32768);
+
+    sim_node_free(client);
+}
+
+int main(void) {
+    test_receive_current();
+    test_aborted_frame(SIM_MS(10));
+    test_aborted_frame(0);
+
+    return TEST_RESULT();
+}
@@ -0,0 +1,209 @@
+// Clock manager (clock_manager.c) against the simulated CLKCTRL: every
+// policy switch starts and returns at once, the change hook and the CLOCK
+// sleep vote follow the request, and clock_wait_ready() only spins for an
+// oscillator that is still starting. A request while a switch is running
+// waits for it instead of being lost. The second part checks the HOST
+// state table: each state runs at the clock policy it declares.
+
+#include <stdio.h>
+#include "sim.h"
+#include "sim_cpu.h"
+#include "main_clock_control.h"
+#include "sleep.h"
+#include "test.h"
+
+static sim_node_t *dut;
+
+static uint32_t hook_calls;
+static clock_policy_t hook_policy;
+
+static void on_clock_change(clock_policy_t policy) {
+    hook_calls++;
+    hook_policy = policy;
+}
+
+static const struct {
+    clock_policy_t policy;
+    uint32_t hz;
+} policies[] = {
+    {CLOCK_POLICY_LOW_POWER, 32768},
+    {CLOCK_POLICY_1MHZ, 1000000},
+    {CLOCK_POLICY_4MHZ, 4000000}
+};
+
+#define POLICY_COUNT (sizeof(policies) / sizeof(policies[0]))
+
+static void check_switch(clock_policy_t from, clock_policy_t to, uint32_t hz) {
+    clock_request(from);
+    clock_wait_ready();
+    hook_calls = 0;
+
+    clock_request(to);
+    if(from == to) {
+        // Nothing to do: no hook, no vote, still ready
+        CHECK_EQ(hook_calls, 0);
+        CHECK(clock_is_ready());
+        CHECK_EQ(power_get_level(), SLEEP_LEVEL_POWERDOWN);
+        return;
+    }
+
+    // Switch started, the oscillator start-up keeps the core out of
+    // STANDBY. An OSCHF retune is immediate, and from 32.768 kHz the
+    // request itself outlasts the OSCHF start-up, so only a switch to
+    // OSC32K is still pending on return.
+    CHECK_EQ(hook_calls, 1);
+    CHECK_EQ(hook_policy, to);
+    CHECK_EQ(clock_get_policy(), to);
+    CHECK_EQ(clock_get_frequency(), hz);
+    CHECK_EQ(power_get_level(), SLEEP_LEVEL_IDLE);
+    if(to == CLOCK_POLICY_LOW_POWER) {
+        CHECK(!clock_is_ready());
+        CHECK(sim_node_cpu_hz(dut) != hz);
+    }
+
+    clock_wait_ready();
+    CHECK(clock_is_ready());
+    CHECK_EQ(sim_node_cpu_hz(dut), hz);
+    CHECK_EQ(power_get_level(), SLEEP_LEVEL_POWERDOWN);
+}
+
+static void test_policy_table(void) {
+    for(uint32_t i = 0; i < POLICY_COUNT; i++) {
+        CHECK_EQ(clock_get_policy_frequency(policies[i].policy), policies[i].hz);
+    }
+
+    // Every pair, both directions and to itself
+    for(uint32_t from = 0; from < POLICY_COUNT; from++) {
+        for(uint32_t to = 0; to < POLICY_COUNT; to++) {
+            check_switch(policies[from].policy, policies[to].policy, policies[to].hz);
+        }
+    }
+}
+
+// Time clock_wait_ready() takes right after a switch from 'from' to 'to'
+static sim_time_t wait_after(clock_policy_t from, clock_policy_t to) {
+    clock_request(from);
+    clock_wait_ready();
+    clock_request(to);
+
+    sim_time_t start = sim_node_now(dut);
+    clock_wait_ready();
+    return sim_node_now(dut) - start;
+}
+
+static void test_wait_cost(void) {
+    // Nothing pending: one status check and the vote
+    sim_time_t ready_1m = wait_after(CLOCK_POLICY_1MHZ, CLOCK_POLICY_1MHZ);
+    sim_time_t ready_4m = wait_after(CLOCK_POLICY_4MHZ, CLOCK_POLICY_4MHZ);
+
+    // OSCHF start-up (~13 us) passes inside clock_request() at 32.768 kHz,
+    // OSC32K start-up (~61 us) is spun away at 4 MHz unless the caller
+    // has other work first
+    sim_time_t to_1m = wait_after(CLOCK_POLICY_LOW_POWER, CLOCK_POLICY_1MHZ);
+    sim_time_t to_4m = wait_after(CLOCK_POLICY_LOW_POWER, CLOCK_POLICY_4MHZ);
+    sim_time_t to_32k = wait_after(CLOCK_POLICY_4MHZ, CLOCK_POLICY_LOW_POWER);
+
+    printf("clock_wait_ready(): ready %.1f us at 1 MHz, %.1f us at 4 MHz; "
+           "after a switch to 1 MHz %.1f us, to 4 MHz %.1f us, to 32.768 kHz %.1f us\n",
+           (double)ready_1m / SIM_US(1), (double)ready_4m / SIM_US(1),
+           (double)to_1m / SIM_US(1), (double)to_4m / SIM_US(1), (double)to_32k / SIM_US(1));
+
+    CHECK_EQ(to_1m, ready_1m);
+    CHECK_EQ(to_4m, ready_4m);
+    CHECK(to_32k >= SIM_US(50));
+}
+
+// New request while the switch before is still running (OSC32K start-up)
+static void test_back_to_back(void) {
+    const sim_stats_t *stats = sim_node_stats(dut);
+
+    clock_request(CLOCK_POLICY_4MHZ);
+    clock_wait_ready();
+    clock_request(CLOCK_POLICY_LOW_POWER);
+    CHECK(!clock_is_ready());
+
+    // Waits for SOSC to clear, then switches back
+    clock_request(CLOCK_POLICY_4MHZ);
+    CHECK_EQ(stats->clock_switch_lost, 0);
+    if(stats->clock_switch_lost) {
+        return;  // The wait would never end
+    }
+
+    clock_wait_ready();
+    CHECK_EQ(sim_node_cpu_hz(dut), 4000000);
+}
+
+// host_main.c app_states_t and the clock each state declares
+static const struct {
+    uint8_t state;
+    const char *name;
+    sim_clk_t clock;
+} host_states[] = {
+    {1, "SLEEP", SIM_CLK_32K},
+    {2, "READ_ADC", SIM_CLK_1M},
+    {4, "SEND_SPI", SIM_CLK_4M}
+};
+
+#define HOST_STATE_COUNT (sizeof(host_states) / sizeof(host_states[0]))
+
+static void test_host_states(void) {
+    sim_node_t *host = sim_node_load(TEST_MODULE("host_fw"), "host");
+    sim_node_t *client = sim_node_load(TEST_MODULE("client_fw"), "client");
+    sim_time_t t = sim_time() + SIM_MS(200);
+    static const char *clock_names[SIM_CLK_COUNT] = {"32 kHz", "1 MHz", "4 MHz", "other"};
+
+    sim_wire(host, 'A', 7, client, 'A', 7);
+    sim_analog_const(host, 8, 0.5);
+    sim_node_start(host);
+    sim_node_start(client);
+    sim_run_until(t);
+    sim_node_stats_reset(host);
+
+    for(uint32_t i = 0; i < 10; i++, t += SIM_MS(300)) {
+        sim_button_press(host, 'F', 6, t, SIM_MS(50));
+    }
+    sim_run_until(t);
+
+    const sim_stats_t *stats = sim_node_stats(host);
+    for(uint32_t i = 0; i < HOST_STATE_COUNT; i++) {
+        const sim_acct_t *acct = &stats->state[host_states[i].state];
+        sim_time_t awake[SIM_CLK_COUNT];
+        sim_time_t total = 0;
+
+        for(int clk = 0; clk < SIM_CLK_COUNT; clk++) {
+            awake[clk] = acct->active[clk] + acct->idle[clk];
+            total += awake[clk];
+        }
+
+        printf("%-8s %6.0f us awake:", host_states[i].name, (double)total / SIM_US(1));
+        for(int clk = 0; clk < SIM_CLK_COUNT; clk++) {
+            printf(" %s %.0f%%", clock_names[clk], total ? 100.0 * awake[clk] / total : 0.0);
+        }
+        printf("\n");
+
+        // Most of the state at its own clock, the rest is the switch
+        // still running on the previous one
+        CHECK(acct->entries >= 10);
+        CHECK(awake[host_states[i].clock] * 2 > total);
+    }
+
+    sim_node_free(client);
+    sim_node_free(host);
+}
+
+int main(void) {
+    dut = sim_node_attach(&sim_io, "dut");
+    sim_node_select(dut);
+    sim_sei();
+
+    clock_set_change_hook(on_clock_change);
+    test_policy_table();
+    test_wait_cost();
+    test_back_to_back();
+    clock_set_change_hook(0);
+
+    sim_node_select(0);
+    test_host_states();
+
+    return TEST_RESULT();
+}
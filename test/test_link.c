@@ -0,0 +1,65 @@
+// HOST and CLIENT firmware over the simulated SPI bus: a button press on
+// the HOST ends up as a sample printed by the CLIENT
+
+#include <string.h>
+#include "sim.h"
+#include "test.h"
+
+// host_main.c app_states_t
+#define STATE_READ_ADC 2
+#define STATE_SEND_SPI 4
+
+int main(void) {
+    sim_node_t *host = sim_node_load(TEST_MODULE("host_fw"), "host");
+    sim_node_t *client = sim_node_load(TEST_MODULE("client_fw"), "client");
+
+    // Chip select, the bus lines are shared by the SPI model
+    sim_wire(host, 'A', 7, client, 'A', 7);
+
+    // Sensor output on AIN8 (PF2)
+    sim_analog_const(host, 8, 0.5);
+
+    sim_node_start(host);
+    sim_node_start(client);
+    sim_run_until(SIM_MS(200));
+
+    // Start-up log dump of the empty EEPROM
+    sim_usart_clear(client);
+
+    sim_button_press(host, 'F', 6, SIM_MS(300), SIM_MS(50));
+    sim_run_until(SIM_MS(1500));
+
+    const char *out = sim_usart_output(client, 0);
+    printf("%s", out);
+
+    // The conversion the HOST made is the one printed
+    char expect[64];
+    uint16_t result = sim_adc_result(host, 0);
+    CHECK_EQ(sim_node_stats(host)->adc_conversions, 1);
+    snprintf(expect, sizeof(expect), "Window: %d\r\nADC: %u\r\n",
+             result > 1000 && result < 3000, result);
+    CHECK(strstr(out, expect) != 0);
+    CHECK(strstr(out, "Frame error") == 0);
+
+    // Pressed again while the HOST waits for VREF to settle: READ_ADC
+    // does not handle the button, the press is taken once back in SLEEP
+    sim_button_press(host, 'F', 6, SIM_MS(1600), SIM_MS(1));
+    while(sim_node_state(host) != STATE_READ_ADC && sim_time() < SIM_MS(2500)) {
+        sim_run_for(SIM_US(50));
+    }
+    CHECK_EQ(sim_node_state(host), STATE_READ_ADC);
+    sim_button_press(host, 'F', 6, sim_time() + SIM_US(100), SIM_MS(1));
+    sim_run_until(SIM_MS(3500));
+    CHECK_EQ(sim_node_stats(host)->adc_conversions, 3);
+    CHECK_EQ(sim_node_stats(host)->state[STATE_SEND_SPI].entries, 3);
+
+    // Both back in deep sleep after the transfer
+    CHECK(sim_node_sleeping(host));
+    CHECK(sim_node_sleeping(client));
+    CHECK_EQ(sim_node_stats(host)->miso_contention, 0);
+    CHECK_EQ(sim_node_stats(client)->spi_rx_lost, 0);
+
+    sim_node_free(client);
+    sim_node_free(host);
+    return TEST_RESULT();
+}
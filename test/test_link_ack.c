@@ -0,0 +1,64 @@
+// Acknowledgements over the full duplex link: each HOST frame brings back
+// the CLIENT's ACK of the previous one. A CLIENT that restarts loses its
+// state, the HOST counts the acknowledgement that does not come back.
+
+#include <string.h>
+#include "sim.h"
+#include "test.h"
+
+#define PRESSES 4
+
+static sim_node_t *host;
+static sim_node_t *client;
+static sim_time_t t;
+
+static void start_client(void) {
+    client = sim_node_load(TEST_MODULE("client_fw"), "client");
+    sim_wire(host, 'A', 7, client, 'A', 7);
+    sim_node_start(client);
+
+    // Start-up log dump of the empty EEPROM
+    t = sim_time() + SIM_MS(200);
+    sim_run_until(t);
+    sim_usart_clear(client);
+}
+
+static void press(uint32_t count) {
+    for(uint32_t i = 0; i < count; i++, t += SIM_MS(300)) {
+        sim_button_press(host, 'F', 6, t, SIM_MS(50));
+    }
+    sim_run_until(t);
+}
+
+int main(void) {
+    host = sim_node_load(TEST_MODULE("host_fw"), "host");
+    sim_analog_const(host, 8, 0.5);
+    sim_node_start(host);
+    start_client();
+
+    const uint8_t *misses = sim_node_symbol(host, "ack_misses");
+    CHECK(misses != 0);
+    if(!misses) {
+        return TEST_RESULT();
+    }
+
+    // Every frame acknowledged during the next one
+    press(PRESSES);
+    const char *out = sim_usart_output(client, 0);
+    CHECK_EQ(*misses, 0);
+    CHECK(strstr(out, "Dropped") == 0);
+    CHECK(strstr(out, "Frame error") == 0);
+
+    // Power cycled CLIENT: the next frame gets no ACK back for the last
+    // one, the ones after it are acknowledged again
+    sim_node_free(client);
+    start_client();
+    press(PRESSES);
+    CHECK_EQ(*misses, 1);
+    CHECK(strstr(sim_usart_output(client, 0), "Dropped") == 0);
+    CHECK_EQ(sim_node_stats(host)->miso_contention, 0);
+
+    sim_node_free(client);
+    sim_node_free(host);
+    return TEST_RESULT();
+}
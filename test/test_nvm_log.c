@@ -0,0 +1,207 @@
+// CLIENT sample log in EEPROM (nvm_log.c): the HOST's periodic
+// SPI_COMMAND_LOG_DUMP streams it back, page erases spread evenly over
+// the ring, and power cut in the middle of a page erase or write loses
+// only that page and the records still in RAM. The cut leaves random
+// bits in the cells being programmed (sim_nvm_power_cut()).
+
+#include <stdio.h>
+#include <string.h>
+#include "sim.h"
+#include "test.h"
+
+#define RING_PAGES   (EEPROM_SIZE / 32)  // NVM_LOG_PAGES
+#define PAGE_RECORDS 7                   // NVM_LOG_PAGE_RECORDS
+#define DUMP_FRAMES  70                  // HOST_LOG_DUMP_FRAMES of host_fw_log_dump
+#define CUT_CASES    10
+
+typedef struct {
+    uint32_t count;  // "Log: <count>"
+    uint32_t lines;  // Record lines that follow
+    uint8_t seq[(RING_PAGES + 1) * PAGE_RECORDS];  // Ring plus the RAM page
+    uint16_t adc[(RING_PAGES + 1) * PAGE_RECORDS];
+} log_dump_t;
+
+// Parse the last dump in a CLIENT's output, 0 if there is none
+static uint32_t parse_last_dump(const char *out, log_dump_t *dump) {
+    const char *p = out;
+    const char *last = 0;
+    uint32_t dumps = 0;
+
+    while((p = strstr(p, "Log: ")) != 0) {
+        last = p++;
+        dumps++;
+    }
+
+    memset(dump, 0, sizeof(*dump));
+    if(!last) {
+        return 0;
+    }
+
+    sscanf(last, "Log: %u", &dump->count);
+    for(p = strchr(last, '\n'); p && p[1] == 'L'; p = strchr(p + 1, '\n')) {
+        unsigned seq, window, adc;
+
+        if(sscanf(p + 1, "L%x W%u A%u", &seq, &window, &adc) != 3 ||
+           dump->lines >= sizeof(dump->seq)) {
+            break;
+        }
+        dump->seq[dump->lines] = (uint8_t)seq;
+        dump->adc[dump->lines] = (uint16_t)adc;
+        dump->lines++;
+    }
+
+    return dumps;
+}
+
+// HOST sampling every 100 ms, log dump command every DUMP_FRAMES frames
+static void test_dump_and_wear(void) {
+    sim_node_t *host = sim_node_load(TEST_MODULE("host_fw_log_dump"), "host");
+    sim_node_t *client = sim_node_load(TEST_MODULE("client_fw"), "client");
+    log_dump_t dump;
+
+    sim_wire(host, 'A', 7, client, 'A', 7);
+    sim_analog_const(host, 8, 0.5);
+    sim_node_start(host);
+    sim_node_start(client);
+
+    // Two dump commands, the ring has wrapped by the second one
+    sim_run_for(SIM_MS(100) * (2 * DUMP_FRAMES + 5));
+
+    const sim_stats_t *stats = sim_node_stats(client);
+    const uint8_t *misses = sim_node_symbol(host, "ack_misses");
+    uint32_t dumps = parse_last_dump(sim_usart_output(client, 0), &dump);
+    uint32_t pages = stats->nvm_erases;
+
+    printf("%u pages written, %u dumps, last one %u records\n", pages, dumps, dump.count);
+
+    // Start-up dump plus one per command, the command frames keep the
+    // acknowledgement sequence intact
+    CHECK_EQ(dumps, 3);
+    CHECK_EQ(*misses, 0);
+    CHECK_EQ(stats->nvm_errors, 0);
+
+    // A full ring plus the records in RAM, oldest first, one command
+    // frame between samples at most
+    CHECK(dump.count >= RING_PAGES * PAGE_RECORDS);
+    CHECK(dump.count < (RING_PAGES + 1) * PAGE_RECORDS);
+    CHECK_EQ(dump.lines, dump.count);
+    for(uint32_t i = 1; i < dump.lines; i++) {
+        uint8_t step = dump.seq[i] - dump.seq[i - 1];
+        CHECK(step == 1 || step == 2);
+    }
+
+    // Whole pages erased, every page of the ring in turn
+    CHECK(pages >= 2 * DUMP_FRAMES / PAGE_RECORDS - 1);
+    for(uint32_t page = 0; page < RING_PAGES; page++) {
+        uint32_t first = page * 32;
+        uint32_t expected = pages / RING_PAGES + (page < pages % RING_PAGES);
+
+        CHECK_EQ(stats->eeprom_erases[first], expected);
+        for(uint32_t i = 1; i < 32; i++) {
+            CHECK_EQ(stats->eeprom_erases[first + i], stats->eeprom_erases[first]);
+        }
+    }
+
+    sim_node_free(client);
+    sim_node_free(host);
+}
+
+// Records a CLIENT booted on the EEPROM image streams at start-up
+static void boot_dump(const uint8_t *image, log_dump_t *dump) {
+    sim_node_t *client = sim_node_load(TEST_MODULE("client_fw"), "client");
+
+    memcpy((void *)sim_node_io(client)->eeprom, image, EEPROM_SIZE);
+    sim_node_start(client);
+    sim_run_for(SIM_MS(200));
+
+    CHECK_EQ(parse_last_dump(sim_usart_output(client, 0), dump), 1);
+    sim_node_free(client);
+}
+
+// Writes completed since the erase, -1 = cut in the erase itself
+static const int cut_points[] = {-1, 0, 6, 13, 27, 30};
+
+// Run on the image until the second page of this boot is being erased or
+// written, cut the power there and keep what is left
+static void run_and_cut(uint8_t *image, double volts, int cut_at) {
+    sim_node_t *host = sim_node_load(TEST_MODULE("host_fw_period100"), "host");
+    sim_node_t *client = sim_node_load(TEST_MODULE("client_fw"), "client");
+    sim_io_t *io = sim_node_io(client);
+    sim_time_t deadline = sim_time() + SIM_S(5);
+    uint32_t page_writes = 0;
+    uint8_t pages = 0;
+    uint8_t erasing = 0;
+
+    memcpy((void *)io->eeprom, image, EEPROM_SIZE);
+    sim_wire(host, 'A', 7, client, 'A', 7);
+    sim_analog_const(host, 8, volts);
+    sim_node_start(host);
+    sim_node_start(client);
+
+    for(;;) {
+        sim_run_for(SIM_MS(1));
+
+        const sim_stats_t *stats = sim_node_stats(client);
+        uint8_t cmd = io->nvmctrl.CTRLA & NVMCTRL_CMD_gm;
+        uint8_t busy = (io->nvmctrl.STATUS & NVMCTRL_EEBUSY_bm) != 0;
+
+        // Erase of a new page started
+        if(busy && cmd == NVMCTRL_CMD_EEMBER32_gc && !erasing) {
+            pages++;
+            page_writes = stats->nvm_writes;
+        }
+        erasing = busy && cmd == NVMCTRL_CMD_EEMBER32_gc;
+
+        if(pages == 2 && busy &&
+           (cut_at < 0 ? erasing : cmd == NVMCTRL_CMD_EEWR_gc &&
+                                   stats->nvm_writes - page_writes == (uint32_t)cut_at)) {
+            break;
+        }
+
+        if(sim_time() > deadline) {
+            CHECK(!"cut point not reached");
+            break;
+        }
+    }
+
+    CHECK_EQ(sim_nvm_power_cut(client), 1);
+    memcpy(image, (const void *)io->eeprom, EEPROM_SIZE);
+
+    sim_node_free(client);
+    sim_node_free(host);
+}
+
+static void test_power_cut(void) {
+    uint8_t image[EEPROM_SIZE];
+    log_dump_t dump;
+
+    memset(image, 0xFF, sizeof(image));
+    sim_nvm_seed(25);
+
+    for(uint32_t c = 0; c < CUT_CASES; c++) {
+        int cut_at = cut_points[c % (sizeof(cut_points) / sizeof(cut_points[0]))];
+
+        // Sample value tells which boot a record is from
+        run_and_cut(image, 0.2 + 0.1 * c, cut_at);
+        boot_dump(image, &dump);
+
+        // One page committed per boot, the torn one holds nothing and
+        // once the ring is full it was the oldest page
+        uint32_t expected = PAGE_RECORDS * (c + 1 < RING_PAGES - 1 ? c + 1 : RING_PAGES - 1);
+        printf("cut %u at write %d: %u records\n", c, cut_at, dump.count);
+        CHECK_EQ(dump.count, expected);
+        CHECK_EQ(dump.lines, dump.count);
+
+        // Oldest first across the boots
+        for(uint32_t i = 1; i < dump.lines; i++) {
+            CHECK(dump.adc[i] >= dump.adc[i - 1]);
+        }
+    }
+}
+
+int main(void) {
+    test_dump_and_wear();
+    test_power_cut();
+
+    return TEST_RESULT();
+}
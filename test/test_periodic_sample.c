@@ -0,0 +1,122 @@
+// Periodic HOST sampling (HOST_SAMPLE_PERIOD_MS): CPU wakes, average
+// current and timestamp jitter with the PIT tick and with the period
+// counted by TCB0 (HOST_SAMPLE_TCB). The README "Periodic sampling" table
+// is this output. Jitter is the largest distance of a conversion from its
+// ideal time (first conversion + n periods).
+
+#include <math.h>
+#include <stdio.h>
+#include "sim.h"
+#include "test.h"
+
+#define MAX_SAMPLES 64
+
+typedef struct {
+    sim_time_t times[MAX_SAMPLES];
+    uint32_t count;
+} sample_log_t;
+
+// Called by the ADC model at every conversion
+static double log_conversion(sim_node_t *node, uint8_t ain, sim_time_t t, void *ctx) {
+    sample_log_t *log = ctx;
+
+    if(log->count < MAX_SAMPLES) {
+        log->times[log->count] = t;
+    }
+    log->count++;
+
+    return 0.5;
+}
+
+typedef struct {
+    double wakes;       // CPU wakes per sample
+    double current_ua;  // HOST average
+    double jitter_ms;
+    double period_ms;   // Mean measured period
+} period_result_t;
+
+static period_result_t run(const char *module, uint32_t period_ms, uint32_t samples) {
+    period_result_t result = {0};
+    sample_log_t log = {{0}, 0};
+    sim_node_t *host = sim_node_load(module, "host");
+    sim_node_t *client = sim_node_load(TEST_MODULE("client_fw"), "client");
+    sim_time_t period = SIM_MS(period_ms);
+    sim_time_t start = sim_time();
+
+    sim_wire(host, 'A', 7, client, 'A', 7);
+    sim_analog_set(host, log_conversion, &log);
+    sim_node_start(host);
+    sim_node_start(client);
+
+    // First sample and link training out of the way
+    sim_run_until(start + period + SIM_MS(500));
+    sim_node_stats_reset(host);
+    uint32_t first = log.count;
+
+    sim_run_until(start + period * (samples + 1) + SIM_MS(500));
+
+    const sim_stats_t *stats = sim_node_stats(host);
+    uint32_t taken = log.count - first;
+
+    CHECK_EQ(taken, samples);
+    CHECK_EQ(stats->tcb_missed, 0);
+
+    result.wakes = (double)stats->wakes / samples;
+    result.current_ua = sim_charge_uc(&stats->total, &sim_power_default) /
+                        ((double)sim_acct_time(&stats->total) / SIM_TIME_HZ);
+
+    // Ideal times from the first conversion on
+    sim_time_t t0 = log.times[0];
+    uint32_t last = log.count < MAX_SAMPLES ? log.count : MAX_SAMPLES;
+    double worst = 0.0;
+    for(uint32_t n = 1; n < last; n++) {
+        double error = fabs((double)log.times[n] - (double)(t0 + n * period));
+        if(error > worst) {
+            worst = error;
+        }
+    }
+    result.jitter_ms = worst / SIM_MS(1);
+    result.period_ms = ((double)(log.times[last - 1] - t0) / (last - 1)) / SIM_MS(1);
+
+    sim_node_free(client);
+    sim_node_free(host);
+    return result;
+}
+
+int main(void) {
+    static const struct {
+        const char *label;
+        uint32_t period_ms;
+        uint32_t samples;
+        const char *pit_module;
+        const char *tcb_module;
+    } runs[] = {
+        {"100 ms", 100, 50, TEST_MODULE("host_fw_period100"), TEST_MODULE("host_fw_period100_tcb")},
+        {"1 s", 1000, 20, TEST_MODULE("host_fw_period1s"), TEST_MODULE("host_fw_period1s_tcb")},
+        {"1 min", 60000, 5, TEST_MODULE("host_fw_period1min"), TEST_MODULE("host_fw_period1min_tcb")},
+        {"1 h", 3600000, 2, TEST_MODULE("host_fw_period1h"), TEST_MODULE("host_fw_period1h_tcb")}
+    };
+
+    printf("| Period | Wake source | Wakes/sample | Max jitter | Average current |\n");
+    printf("|--------|-------------|--------------|------------|-----------------|\n");
+
+    for(size_t i = 0; i < sizeof(runs) / sizeof(runs[0]); i++) {
+        period_result_t pit = run(runs[i].pit_module, runs[i].period_ms, runs[i].samples);
+        period_result_t tcb = run(runs[i].tcb_module, runs[i].period_ms, runs[i].samples);
+
+        printf("| %-6s | PIT tick    | %-12.1f | %-7.2f ms | %-9.2f µA    |\n",
+               runs[i].label, pit.wakes, pit.jitter_ms, pit.current_ua);
+        printf("| %-6s | TCB0 count  | %-12.1f | %-7.2f ms | %-9.2f µA    |\n",
+               runs[i].label, tcb.wakes, tcb.jitter_ms, tcb.current_ua);
+
+        // The mean period stays exact, the remainder carries over
+        CHECK(fabs(pit.period_ms - runs[i].period_ms) < 0.01 * runs[i].period_ms);
+        CHECK(fabs(tcb.period_ms - runs[i].period_ms) < 0.01 * runs[i].period_ms);
+
+        // PIT: at least 8 ticks per sample unless the tick is 1 s,
+        // TCB0: the sample itself only
+        CHECK(tcb.wakes < pit.wakes);
+    }
+
+    return TEST_RESULT();
+}
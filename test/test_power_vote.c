@@ -0,0 +1,135 @@
+// Sleep level votes (power_manager.c): the resolution table, every
+// combination of voters and levels against "shallowest vote wins", and
+// power_idle() sleeping at the resolved level in the simulated core
+
+#include "sim.h"
+#include "sim_cpu.h"
+#include "sleep.h"
+#include "rtc.h"
+#include "test.h"
+
+static sim_node_t *dut;
+
+static const sleep_level_t levels[] = {
+    SLEEP_LEVEL_IDLE, SLEEP_LEVEL_STANDBY, SLEEP_LEVEL_POWERDOWN
+};
+
+#define LEVEL_COUNT (sizeof(levels) / sizeof(levels[0]))
+
+// Votes cast in order, then the level power_idle() must pick
+typedef struct {
+    struct {
+        power_voter_t voter;
+        sleep_level_t level;
+    } votes[4];
+    uint8_t vote_count;
+    sleep_level_t expected;
+} vote_case_t;
+
+static const vote_case_t cases[] = {
+    // No votes
+    {{{0}}, 0, SLEEP_LEVEL_POWERDOWN},
+    // One voter
+    {{{POWER_VOTER_USART, SLEEP_LEVEL_IDLE}}, 1, SLEEP_LEVEL_IDLE},
+    {{{POWER_VOTER_RTC, SLEEP_LEVEL_STANDBY}}, 1, SLEEP_LEVEL_STANDBY},
+    // Shallowest wins, whatever the order
+    {{{POWER_VOTER_RTC, SLEEP_LEVEL_STANDBY}, {POWER_VOTER_SPI, SLEEP_LEVEL_IDLE}}, 2, SLEEP_LEVEL_IDLE},
+    {{{POWER_VOTER_SPI, SLEEP_LEVEL_IDLE}, {POWER_VOTER_RTC, SLEEP_LEVEL_STANDBY}}, 2, SLEEP_LEVEL_IDLE},
+    {{{POWER_VOTER_ADC, SLEEP_LEVEL_STANDBY}, {POWER_VOTER_APP, SLEEP_LEVEL_POWERDOWN}}, 2, SLEEP_LEVEL_STANDBY},
+    // A new vote replaces the voter's old one
+    {{{POWER_VOTER_USART, SLEEP_LEVEL_IDLE}, {POWER_VOTER_USART, SLEEP_LEVEL_STANDBY}}, 2, SLEEP_LEVEL_STANDBY},
+    {{{POWER_VOTER_RTC, SLEEP_LEVEL_STANDBY}, {POWER_VOTER_RTC, SLEEP_LEVEL_IDLE}}, 2, SLEEP_LEVEL_IDLE},
+    // Withdrawing the IDLE vote falls back to the STANDBY one left
+    {{{POWER_VOTER_CLOCK, SLEEP_LEVEL_IDLE}, {POWER_VOTER_TRACE, SLEEP_LEVEL_STANDBY},
+      {POWER_VOTER_CLOCK, SLEEP_LEVEL_POWERDOWN}}, 3, SLEEP_LEVEL_STANDBY},
+    {{{POWER_VOTER_APP, SLEEP_LEVEL_IDLE}, {POWER_VOTER_NVM, SLEEP_LEVEL_IDLE},
+      {POWER_VOTER_APP, SLEEP_LEVEL_POWERDOWN}, {POWER_VOTER_NVM, SLEEP_LEVEL_POWERDOWN}}, 4, SLEEP_LEVEL_POWERDOWN}
+};
+
+#define CASE_COUNT (sizeof(cases) / sizeof(cases[0]))
+
+static void clear_votes(void) {
+    for(uint8_t voter = 0; voter < POWER_VOTER_COUNT; voter++) {
+        power_vote((power_voter_t)voter, SLEEP_LEVEL_POWERDOWN);
+    }
+}
+
+static void test_table(void) {
+    for(uint32_t i = 0; i < CASE_COUNT; i++) {
+        clear_votes();
+        for(uint8_t v = 0; v < cases[i].vote_count; v++) {
+            power_vote(cases[i].votes[v].voter, cases[i].votes[v].level);
+        }
+        CHECK_EQ(power_get_level(), cases[i].expected);
+    }
+}
+
+// Every voter at every level: 3^POWER_VOTER_COUNT combinations
+static void test_all_combinations(void) {
+    uint32_t combinations = 1;
+    for(uint8_t voter = 0; voter < POWER_VOTER_COUNT; voter++) {
+        combinations *= LEVEL_COUNT;
+    }
+
+    uint32_t wrong = 0;
+    for(uint32_t n = 0; n < combinations; n++) {
+        sleep_level_t expected = SLEEP_LEVEL_POWERDOWN;
+        uint32_t digits = n;
+
+        for(uint8_t voter = 0; voter < POWER_VOTER_COUNT; voter++) {
+            sleep_level_t level = levels[digits % LEVEL_COUNT];
+            digits /= LEVEL_COUNT;
+
+            power_vote((power_voter_t)voter, level);
+            if(level < expected) {
+                expected = level;
+            }
+        }
+
+        wrong += power_get_level() != expected;
+    }
+    CHECK_EQ(wrong, 0);
+    clear_votes();
+}
+
+// power_idle() with an RTC compare armed (STANDBY vote) as the wake source
+static void check_idle(sleep_level_t extra_vote, sim_sleep_t expected) {
+    const sim_stats_t *stats = sim_node_stats(dut);
+    sim_acct_t before = stats->total;
+
+    power_vote(POWER_VOTER_USART, extra_vote);
+    rtc_timeout_start(100);
+
+    sim_cli();
+    while(!get_rtc_timeout_status()) {
+        power_idle();
+        sim_cli();
+    }
+    sim_sei();
+    rtc_timeout_cancel();
+    power_vote(POWER_VOTER_USART, SLEEP_LEVEL_POWERDOWN);
+
+    // Whole compare period asleep at the resolved level
+    sim_time_t slept = stats->total.sleep[expected] - before.sleep[expected];
+    CHECK(slept + 2 * SIM_RTC_TICK >= 100 * SIM_RTC_TICK);
+    CHECK_EQ(SLPCTRL.CTRLA & SLPCTRL_SMODE_gm, expected == SIM_SLEEP_IDLE ?
+             SLEEP_LEVEL_IDLE : SLEEP_LEVEL_STANDBY);
+}
+
+int main(void) {
+    dut = sim_node_attach(&sim_io, "dut");
+    sim_node_select(dut);
+    sim_sei();
+
+    CHECK_EQ(power_get_level(), SLEEP_LEVEL_POWERDOWN);
+    test_table();
+    test_all_combinations();
+    CHECK_EQ(power_get_level(), SLEEP_LEVEL_POWERDOWN);
+
+    // The RTC vote alone allows STANDBY, an IDLE vote keeps the core in IDLE
+    check_idle(SLEEP_LEVEL_POWERDOWN, SIM_SLEEP_STANDBY);
+    check_idle(SLEEP_LEVEL_IDLE, SIM_SLEEP_IDLE);
+
+    sim_node_select(0);
+    return TEST_RESULT();
+}
@@ -0,0 +1,91 @@
+// RTC compare timed sleeps against the simulated OSC32K: delay_sleep_*
+// round up to whole ticks, sleep at the requested level for all but the
+// code around the sleep, and split delays longer than the 16-bit compare.
+// At 32.768 kHz that code takes ~3 ms, so shorter delays never sleep.
+
+#include "sim.h"
+#include "sim_cpu.h"
+#include "main_clock_control.h"
+#include "rtc.h"
+#include "test.h"
+
+static sim_node_t *dut;
+
+// Code around one compare period at the current clock
+static sim_time_t max_overhead;
+
+typedef enum {
+    DELAY_US,
+    DELAY_MS
+} delay_unit_t;
+
+static void check_delay(delay_unit_t unit, uint16_t amount, sleep_level_t sleep_level) {
+    const sim_stats_t *stats = sim_node_stats(dut);
+    sim_acct_t before = stats->total;
+    uint32_t isr_before = stats->isr[SIM_VECT_RTC_CNT];
+    sim_time_t start = sim_node_now(dut);
+
+    // Expected ticks, rounded up like the driver
+    uint64_t ticks;
+    if(unit == DELAY_US) {
+        delay_sleep_us(amount, sleep_level);
+        ticks = ((uint64_t)amount * 32768 + 999999) / 1000000;
+    } else {
+        delay_sleep_ms(amount, sleep_level);
+        ticks = ((uint64_t)amount * 32768 + 999) / 1000;
+    }
+
+    sim_time_t elapsed = sim_node_now(dut) - start;
+    sim_time_t active = sim_acct_active(&stats->total) - sim_acct_active(&before);
+    sim_time_t asleep = stats->total.sleep[SIM_SLEEP_STANDBY] - before.sleep[SIM_SLEEP_STANDBY];
+    sim_time_t idle = 0;
+    for(int clk = 0; clk < SIM_CLK_COUNT; clk++) {
+        idle += stats->total.idle[clk] - before.idle[clk];
+    }
+
+    // The first tick may be partial, code before the compare is armed
+    // and after the wake adds to the time
+    CHECK(elapsed + SIM_RTC_TICK >= ticks * SIM_RTC_TICK);
+    CHECK(elapsed <= (ticks + 1) * SIM_RTC_TICK + active);
+    CHECK(active <= max_overhead * ((ticks + 0xFFFE) / 0xFFFF));
+
+    // Asleep at the requested level for the rest
+    sim_time_t slept = sleep_level == SLEEP_LEVEL_IDLE ? idle : asleep;
+    CHECK(slept + active + SIM_RTC_TICK >= elapsed);
+
+    // One compare per 16-bit period, disarmed afterwards
+    CHECK_EQ(stats->isr[SIM_VECT_RTC_CNT] - isr_before, (ticks + 0xFFFE) / 0xFFFF);
+    CHECK_EQ(RTC.INTCTRL, 0);
+}
+
+static void check_clock(clock_policy_t policy, sim_time_t overhead) {
+    max_overhead = overhead;
+    clock_request(policy);
+    clock_wait_ready();
+
+    check_delay(DELAY_US, 250, SLEEP_LEVEL_STANDBY);
+    check_delay(DELAY_US, 1000, SLEEP_LEVEL_STANDBY);
+    check_delay(DELAY_US, 40000, SLEEP_LEVEL_STANDBY);
+    check_delay(DELAY_US, 1000, SLEEP_LEVEL_IDLE);
+    check_delay(DELAY_MS, 1, SLEEP_LEVEL_STANDBY);
+    check_delay(DELAY_MS, 100, SLEEP_LEVEL_STANDBY);
+    check_delay(DELAY_MS, 10, SLEEP_LEVEL_IDLE);
+
+    // 2.5 s is more than one 16-bit compare period
+    check_delay(DELAY_MS, 2500, SLEEP_LEVEL_STANDBY);
+}
+
+int main(void) {
+    dut = sim_node_attach(&sim_io, "dut");
+    sim_node_select(dut);
+    sim_sei();
+
+    check_clock(CLOCK_POLICY_4MHZ, SIM_US(100));
+    CHECK_EQ(sim_node_cpu_hz(dut), 4000000);
+
+    check_clock(CLOCK_POLICY_LOW_POWER, SIM_MS(4));
+    CHECK_EQ(sim_node_cpu_hz(dut), 32768);
+
+    sim_node_select(0);
+    return TEST_RESULT();
+}
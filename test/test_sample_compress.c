@@ -0,0 +1,221 @@
+// Delta sample compression: round trip, buffer sizes past 255 nibbles,
+// and the payload size and cycles per sample on recorded and synthetic
+// waveforms (README "SPI-data-packet-format" table is this output).
+// Cycles are the simulator's estimate (2 per memory access), good for
+// comparing signals and spotting unbounded work, not an AVR count.
+
+#include <math.h>
+#include <string.h>
+#include "sim.h"
+#include "spi_frame.h"
+#include "test.h"
+
+#define BATCH      8    // HOST_BATCH_SIZE of the README figures
+#define BATCHES    200
+#define VREF_VOLTS 3.3  // host_main.c ADC configuration
+
+static sim_node_t *dut;
+
+// Recorded sensor output (test_adc_monitor.c), linear between points
+typedef struct {
+    double ms;
+    double volts;
+} wave_point_t;
+
+static const wave_point_t wave[] = {
+    {0,    0.32}, {300,  0.39}, {500,  1.29}, {900,  1.68},
+    {1000, 1.93}, {1150, 2.90}, {1350, 2.26}, {1700, 1.45},
+    {2000, 0.48}, {2300, 0.16}, {2600, 1.13}, {3000, 1.61},
+    {3500, 1.61}
+};
+
+#define WAVE_POINTS (sizeof(wave) / sizeof(wave[0]))
+
+static uint32_t rng = 1;
+
+// Deterministic noise, so the table does not change between runs
+static uint32_t next_random(void) {
+    rng = rng * 1103515245u + 12345u;
+    return (rng >> 16) & 0x7FFF;
+}
+
+static int32_t noise(int32_t lsb) {
+    return (int32_t)(next_random() % (2 * lsb + 1)) - lsb;
+}
+
+static double wave_volts(double ms) {
+    ms = fmod(ms, wave[WAVE_POINTS - 1].ms);
+
+    for(size_t i = 1; i < WAVE_POINTS; i++) {
+        if(ms <= wave[i].ms) {
+            double f = (ms - wave[i - 1].ms) / (wave[i].ms - wave[i - 1].ms);
+            return wave[i - 1].volts + f * (wave[i].volts - wave[i - 1].volts);
+        }
+    }
+
+    return wave[WAVE_POINTS - 1].volts;
+}
+
+typedef enum {
+    SIGNAL_CONSTANT,
+    SIGNAL_NOISE_1,
+    SIGNAL_NOISE_3,
+    SIGNAL_SINE,
+    SIGNAL_RECORDED,
+    SIGNAL_RANDOM,
+    SIGNAL_COUNT
+} signal_t;
+
+static const char *const signal_names[SIGNAL_COUNT] = {
+    "Constant", "±1 LSB noise", "±3 LSB noise", "Slow sine",
+    "Recorded, 10 ms", "Uniform random"
+};
+
+static uint16_t signal_sample(signal_t signal, uint32_t n) {
+    int32_t code = 2048;
+
+    switch(signal) {
+        case SIGNAL_CONSTANT:
+            break;
+        case SIGNAL_NOISE_1:
+            code += noise(1);
+            break;
+        case SIGNAL_NOISE_3:
+            code += noise(3);
+            break;
+        case SIGNAL_SINE:
+            code += (int32_t)lround(1500.0 * sin(n * 2.0 * M_PI / 500.0));
+            break;
+        case SIGNAL_RECORDED:
+            code = (int32_t)lround(wave_volts(n * 10.0) / VREF_VOLTS * 4095.0) + noise(1);
+            break;
+        default:
+            code = next_random() & SPI_SAMPLE_ADC_gm;
+            break;
+    }
+
+    if(code < 0) {
+        code = 0;
+    } else if(code > 4095) {
+        code = 4095;
+    }
+
+    return (uint16_t)code;
+}
+
+static uint64_t cycles(void) {
+    return sim_node_stats(dut)->total.cycles;
+}
+
+static void test_buffer_sizes(void) {
+    uint8_t samples[SPI_DELTA_MAX_SAMPLES * SPI_SAMPLE_SIZE];
+    uint8_t out[SPI_DELTA_MAX_SAMPLES * SPI_SAMPLE_SIZE];
+    uint8_t packed[255];
+
+    for(uint8_t i = 0; i < SPI_DELTA_MAX_SAMPLES; i++) {
+        spi_sample_pack(&samples[i * SPI_SAMPLE_SIZE], 1000 + i * 37, i & 1);
+    }
+
+    uint8_t size = spi_sample_compress(packed, SPI_FRAME_MAX_PAYLOAD, samples, 4);
+    CHECK(size > 0);
+
+    // Every buffer large enough must work, also those with more than
+    // 255 nibbles (131 bytes and up)
+    for(uint16_t dst_size = size; dst_size <= sizeof(packed); dst_size++) {
+        memset(out, 0, sizeof(out));
+        CHECK_EQ(spi_sample_compress(packed, (uint8_t)dst_size, samples, 4), size);
+        CHECK_EQ(spi_sample_decompress(out, SPI_DELTA_MAX_SAMPLES, packed, (uint8_t)dst_size), 4);
+        CHECK(memcmp(out, samples, 4 * SPI_SAMPLE_SIZE) == 0);
+    }
+
+    // One byte short fails instead of writing past the buffer
+    packed[size - 1] = 0xEE;
+    CHECK_EQ(spi_sample_compress(packed, size - 1, samples, 4), 0);
+    CHECK_EQ(packed[size - 1], 0xEE);
+}
+
+int main(void) {
+    dut = sim_node_attach(&sim_io, "dut");
+    sim_node_select(dut);
+
+    test_buffer_sizes();
+
+    printf("| Signal          | Payload (16 bytes raw) | Ratio | Compress (cycles/sample) | Expand (cycles/sample) |\n");
+    printf("|-----------------|------------------------|-------|--------------------------|------------------------|\n");
+
+    for(signal_t signal = 0; signal < SIGNAL_COUNT; signal++) {
+        uint8_t samples[BATCH * SPI_SAMPLE_SIZE];
+        uint8_t out[BATCH * SPI_SAMPLE_SIZE];
+        uint8_t packed[SPI_FRAME_MAX_PAYLOAD];
+        uint32_t bytes = 0;
+        uint64_t compress_cycles = 0;
+        uint64_t expand_cycles = 0;
+        uint64_t worst_batch = 0;
+        uint32_t n = 0;
+
+        rng = 1;
+
+        for(uint32_t batch = 0; batch < BATCHES; batch++) {
+            for(uint8_t i = 0; i < BATCH; i++) {
+                spi_sample_pack(&samples[i * SPI_SAMPLE_SIZE], signal_sample(signal, n++), 0);
+            }
+
+            uint64_t start = cycles();
+            uint8_t size = spi_sample_compress(packed, sizeof(packed), samples, BATCH);
+            uint64_t batch_cycles = cycles() - start;
+            compress_cycles += batch_cycles;
+
+            // The HOST falls back to raw samples when not shorter
+            if(!size || size >= sizeof(samples)) {
+                bytes += sizeof(samples);
+                if(batch_cycles > worst_batch) {
+                    worst_batch = batch_cycles;
+                }
+                continue;
+            }
+            bytes += size;
+
+            start = cycles();
+            uint8_t count = spi_sample_decompress(out, BATCH, packed, size);
+            expand_cycles += cycles() - start;
+            batch_cycles += cycles() - start;
+            if(batch_cycles > worst_batch) {
+                worst_batch = batch_cycles;
+            }
+
+            CHECK_EQ(count, BATCH);
+            CHECK(memcmp(out, samples, sizeof(samples)) == 0);
+        }
+
+        double payload = (double)bytes / BATCHES;
+        uint32_t samples_sent = BATCHES * BATCH;
+        char payload_text[24];
+        char ratio_text[16];
+
+        snprintf(payload_text, sizeof(payload_text), "%.1f bytes%s", payload,
+                 payload >= sizeof(samples) ? " (raw)" : "");
+        snprintf(ratio_text, sizeof(ratio_text), "%.2f", sizeof(samples) / payload);
+
+        // "±" is two bytes wide in UTF-8
+        int name_width = 15 + (strstr(signal_names[signal], "±") != 0);
+        printf("| %-*s | %-22s | %-5s | %-24.0f | %-22.0f |\n",
+               name_width, signal_names[signal], payload_text, ratio_text,
+               (double)compress_cycles / samples_sent,
+               (double)expand_cycles / samples_sent);
+
+        // Bounded work: no batch beyond what every sample at the
+        // longest code (SPI_DELTA_MAX_NIBBLES) could cost
+        CHECK(worst_batch < BATCH * SPI_DELTA_MAX_NIBBLES * 2 * 8);
+
+        // Slow signals compress, noise only compresses when small
+        if(signal != SIGNAL_RANDOM) {
+            CHECK(payload < sizeof(samples));
+        }
+        if(signal == SIGNAL_CONSTANT || signal == SIGNAL_NOISE_1) {
+            CHECK(payload < sizeof(samples) / 2);
+        }
+    }
+
+    sim_node_select(0);
+    return TEST_RESULT();
+}
@@ -0,0 +1,139 @@
+// Event scheduler (test/sched_app.c on scheduler.c): entry chaining,
+// FIFO dispatch, queue overflow, sleeping at the state's level with an
+// empty queue, and the button-to-handler dispatch latency (README "Event
+// scheduler" table is this output)
+
+#include "sim.h"
+#include "scheduler.h"
+#include "test.h"
+
+// sched_app.c
+enum {
+    APP_INIT,
+    APP_SLEEP,
+    APP_BUSY
+};
+
+#define EVENT_APP_BURST 0x40
+
+extern void (*app_on_event)(uint8_t state, sched_event_t event);
+extern uint8_t app_burst_size;
+
+#define LOG_SIZE 64
+
+static sim_node_t *dut;
+
+static struct {
+    uint8_t state;
+    sched_event_t event;
+} events[LOG_SIZE];
+static uint32_t event_count;
+
+// Cycles and time at the first EVENT_BUTTON dispatch since press()
+static uint64_t button_cycles;
+static sim_time_t button_time;
+
+// Queue overflows seen by the handler of the last event
+static uint8_t overflows;
+
+static void on_event(uint8_t state, sched_event_t event) {
+    if(event_count < LOG_SIZE) {
+        events[event_count].state = state;
+        events[event_count].event = event;
+    }
+    event_count++;
+
+    if(event == EVENT_BUTTON && !button_time) {
+        button_cycles = sim_node_stats(dut)->total.cycles;
+        button_time = sim_node_now(dut);
+    }
+
+    // Runs on the node, its scheduler can be asked directly
+    overflows = sched_get_overflow_count();
+}
+
+// Press the button at t, return the dispatch latency in cycles and time
+static void press(sim_time_t t, uint64_t *cycles, sim_time_t *latency) {
+    sim_run_until(t);
+
+    uint64_t start = sim_node_stats(dut)->total.cycles;
+
+    button_time = 0;
+    sim_button_press(dut, 'F', 6, t, SIM_MS(1));
+    sim_run_until(t + SIM_MS(20));
+
+    CHECK(button_time != 0);
+    *cycles = button_cycles - start;
+    *latency = button_time - t;
+}
+
+static uint8_t logged(uint32_t index, uint8_t state, sched_event_t event) {
+    return index < event_count && index < LOG_SIZE &&
+           events[index].state == state && events[index].event == event;
+}
+
+int main(void) {
+    uint64_t sleep_cycles;
+    uint64_t busy_cycles;
+    sim_time_t sleep_latency;
+    sim_time_t busy_latency;
+
+    dut = sim_node_attach(&sim_io, "dut");
+    app_on_event = on_event;
+    app_burst_size = SCHED_QUEUE_SIZE + 3;
+    sim_node_start(dut);
+    sim_run_until(SIM_MS(100));
+
+    // Entry handlers chain, then the core sleeps in POWERDOWN
+    CHECK_EQ(event_count, 2);
+    CHECK(logged(0, APP_INIT, EVENT_ENTER));
+    CHECK(logged(1, APP_SLEEP, EVENT_ENTER));
+    CHECK(sim_node_sleeping(dut));
+    CHECK_EQ(sim_node_state(dut), APP_SLEEP);
+
+    // Sleep time is accounted when the core wakes up
+    const sim_stats_t *stats = sim_node_stats(dut);
+    sim_node_stats_reset(dut);
+    sim_run_until(SIM_MS(300));
+    CHECK_EQ(stats->total.cycles, 0);
+
+    // Woken from POWERDOWN at 32.768 kHz: BUSY takes its burst in order,
+    // the queue holds SCHED_QUEUE_SIZE - 1, the rest is counted
+    event_count = 0;
+    press(SIM_MS(300), &sleep_cycles, &sleep_latency);
+    CHECK(stats->total.sleep[SIM_SLEEP_POWERDOWN] >= SIM_MS(200));
+
+    uint32_t kept = SCHED_QUEUE_SIZE - 1;
+    CHECK_EQ(event_count, 2 + kept);
+    CHECK(logged(0, APP_SLEEP, EVENT_BUTTON));
+    CHECK(logged(1, APP_BUSY, EVENT_ENTER));
+    for(uint32_t i = 0; i < kept; i++) {
+        CHECK(logged(2 + i, APP_BUSY, EVENT_APP_BURST + i));
+    }
+    CHECK_EQ(sim_node_state(dut), APP_BUSY);
+    CHECK(sim_node_sleeping(dut));
+
+    CHECK_EQ(overflows, app_burst_size - kept);
+
+    // Waiting in BUSY: IDLE sleep at 4 MHz
+    sim_node_stats_reset(dut);
+    event_count = 0;
+    press(SIM_MS(400), &busy_cycles, &busy_latency);
+    CHECK(stats->total.idle[SIM_CLK_4M] >= SIM_MS(50));
+    CHECK_EQ(event_count, 2);
+    CHECK(logged(0, APP_BUSY, EVENT_BUTTON));
+    CHECK(logged(1, APP_SLEEP, EVENT_ENTER));
+
+    printf("| Waiting in | Clock      | Button to handler | CPU cycles |\n");
+    printf("|------------|------------|-------------------|------------|\n");
+    printf("| POWERDOWN  | 32.768 kHz | %4.0f µs           | %-10llu |\n",
+           (double)sleep_latency / SIM_US(1), (unsigned long long)sleep_cycles);
+    printf("| IDLE       | 4 MHz      | %4.0f µs           | %-10llu |\n",
+           (double)busy_latency / SIM_US(1), (unsigned long long)busy_cycles);
+
+    // Port ISR, poll hook, queue and dispatch: a few hundred cycles
+    CHECK(busy_cycles > 0 && busy_cycles < 400);
+    CHECK(sleep_cycles >= busy_cycles);
+
+    return TEST_RESULT();
+}
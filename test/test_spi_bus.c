@@ -0,0 +1,139 @@
+// Bus time per frame with 1, 2, 4 and 8 CLIENTs (README "Multiple
+// CLIENTs" table is this output): the HOST broadcasts each sample, every
+// CLIENT prints it, and only the selected CLIENT ever drives MISO.
+
+#include <stdio.h>
+#include <string.h>
+#include "sim.h"
+#include "test.h"
+
+#define STATE_SEND_SPI 4  // host_main.c app_states_t
+#define SAMPLES        4
+#define MAX_CLIENTS    8
+
+// host_main.c host_spi_clients[]
+static const struct {
+    char port;
+    uint8_t pin;
+} chip_selects[MAX_CLIENTS] = {
+    {'A', 7}, {'C', 0}, {'C', 1}, {'D', 1}, {'D', 2}, {'D', 3}, {'D', 5}, {'D', 6}
+};
+
+// Count occurrences of a string in a CLIENT's output
+static uint32_t count(const char *text, const char *what) {
+    uint32_t n = 0;
+
+    while((text = strstr(text, what)) != 0) {
+        n++;
+        text += strlen(what);
+    }
+
+    return n;
+}
+
+// Training frames addressed to the other CLIENTs, and every broadcast
+// after them, must not look like a gap or a bad frame
+static void check_clean(sim_node_t *client) {
+    const char *out = sim_usart_output(client, 0);
+
+    CHECK_EQ(count(out, "Dropped"), 0);
+    CHECK_EQ(count(out, "Frame error"), 0);
+}
+
+// HOST SEND_SPI time per frame, in ms
+static double run(const char *module, uint8_t clients) {
+    sim_node_t *host = sim_node_load(module, "host");
+    sim_node_t *client[MAX_CLIENTS];
+    sim_time_t t = sim_time() + SIM_MS(200);  // Nodes start at the current time
+
+    for(uint8_t i = 0; i < clients; i++) {
+        char name[16];
+
+        snprintf(name, sizeof(name), "client%u", i);
+        client[i] = sim_node_load(TEST_MODULE("client_fw"), name);
+        sim_wire(host, chip_selects[i].port, chip_selects[i].pin, client[i], 'A', 7);
+    }
+
+    sim_analog_const(host, 8, 0.5);
+    sim_node_start(host);
+    for(uint8_t i = 0; i < clients; i++) {
+        sim_node_start(client[i]);
+    }
+
+    // Warm-up frame (link training with every CLIENT), the first
+    // broadcast after training is checked here before the output is cleared
+    sim_button_press(host, 'F', 6, t, SIM_MS(50));
+    t += SIM_MS(500);
+    sim_run_until(t);
+    sim_node_stats_reset(host);
+    for(uint8_t i = 0; i < clients; i++) {
+        check_clean(client[i]);
+        CHECK_EQ(count(sim_usart_output(client[i], 0), "ADC: "), 1);
+        sim_node_stats_reset(client[i]);
+        sim_usart_clear(client[i]);
+    }
+
+    for(uint8_t i = 0; i < SAMPLES; i++, t += SIM_MS(300)) {
+        sim_button_press(host, 'F', 6, t, SIM_MS(50));
+    }
+    sim_run_until(t + SIM_MS(300));
+
+    const sim_stats_t *stats = sim_node_stats(host);
+    uint32_t frames = stats->state[STATE_SEND_SPI].entries;
+
+    CHECK_EQ(frames, SAMPLES);
+    CHECK_EQ(stats->miso_contention, 0);
+    for(uint8_t i = 0; i < clients; i++) {
+        const sim_stats_t *client_stats = sim_node_stats(client[i]);
+
+        CHECK_EQ(count(sim_usart_output(client[i], 0), "ADC: "), SAMPLES);
+        check_clean(client[i]);
+        CHECK_EQ(client_stats->miso_driven_unselected, 0);
+    }
+
+    double ms = (double)sim_acct_time(&stats->state[STATE_SEND_SPI]) / SIM_MS(1) /
+                (frames ? frames : 1);
+
+    for(uint8_t i = 0; i < clients; i++) {
+        sim_node_free(client[i]);
+    }
+    sim_node_free(host);
+    return ms;
+}
+
+int main(void) {
+    static const struct {
+        uint8_t clients;
+        const char *module;
+    } runs[] = {
+        {1, TEST_MODULE("host_fw")},
+        {2, TEST_MODULE("host_fw_bus2")},
+        {4, TEST_MODULE("host_fw_bus4")},
+        {8, TEST_MODULE("host_fw_bus8")}
+    };
+    double single = 0;
+
+    printf("| CLIENTs | Broadcast | One by one (N x 1 CLIENT) |\n");
+    printf("|---------|-----------|---------------------------|\n");
+
+    for(size_t i = 0; i < sizeof(runs) / sizeof(runs[0]); i++) {
+        double ms = run(runs[i].module, runs[i].clients);
+
+        if(runs[i].clients == 1) {
+            single = ms;
+        }
+
+        char broadcast[16];
+        char one_by_one[16];
+        snprintf(broadcast, sizeof(broadcast), "%.1f ms", ms);
+        snprintf(one_by_one, sizeof(one_by_one), "%.1f ms", single * runs[i].clients);
+        printf("| %-7u | %-9s | %-25s |\n", runs[i].clients, broadcast, one_by_one);
+
+        // The shared wake pulse beats waking each CLIENT in turn
+        if(runs[i].clients > 1) {
+            CHECK(ms < single * runs[i].clients);
+        }
+    }
+
+    return TEST_RESULT();
+}
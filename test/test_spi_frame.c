@@ -0,0 +1,103 @@
+// Frame layer: CRC-8 check value, encode/decode round trip, and the
+// length, CRC and type errors a receiver must catch
+
+#include <string.h>
+#include "spi_frame.h"
+#include "test.h"
+
+static void test_crc8(void) {
+    // CRC-8 (poly 0x07, init 0x00) check value
+    CHECK_EQ(spi_frame_crc8((const uint8_t *)"123456789", 9), 0xF4);
+    CHECK_EQ(spi_frame_crc8(0, 0), 0x00);
+}
+
+static void test_round_trip(void) {
+    uint8_t payload[SPI_FRAME_MAX_PAYLOAD];
+    uint8_t frame[SPI_FRAME_MAX_SIZE];
+    spi_frame_t out;
+
+    for(uint8_t i = 0; i < sizeof(payload); i++) {
+        payload[i] = (uint8_t)(i * 37 + 1);
+    }
+
+    for(uint8_t len = 0; len <= SPI_FRAME_MAX_PAYLOAD; len++) {
+        uint8_t size = spi_frame_encode(frame, SPI_FRAME_TYPE_SAMPLES, len + 100, payload, len);
+
+        CHECK_EQ(size, len + SPI_FRAME_OVERHEAD);
+        CHECK_EQ(spi_frame_size(frame[SPI_FRAME_LEN_POS]), size);
+        CHECK_EQ(spi_frame_decode(frame, size, &out), SPI_FRAME_OK);
+        CHECK_EQ(out.type, SPI_FRAME_TYPE_SAMPLES);
+        CHECK_EQ(out.seq, len + 100);
+        CHECK_EQ(out.len, len);
+        CHECK(memcmp(out.payload, payload, len) == 0);
+
+        // Trailing bytes after the CRC are ignored
+        CHECK_EQ(spi_frame_decode(frame, SPI_FRAME_MAX_SIZE, &out), SPI_FRAME_OK);
+    }
+
+    // Too long for one frame
+    CHECK_EQ(spi_frame_encode(frame, SPI_FRAME_TYPE_SAMPLES, 0, payload,
+                              SPI_FRAME_MAX_PAYLOAD + 1), 0);
+}
+
+static void test_corrupted(void) {
+    const uint8_t payload[4] = {0x12, 0x34, 0x56, 0x78};
+    uint8_t frame[SPI_FRAME_MAX_SIZE];
+    spi_frame_t out;
+    uint8_t size = spi_frame_encode(frame, SPI_FRAME_TYPE_SAMPLES, 7, payload, sizeof(payload));
+
+    // Every single bit error is caught by the CRC or the length check
+    for(uint8_t byte = 0; byte < size; byte++) {
+        for(uint8_t bit = 0; bit < 8; bit++) {
+            frame[byte] ^= 1 << bit;
+            CHECK(spi_frame_decode(frame, size, &out) != SPI_FRAME_OK);
+            frame[byte] ^= 1 << bit;
+        }
+    }
+
+    // Corrupted CRC
+    frame[size - 1] ^= 0xFF;
+    CHECK_EQ(spi_frame_decode(frame, size, &out), SPI_FRAME_ERR_CRC);
+    frame[size - 1] ^= 0xFF;
+
+    // LEN beyond the protocol limit, or beyond the bytes received
+    frame[SPI_FRAME_LEN_POS] = SPI_FRAME_MAX_PAYLOAD + 1;
+    CHECK_EQ(spi_frame_decode(frame, SPI_FRAME_MAX_SIZE, &out), SPI_FRAME_ERR_LENGTH);
+    CHECK_EQ(spi_frame_size(frame[SPI_FRAME_LEN_POS]), SPI_FRAME_MAX_SIZE);
+    frame[SPI_FRAME_LEN_POS] = sizeof(payload);
+    CHECK_EQ(spi_frame_decode(frame, size - 1, &out), SPI_FRAME_ERR_LENGTH);
+    CHECK_EQ(spi_frame_decode(frame, SPI_FRAME_OVERHEAD - 1, &out), SPI_FRAME_ERR_LENGTH);
+
+    // All zeros (idle or stuck-low MISO) has a valid CRC but TYPE 0x00
+    memset(frame, 0, sizeof(frame));
+    CHECK_EQ(spi_frame_decode(frame, SPI_FRAME_OVERHEAD, &out), SPI_FRAME_ERR_TYPE);
+
+    // All ones (MISO not driven, pull-up) is rejected by its length
+    memset(frame, 0xFF, sizeof(frame));
+    CHECK_EQ(spi_frame_decode(frame, SPI_FRAME_MAX_SIZE, &out), SPI_FRAME_ERR_LENGTH);
+}
+
+static void test_sample_pack(void) {
+    uint8_t sample[SPI_SAMPLE_SIZE];
+
+    spi_sample_pack(sample, 0x0ABC, 1);
+    CHECK_EQ(sample[0], 0xBC);
+    CHECK_EQ(sample[1], 0x8A);
+    CHECK_EQ(spi_sample_unpack(sample), 0x8ABC);
+
+    // Bits above the 12-bit result are dropped
+    spi_sample_pack(sample, 0xFFFF, 0);
+    CHECK_EQ(spi_sample_unpack(sample), 0x0FFF);
+
+    spi_sample_pack_hires(sample, 0x7FFF, 1);
+    CHECK_EQ(spi_sample_unpack(sample), 0xFFFF);
+}
+
+int main(void) {
+    test_crc8();
+    test_round_trip();
+    test_corrupted();
+    test_sample_pack();
+
+    return TEST_RESULT();
+}
@@ -0,0 +1,132 @@
+// Ready handshake latency: time from the HOST pulling SS low to the poll
+// that gets SPI_READY_BYTE back, over button presses at random intervals.
+// The fixed 4 ms SS-to-data wait it replaced is the reference: the
+// handshake is shorter on average and still delivers when the CLIENT
+// needs longer than 4 ms. The README "Ready handshake" table is this
+// output.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "sim.h"
+#include "test.h"
+
+#define PRESSES     60
+#define STEP        SIM_US(5)
+#define BYTE_GAP    SIM_US(100)  // Longer gaps separate polls, frame bytes are back to back
+#define FIXED_WAIT  SIM_MS(4)
+#define MAX_SELECTS 256
+#define POLL_BUDGET SIM_US(250 * 40)  // SPI_READY_POLL_US * SPI_READY_MAX_POLLS
+
+static uint32_t rng_state = 6;
+
+static uint32_t next_random(void) {
+    // xorshift32
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 17;
+    rng_state ^= rng_state << 5;
+    return rng_state;
+}
+
+static int compare_time(const void *a, const void *b) {
+    sim_time_t x = *(const sim_time_t *)a;
+    sim_time_t y = *(const sim_time_t *)b;
+
+    return (x > y) - (x < y);
+}
+
+static double to_us(sim_time_t t) {
+    return (double)t / SIM_US(1);
+}
+
+int main(void) {
+    static sim_time_t latency[MAX_SELECTS];
+    uint32_t selects = 0;
+    sim_node_t *host = sim_node_load(TEST_MODULE("host_fw"), "host");
+    sim_node_t *client = sim_node_load(TEST_MODULE("client_fw"), "client");
+    sim_time_t t = sim_time() + SIM_MS(200);
+
+    sim_wire(host, 'A', 7, client, 'A', 7);
+    sim_analog_const(host, 8, 0.5);
+    sim_node_start(host);
+    sim_node_start(client);
+
+    // 2 ms (CLIENT still printing) to 300 ms (long asleep) apart
+    for(uint32_t i = 0; i < PRESSES; i++) {
+        sim_button_press(host, 'F', 6, t, SIM_MS(1));
+        t += SIM_MS(2 + next_random() % 299);
+    }
+
+    // Follow SS and the bytes the HOST shifts while it is low
+    uint8_t ss = 1;
+    uint32_t bytes = sim_node_stats(host)->spi_bytes;
+    sim_time_t ss_fall = 0;
+    sim_time_t last_byte = 0;
+    sim_time_t burst_start = 0;
+
+    while(sim_time() < t + SIM_MS(300)) {
+        sim_run_for(STEP);
+        sim_time_t now = sim_time();
+        uint8_t level = sim_pin_level(client, 'A', 7);
+
+        if(ss && !level) {
+            ss_fall = now;
+            last_byte = now;
+            burst_start = 0;
+        }
+
+        // The ready poll and the frame come as one burst after the
+        // last sleep between polls
+        uint32_t shifted = sim_node_stats(host)->spi_bytes;
+        if(shifted != bytes && !(ss && level)) {
+            if(!burst_start || now - last_byte > BYTE_GAP) {
+                burst_start = now;
+            }
+            last_byte = now;
+        }
+        bytes = shifted;
+
+        if(!ss && level && burst_start && selects < MAX_SELECTS) {
+            latency[selects++] = burst_start - ss_fall;
+        }
+        ss = level;
+    }
+
+    const sim_stats_t *stats = sim_node_stats(host);
+    uint32_t frames = stats->state[4].entries;  // host_main.c STATE_SEND_SPI
+    uint8_t misses = *(const uint8_t *)sim_node_symbol(host, "ack_misses");
+
+    qsort(latency, selects, sizeof(latency[0]), compare_time);
+
+    sim_time_t sum = 0;
+    uint32_t over = 0;
+    for(uint32_t i = 0; i < selects; i++) {
+        sum += latency[i];
+        over += latency[i] > FIXED_WAIT;
+    }
+
+    printf("%u frames, %u selects, %u longer than the fixed wait\n", frames, selects, over);
+    printf("| SS low to ready | Handshake   | Fixed wait |\n");
+    printf("|-----------------|-------------|------------|\n");
+    printf("| Minimum         | %-8.0f µs | %-7.0f µs |\n", to_us(latency[0]), to_us(FIXED_WAIT));
+    printf("| Median          | %-8.0f µs | %-7.0f µs |\n", to_us(latency[selects / 2]),
+           to_us(FIXED_WAIT));
+    printf("| 90th percentile | %-8.0f µs | %-7.0f µs |\n", to_us(latency[selects * 9 / 10]),
+           to_us(FIXED_WAIT));
+    printf("| Maximum         | %-8.0f µs | %-7.0f µs |\n", to_us(latency[selects - 1]),
+           to_us(FIXED_WAIT));
+    printf("| Mean            | %-8.0f µs | %-7.0f µs |\n", to_us(sum / selects), to_us(FIXED_WAIT));
+
+    // Every sample delivered and acknowledged, no select gave up
+    CHECK(frames >= PRESSES * 9 / 10);
+    CHECK_EQ(misses, 0);
+    CHECK(selects >= frames);
+
+    // Shorter than the fixed wait on average, the slowest wake well
+    // inside the poll budget
+    CHECK(sum / selects < FIXED_WAIT);
+    CHECK(latency[selects - 1] < POLL_BUDGET / 2);
+
+    sim_node_free(client);
+    sim_node_free(host);
+    return TEST_RESULT();
+}
@@ -0,0 +1,104 @@
+// Interrupt-driven SPI host transfers against the SPI0 register model:
+// every byte shifted once, one TXC per transfer, the core sleeps in IDLE
+// meanwhile, and blocking calls refuse to start while an async transfer
+// owns the bus
+
+#include "sim.h"
+#include "sim_cpu.h"
+#include "spi0.h"
+#include "test.h"
+
+static sim_node_t *dut;
+static volatile uint8_t done_calls;
+
+static void on_done(void) {
+    done_calls++;
+}
+
+static void spin_until_complete(void) {
+    for(int i = 0; i < 1000 && !get_spi_tx_complete_status(); i++) {
+        sim_spin(dut, SIM_US(10));
+    }
+}
+
+static void test_blocking(void) {
+    static const uint8_t tx[] = {0x5A, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0xA5};
+    uint8_t rx[sizeof(tx)];
+    const sim_stats_t *stats = sim_node_stats(dut);
+    uint32_t bytes = stats->spi_bytes;
+    uint32_t txc = stats->isr[SIM_VECT_SPI0];
+    sim_time_t idle = stats->total.idle[SIM_CLK_4M];
+
+    CHECK(spi_transfer(tx, rx, sizeof(tx)));
+
+    CHECK_EQ(stats->spi_bytes - bytes, sizeof(tx));
+    CHECK(stats->isr[SIM_VECT_SPI0] - txc >= 2);
+    CHECK(stats->total.idle[SIM_CLK_4M] > idle);
+    CHECK(get_spi_tx_complete_status());
+    CHECK_EQ(SPI0.INTCTRL, 0);
+    CHECK_EQ(stats->spi_tx_overwrites, 0);
+}
+
+static void test_async_busy(void) {
+    static const uint8_t tx[16] = {0};
+    static const uint8_t frame[] = {0x11, 0x22};
+    const sim_stats_t *stats = sim_node_stats(dut);
+
+    uint32_t start = stats->spi_bytes;
+
+    done_calls = 0;
+    CHECK(spi0_write_block_async(tx, sizeof(tx), on_done));
+    CHECK(!get_spi_tx_complete_status());
+
+    // Bus taken: no second transfer, no select, nothing shifted
+    uint32_t bytes = stats->spi_bytes;
+    CHECK(!spi_transfer_async(frame, 0, sizeof(frame), 0));
+    CHECK(!spi_transfer(frame, 0, sizeof(frame)));
+    CHECK(!spi0_write_block(frame, sizeof(frame)));
+    CHECK_EQ(spi_send_frame_to(0, frame, sizeof(frame), 0), 0);
+    CHECK_EQ(spi_send_frame_to(SPI_BROADCAST, frame, sizeof(frame), 0), 0);
+    CHECK(sim_pin_level(dut, 'A', 7));
+    CHECK(stats->spi_bytes - bytes <= 1);  // Only the async transfer's own
+
+    spin_until_complete();
+    CHECK(get_spi_tx_complete_status());
+    CHECK_EQ(done_calls, 1);
+    CHECK_EQ(stats->spi_bytes - start, sizeof(tx));
+    CHECK_EQ(stats->spi_tx_overwrites, 0);
+
+    // Free again
+    CHECK(spi_transfer(frame, 0, sizeof(frame)));
+}
+
+static void test_no_client(void) {
+    static const uint8_t frame[] = {0x11, 0x22};
+    const sim_stats_t *stats = sim_node_stats(dut);
+    uint32_t bytes = stats->spi_bytes;
+
+    // Nobody answers the polls: every select runs out its budget, the
+    // frame itself is never sent
+    CHECK_EQ(spi_send_frame_to(0, frame, sizeof(frame), 0), 0);
+    CHECK_EQ(stats->spi_bytes - bytes, SPI_SELECT_RETRIES * SPI_READY_MAX_POLLS);
+    sim_spin(dut, SIM_US(1));  // Let the model see the last register write
+    CHECK(sim_pin_level(dut, 'A', 7));
+
+    // Unknown client address
+    bytes = stats->spi_bytes;
+    CHECK_EQ(spi_send_frame_to(1, frame, sizeof(frame), 0), 0);
+    CHECK_EQ(stats->spi_bytes, bytes);
+}
+
+int main(void) {
+    dut = sim_node_attach(&sim_io, "dut");
+    sim_node_select(dut);
+
+    spi_host_init();
+    sim_sei();
+
+    test_blocking();
+    test_async_busy();
+    test_no_client();
+
+    sim_node_select(0);
+    return TEST_RESULT();
+}
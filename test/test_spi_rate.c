@@ -0,0 +1,89 @@
+// SPI clock rate benchmark (spi_driver.c): HOST transfers at every
+// spi_rate_t on the SPI0 register model, bytes per second and the HOST's
+// energy per byte (CPU at 4 MHz, IDLE between the DRE and TXC
+// interrupts). The README "SPI clock rate" table is this output.
+
+#include <stdio.h>
+#include "sim.h"
+#include "sim_cpu.h"
+#include "spi0.h"
+#include "test.h"
+
+#define TRANSFERS     8
+#define TRANSFER_SIZE 64
+
+static sim_node_t *dut;
+
+static const char *const rate_names[SPI_RATE_COUNT] = {
+    "DIV128", "DIV64", "DIV32", "DIV16", "DIV8", "DIV4", "DIV2"
+};
+
+typedef struct {
+    double bytes_per_s;
+    double energy_nj;  // Per byte
+} rate_result_t;
+
+static rate_result_t measure(spi_rate_t rate) {
+    static uint8_t tx[TRANSFER_SIZE];
+    static uint8_t rx[TRANSFER_SIZE];
+    const sim_stats_t *stats = sim_node_stats(dut);
+    rate_result_t result;
+
+    for(uint32_t i = 0; i < TRANSFER_SIZE; i++) {
+        tx[i] = (uint8_t)(i * 37);
+    }
+
+    spi_host_set_rate(rate);
+    sim_node_stats_reset(dut);
+    sim_time_t start = sim_node_now(dut);
+
+    for(uint32_t i = 0; i < TRANSFERS; i++) {
+        CHECK(spi_transfer(tx, rx, sizeof(tx)));
+    }
+
+    sim_time_t elapsed = sim_node_now(dut) - start;
+    CHECK_EQ(stats->spi_bytes, TRANSFERS * TRANSFER_SIZE);
+    CHECK_EQ(stats->spi_tx_overwrites, 0);
+
+    result.bytes_per_s = stats->spi_bytes / ((double)elapsed / SIM_TIME_HZ);
+    result.energy_nj = sim_energy_uj(&stats->total, &sim_power_default) * 1000.0 / stats->spi_bytes;
+    return result;
+}
+
+int main(void) {
+    rate_result_t results[SPI_RATE_COUNT];
+
+    dut = sim_node_attach(&sim_io, "dut");
+    sim_node_select(dut);
+    spi_host_init();
+    sim_sei();
+
+    printf("| Rate   | SCK      | Bytes/s | Energy/byte |\n");
+    printf("|--------|----------|---------|-------------|\n");
+    for(spi_rate_t rate = 0; rate < SPI_RATE_COUNT; rate++) {
+        double sck_khz = 4000.0 / (2 << (SPI_RATE_COUNT - 1 - rate));
+
+        results[rate] = measure(rate);
+        printf("| %-6s | %-4g kHz | %-7.0f | %-8.0f nJ |\n", rate_names[rate], sck_khz,
+               results[rate].bytes_per_s, results[rate].energy_nj);
+    }
+
+    for(spi_rate_t rate = 0; rate < SPI_RATE_COUNT; rate++) {
+        double sck_bytes = 4000000.0 / (2 << (SPI_RATE_COUNT - 1 - rate)) / 8;
+
+        // Never faster than SCK, close to it while the ISR keeps up
+        CHECK(results[rate].bytes_per_s <= sck_bytes);
+        if(rate <= SPI_RATE_DIV16) {
+            CHECK(results[rate].bytes_per_s > 0.8 * sck_bytes);
+        }
+
+        // Faster is never slower and never costs more per byte
+        if(rate) {
+            CHECK(results[rate].bytes_per_s >= results[rate - 1].bytes_per_s);
+            CHECK(results[rate].energy_nj <= results[rate - 1].energy_nj);
+        }
+    }
+
+    sim_node_select(0);
+    return TEST_RESULT();
+}
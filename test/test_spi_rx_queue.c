@@ -0,0 +1,139 @@
+// CLIENT receive queue under load: frames arrive back to back at random
+// gaps while the consumer reads slots with the SPI ISR running between
+// any two of its byte reads, and stalls now and then to fill the queue.
+// Every frame read must be whole, in order, and every dropped frame
+// counted in the overruns of the next one.
+
+#include <string.h>
+#include "sim.h"
+#include "sim_cpu.h"
+#include "spi0.h"
+#include "spi_frame.h"
+#include "test.h"
+
+#define FRAMES 2000
+
+static sim_node_t *dut;
+
+// test/client_select.c: spi_client_set_ready() on every select
+void client_select_init(void);
+
+static uint32_t rng = 12345;
+
+static uint32_t random_below(uint32_t n) {
+    // xorshift32
+    rng ^= rng << 13;
+    rng ^= rng >> 17;
+    rng ^= rng << 5;
+    return rng % n;
+}
+
+// Payload derived from the frame number, so a torn slot cannot decode
+static uint8_t payload_byte(uint32_t frame, uint8_t i) {
+    return (uint8_t)(frame * 7 + i * 31);
+}
+
+// One whole transaction from an outside host, from t on: SS low, two
+// ready polls (the client only takes bytes once ready), the frame
+// bytes, SS high. Returns the end time.
+static sim_time_t send_frame(uint32_t frame, sim_time_t t) {
+    uint8_t payload[SPI_FRAME_MAX_PAYLOAD];
+    uint8_t data[SPI_FRAME_MAX_SIZE];
+    uint8_t len = (uint8_t)random_below(SPI_FRAME_MAX_PAYLOAD + 1);
+
+    for(uint8_t i = 0; i < len; i++) {
+        payload[i] = payload_byte(frame, i);
+    }
+    uint8_t size = spi_frame_encode(data, SPI_FRAME_TYPE_SAMPLES, (uint8_t)frame,
+                                    payload, len);
+
+    // 250 kHz .. 125 kHz SCK, the client ISR keeps up at 4 MHz
+    sim_time_t byte_time = SIM_US(32) + random_below(SIM_US(32));
+
+    sim_pin_drive(dut, 'A', 7, 0, t);
+    t += SIM_US(2);
+    for(uint8_t i = 0; i < 2; i++) {
+        t += byte_time;
+        sim_spi_inject(dut, SPI_POLL_BYTE, t);
+    }
+    for(uint8_t i = 0; i < size; i++) {
+        t += byte_time;
+        sim_spi_inject(dut, data[i], t);
+    }
+    t += SIM_US(2);
+    sim_pin_drive(dut, 'A', 7, 1, t);
+
+    return t;
+}
+
+int main(void) {
+    const sim_stats_t *stats;
+    uint32_t sent = 0;
+    uint32_t received = 0;
+    uint32_t dropped = 0;
+    uint32_t expected = 0;  // Frame number of the next one in the queue
+    sim_time_t t;
+
+    dut = sim_node_attach(&sim_io, "dut");
+    stats = sim_node_stats(dut);
+    sim_node_select(dut);
+
+    sim_pin_drive(dut, 'A', 7, 1, 0);
+    client_select_init();
+    spi_client_init();
+    sim_sei();
+    sim_spin(dut, SIM_US(10));
+    t = sim_node_now(dut);
+
+    while(expected < FRAMES) {
+        // Keep the bus busy ahead of the consumer. Frames dropped at the
+        // end are only counted by the next one, so send on past FRAMES.
+        while(t < sim_node_now(dut) + SIM_MS(5)) {
+            t = send_frame(sent++, t + random_below(SIM_US(100)));
+        }
+
+        const spi_rx_slot_t *slot = spi_rx_peek();
+        if(!slot) {
+            sim_spin(dut, SIM_US(1) + random_below(SIM_US(20)));
+            continue;
+        }
+
+        // Byte by byte, the ISR may fill other slots in between
+        uint8_t copy[SPI_FRAME_MAX_SIZE];
+        for(uint8_t i = 0; i < sizeof(copy); i++) {
+            copy[i] = slot->data[i];
+            sim_spin(dut, random_below(SIM_US(4)));
+        }
+        uint8_t overruns = slot->overruns;
+
+        spi_frame_t frame;
+        CHECK_EQ(spi_frame_decode(copy, sizeof(copy), &frame), SPI_FRAME_OK);
+
+        // Frames lost before this one, all of them counted
+        CHECK_EQ((uint8_t)(frame.seq - (uint8_t)expected), overruns);
+        dropped += overruns;
+        expected += overruns;
+
+        for(uint8_t i = 0; i < frame.len; i++) {
+            CHECK_EQ(frame.payload[i], payload_byte(expected, i));
+        }
+        expected++;
+        received++;
+
+        spi_rx_release();
+
+        // Stall now and then so the queue fills up and drops frames
+        if(random_below(8) == 0) {
+            sim_spin(dut, SIM_US(500) + random_below(SIM_MS(3)));
+        }
+    }
+
+    printf("%u frames: %u received, %u dropped\n", expected, received, dropped);
+    CHECK(dropped > 0);
+    CHECK(received > expected / 2);
+    CHECK_EQ(stats->spi_overflows, 0);
+    CHECK_EQ(stats->spi_rx_lost, 0);
+
+    sim_node_select(0);
+    return TEST_RESULT();
+}
@@ -0,0 +1,85 @@
+// HOST state trace (TRACE_ENABLE=1): the ring is dumped once it fills
+// up, not after every wake, and the traced state times match the
+// simulator's own per-state accounting. The HOST output is written to
+// trace_host.txt for the trace_report check.
+
+#include <stdio.h>
+#include <string.h>
+#include "sim.h"
+#include "test.h"
+
+#define STATE_SLEEP    1  // host_main.c app_states_t
+#define STATE_SEND_SPI 4
+#define SAMPLES        24
+
+int main(void) {
+    sim_node_t *host = sim_node_load(TEST_MODULE("host_fw_trace"), "host");
+    sim_node_t *client = sim_node_load(TEST_MODULE("client_fw"), "client");
+    sim_time_t t = sim_time() + SIM_MS(200);
+    size_t last_len = 0;
+    uint32_t dumps = 0;
+
+    sim_wire(host, 'A', 7, client, 'A', 7);
+    sim_analog_const(host, 8, 0.5);
+    sim_node_start(host);
+    sim_node_start(client);
+
+    // One sample per press, the next one once the HOST is asleep again
+    // (a dump at 1200 baud takes ~0.5 s). Note the wakes that printed.
+    for(uint32_t i = 0; i < SAMPLES; i++) {
+        sim_button_press(host, 'F', 6, t, SIM_MS(50));
+        sim_run_until(t + SIM_MS(100));
+        while(sim_node_state(host) != STATE_SLEEP || !sim_node_sleeping(host)) {
+            sim_run_for(SIM_MS(10));
+        }
+        t = sim_time() + SIM_MS(100);
+
+        size_t len;
+        sim_usart_output(host, &len);
+        dumps += len != last_len;
+        last_len = len;
+    }
+
+    const sim_stats_t *stats = sim_node_stats(host);
+    const char *out = sim_usart_output(host, 0);
+    uint32_t frames = stats->state[STATE_SEND_SPI].entries;
+
+    // Traced SEND_SPI time against the simulator
+    uint32_t lines = 0;
+    uint32_t spi_entries = 0;
+    uint64_t spi_ticks = 0;
+    for(const char *p = out; p && *p; p = strchr(p, '\n'), p = p ? p + 1 : 0) {
+        unsigned state, clock, ticks;
+
+        if(sscanf(p, "S%u C%u T%u", &state, &clock, &ticks) == 3) {
+            lines++;
+            if(state == STATE_SEND_SPI) {
+                spi_entries++;
+                spi_ticks += ticks;
+            }
+        }
+    }
+
+    double traced_ms = spi_entries ? 1000.0 * spi_ticks / 32768 / spi_entries : 0;
+    double sim_ms = (double)sim_acct_time(&stats->state[STATE_SEND_SPI]) / SIM_MS(1) / frames;
+    printf("%u frames, %u dumps, %u lines, SEND_SPI %.3f ms traced, %.3f ms simulated\n",
+           frames, dumps, lines, traced_ms, sim_ms);
+
+    CHECK_EQ(frames, SAMPLES);
+    CHECK(dumps >= 1);
+    CHECK(dumps <= frames / 3);
+    CHECK(strstr(out, "Trace lost") == 0);
+    CHECK(spi_entries > 0);
+    CHECK(traced_ms > sim_ms * 0.9 && traced_ms < sim_ms * 1.1 + 0.1);
+
+    FILE *file = fopen("trace_host.txt", "w");
+    CHECK(file != 0);
+    if(file) {
+        fputs(out, file);
+        fclose(file);
+    }
+
+    sim_node_free(client);
+    sim_node_free(host);
+    return TEST_RESULT();
+}
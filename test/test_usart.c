@@ -0,0 +1,122 @@
+// Interrupt-driven USART0 transmitter against the DREIF/TXCIF flag
+// model: every byte goes out once and in order, TXC completes only after
+// the last frame, a full ring buffer blocks instead of dropping, and the
+// clock change hook drains the buffer without touching the caller's I bit
+
+#include <string.h>
+#include "sim.h"
+#include "sim_cpu.h"
+#include "main_clock_control.h"
+#include "usart0_tx.h"
+#include "test.h"
+
+USART_CONFIG(test_usart_config, 0x00, 0x00, 0, 0x03, 115200);
+
+static sim_node_t *dut;
+
+// Spin until the transmitter reports completion, 1 = it did in time
+static uint8_t wait_tx_complete(sim_time_t timeout) {
+    sim_time_t end = sim_node_now(dut) + timeout;
+
+    while(sim_node_now(dut) < end) {
+        if(get_usart_tx_complete_status()) {
+            return 1;
+        }
+        sim_spin(dut, SIM_US(10));
+    }
+
+    return 0;
+}
+
+static void test_single_burst(void) {
+    const char *text = "Hello, world\r\n";
+    size_t len = strlen(text);
+    const sim_stats_t *stats = sim_node_stats(dut);
+    uint32_t bytes_before = stats->usart_bytes;
+
+    sim_usart_clear(dut);
+    usart0_send_string(text);
+    CHECK(!get_usart_tx_complete_status());
+
+    // Complete exactly when the last frame has left the shift register
+    while(!get_usart_tx_complete_status()) {
+        CHECK(sim_usart_output(dut, 0)[0] == '\0' || strlen(sim_usart_output(dut, 0)) < len);
+        sim_spin(dut, SIM_US(5));
+    }
+    CHECK(strcmp(sim_usart_output(dut, 0), text) == 0);
+
+    // Each byte shifted once, one TXC for the whole burst
+    CHECK_EQ(stats->usart_bytes - bytes_before, len);
+    CHECK(stats->isr[SIM_VECT_USART0_DRE] >= len + 1);
+    CHECK_EQ(stats->isr[SIM_VECT_USART0_TXC], 1);
+    CHECK_EQ(stats->usart_bad_rate, 0);
+    CHECK_EQ(get_usart_tx_dropped_count(), 0);
+
+    // Interrupts off again once idle
+    CHECK_EQ(USART0.CTRLA & (USART_DREIE_bm | USART_TXCIE_bm), 0);
+}
+
+static void test_buffer_full(void) {
+    char text[3 * USART0_TX_BUFFER_SIZE + 1];
+
+    for(size_t i = 0; i < sizeof(text) - 1; i++) {
+        text[i] = 'a' + (char)(i % 26);
+    }
+    text[sizeof(text) - 1] = '\0';
+
+    // Blocking API waits for room, nothing is lost
+    sim_usart_clear(dut);
+    usart0_send_string(text);
+    CHECK(wait_tx_complete(SIM_MS(100)));
+    CHECK(strcmp(sim_usart_output(dut, 0), text) == 0);
+    CHECK_EQ(get_usart_tx_dropped_count(), 0);
+
+    // Non-blocking API drops what does not fit
+    uint8_t queued = 0;
+    for(int i = 0; i < 2 * USART0_TX_BUFFER_SIZE; i++) {
+        queued += usart0_tx_enqueue('x');
+    }
+    CHECK(queued < 2 * USART0_TX_BUFFER_SIZE);
+    CHECK_EQ(get_usart_tx_dropped_count(), 2 * USART0_TX_BUFFER_SIZE - queued);
+    CHECK(wait_tx_complete(SIM_MS(100)));
+    clear_usart_tx_dropped_count();
+}
+
+static void test_clock_changed(void) {
+    // Called with interrupts on and off: queued bytes finish either way,
+    // the I bit is left as it was
+    for(uint8_t sreg = 0; sreg < 2; sreg++) {
+        sim_usart_clear(dut);
+        usart0_send_string("abc");
+        CHECK(!get_usart_tx_complete_status());
+
+        if(sreg) {
+            sim_sei();
+        } else {
+            sim_cli();
+        }
+        usart_clock_changed(clock_get_policy());
+
+        CHECK(get_usart_tx_complete_status());
+        CHECK(strcmp(sim_usart_output(dut, 0), "abc") == 0);
+        CHECK_EQ(sim_sreg_get(), sreg ? 0x80 : 0x00);
+    }
+    sim_sei();
+}
+
+int main(void) {
+    dut = sim_node_attach(&sim_io, "dut");
+    sim_usart_expect_baud(dut, 115200);
+    sim_node_select(dut);
+
+    // Out of reset at 4 MHz, the 115200 policy
+    usart_apply_config(&test_usart_config);
+    sim_sei();
+
+    test_single_burst();
+    test_buffer_full();
+    test_clock_changed();
+
+    sim_node_select(0);
+    return TEST_RESULT();
+}
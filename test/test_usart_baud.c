@@ -0,0 +1,115 @@
+// USART baud table (README "USART baud rate") against the datasheet,
+// f_baud = 64 * f_clk / (16 * BAUD) in floating point: the BAUD values
+// and errors of the table, USART_BAUD_FOR(), usart_init() and the rate
+// the USART model measures all agree. PD4 stays high (no break) while
+// a policy cannot reach the rate and the transmitter is off.
+
+#include <math.h>
+#include "sim.h"
+#include "sim_cpu.h"
+#include "main_clock_control.h"
+#include "usart0_tx.h"
+#include "test.h"
+
+static sim_node_t *dut;
+
+static const uint32_t clock_hz[CLOCK_POLICY_COUNT] = {
+    CLOCK_LOW_POWER_HZ, CLOCK_1MHZ_HZ, CLOCK_4MHZ_HZ
+};
+
+// README table, 0 = unreachable, errors in 0.01 % units
+static const struct {
+    uint32_t baud;
+    uint16_t reg[CLOCK_POLICY_COUNT];
+    int16_t error[CLOCK_POLICY_COUNT];
+} table[] = {
+    {1200,   {109, 3333, 13333}, {21, 1, 0}},
+    {9600,   {0,   417,  1667},  {0, -8, -2}},
+    {57600,  {0,   69,   278},   {0, 64, -8}},
+    {115200, {0,   0,    139},   {0, 0, -8}},
+};
+
+#define TABLE_ROWS (sizeof(table) / sizeof(table[0]))
+
+// Datasheet BAUD, 0 outside the 64..65535 register range
+static uint16_t datasheet_reg(uint32_t clk_hz, uint32_t baud) {
+    double reg = round(64.0 * clk_hz / (16.0 * baud));
+
+    return (reg >= 64 && reg <= 65535) ? (uint16_t)reg : 0;
+}
+
+static int32_t datasheet_error(uint32_t clk_hz, uint32_t baud, uint16_t reg) {
+    double actual = 64.0 * clk_hz / (16.0 * reg);
+
+    return (int32_t)lround((actual - baud) / baud * 10000.0);
+}
+
+static void check_formula(void) {
+    for(size_t row = 0; row < TABLE_ROWS; row++) {
+        uint32_t baud = table[row].baud;
+
+        for(int policy = 0; policy < CLOCK_POLICY_COUNT; policy++) {
+            uint32_t hz = clock_hz[policy];
+            uint16_t reg = table[row].reg[policy];
+
+            CHECK_EQ(datasheet_reg(hz, baud), reg);
+            CHECK_EQ(USART_BAUD_FOR(hz, baud), reg);
+            if(reg) {
+                CHECK_EQ(datasheet_error(hz, baud, reg), table[row].error[policy]);
+                CHECK_EQ(USART_BAUD_ERROR(hz, baud), table[row].error[policy]);
+                CHECK(USART_BAUD_ERROR_OK(hz, baud));
+            }
+        }
+    }
+}
+
+// Run one row through the driver at every policy
+static void check_driver(size_t row) {
+    const sim_stats_t *stats = sim_node_stats(dut);
+    uint32_t baud = table[row].baud;
+
+    sim_usart_expect_baud(dut, baud);
+    clock_request(CLOCK_POLICY_4MHZ);
+    clock_wait_ready();
+    usart_init(0x00, 0x00, 0, 0x03, baud);
+
+    for(int policy = 0; policy < CLOCK_POLICY_COUNT; policy++) {
+        uint16_t reg = table[row].reg[policy];
+        uint32_t bytes = stats->usart_bytes;
+
+        clock_request((clock_policy_t)policy);
+        clock_wait_ready();
+        CHECK_EQ(usart_is_tx_enabled(), reg != 0);
+        if(reg) {
+            CHECK_EQ(USART0.BAUD, reg);
+
+            // Measured by the model, within 2 % of the wanted rate
+            usart0_send_char('U');
+            while(!get_usart_tx_complete_status()) {
+                sim_spin(dut, SIM_US(100));
+            }
+            CHECK_EQ(stats->usart_bytes - bytes, 1);
+        }
+
+        // Transmitter off or idle: the line stays high
+        sim_spin(dut, SIM_MS(1));
+        CHECK(sim_pin_level(dut, 'D', 4));
+    }
+
+    CHECK_EQ(stats->usart_bad_rate, 0);
+    CHECK_EQ(stats->usart_breaks, 0);
+}
+
+int main(void) {
+    dut = sim_node_attach(&sim_io, "dut");
+    sim_node_select(dut);
+    sim_sei();
+
+    check_formula();
+    for(size_t row = 0; row < TABLE_ROWS; row++) {
+        check_driver(row);
+    }
+
+    sim_node_select(0);
+    return TEST_RESULT();
+}
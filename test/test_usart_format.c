@@ -0,0 +1,70 @@
+// printf-free formatter: output matches printf for the edge values of
+// each conversion, written through the simulated USART
+
+#include <stdio.h>
+#include <string.h>
+#include "sim.h"
+#include "sim_cpu.h"
+#include "usart0_tx.h"
+#include "usart0_format.h"
+#include "test.h"
+
+USART_CONFIG(test_usart_config, 0x00, 0x00, 0, 0x03, 115200);
+
+static sim_node_t *dut;
+
+// Output of one formatter call, once shifted out
+static const char *output(void) {
+    while(!get_usart_tx_complete_status()) {
+        sim_spin(dut, SIM_US(50));
+    }
+
+    return sim_usart_output(dut, 0);
+}
+
+#define CHECK_OUTPUT(call, expected)                                        \
+    do {                                                                    \
+        sim_usart_clear(dut);                                               \
+        call;                                                               \
+        if(strcmp(output(), expected) != 0) {                               \
+            fprintf(stderr, "%s:%d: %s printed \"%s\", expected \"%s\"\n",  \
+                    __FILE__, __LINE__, #call, output(), expected);         \
+            test_failures++;                                                \
+        }                                                                   \
+    } while(0)
+
+int main(void) {
+    static const uint16_t values[] = {0, 1, 9, 10, 99, 100, 999, 1000, 4095,
+                                      9999, 10000, 32768, 65534, 65535};
+    char expected[16];
+
+    dut = sim_node_attach(&sim_io, "dut");
+    sim_node_select(dut);
+    usart_apply_config(&test_usart_config);
+    sim_sei();
+
+    for(size_t i = 0; i < sizeof(values) / sizeof(values[0]); i++) {
+        uint16_t v = values[i];
+
+        snprintf(expected, sizeof(expected), "%u", v);
+        CHECK_OUTPUT(usart0_put_dec16(v), expected);
+
+        snprintf(expected, sizeof(expected), "%04X", v);
+        CHECK_OUTPUT(usart0_put_hex16(v), expected);
+
+        snprintf(expected, sizeof(expected), "%02X", v & 0xFF);
+        CHECK_OUTPUT(usart0_put_hex8((uint8_t)v), expected);
+
+        // Low-order digits, zero padded
+        snprintf(expected, sizeof(expected), "%04u", v % 10000);
+        CHECK_OUTPUT(usart0_put_dec16_fixed(v, 4), expected);
+    }
+
+    // Width clamped to 1..5
+    CHECK_OUTPUT(usart0_put_dec16_fixed(2748, 0), "8");
+    CHECK_OUTPUT(usart0_put_dec16_fixed(2748, 5), "02748");
+    CHECK_OUTPUT(usart0_put_dec16_fixed(2748, 9), "02748");
+
+    sim_node_select(0);
+    return TEST_RESULT();
+}
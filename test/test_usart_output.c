@@ -0,0 +1,88 @@
+// CLIENT STATE_WRITE_TO_USART per packet with each output path: the
+// usart0_format.c formatter (verbose and compact) against the printf()
+// report it replaced (CLIENT_PRINTF_OUTPUT, printf stand-in in
+// sim/baseline/printf.c). The README "Output" table is this output.
+
+#include <stdio.h>
+#include <string.h>
+#include "sim.h"
+#include "test.h"
+
+#define STATE_WRITE_TO_USART 4  // client_main.c app_states_t
+#define PACKETS              8
+
+typedef struct {
+    double cycles;  // Per packet
+    double us;      // Awake per packet
+    size_t bytes;   // Per packet
+    char text[1024];
+} output_result_t;
+
+static output_result_t run(const char *module) {
+    output_result_t result = {0};
+    sim_node_t *host = sim_node_load(TEST_MODULE("host_fw"), "host");
+    sim_node_t *client = sim_node_load(module, "client");
+    sim_time_t t = sim_time() + SIM_MS(200);
+
+    sim_wire(host, 'A', 7, client, 'A', 7);
+    sim_analog_const(host, 8, 0.5);
+    sim_node_start(host);
+    sim_node_start(client);
+
+    // Warm-up packet (link training, start-up log dump)
+    sim_button_press(host, 'F', 6, t, SIM_MS(50));
+    t += SIM_MS(300);
+    sim_run_until(t);
+    sim_node_stats_reset(client);
+    sim_usart_clear(client);
+
+    for(uint8_t i = 0; i < PACKETS; i++, t += SIM_MS(300)) {
+        sim_button_press(host, 'F', 6, t, SIM_MS(50));
+    }
+    sim_run_until(t);
+
+    const sim_acct_t *acct = &sim_node_stats(client)->state[STATE_WRITE_TO_USART];
+    size_t len;
+    const char *out = sim_usart_output(client, &len);
+
+    result.cycles = (double)acct->cycles / PACKETS;
+    result.us = (double)sim_acct_time(acct) / SIM_US(1) / PACKETS;
+    result.bytes = len / PACKETS;
+    snprintf(result.text, sizeof(result.text), "%s", out);
+
+    CHECK_EQ(acct->entries, PACKETS);
+    CHECK_EQ(len % PACKETS, 0);
+
+    sim_node_free(client);
+    sim_node_free(host);
+    return result;
+}
+
+int main(void) {
+    static const struct {
+        const char *name;
+        const char *module;
+    } runs[] = {
+        {"printf (verbose)", TEST_MODULE("client_fw_printf")},
+        {"formatter (verbose)", TEST_MODULE("client_fw")},
+        {"formatter (compact)", TEST_MODULE("client_fw_compact")}
+    };
+    static output_result_t results[sizeof(runs) / sizeof(runs[0])];
+
+    printf("| Output              | Bytes | Cycles per packet | Awake per packet |\n");
+    printf("|---------------------|-------|-------------------|------------------|\n");
+    for(size_t i = 0; i < sizeof(runs) / sizeof(runs[0]); i++) {
+        results[i] = run(runs[i].module);
+        printf("| %-19s | %-5zu | %-17.0f | %-13.0f µs |\n", runs[i].name, results[i].bytes,
+               results[i].cycles, results[i].us);
+    }
+
+    // Same report either way, the formatter in fewer cycles; compact
+    // output is shorter still
+    CHECK(strcmp(results[0].text, results[1].text) == 0);
+    CHECK(results[1].cycles < results[0].cycles);
+    CHECK(results[2].bytes < results[1].bytes);
+    CHECK(results[2].cycles < results[1].cycles);
+
+    return TEST_RESULT();
+}
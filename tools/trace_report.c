@@ -0,0 +1,222 @@
+// State trace post-processing (README "State trace"): reads the USART
+// output of a TRACE_ENABLE=1 build, picks out the "S<state> C<clock>
+// T<ticks>" lines and prints time and energy per state.
+//
+//   trace_report [--client] [--vdd <volts>] [--current <state>=<uA>] [file]
+//
+// Currents come from the README power table. States it does not list
+// (INIT, clock switches, the dump itself) are charged at the device's
+// figure for the clock they ran at. Other output lines are skipped.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define TRACE_TICK_HZ    32768.0
+#define TRACE_STATE_DUMP 0xFE   // trace.h
+#define MAX_STATES       256
+#define CLOCKS           3      // clock_policy_t
+
+typedef struct {
+    const char *name;
+    double current_ua;  // 0 = by clock
+} state_info_t;
+
+typedef struct {
+    const char *device;
+    const state_info_t *states;
+    unsigned state_count;
+    double clock_ua[CLOCKS];    // 32.768 kHz, 1 MHz, 4 MHz
+} device_info_t;
+
+// host_main.c app_states_t
+static const state_info_t host_states[] = {
+    {"INIT",                0},
+    {"SLEEP",               1.5},
+    {"READ_ADC",            160},
+    {"WAKE_DISPATCH",       0},
+    {"SEND_SPI",            1300},
+    {"SWITCH_TO_LOWPOWER",  0}
+};
+
+// client_main.c app_states_t
+static const state_info_t client_states[] = {
+    {"INIT",                0},
+    {"SLEEP",               2},
+    {"SWITCH_TO_HIGHSPEED", 0},
+    {"RECEIVE_SPI",         1100},
+    {"WRITE_TO_USART",      1100},
+    {"SWITCH_TO_LOWPOWER",  0}
+};
+
+static const device_info_t host = {
+    "HOST", host_states, sizeof(host_states) / sizeof(host_states[0]),
+    {1.5, 160, 1300}
+};
+
+static const device_info_t client = {
+    "CLIENT", client_states, sizeof(client_states) / sizeof(client_states[0]),
+    {2, 1100, 1100}
+};
+
+typedef struct {
+    unsigned long entries;
+    unsigned long long ticks;
+    double uj;
+    double override_ua;  // --current, 0 = none
+} state_total_t;
+
+static state_total_t totals[MAX_STATES];
+
+static const char *state_name(const device_info_t *device, unsigned state) {
+    static char unknown[16];
+
+    if(state == TRACE_STATE_DUMP) {
+        return "(trace dump)";
+    }
+    if(state < device->state_count) {
+        return device->states[state].name;
+    }
+    snprintf(unknown, sizeof(unknown), "S%u", state);
+    return unknown;
+}
+
+static double state_current(const device_info_t *device, unsigned state, unsigned clock) {
+    if(totals[state].override_ua > 0) {
+        return totals[state].override_ua;
+    }
+    if(state < device->state_count && device->states[state].current_ua > 0) {
+        return device->states[state].current_ua;
+    }
+    return device->clock_ua[clock < CLOCKS ? clock : CLOCKS - 1];
+}
+
+static int find_state(const device_info_t *device, const char *name) {
+    if(name[0] == 'S' && name[1] >= '0' && name[1] <= '9') {
+        return atoi(name + 1);
+    }
+    for(unsigned i = 0; i < device->state_count; i++) {
+        if(strcmp(device->states[i].name, name) == 0) {
+            return (int)i;
+        }
+    }
+    return -1;
+}
+
+static void usage(void) {
+    fprintf(stderr, "usage: trace_report [--client] [--vdd <volts>] "
+                    "[--current <state>=<uA>]... [file]\n");
+    exit(2);
+}
+
+int main(int argc, char **argv) {
+    const device_info_t *device = &host;
+    const char *path = 0;
+    double vdd = 3.3;
+    FILE *in = stdin;
+
+    // Device first, --current names depend on it
+    for(int i = 1; i < argc; i++) {
+        if(strcmp(argv[i], "--client") == 0) {
+            device = &client;
+        }
+    }
+
+    for(int i = 1; i < argc; i++) {
+        if(strcmp(argv[i], "--client") == 0) {
+            continue;
+        } else if(strcmp(argv[i], "--vdd") == 0 && i + 1 < argc) {
+            vdd = atof(argv[++i]);
+        } else if(strcmp(argv[i], "--current") == 0 && i + 1 < argc) {
+            char name[32];
+            double ua;
+
+            if(sscanf(argv[++i], "%31[^=]=%lf", name, &ua) != 2) {
+                usage();
+            }
+            int state = find_state(device, name);
+            if(state < 0 || state >= MAX_STATES) {
+                fprintf(stderr, "trace_report: unknown state %s\n", name);
+                return 2;
+            }
+            totals[state].override_ua = ua;
+        } else if(argv[i][0] == '-' || path) {
+            usage();
+        } else {
+            path = argv[i];
+        }
+    }
+
+    if(path) {
+        in = fopen(path, "r");
+        if(!in) {
+            perror(path);
+            return 1;
+        }
+    }
+
+    char line[256];
+    unsigned long lines = 0;
+    unsigned long lost = 0;
+    unsigned long long all_ticks = 0;
+    double all_uj = 0;
+
+    while(fgets(line, sizeof(line), in)) {
+        unsigned state;
+        unsigned clock;
+        unsigned ticks;
+        unsigned long n;
+
+        if(sscanf(line, "Trace lost: %lu", &n) == 1) {
+            lost += n;
+            continue;
+        }
+        if(sscanf(line, "S%u C%u T%u", &state, &clock, &ticks) != 3 || state >= MAX_STATES) {
+            continue;
+        }
+
+        double uj = ticks / TRACE_TICK_HZ * state_current(device, state, clock) * vdd;
+
+        totals[state].entries++;
+        totals[state].ticks += ticks;
+        totals[state].uj += uj;
+        all_ticks += ticks;
+        all_uj += uj;
+        lines++;
+    }
+
+    if(path) {
+        fclose(in);
+    }
+
+    if(!lines) {
+        fprintf(stderr, "trace_report: no trace lines\n");
+        return 1;
+    }
+
+    printf("%s trace: %lu states, %.3f s at %.2f V", device->device, lines,
+           all_ticks / TRACE_TICK_HZ, vdd);
+    if(lost) {
+        printf(", %lu entries lost", lost);
+    }
+    printf("\n\n");
+
+    printf("| State                | Entries | Time (ms)  | Share   | Energy (uJ) | Per entry (uJ) |\n");
+    printf("|----------------------|---------|------------|---------|-------------|----------------|\n");
+    for(unsigned state = 0; state < MAX_STATES; state++) {
+        const state_total_t *total = &totals[state];
+
+        if(!total->entries) {
+            continue;
+        }
+        printf("| %-20s | %7lu | %10.3f | %6.2f%% | %11.3f | %14.3f |\n",
+               state_name(device, state), total->entries,
+               total->ticks / TRACE_TICK_HZ * 1000.0,
+               100.0 * total->ticks / all_ticks,
+               total->uj, total->uj / total->entries);
+    }
+    printf("| %-20s | %7lu | %10.3f | %6.2f%% | %11.3f | %14s |\n",
+           "Total", lines, all_ticks / TRACE_TICK_HZ * 1000.0, 100.0, all_uj, "");
+
+    return 0;
+}
@@ -0,0 +1,104 @@
+#include <stdint.h>
+#include "trace.h"
+#include "main_clock_control.h"
+#include "rtc.h"
+#include "sleep.h"
+#include "usart0_tx.h"
+#include "usart0_format.h"
+
+#if TRACE_ENABLE
+
+#define TRACE_MASK (TRACE_DEPTH - 1)
+
+#if (TRACE_DEPTH & TRACE_MASK) != 0
+#error "TRACE_DEPTH must be a power of 2"
+#endif
+
+// Ring buffer, written and dumped from the main loop only
+static trace_entry_t trace_buffer[TRACE_DEPTH];
+static uint8_t trace_head = 0;
+static uint8_t trace_count = 0;
+
+// Entries overwritten before they were dumped
+static uint8_t trace_lost = 0;
+
+// State of the newest entry, repeated passes are not logged
+static uint8_t last_state = 0xFF;
+
+// Set by trace_request_dump()
+static uint8_t dump_requested = 0;
+
+void trace_record(uint8_t state) {
+    if(state == last_state) {
+        return;
+    }
+    
+    // First entry: timestamps need the counter, also while asleep
+    // (no-op if already running)
+    if(last_state == 0xFF) {
+        rtc_counter_init();
+        power_vote(POWER_VOTER_TRACE, SLEEP_LEVEL_STANDBY);
+    }
+    last_state = state;
+    
+    trace_entry_t *entry = &trace_buffer[trace_head];
+    entry->state = state;
+    entry->clock = (uint8_t)clock_get_policy();
+    entry->tick = rtc_get_ticks();
+    
+    trace_head = (trace_head + 1) & TRACE_MASK;
+    
+    // Full: the oldest entry is overwritten
+    if(trace_count < TRACE_DEPTH) {
+        trace_count++;
+    } else if(trace_lost != 0xFF) {
+        trace_lost++;
+    }
+}
+
+void trace_request_dump(void) {
+    dump_requested = 1;
+}
+
+uint8_t trace_dump(void) {
+    // Newest entry is the running state, its duration is not known yet
+    if(trace_count < 2 || (trace_count < TRACE_DUMP_LEVEL && !dump_requested)) {
+        return 0;
+    }
+    dump_requested = 0;
+    
+    // Ends the running state, the output drains in its own entry
+    trace_record(TRACE_STATE_DUMP);
+    
+    uint8_t index = (trace_head - trace_count) & TRACE_MASK;
+    
+    if(trace_lost) {
+        usart0_send_string("Trace lost: ");
+        usart0_put_dec16(trace_lost);
+        usart0_send_string("\r\n");
+        trace_lost = 0;
+    }
+    
+    // One line per completed state: "S<state> C<clock> T<ticks>"
+    while(trace_count > 1) {
+        const trace_entry_t *entry = &trace_buffer[index];
+        index = (index + 1) & TRACE_MASK;
+        
+        // 16-bit wrap gives the right duration below 2 s
+        uint16_t duration = trace_buffer[index].tick - entry->tick;
+        
+        usart0_send_char('S');
+        usart0_put_dec16(entry->state);
+        usart0_send_string(" C");
+        usart0_put_dec16(entry->clock);
+        usart0_send_string(" T");
+        usart0_put_dec16(duration);
+        usart0_send_string("\r\n");
+        
+        trace_count--;
+    }
+    
+    return 1;
+}
+
+#endif // TRACE_ENABLE
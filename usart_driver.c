@@ -1,17 +1,41 @@
 #include <avr/io.h>
+#include <avr/interrupt.h>
+#include <util/atomic.h>
 #include <stdio.h>
 #include <stdint.h>
 #include "usart0_tx.h"
+#include "main_clock_control.h"
+#include "scheduler.h"
+#include "sleep.h"
 
-#define USART0_BAUD_RATE(BAUD_RATE) ((float)(F_CPU * 64 / (16 * (float)BAUD_RATE)) + 0.5)
+#define USART0_TX_BUFFER_MASK (USART0_TX_BUFFER_SIZE - 1)
 
-// USART transmit function
+#if (USART0_TX_BUFFER_SIZE & USART0_TX_BUFFER_MASK) != 0
+#error "USART0_TX_BUFFER_SIZE must be a power of 2"
+#endif
+
+// TX ring buffer (written by main, drained by DRE ISR)
+static volatile uint8_t tx_buffer[USART0_TX_BUFFER_SIZE];
+static volatile uint8_t tx_head = 0;
+static volatile uint8_t tx_tail = 0;
+
+// Set by TXC ISR once the last frame has left the shift register
+static volatile uint8_t tx_complete_flag = 1;
+
+// Bytes rejected by usart0_tx_enqueue() because the buffer was full
+// or the baud rate is not reachable from the current clock
+static volatile uint8_t tx_dropped_count = 0;
+
+// Per-policy BAUD values and frame format in use
+static const usart_config_t *active_config = 0;
+static usart_config_t runtime_config;
+
+// Transmitter on (BAUD reachable at the current clock)
+static volatile uint8_t tx_enabled = 0;
+
+// USART transmit function (blocks only while the ring buffer is full)
 static int usart0_printchar(char c, FILE *stream) {
-    // Wait for transmit buffer to be empty
-    while(!(USART0.STATUS & USART_DREIF_bm));
-    
-    // Send character
-    USART0.TXDATAL = c;
+    usart0_send_char(c);
     
     return 0;
 }
@@ -19,35 +43,142 @@ static int usart0_printchar(char c, FILE *stream) {
 // Standard output stream
 static FILE usart0_stream = FDEV_SETUP_STREAM(usart0_printchar, NULL, _FDEV_SETUP_WRITE);
 
-void usart_init(uint8_t mode, uint8_t parity, uint8_t stop_bits, 
-                uint8_t char_size, uint32_t baud_rate) {
+// Load BAUD for a clock policy, transmitter stays off if unreachable
+static void usart_load_baud(clock_policy_t policy) {
+    uint16_t baud = active_config->baud[policy];
+    
+    if(baud) {
+        USART0.BAUD = baud;
+        USART0.CTRLB = USART_TXEN_bm;
+        tx_enabled = 1;
+    } else {
+        USART0.CTRLB = 0;
+        tx_enabled = 0;
+    }
+}
+
+void usart_apply_config(const usart_config_t *config) {
     
-    // Set pin direction (PD4 = TX as output)
+    // Idle level first, PD4 is driven low (a break) whenever the
+    // transmitter is off, then set pin direction (PD4 = TX as output)
+    PORTD.OUTSET = PIN4_bm;
     PORTD.DIRSET = PIN4_bm;
     
-    // Calculate and set baud rate
-    uint16_t baud_setting = (uint16_t)USART0_BAUD_RATE(baud_rate);
-    USART0.BAUD = baud_setting;
+    // Reset TX ring buffer, interrupts stay off until data is queued
+    tx_head = 0;
+    tx_tail = 0;
+    tx_complete_flag = 1;
+    tx_dropped_count = 0;
+    USART0.CTRLA &= ~(USART_DREIE_bm | USART_TXCIE_bm);
     
-    // Configure USART Control A
-    USART0.CTRLC = (mode << USART_CMODE_gp)       // Mode (async/sync)
-                 | (parity << USART_PMODE_gp)     // Parity
-                 | (stop_bits << USART_SBMODE_bp) // Stop bits
-                 | (char_size << USART_CHSIZE_gp);// Character size
+    // Frame format and BAUD precomputed by USART_CONFIG()
+    active_config = config;
+    USART0.CTRLC = config->ctrlc;
+    usart_load_baud(clock_get_policy());
     
-    // Enable transmitter
-    USART0.CTRLB = USART_TXEN_bm;
+    // Follow later clock switches
+    clock_set_change_hook(usart_clock_changed);
     
     // Redirect stdout to USART
     stdout = &usart0_stream;
 }
 
+void usart_init(uint8_t mode, uint8_t parity, uint8_t stop_bits, 
+                uint8_t char_size, uint32_t baud_rate) {
+    
+    // Same integer calculation as USART_CONFIG(), done at run time
+    for(uint8_t policy = 0; policy < CLOCK_POLICY_COUNT; policy++) {
+        uint32_t baud = (4UL * clock_get_policy_frequency(policy) + baud_rate / 2UL) / baud_rate;
+        
+        runtime_config.baud[policy] = (baud >= 64UL && baud <= 0xFFFFUL) ? (uint16_t)baud : 0;
+    }
+    
+    // Configure USART Control C
+    runtime_config.ctrlc = (mode << USART_CMODE_gp)       // Mode (async/sync)
+                         | (parity << USART_PMODE_gp)     // Parity
+                         | (stop_bits << USART_SBMODE_bp) // Stop bits
+                         | (char_size << USART_CHSIZE_gp);// Character size
+    
+    usart_apply_config(&runtime_config);
+}
+
+void usart_clock_changed(clock_policy_t policy) {
+    // Let queued bytes finish at the old rate, asleep (IDLE by the USART
+    // vote) until the TXC ISR sets the flag. power_idle() enables
+    // interrupts for that ISR, the caller's I bit is restored afterwards.
+    if(tx_enabled) {
+        ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+            while(!tx_complete_flag) {
+                power_idle();
+                cli();
+            }
+        }
+    }
+    
+    usart_load_baud(policy);
+}
+
+uint8_t usart_is_tx_enabled(void) {
+    return tx_enabled;
+}
+
+uint8_t usart0_tx_enqueue(char c) {
+    uint8_t next = (tx_head + 1) & USART0_TX_BUFFER_MASK;
+    
+    // Buffer full or no usable baud rate: drop the new byte, keep what
+    // is already queued
+    if(next == tx_tail || !tx_enabled) {
+        if(tx_dropped_count != 0xFF) {
+            tx_dropped_count++;
+        }
+        return 0;
+    }
+    
+    tx_buffer[tx_head] = (uint8_t)c;
+    
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        tx_head = next;
+        tx_complete_flag = 0;
+        
+        // USART0 is clocked by the peripheral clock, stopped in STANDBY
+        power_vote(POWER_VOTER_USART, SLEEP_LEVEL_IDLE);
+        
+        // Hand over to DRE ISR, TXC is re-armed once the buffer empties
+        USART0.CTRLA = (USART0.CTRLA & ~USART_TXCIE_bm) | USART_DREIE_bm;
+    }
+    
+    return 1;
+}
+
+uint8_t usart0_tx_free_space(void) {
+    return (uint8_t)((tx_tail - tx_head - 1) & USART0_TX_BUFFER_MASK);
+}
+
+uint8_t get_usart_tx_complete_status(void) {
+    return tx_complete_flag;
+}
+
+uint8_t get_usart_tx_dropped_count(void) {
+    return tx_dropped_count;
+}
+
+void clear_usart_tx_dropped_count(void) {
+    tx_dropped_count = 0;
+}
+
 void usart0_send_char(char c) {
-    // Wait for transmit buffer to be empty
-    while(!(USART0.STATUS & USART_DREIF_bm));
+    // Sleep until there is room in the ring buffer (the DRE ISR frees one
+    // slot per byte and wakes the core)
+    if(tx_enabled) {
+        cli();
+        while(usart0_tx_free_space() == 0) {
+            power_idle();
+            cli();
+        }
+        sei();
+    }
     
-    // Send character
-    USART0.TXDATAL = c;
+    usart0_tx_enqueue(c);
 }
 
 void usart0_send_string(const char *str) {
@@ -55,3 +186,26 @@ void usart0_send_string(const char *str) {
         usart0_send_char(*str++);
     }
 }
+
+// Data register empty: move next queued byte into TXDATA
+ISR(USART0_DRE_vect) {
+    if(tx_head != tx_tail) {
+        USART0.TXDATAL = tx_buffer[tx_tail];
+        
+        // Clear after the write so TXC only fires after the final byte
+        USART0.STATUS = USART_TXCIF_bm;
+        tx_tail = (tx_tail + 1) & USART0_TX_BUFFER_MASK;
+    } else {
+        // Buffer empty: stop DRE, wait for last frame to shift out
+        USART0.CTRLA = (USART0.CTRLA & ~USART_DREIE_bm) | USART_TXCIE_bm;
+    }
+}
+
+// Transmit complete: shift register and TXDATA are both empty
+ISR(USART0_TXC_vect) {
+    USART0.STATUS = USART_TXCIF_bm;
+    USART0.CTRLA &= ~USART_TXCIE_bm;
+    tx_complete_flag = 1;
+    power_vote(POWER_VOTER_USART, SLEEP_LEVEL_POWERDOWN);
+    sched_post(EVENT_USART_TX_DONE);
+}
@@ -0,0 +1,71 @@
+#include <stdint.h>
+#include "usart0_tx.h"
+#include "usart0_format.h"
+
+// Hex digit lookup table
+static const char hex_digits[16] = {
+    '0', '1', '2', '3', '4', '5', '6', '7',
+    '8', '9', 'A', 'B', 'C', 'D', 'E', 'F'
+};
+
+// Decimal place values for a 16-bit number (no division on the AVR)
+static const uint16_t dec_places[5] = {10000, 1000, 100, 10, 1};
+
+// Fill buf[0..4] with the five decimal digits of value (leading zeros kept)
+static void dec16_to_digits(uint16_t value, char *buf) {
+    for(uint8_t i = 0; i < 5; i++) {
+        char digit = '0';
+        
+        // Repeated subtraction, at most 9 per place
+        while(value >= dec_places[i]) {
+            value -= dec_places[i];
+            digit++;
+        }
+        
+        buf[i] = digit;
+    }
+}
+
+void usart0_put_hex8(uint8_t value) {
+    usart0_send_char(hex_digits[value >> 4]);
+    usart0_send_char(hex_digits[value & 0x0F]);
+}
+
+void usart0_put_hex16(uint16_t value) {
+    usart0_put_hex8((uint8_t)(value >> 8));
+    usart0_put_hex8((uint8_t)(value & 0xFF));
+}
+
+void usart0_put_dec16(uint16_t value) {
+    char digits[5];
+    uint8_t i = 0;
+    
+    dec16_to_digits(value, digits);
+    
+    // Skip leading zeros, always keep the last digit
+    while(i < 4 && digits[i] == '0') {
+        i++;
+    }
+    
+    for(; i < 5; i++) {
+        usart0_send_char(digits[i]);
+    }
+}
+
+void usart0_put_dec16_fixed(uint16_t value, uint8_t width) {
+    char digits[5];
+    
+    // Clamp width to the 1..5 digits a 16-bit value can need
+    if(width == 0) {
+        width = 1;
+    } else if(width > 5) {
+        width = 5;
+    }
+    
+    dec16_to_digits(value, digits);
+    
+    // Zero padded, low-order 'width' digits
+    for(uint8_t i = 5 - width; i < 5; i++) {
+        usart0_send_char(digits[i]);
+    }
+}